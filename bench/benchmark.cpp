@@ -0,0 +1,394 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace bench
+{
+    namespace
+    {
+        std::vector<std::unique_ptr<Benchmark>> &registry()
+        {
+            static std::vector<std::unique_ptr<Benchmark>> benchmarks;
+            return benchmarks;
+        }
+
+        struct Result
+        {
+            std::string name;
+            // "iteration", or "aggregate" for the median
+            bool aggregate = false;
+            uint32_t repetitionIndex = 0;
+            uint64_t iterations = 0;
+            // Per iteration, in nanoseconds
+            double realTime = 0.0;
+            double cpuTime = 0.0;
+            double itemsPerSecond = 0.0;
+            double bytesPerSecond = 0.0;
+            std::string label;
+            std::string error;
+        };
+
+        double median(std::vector<double> values)
+        {
+            std::sort(values.begin(), values.end());
+            size_t middle = values.size() / 2;
+            return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+        }
+
+        void writeString(std::ostream &out, const std::string &text)
+        {
+            out << '"';
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    out << '\\' << c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                    out << escaped;
+                }
+                else
+                {
+                    out << c;
+                }
+            }
+            out << '"';
+        }
+
+        void printResult(const Result &result)
+        {
+            char line[256];
+            if (!result.error.empty())
+            {
+                std::snprintf(line, sizeof(line), "%-40s ERROR: %s", result.name.c_str(), result.error.c_str());
+                std::cout << line << std::endl;
+                return;
+            }
+            std::snprintf(line, sizeof(line), "%-40s %14.1f ns %14.1f ns %12llu", result.name.c_str(), result.realTime,
+                          result.cpuTime, static_cast<unsigned long long>(result.iterations));
+            std::cout << line;
+            if (result.itemsPerSecond > 0.0)
+            {
+                std::cout << " items/s=" << result.itemsPerSecond;
+            }
+            if (result.bytesPerSecond > 0.0)
+            {
+                std::cout << " MB/s=" << result.bytesPerSecond / 1e6;
+            }
+            if (!result.label.empty())
+            {
+                std::cout << " " << result.label;
+            }
+            std::cout << std::endl;
+        }
+    } // namespace
+
+    State::State(uint64_t iterations, std::vector<int64_t> arguments)
+        : m_iterations(iterations), m_remaining(iterations), m_arguments(std::move(arguments))
+    {
+    }
+
+    void State::start()
+    {
+        if (!m_running)
+        {
+            m_running = true;
+            m_cpuStart = std::clock();
+            m_realStart = std::chrono::steady_clock::now();
+        }
+    }
+
+    void State::stop()
+    {
+        if (m_running)
+        {
+            m_realSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_realStart).count();
+            m_cpuSeconds += static_cast<double>(std::clock() - m_cpuStart) / CLOCKS_PER_SEC;
+            m_running = false;
+        }
+    }
+
+    Benchmark::Benchmark(std::string name, Function function)
+        : m_name(std::move(name)), m_function(function)
+    {
+    }
+
+    Benchmark *Benchmark::args(std::initializer_list<int64_t> values)
+    {
+        m_arguments.emplace_back(values);
+        return this;
+    }
+
+    Benchmark *registerBenchmark(const char *name, Function function)
+    {
+        registry().push_back(std::make_unique<Benchmark>(name, function));
+        return registry().back().get();
+    }
+
+    /**
+     * Runs one benchmark with one set of arguments.
+     */
+    class Runner
+    {
+    public:
+        Runner(double minTime, uint32_t repetitions)
+            : m_minTime(minTime), m_repetitions(repetitions)
+        {
+        }
+
+        std::vector<Result> run(const Benchmark &benchmark, const std::vector<int64_t> &arguments, const std::string &name) const
+        {
+            // Grow the iteration count until a run is long enough to time,
+            // the way Google Benchmark does
+            uint64_t iterations = 1;
+            State state = runOnce(benchmark, iterations, arguments);
+            while (state.m_error.empty() && state.m_realSeconds < m_minTime && iterations < 1000000000)
+            {
+                double multiplier = state.m_realSeconds > 0.0 ? m_minTime * 1.4 / state.m_realSeconds : 10.0;
+                if (state.m_realSeconds / m_minTime <= 0.1)
+                {
+                    multiplier = std::min(multiplier, 10.0);
+                }
+                iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * multiplier));
+                state = runOnce(benchmark, iterations, arguments);
+            }
+
+            std::vector<Result> results;
+            for (uint32_t repetition = 0; repetition < m_repetitions; ++repetition)
+            {
+                // The run that was long enough is the first repetition
+                if (repetition > 0)
+                {
+                    state = runOnce(benchmark, iterations, arguments);
+                }
+                Result result;
+                result.name = name;
+                result.repetitionIndex = repetition;
+                result.iterations = iterations;
+                result.error = state.m_error;
+                result.label = state.m_label;
+                result.realTime = state.m_realSeconds * 1e9 / iterations;
+                result.cpuTime = state.m_cpuSeconds * 1e9 / iterations;
+                if (state.m_realSeconds > 0.0)
+                {
+                    result.itemsPerSecond = state.m_items / state.m_realSeconds;
+                    result.bytesPerSecond = state.m_bytes / state.m_realSeconds;
+                }
+                printResult(result);
+                results.push_back(result);
+                if (!result.error.empty())
+                {
+                    return results;
+                }
+            }
+
+            if (results.size() > 1)
+            {
+                Result aggregate = results.front();
+                aggregate.name = name + "_median";
+                aggregate.aggregate = true;
+                auto medianOf = [&](double Result::*field)
+                {
+                    std::vector<double> values;
+                    for (const Result &result : results)
+                    {
+                        values.push_back(result.*field);
+                    }
+                    return median(values);
+                };
+                aggregate.realTime = medianOf(&Result::realTime);
+                aggregate.cpuTime = medianOf(&Result::cpuTime);
+                aggregate.itemsPerSecond = medianOf(&Result::itemsPerSecond);
+                aggregate.bytesPerSecond = medianOf(&Result::bytesPerSecond);
+                printResult(aggregate);
+                results.push_back(aggregate);
+            }
+            return results;
+        }
+
+    private:
+        State runOnce(const Benchmark &benchmark, uint64_t iterations, const std::vector<int64_t> &arguments) const
+        {
+            State state(iterations, arguments);
+            benchmark.m_function(state);
+            state.stop();
+            if (state.m_error.empty() && state.m_remaining != 0)
+            {
+                state.m_error = "the benchmark did not run all its iterations";
+            }
+            return state;
+        }
+
+        double m_minTime;
+        uint32_t m_repetitions;
+    };
+
+    int runBenchmarks(int argc, char **argv)
+    {
+        std::string filter;
+        double minTime = 0.5;
+        uint32_t repetitions = 3;
+        std::string jsonPath;
+        bool validArguments = true;
+        try
+        {
+            for (int i = 1; i < argc && validArguments; ++i)
+            {
+                bool hasValue = i + 1 < argc;
+                if (std::strcmp(argv[i], "--filter") == 0 && hasValue)
+                {
+                    filter = argv[++i];
+                }
+                else if (std::strcmp(argv[i], "--min-time") == 0 && hasValue)
+                {
+                    minTime = std::stod(argv[++i]);
+                }
+                else if (std::strcmp(argv[i], "--repetitions") == 0 && hasValue)
+                {
+                    unsigned long value = std::stoul(argv[++i]);
+                    if (value > std::numeric_limits<uint32_t>::max())
+                    {
+                        throw std::out_of_range("--repetitions");
+                    }
+                    repetitions = std::max(1u, static_cast<uint32_t>(value));
+                }
+                else if (std::strcmp(argv[i], "--json") == 0 && hasValue)
+                {
+                    jsonPath = argv[++i];
+                }
+                else
+                {
+                    validArguments = false;
+                }
+            }
+        }
+        catch (const std::exception &)
+        {
+            // A value that is not a number (std::invalid_argument) or too
+            // large (std::out_of_range)
+            validArguments = false;
+        }
+        if (!validArguments)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--filter <substring>] [--min-time <seconds>] [--repetitions <N>] [--json <file>]"
+                      << std::endl;
+            return 1;
+        }
+
+        char header[256];
+        std::snprintf(header, sizeof(header), "%-40s %17s %17s %12s", "Benchmark", "Time", "CPU", "Iterations");
+        std::cout << header << std::endl
+                  << std::string(std::strlen(header), '-') << std::endl;
+
+        Runner runner(minTime, repetitions);
+        std::vector<Result> results;
+        bool failed = false;
+        for (const std::unique_ptr<Benchmark> &benchmark : registry())
+        {
+            std::vector<std::vector<int64_t>> argumentSets = benchmark->arguments();
+            if (argumentSets.empty())
+            {
+                argumentSets.emplace_back();
+            }
+            for (const std::vector<int64_t> &arguments : argumentSets)
+            {
+                std::string name = benchmark->name();
+                for (int64_t argument : arguments)
+                {
+                    name += "/" + std::to_string(argument);
+                }
+                if (name.find(filter) == std::string::npos)
+                {
+                    continue;
+                }
+                for (Result &result : runner.run(*benchmark, arguments, name))
+                {
+                    failed = failed || !result.error.empty();
+                    results.push_back(std::move(result));
+                }
+            }
+        }
+
+        if (jsonPath.empty())
+        {
+            return failed ? 1 : 0;
+        }
+        // The layout of Google Benchmark's --benchmark_format=json
+        std::ofstream out(jsonPath, std::ios::binary);
+        out.precision(12);
+        char date[64];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+        out << "{\n  \"context\": {\n    \"date\": ";
+        writeString(out, date);
+        out << ",\n    \"executable\": ";
+        writeString(out, argv[0]);
+        out << ",\n    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n    \"library_build_type\": "
+#ifdef NDEBUG
+            << "\"release\""
+#else
+            << "\"debug\""
+#endif
+            << "\n  },\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result &result = results[i];
+            std::string runName = result.aggregate ? result.name.substr(0, result.name.size() - std::strlen("_median")) : result.name;
+            out << (i == 0 ? "\n" : ",\n") << "    {\n      \"name\": ";
+            writeString(out, result.name);
+            out << ",\n      \"run_name\": ";
+            writeString(out, runName);
+            out << ",\n      \"run_type\": \"" << (result.aggregate ? "aggregate" : "iteration") << "\",\n      \"repetitions\": "
+                << repetitions;
+            if (result.aggregate)
+            {
+                out << ",\n      \"aggregate_name\": \"median\"";
+            }
+            else
+            {
+                out << ",\n      \"repetition_index\": " << result.repetitionIndex;
+            }
+            if (!result.error.empty())
+            {
+                out << ",\n      \"error_occurred\": true,\n      \"error_message\": ";
+                writeString(out, result.error);
+            }
+            out << ",\n      \"iterations\": " << result.iterations << ",\n      \"real_time\": " << result.realTime
+                << ",\n      \"cpu_time\": " << result.cpuTime << ",\n      \"time_unit\": \"ns\"";
+            if (result.itemsPerSecond > 0.0)
+            {
+                out << ",\n      \"items_per_second\": " << result.itemsPerSecond;
+            }
+            if (result.bytesPerSecond > 0.0)
+            {
+                out << ",\n      \"bytes_per_second\": " << result.bytesPerSecond;
+            }
+            if (!result.label.empty())
+            {
+                out << ",\n      \"label\": ";
+                writeString(out, result.label);
+            }
+            out << "\n    }";
+        }
+        out << "\n  ]\n}\n";
+        if (!out)
+        {
+            std::cerr << "Could not write " << jsonPath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << results.size() << " results to " << jsonPath << std::endl;
+        return failed ? 1 : 0;
+    }
+} // namespace bench
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/**
+ * A small benchmark harness in the style of Google Benchmark, so that the
+ * results it writes can be read by the same tools (including its
+ * compare.py, or bench/compare-benchmarks.py).
+ *
+ *     void loadMesh(bench::State &state)
+ *     {
+ *         Mesh mesh = makeMesh(state.range(0)); // not timed
+ *         while (state.keepRunning())
+ *         {
+ *             load(mesh);
+ *         }
+ *         state.setItemsProcessed(state.iterations() * state.range(0));
+ *     }
+ *     BENCHMARK(loadMesh)->arg(1000)->arg(1000000);
+ *
+ * Each benchmark runs with more and more iterations until they take at
+ * least the minimum time, then that many iterations are timed again for
+ * each repetition, and the median of the repetitions is reported.
+ */
+namespace bench
+{
+    class State
+    {
+    public:
+        State(uint64_t iterations, std::vector<int64_t> arguments);
+
+        /**
+         * True `iterations()` times, timing what runs in between; false
+         * once done (and then stops timing).
+         */
+        bool keepRunning()
+        {
+            if (m_remaining == m_iterations && !m_running)
+            {
+                start();
+            }
+            if (m_remaining == 0)
+            {
+                stop();
+                return false;
+            }
+            --m_remaining;
+            return true;
+        }
+
+        int64_t range(size_t index = 0) const { return index < m_arguments.size() ? m_arguments[index] : 0; }
+        uint64_t iterations() const { return m_iterations; }
+
+        /**
+         * Leave out setup done inside the loop.
+         */
+        void pauseTiming() { stop(); }
+        void resumeTiming() { start(); }
+
+        void setItemsProcessed(uint64_t items) { m_items = items; }
+        void setBytesProcessed(uint64_t bytes) { m_bytes = bytes; }
+        void setLabel(const std::string &label) { m_label = label; }
+        /**
+         * Report the benchmark as failed, e.g. when its setup could not be
+         * done. The loop should not be entered.
+         */
+        void skipWithError(const std::string &error) { m_error = error; }
+
+    private:
+        friend class Runner;
+
+        void start();
+        void stop();
+
+        uint64_t m_iterations;
+        uint64_t m_remaining;
+        std::vector<int64_t> m_arguments;
+        bool m_running = false;
+        std::chrono::steady_clock::time_point m_realStart;
+        std::clock_t m_cpuStart = 0;
+        double m_realSeconds = 0.0;
+        double m_cpuSeconds = 0.0;
+        uint64_t m_items = 0;
+        uint64_t m_bytes = 0;
+        std::string m_label;
+        std::string m_error;
+    };
+
+    using Function = void (*)(State &);
+
+    class Benchmark
+    {
+    public:
+        Benchmark(std::string name, Function function);
+
+        /**
+         * Run once more with these arguments, see State::range().
+         */
+        Benchmark *arg(int64_t value) { return args({value}); }
+        Benchmark *args(std::initializer_list<int64_t> values);
+
+        const std::string &name() const { return m_name; }
+        const std::vector<std::vector<int64_t>> &arguments() const { return m_arguments; }
+
+    private:
+        friend class Runner;
+
+        std::string m_name;
+        Function m_function;
+        std::vector<std::vector<int64_t>> m_arguments;
+    };
+
+    /**
+     * Add a benchmark to those runBenchmarks() runs, see BENCHMARK().
+     */
+    Benchmark *registerBenchmark(const char *name, Function function);
+
+    /**
+     * Run the benchmarks, with the options:
+     *   --filter <substring>  only those whose name contains it
+     *   --min-time <seconds>  that each run must take at least (default 0.5)
+     *   --repetitions <N>     runs of each benchmark (default 3)
+     *   --json <file>         where to write the results
+     * Returns the exit code, non-zero if a benchmark failed.
+     */
+    int runBenchmarks(int argc, char **argv);
+} // namespace bench
+
+#define BENCH_CONCAT_INNER(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_INNER(a, b)
+#define BENCHMARK(function) \
+    static bench::Benchmark *BENCH_CONCAT(benchmark, __LINE__) = bench::registerBenchmark(#function, function)
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""
+Compare two results of the Benchmarks target (or of any Google Benchmark
+executable run with --benchmark_format=json) and flag regressions.
+
+Usage: compare-benchmarks.py baseline.json contender.json
+                             [--threshold 0.05] [--metric real_time|cpu_time]
+
+Benchmarks are matched by run name, using the median of their repetitions
+when there is one and their mean otherwise. A benchmark regresses when its
+contender time is more than `threshold` (a fraction) above the baseline.
+Exits with 1 if any benchmark regressed, so that CI can fail on it.
+"""
+
+import argparse
+import json
+import sys
+
+TIME_UNITS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load_times(path, metric):
+    """Nanoseconds per iteration of each run name, in file order."""
+    with open(path) as file:
+        results = json.load(file)["benchmarks"]
+
+    samples = {}
+    medians = {}
+    for result in results:
+        if result.get("error_occurred"):
+            continue
+        name = result.get("run_name", result["name"])
+        nanoseconds = result[metric] * TIME_UNITS[result.get("time_unit", "ns")]
+        if result.get("run_type") == "aggregate":
+            if result.get("aggregate_name") == "median":
+                medians[name] = nanoseconds
+        else:
+            samples.setdefault(name, []).append(nanoseconds)
+
+    times = {}
+    for name in list(samples) + list(medians):
+        if name in times:
+            continue
+        times[name] = medians[name] if name in medians else sum(samples[name]) / len(samples[name])
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flag benchmark regressions between two JSON results.")
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative slowdown above which a benchmark regresses (default 0.05)")
+    parser.add_argument("--metric", choices=["real_time", "cpu_time"], default="real_time")
+    args = parser.parse_args()
+
+    baseline = load_times(args.baseline, args.metric)
+    contender = load_times(args.contender, args.metric)
+
+    regressions = 0
+    print(f"{'Benchmark':<40} {'Baseline':>14} {'Contender':>14} {'Change':>9}")
+    print("-" * 80)
+    for name, before in baseline.items():
+        if name not in contender:
+            print(f"{name:<40} {before:>11.1f} ns {'missing':>14}")
+            continue
+        after = contender[name]
+        change = (after - before) / before if before > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improvement"
+        print(f"{name:<40} {before:>11.1f} ns {after:>11.1f} ns {change:>+8.1%}{flag}")
+    for name in contender:
+        if name not in baseline:
+            print(f"{name:<40} {'new':>14} {contender[name]:>11.1f} ns")
+
+    print(f"{regressions} regression(s) above {args.threshold:.0%} in {args.metric}")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
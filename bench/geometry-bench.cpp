@@ -0,0 +1,341 @@
+/**
+ * Measures the throughput of loadGeometry on a synthetic mesh.
+ *
+ * Usage: GeometryBench [compare|scaling|stream] [vertexCount] [repeat]
+ *
+ *  - compare (default, 1M vertices) times the loader against the previous
+ *    getline/istringstream based loader, both when parsing the text and
+ *    when reading back the binary cache.
+ *  - scaling (default, 10M vertices) times the chunked parser with 1 to N
+ *    threads and checks that every thread count gives the same bytes.
+ *  - stream (default, 10M vertices) reads the mesh with GeometryStream in
+ *    1 MB blocks then with loadGeometry, and reports the peak resident set
+ *    after each. Run it in a fresh process, since the peak never goes down.
+ */
+
+#include "geometry.h"
+#include "geometry-cache.h"
+#include "hash.h"
+#include "thread-pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    /**
+     * The loader as it was before it was memory-mapped, kept here as the
+     * baseline to compare against.
+     */
+    bool loadGeometryIostream(
+        const fs::path &path,
+        std::vector<float> &pointData,
+        std::vector<uint32_t> &indexData,
+        int dimensions)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        pointData.clear();
+        indexData.clear();
+
+        enum class Section
+        {
+            None,
+            Points,
+            Indices,
+        };
+        Section currentSection = Section::None;
+
+        float value;
+        uint32_t index;
+        std::string line;
+        while (!file.eof())
+        {
+            getline(file, line);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+
+            if (line == "[points]")
+            {
+                currentSection = Section::Points;
+            }
+            else if (line == "[indices]")
+            {
+                currentSection = Section::Indices;
+            }
+            else if (line[0] == '#' || line.empty())
+            {
+            }
+            else if (currentSection == Section::Points)
+            {
+                std::istringstream iss(line);
+                for (int i = 0; i < dimensions + 3; ++i)
+                {
+                    iss >> value;
+                    pointData.push_back(value);
+                }
+            }
+            else if (currentSection == Section::Indices)
+            {
+                std::istringstream iss(line);
+                for (int i = 0; i < 3; ++i)
+                {
+                    iss >> index;
+                    indexData.push_back(index);
+                }
+            }
+        }
+        return true;
+    }
+
+    void writeSyntheticMesh(const fs::path &path, size_t vertexCount)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> color(0.0f, 1.0f);
+        std::uniform_int_distribution<uint32_t> corner(0, static_cast<uint32_t>(vertexCount - 1));
+
+        std::ofstream file(path, std::ios::binary);
+        file << "[points]\n# x y z r g b\n";
+        char row[128];
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            int length = std::snprintf(row, sizeof(row), "%+.4f %+.4f %+.4f    %.3f %.3f %.3f\n",
+                                       position(rng), position(rng), position(rng),
+                                       color(rng), color(rng), color(rng));
+            file.write(row, length);
+        }
+        file << "\n[indices]\n";
+        for (size_t i = 0; i < vertexCount * 2; ++i)
+        {
+            int length = std::snprintf(row, sizeof(row), "%u %u %u\n", corner(rng), corner(rng), corner(rng));
+            file.write(row, length);
+        }
+    }
+
+    using Loader = std::function<bool(const fs::path &, std::vector<float> &, std::vector<uint32_t> &, int)>;
+
+    /**
+     * Returns the best of `repeat` runs, in seconds.
+     */
+    double timeLoader(const Loader &loader, const fs::path &path, int repeat,
+                      std::vector<float> &pointData, std::vector<uint32_t> &indexData)
+    {
+        double best = 1e30;
+        for (int i = 0; i < repeat; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            loader(path, pointData, indexData, 3);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    int compare(const fs::path &path, double megabytes, int repeat)
+    {
+        auto parseOnly = [](const fs::path &path, std::vector<float> &pointData, std::vector<uint32_t> &indexData, int dimensions)
+        {
+            return loadGeometry(path, pointData, indexData, dimensions, {GeometryCacheMode::Disabled});
+        };
+        auto cached = [](const fs::path &path, std::vector<float> &pointData, std::vector<uint32_t> &indexData, int dimensions)
+        {
+            return loadGeometry(path, pointData, indexData, dimensions, {GeometryCacheMode::ReadWrite});
+        };
+
+        std::vector<float> referencePoints, points, cachedPoints;
+        std::vector<uint32_t> referenceIndices, indices, cachedIndices;
+        double iostreamTime = timeLoader(loadGeometryIostream, path, repeat, referencePoints, referenceIndices);
+        double mappedTime = timeLoader(parseOnly, path, repeat, points, indices);
+        // The first run writes the cache, the best of the others reads it
+        double cachedTime = timeLoader(cached, path, repeat + 1, cachedPoints, cachedIndices);
+        fs::remove(GeometryCache::pathFor(path));
+
+        std::cout << "getline/istringstream: " << megabytes / iostreamTime << " MB/s" << std::endl;
+        std::cout << "mmap/from_chars:       " << megabytes / mappedTime << " MB/s"
+                  << " (x" << iostreamTime / mappedTime << ")" << std::endl;
+        std::cout << "binary cache:          " << megabytes / cachedTime << " MB/s"
+                  << " (x" << iostreamTime / cachedTime << ")" << std::endl;
+
+        if (points != referencePoints || indices != referenceIndices ||
+            cachedPoints != referencePoints || cachedIndices != referenceIndices)
+        {
+            std::cerr << "Loaders disagree!" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    int scaling(const fs::path &path, double megabytes, int repeat)
+    {
+        std::vector<float> referencePoints;
+        std::vector<uint32_t> referenceIndices;
+        double sequentialTime = 0;
+
+        unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned threadCount = 1;; threadCount = std::min(threadCount * 2, maxThreads))
+        {
+            ThreadPool threadPool(threadCount);
+            auto parse = [&](const fs::path &path, std::vector<float> &pointData, std::vector<uint32_t> &indexData, int dimensions)
+            {
+                return loadGeometry(path, pointData, indexData, dimensions, {GeometryCacheMode::Disabled, &threadPool});
+            };
+
+            std::vector<float> points;
+            std::vector<uint32_t> indices;
+            double time = timeLoader(parse, path, repeat, points, indices);
+            if (threadCount == 1)
+            {
+                sequentialTime = time;
+                referencePoints = std::move(points);
+                referenceIndices = std::move(indices);
+            }
+            else if (points.size() != referencePoints.size() || indices.size() != referenceIndices.size() ||
+                     std::memcmp(points.data(), referencePoints.data(), points.size() * sizeof(float)) != 0 ||
+                     std::memcmp(indices.data(), referenceIndices.data(), indices.size() * sizeof(uint32_t)) != 0)
+            {
+                std::cerr << threadCount << " threads: output differs from the sequential parser!" << std::endl;
+                return 1;
+            }
+
+            std::cout << threadCount << " thread(s): " << megabytes / time << " MB/s"
+                      << " (x" << sequentialTime / time << ")" << std::endl;
+            if (threadCount == maxThreads)
+            {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    double peakResidentMegabytes()
+    {
+#ifdef _WIN32
+        return 0.0;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+    }
+
+    int stream(const fs::path &path, double megabytes)
+    {
+        constexpr uint64_t blockSize = 1 << 20;
+        std::cout << "Peak RSS before loading: " << peakResidentMegabytes() << " MB" << std::endl;
+
+        // Only fold the blocks into a hash, like an upload would drop them
+        auto start = std::chrono::steady_clock::now();
+        GeometryStream geometry;
+        geometry.open(path, 3, GeometryCacheMode::Disabled);
+        uint64_t vertexHash = 0;
+        uint64_t indexHash = 0;
+        geometry.read(
+            blockSize,
+            [&](const GeometryBlock &block)
+            { vertexHash = hashCombine(vertexHash, hashBytes(block.data, block.size)); },
+            [&](const GeometryBlock &block)
+            { indexHash = hashCombine(indexHash, hashBytes(block.data, block.size)); });
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "GeometryStream: " << megabytes / elapsed.count() << " MB/s, peak RSS "
+                  << peakResidentMegabytes() << " MB" << std::endl;
+
+        std::vector<float> points;
+        std::vector<uint32_t> indices;
+        start = std::chrono::steady_clock::now();
+        loadGeometry(path, points, indices, 3, {GeometryCacheMode::Disabled});
+        elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "loadGeometry:   " << megabytes / elapsed.count() << " MB/s, peak RSS "
+                  << peakResidentMegabytes() << " MB" << std::endl;
+
+        // Blocks are cut in the same places when they are replayed from memory
+        uint64_t expectedVertexHash = 0;
+        uint64_t expectedIndexHash = 0;
+        std::vector<uint8_t> indexBytes = packIndices(indices.data(), indices.size(), geometry.indexFormat());
+        const char *pointBytes = reinterpret_cast<const char *>(points.data());
+        uint64_t vertexBlock = blockSize / (6 * sizeof(float)) * (6 * sizeof(float));
+        for (uint64_t offset = 0; offset < points.size() * sizeof(float); offset += vertexBlock)
+        {
+            uint64_t size = std::min<uint64_t>(vertexBlock, points.size() * sizeof(float) - offset);
+            expectedVertexHash = hashCombine(expectedVertexHash, hashBytes(pointBytes + offset, size));
+        }
+        for (uint64_t offset = 0; offset < indexBytes.size(); offset += blockSize)
+        {
+            uint64_t size = std::min<uint64_t>(blockSize, indexBytes.size() - offset);
+            expectedIndexHash = hashCombine(expectedIndexHash, hashBytes(indexBytes.data() + offset, size));
+        }
+        if (vertexHash != expectedVertexHash || indexHash != expectedIndexHash)
+        {
+            std::cerr << "Streamed blocks differ from loadGeometry!" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "compare";
+    size_t vertexCount = 0;
+    int repeat = 0;
+    try
+    {
+        vertexCount = argc > 2 ? std::stoul(argv[2]) : (mode == "compare" ? 1000000 : 10000000);
+        repeat = argc > 3 ? std::stoi(argv[3]) : 3;
+    }
+    catch (const std::exception &)
+    {
+        vertexCount = 0;
+    }
+    if ((mode != "compare" && mode != "scaling" && mode != "stream") || vertexCount == 0 || repeat < 1)
+    {
+        std::cerr << "Usage: GeometryBench [compare|scaling|stream] [vertexCount] [repeat]" << std::endl;
+        return 1;
+    }
+
+    fs::path path = fs::temp_directory_path() / "webgpu-geometry-bench.txt";
+    writeSyntheticMesh(path, vertexCount);
+    double megabytes = static_cast<double>(fs::file_size(path)) / (1024.0 * 1024.0);
+    std::cout << "Synthetic mesh: " << vertexCount << " vertices, " << megabytes << " MB" << std::endl;
+
+    int result = 0;
+    if (mode == "compare")
+    {
+        result = compare(path, megabytes, repeat);
+    }
+    else if (mode == "scaling")
+    {
+        result = scaling(path, megabytes, repeat);
+    }
+    else
+    {
+        result = stream(path, megabytes);
+    }
+    fs::remove(path);
+    return result;
+}
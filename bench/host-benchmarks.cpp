@@ -0,0 +1,388 @@
+/**
+ * Micro and macro benchmarks of the App's host-side code, see benchmark.h:
+ * loading geometry (text and binary cache), reading and creating shader
+ * modules, packing uniforms, and encoding and submitting frames.
+ *
+ * Usage: Benchmarks [--filter <substring>] [--min-time <seconds>]
+ *                   [--repetitions <N>] [--json <file>]
+ *
+ * WebGPU calls go to libs/webgpu-mock with its call counting off, so that
+ * they do (almost) nothing and the numbers are those of the host code,
+ * without a GPU. Inputs are synthetic and written to a temporary directory,
+ * removed at the end. Compare two --json outputs with
+ * bench/compare-benchmarks.py.
+ */
+
+#define WEBGPU_CPP_IMPLEMENTATION
+#include <webgpu/webgpu.hpp>
+#include <webgpu-mock.h>
+
+#include "benchmark.h"
+#include "frame-pacer.h"
+#include "geometry.h"
+#include "thread-pool.h"
+#include "uniform-ring.h"
+#include "utils.h"
+#include "webgpu-release.h"
+
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace wgpu;
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Same layout as the App's
+    struct MyUniforms
+    {
+        std::array<float, 4> color;
+        float time;
+        float _pad[3];
+    };
+
+    const fs::path &scratchDirectory()
+    {
+        static const fs::path directory = fs::temp_directory_path() / "webgpu-cpp-benchmarks";
+        static bool created = fs::create_directories(directory) || fs::is_directory(directory);
+        (void)created;
+        return directory;
+    }
+
+    struct MockDevice
+    {
+        Instance instance = nullptr;
+        Adapter adapter = nullptr;
+        Device device = nullptr;
+        Queue queue = nullptr;
+    };
+
+    MockDevice &mockDevice()
+    {
+        static MockDevice mock = []()
+        {
+            webgpu_mock::setCallCounting(false);
+            MockDevice mock;
+            mock.instance = createInstance(InstanceDescriptor{});
+            mock.adapter = mock.instance.requestAdapter(RequestAdapterOptions{});
+            DeviceDescriptor deviceDesc;
+            deviceDesc.label = "Benchmark device";
+            deviceDesc.requiredFeaturesCount = 0;
+            deviceDesc.requiredLimits = nullptr;
+            deviceDesc.defaultQueue.label = "Benchmark queue";
+            mock.device = mock.adapter.requestDevice(deviceDesc);
+            mock.queue = mock.device.getQueue();
+            return mock;
+        }();
+        return mock;
+    }
+
+    /**
+     * A random mesh of `vertexCount` vertices and twice as many triangles,
+     * in the text format of resources/pyramid.txt, written once.
+     */
+    fs::path syntheticMesh(int64_t vertexCount)
+    {
+        fs::path path = scratchDirectory() / ("mesh-" + std::to_string(vertexCount) + ".txt");
+        if (fs::exists(path))
+        {
+            return path;
+        }
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> color(0.0f, 1.0f);
+        std::uniform_int_distribution<uint32_t> corner(0, static_cast<uint32_t>(vertexCount - 1));
+
+        std::ofstream file(path, std::ios::binary);
+        file << "[points]\n# x y z r g b\n";
+        char row[128];
+        for (int64_t i = 0; i < vertexCount; ++i)
+        {
+            int length = std::snprintf(row, sizeof(row), "%+.4f %+.4f %+.4f    %.3f %.3f %.3f\n",
+                                       position(rng), position(rng), position(rng), color(rng), color(rng), color(rng));
+            file.write(row, length);
+        }
+        file << "\n[indices]\n";
+        for (int64_t i = 0; i < vertexCount * 2; ++i)
+        {
+            int length = std::snprintf(row, sizeof(row), "%u %u %u\n", corner(rng), corner(rng), corner(rng));
+            file.write(row, length);
+        }
+        return path;
+    }
+
+    /**
+     * The App's shader, padded with comments to about `kilobytes`.
+     */
+    fs::path syntheticShader(int64_t kilobytes)
+    {
+        fs::path path = scratchDirectory() / ("shader-" + std::to_string(kilobytes) + ".wgsl");
+        if (fs::exists(path))
+        {
+            return path;
+        }
+        std::ifstream source(RESOURCE_DIR "shader.wgsl", std::ios::binary);
+        std::string code((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+        std::ofstream file(path, std::ios::binary);
+        file << code;
+        std::string comment = "// " + std::string(76, '-') + "\n";
+        for (size_t size = code.size(); size < static_cast<size_t>(kilobytes) * 1024; size += comment.size())
+        {
+            file << comment;
+        }
+        return path;
+    }
+
+    void loadGeometryText(bench::State &state)
+    {
+        fs::path path = syntheticMesh(state.range(0));
+        ThreadPool threadPool(1);
+        std::vector<float> points;
+        std::vector<uint32_t> indices;
+        while (state.keepRunning())
+        {
+            if (!loadGeometry(path, points, indices, 3, {GeometryCacheMode::Disabled, &threadPool}))
+            {
+                state.skipWithError("could not load " + path.string());
+                break;
+            }
+        }
+        state.setItemsProcessed(state.iterations() * state.range(0));
+        state.setBytesProcessed(state.iterations() * fs::file_size(path));
+        state.setLabel("1 thread");
+    }
+    BENCHMARK(loadGeometryText)->arg(1 << 10)->arg(1 << 14)->arg(1 << 18);
+
+    void loadGeometryParallel(bench::State &state)
+    {
+        fs::path path = syntheticMesh(state.range(0));
+        std::vector<float> points;
+        std::vector<uint32_t> indices;
+        while (state.keepRunning())
+        {
+            loadGeometry(path, points, indices, 3, {GeometryCacheMode::Disabled});
+        }
+        state.setItemsProcessed(state.iterations() * state.range(0));
+        state.setBytesProcessed(state.iterations() * fs::file_size(path));
+        unsigned threadCount = ThreadPool::shared().threadCount();
+        state.setLabel(std::to_string(threadCount) + (threadCount == 1 ? " thread" : " threads"));
+    }
+    BENCHMARK(loadGeometryParallel)->arg(1 << 18);
+
+    void loadGeometryCached(bench::State &state)
+    {
+        fs::path path = syntheticMesh(state.range(0));
+        std::vector<float> points;
+        std::vector<uint32_t> indices;
+        // Write the binary cache, which the timed loads read
+        loadGeometry(path, points, indices, 3, {GeometryCacheMode::ReadWrite});
+        while (state.keepRunning())
+        {
+            loadGeometry(path, points, indices, 3, {GeometryCacheMode::ReadWrite});
+        }
+        state.setItemsProcessed(state.iterations() * state.range(0));
+        state.setBytesProcessed(state.iterations() * fs::file_size(GeometryCache::pathFor(path)));
+    }
+    BENCHMARK(loadGeometryCached)->arg(1 << 10)->arg(1 << 14)->arg(1 << 18);
+
+    void loadShaderModuleFile(bench::State &state)
+    {
+        fs::path path = syntheticShader(state.range(0));
+        Device device = mockDevice().device;
+        while (state.keepRunning())
+        {
+            ShaderModule module = loadShaderModule(path, device);
+            if (!module)
+            {
+                state.skipWithError("could not load " + path.string());
+                break;
+            }
+            wgpuShaderModuleRelease(module);
+        }
+        state.setBytesProcessed(state.iterations() * fs::file_size(path));
+    }
+    BENCHMARK(loadShaderModuleFile)->arg(4)->arg(64)->arg(1024);
+
+    void packUniforms(bench::State &state)
+    {
+        MockDevice &mock = mockDevice();
+        uint32_t drawCount = static_cast<uint32_t>(state.range(0));
+        UniformRing ring(mock.device, 256, drawCount * 256, 2);
+        MyUniforms uniforms = {{0.0f, 1.0f, 0.4f, 1.0f}, 0.0f, {}};
+        uint32_t frame = 0;
+        while (state.keepRunning())
+        {
+            ring.beginFrame(frame++ % 2);
+            for (uint32_t draw = 0; draw < drawCount; ++draw)
+            {
+                uniforms.time = static_cast<float>(draw);
+                ring.push(uniforms);
+            }
+            ring.upload(mock.queue);
+        }
+        state.setItemsProcessed(state.iterations() * drawCount);
+        state.setBytesProcessed(state.iterations() * drawCount * sizeof(MyUniforms));
+    }
+    BENCHMARK(packUniforms)->arg(1)->arg(64)->arg(1024);
+
+    /**
+     * What a frame of the App binds and draws with, created once.
+     */
+    struct FrameResources
+    {
+        explicit FrameResources(Device device)
+        {
+            TextureDescriptor textureDesc;
+            textureDesc.label = "Color target";
+            textureDesc.dimension = TextureDimension::_2D;
+            textureDesc.format = TextureFormat::BGRA8Unorm;
+            textureDesc.mipLevelCount = 1;
+            textureDesc.sampleCount = 1;
+            textureDesc.size = {640, 480, 1};
+            textureDesc.usage = TextureUsage::RenderAttachment;
+            textureDesc.viewFormatCount = 0;
+            textureDesc.viewFormats = nullptr;
+            texture = device.createTexture(textureDesc);
+            TextureViewDescriptor viewDesc;
+            viewDesc.format = TextureFormat::BGRA8Unorm;
+            viewDesc.dimension = TextureViewDimension::_2D;
+            viewDesc.baseMipLevel = 0;
+            viewDesc.mipLevelCount = 1;
+            viewDesc.baseArrayLayer = 0;
+            viewDesc.arrayLayerCount = 1;
+            viewDesc.aspect = TextureAspect::All;
+            view = texture.createView(viewDesc);
+
+            BufferDescriptor bufferDesc;
+            bufferDesc.size = 1 << 16;
+            bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Vertex | BufferUsage::Index;
+            bufferDesc.mappedAtCreation = false;
+            geometryBuffer = device.createBuffer(bufferDesc);
+
+            BindGroupLayoutDescriptor layoutDesc;
+            layoutDesc.entryCount = 0;
+            layoutDesc.entries = nullptr;
+            bindGroupLayout = device.createBindGroupLayout(layoutDesc);
+            BindGroupDescriptor bindGroupDesc;
+            bindGroupDesc.layout = bindGroupLayout;
+            bindGroupDesc.entryCount = 0;
+            bindGroupDesc.entries = nullptr;
+            bindGroup = device.createBindGroup(bindGroupDesc);
+
+            RenderPipelineDescriptor pipelineDesc;
+            pipelineDesc.label = "Benchmark pipeline";
+            pipeline = device.createRenderPipeline(pipelineDesc);
+        }
+
+        ~FrameResources()
+        {
+            wgpuRenderPipelineRelease(pipeline);
+            wgpuBindGroupRelease(bindGroup);
+            wgpuBindGroupLayoutRelease(bindGroupLayout);
+            wgpuBufferRelease(geometryBuffer);
+            wgpuTextureViewRelease(view);
+            wgpuTextureRelease(texture);
+        }
+
+        /**
+         * Record the App's color pass with `drawCount` draws.
+         */
+        void encode(CommandEncoder encoder, uint32_t drawCount) const
+        {
+            RenderPassColorAttachment colorAttachment;
+            colorAttachment.view = view;
+            colorAttachment.resolveTarget = nullptr;
+            colorAttachment.loadOp = LoadOp::Clear;
+            colorAttachment.storeOp = StoreOp::Store;
+            colorAttachment.clearValue = Color{0.05, 0.05, 0.05, 1.0};
+            RenderPassDescriptor renderPassDesc;
+            renderPassDesc.colorAttachmentCount = 1;
+            renderPassDesc.colorAttachments = &colorAttachment;
+            renderPassDesc.depthStencilAttachment = nullptr;
+            renderPassDesc.timestampWriteCount = 0;
+            renderPassDesc.timestampWrites = nullptr;
+            RenderPassEncoder renderPass = encoder.beginRenderPass(renderPassDesc);
+            renderPass.setPipeline(pipeline);
+            renderPass.setViewport(0.0f, 0.0f, 640.0f, 480.0f, 0.0f, 1.0f);
+            renderPass.setVertexBuffer(0, geometryBuffer, 0, 1 << 15);
+            renderPass.setIndexBuffer(geometryBuffer, IndexFormat::Uint16, 1 << 15, 1 << 15);
+            for (uint32_t draw = 0; draw < drawCount; ++draw)
+            {
+                uint32_t offset = draw * 256;
+                renderPass.setBindGroup(0, bindGroup, 1, &offset);
+                renderPass.drawIndexed(18, 1, 0, 0, 0);
+            }
+            renderPass.end();
+            wgpuRenderPassEncoderRelease(renderPass);
+        }
+
+        Texture texture = nullptr;
+        TextureView view = nullptr;
+        Buffer geometryBuffer = nullptr;
+        BindGroupLayout bindGroupLayout = nullptr;
+        BindGroup bindGroup = nullptr;
+        RenderPipeline pipeline = nullptr;
+    };
+
+    void encodeFrame(bench::State &state)
+    {
+        MockDevice &mock = mockDevice();
+        FrameResources resources(mock.device);
+        uint32_t drawCount = static_cast<uint32_t>(state.range(0));
+        while (state.keepRunning())
+        {
+            CommandEncoderDescriptor encoderDesc;
+            encoderDesc.label = "Frame encoder";
+            CommandEncoder encoder = mock.device.createCommandEncoder(encoderDesc);
+            resources.encode(encoder, drawCount);
+            CommandBufferDescriptor commandsDesc;
+            commandsDesc.label = "Frame commands";
+            CommandBuffer commands = encoder.finish(commandsDesc);
+            mock.queue.submit(commands);
+            wgpuCommandBufferRelease(commands);
+            wgpuCommandEncoderRelease(encoder);
+        }
+        state.setItemsProcessed(state.iterations() * drawCount);
+    }
+    BENCHMARK(encodeFrame)->arg(2)->arg(64)->arg(1024);
+
+    /**
+     * The App's render loop on the host: pacing, uniforms, encoding and
+     * submission with fences.
+     */
+    void renderLoop(bench::State &state)
+    {
+        MockDevice &mock = mockDevice();
+        FrameResources resources(mock.device);
+        uint32_t drawCount = static_cast<uint32_t>(state.range(0));
+        FramePacer pacer(mock.device, mock.queue, 2, 256, drawCount * 256);
+        MyUniforms uniforms = {{0.0f, 1.0f, 0.4f, 1.0f}, 0.0f, {}};
+        while (state.keepRunning())
+        {
+            pacer.beginFrame();
+            for (uint32_t draw = 0; draw < drawCount; ++draw)
+            {
+                pacer.uniforms().push(uniforms);
+            }
+            resources.encode(pacer.encoder(), drawCount);
+            pacer.submit();
+        }
+        pacer.waitIdle();
+        state.setItemsProcessed(state.iterations());
+    }
+    BENCHMARK(renderLoop)->arg(2)->arg(64)->arg(1024);
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int exitCode = bench::runBenchmarks(argc, argv);
+    std::error_code error;
+    fs::remove_all(scratchDirectory(), error);
+    return exitCode;
+}
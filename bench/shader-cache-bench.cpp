@@ -0,0 +1,128 @@
+/**
+ * Measures what the on-disk shader cache of shader-cache.h saves at
+ * startup: loading the App's shader from a cold cache (empty directory),
+ * from a warm one, and without a directory at all. Each load uses a new
+ * ShaderCache, like a new run of the App would, and includes creating the
+ * module on the device.
+ *
+ * Usage: ShaderCacheBench [runs] [cacheDirectory]
+ *
+ * It then loads many distinct variants of the shader with a small size cap,
+ * to check that least recently used files are evicted and the directory
+ * stays under the cap. The directory (by default one in the temporary
+ * directory) is removed at the end.
+ */
+
+#define WEBGPU_CPP_IMPLEMENTATION
+#include <webgpu/webgpu.hpp>
+
+#include "shader-cache.h"
+#include "vertex-quantization.h"
+#include "webgpu-release.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace wgpu;
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Timings
+    {
+        std::vector<double> milliseconds;
+        ShaderCacheStatistics statistics;
+
+        void print(const char *name)
+        {
+            std::sort(milliseconds.begin(), milliseconds.end());
+            std::cout << name << ": median " << milliseconds[milliseconds.size() / 2] << " ms, best "
+                      << milliseconds.front() << " ms (" << statistics.hits << " hits, " << statistics.misses
+                      << " misses)" << std::endl;
+        }
+    };
+
+    /**
+     * One startup: a new cache loading the shader.
+     */
+    bool load(Timings &timings, const fs::path &directory, const std::string &identity, Device device, const std::string &prelude)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ShaderCache cache(directory, identity);
+        ShaderModule module = cache.load(RESOURCE_DIR "shader.wgsl", device, prelude);
+        timings.milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        timings.statistics.hits += cache.statistics().hits;
+        timings.statistics.misses += cache.statistics().misses;
+        return module != nullptr;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? std::max(1, std::stoi(argv[1])) : 20;
+    std::error_code ec;
+    fs::path directory = argc > 2 ? fs::path(argv[2]) : fs::temp_directory_path(ec) / "webgpu-cpp-shader-cache-bench";
+
+    Instance instance = createInstance(InstanceDescriptor{});
+    Adapter adapter = instance ? instance.requestAdapter(RequestAdapterOptions{}) : nullptr;
+    Device device = adapter ? adapter.requestDevice(DeviceDescriptor{}) : nullptr;
+    if (!device)
+    {
+        std::cerr << "Could not get a WebGPU device" << std::endl;
+        return 1;
+    }
+    std::string identity = ShaderCache::adapterIdentity(adapter);
+    // The same prelude as the App, for vertices that need no decoding
+    std::string prelude = PackedVertexFormat().wgslDecode();
+
+    bool succeeded = true;
+    Timings uncached;
+    Timings cold;
+    Timings warm;
+    for (int i = 0; i < runs; ++i)
+    {
+        succeeded = load(uncached, {}, identity, device, prelude) && succeeded;
+        fs::remove_all(directory, ec);
+        succeeded = load(cold, directory, identity, device, prelude) && succeeded;
+    }
+    for (int i = 0; i < runs; ++i)
+    {
+        succeeded = load(warm, directory, identity, device, prelude) && succeeded;
+    }
+    uncached.print("No cache  ");
+    cold.print("Cold cache");
+    warm.print("Warm cache");
+    succeeded = succeeded && warm.statistics.hits == static_cast<uint64_t>(runs);
+
+    // Variants of the shader, each about 2.6 KB on disk, with a cap that
+    // fits a quarter of them
+    const int variantCount = 64;
+    const uint64_t maxBytes = 16 * 2800;
+    fs::remove_all(directory, ec);
+    {
+        ShaderCache cache(directory, identity, maxBytes);
+        for (int i = 0; i < variantCount; ++i)
+        {
+            std::string variantPrelude = prelude + "const benchVariant = " + std::to_string(i) + ";\n";
+            succeeded = cache.load(RESOURCE_DIR "shader.wgsl", device, variantPrelude) && succeeded;
+        }
+        std::cout << variantCount << " variants with a " << maxBytes / 1024 << " KB cap: "
+                  << cache.statistics().evictions << " files evicted, " << cache.diskUsage() << " bytes kept" << std::endl;
+        succeeded = succeeded && cache.diskUsage() <= maxBytes && cache.statistics().evictions > 0;
+    }
+    fs::remove_all(directory, ec);
+
+    wgpuDeviceRelease(device);
+    wgpuAdapterRelease(adapter);
+    wgpuInstanceRelease(instance);
+    if (!succeeded)
+    {
+        std::cerr << "Unexpected cache behavior" << std::endl;
+        return 1;
+    }
+    return 0;
+}
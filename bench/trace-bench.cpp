@@ -0,0 +1,137 @@
+/**
+ * Measures what a TRACE_SCOPE of trace-recorder.h costs, which must stay
+ * under 100 ns for scopes to be left enabled: recorded on one thread, with
+ * recording disabled, and on several threads while another one takes
+ * snapshots of their buffers. Times are per thread (CPU time on Linux).
+ *
+ * Usage: TraceBench [scopeCount] [threadCount]
+ *
+ * It also checks that snapshots taken while a buffer is being written
+ * only hold whole events, in order.
+ */
+
+#include "trace-recorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <time.h>
+#endif
+
+namespace
+{
+    /**
+     * Time spent by the calling thread, so that threads sharing fewer
+     * cores than there are threads are not charged for each other.
+     */
+    double threadNanoseconds()
+    {
+#ifdef __linux__
+        timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return time.tv_sec * 1e9 + time.tv_nsec;
+#else
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Nanoseconds per scope, the best of a few runs
+    double timeScopes(uint64_t count)
+    {
+        double best = 1e9;
+        for (int run = 0; run < 5; ++run)
+        {
+            double start = threadNanoseconds();
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                TRACE_SCOPE("Bench scope");
+            }
+            best = std::min(best, (threadNanoseconds() - start) / count);
+        }
+        return best;
+    }
+
+    /**
+     * Whether every snapshot of a buffer written with consecutive events
+     * (start i, duration i) holds consecutive whole events.
+     */
+    bool checkSnapshots(uint64_t count)
+    {
+        TraceBuffer buffer("Check", 1024);
+        std::atomic<bool> done{false};
+        std::thread writer([&]()
+                           {
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                buffer.record("Event", i, i);
+            }
+            done = true; });
+
+        bool consistent = true;
+        uint64_t snapshots = 0;
+        while (!done || snapshots == 0)
+        {
+            std::vector<TraceBuffer::Snapshot> events = buffer.snapshot();
+            for (size_t i = 0; i < events.size(); ++i)
+            {
+                consistent = consistent && events[i].start == events[i].duration &&
+                             (i == 0 || events[i].start == events[i - 1].start + 1);
+            }
+            ++snapshots;
+        }
+        writer.join();
+        std::cout << "Snapshots while writing: " << snapshots << ", " << (consistent ? "all consistent" : "TORN EVENTS") << std::endl;
+        return consistent;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    uint64_t scopeCount = argc > 1 ? std::stoull(argv[1]) : 10 * 1000 * 1000;
+    unsigned threadCount = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 4;
+    TraceRecorder &recorder = TraceRecorder::shared();
+    recorder.setThreadName("Bench");
+
+    double enabled = timeScopes(scopeCount);
+    recorder.setEnabled(false);
+    double disabled = timeScopes(scopeCount);
+    recorder.setEnabled(true);
+    std::cout << "One thread: " << enabled << " ns per scope (" << disabled << " ns disabled)" << std::endl;
+
+    // Threads record while this one keeps taking snapshots, like a flush
+    std::vector<double> perThread(threadCount);
+    std::atomic<unsigned> running{threadCount};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            perThread[t] = timeScopes(scopeCount / threadCount);
+            --running; });
+    }
+    uint64_t flushes = 0;
+    while (running > 0)
+    {
+        std::ostringstream json;
+        recorder.writeChromeTrace(json);
+        ++flushes;
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    double worst = *std::max_element(perThread.begin(), perThread.end());
+    std::cout << threadCount << " threads: at most " << worst << " ns per scope, during " << flushes << " flushes" << std::endl;
+
+    bool consistent = checkSnapshots(scopeCount);
+    bool withinBudget = enabled < 100.0 && worst < 100.0;
+    std::cout << (withinBudget ? "Within" : "Over") << " the 100 ns per scope budget" << std::endl;
+    return consistent && withinBudget ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+/**
+ * A stand-in implementation of the webgpu.h (and wgpu.h) C API that runs
+ * on the CPU only. It is built as the `webgpu` target when configuring with
+ * -DWEBGPU_MOCK=ON, so that host code (and webgpu.hpp) links against it
+ * unchanged on machines without a GPU.
+ *
+ * Nothing is ever rendered. Objects only keep what host code can observe:
+ * buffers hold their contents (writes, copies between buffers and mapping
+ * work), textures hold none (copying one to a buffer writes zeros), and
+ * pipelines and shaders only keep their descriptor sizes.
+ *
+ * The TimestampQuery feature is supported: timestamps are the host clock,
+ * in nanoseconds, when the writing command runs on submit.
+ *
+ * Submitted work completes as soon as the device is polled (wgpuDevicePoll,
+ * wgpuInstanceProcessEvents) or the next submit happens, which is when
+ * onSubmittedWorkDone, mapAsync and create*PipelineAsync call back.
+ *
+ * A few common validation rules (copy alignments, buffer bounds, dynamic
+ * offset alignment, map states) are checked and reported through the error
+ * callback or error scopes, like a real device would.
+ *
+ * Every call is counted with its byte count and duration, which this header
+ * gives access to.
+ */
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace webgpu_mock
+{
+    struct CallStatistics
+    {
+        uint64_t count = 0;
+        // Bytes the call moved or allocated (e.g. writeBuffer size, buffer
+        // size on creation, shader code size), 0 for most calls
+        uint64_t bytes = 0;
+        // Time spent inside the mock, which is mostly bookkeeping
+        uint64_t nanoseconds = 0;
+    };
+
+    struct Statistics
+    {
+        // By function name, e.g. "wgpuQueueWriteBuffer"
+        std::map<std::string, CallStatistics> calls;
+
+        uint64_t objectsCreated = 0;
+        uint64_t objectsAlive = 0;
+        uint64_t bufferBytesAllocated = 0;
+        uint64_t bufferBytesAlive = 0;
+        // Through queue writes, i.e. host to device traffic
+        uint64_t bytesUploaded = 0;
+        // Through mapped buffers, i.e. device to host traffic
+        uint64_t bytesReadBack = 0;
+        uint64_t submits = 0;
+        uint64_t commandBuffers = 0;
+        uint64_t renderPasses = 0;
+        uint64_t draws = 0;
+        uint64_t presents = 0;
+        uint64_t validationErrors = 0;
+
+        // Counters of the calls of `function`, zero if it was never called
+        CallStatistics call(const std::string &function) const;
+    };
+
+    /**
+     * One call, when call recording is on.
+     */
+    struct CallRecord
+    {
+        const char *function;
+        uint64_t bytes;
+        // Since the last resetStatistics()
+        uint64_t startNanoseconds;
+        uint64_t durationNanoseconds;
+    };
+
+    Statistics statistics();
+
+    /**
+     * Zero all counters (except objectsAlive and bufferBytesAlive, which
+     * describe live objects) and drop recorded calls.
+     */
+    void resetStatistics();
+
+    /**
+     * Count (and time) every call per function, on by default. Off, calls
+     * are neither counted nor recorded and the entry points do little more
+     * than what they must to work, e.g. to benchmark the host code calling
+     * them; the other statistics are still kept.
+     */
+    void setCallCounting(bool enabled);
+
+    /**
+     * While held, polls and submits call nothing back, as if the GPU were
+     * still busy with the work submitted, e.g. to check what host code does
+     * while its readbacks are pending. Callbacks deferred in the meantime
+     * are called on the first poll or submit after release.
+     */
+    void setCallbacksHeld(bool held);
+
+    /**
+     * Keep a record of every call, in order, until takeCallRecords(). Off
+     * by default, since records grow for as long as the program runs.
+     */
+    void setCallRecording(bool enabled);
+    std::vector<CallRecord> takeCallRecords();
+
+    /**
+     * A table of the calls made, by decreasing count, and the counters.
+     */
+    void printStatistics(std::ostream &stream, const Statistics &statistics);
+} // namespace webgpu_mock
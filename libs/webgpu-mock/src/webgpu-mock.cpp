@@ -0,0 +1,1878 @@
+#include "webgpu-mock.h"
+
+#include <webgpu/webgpu.h>
+#include <webgpu/wgpu.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Everything the mock counts. Object and traffic counters are atomics,
+     * per-function counters are behind the mutex.
+     */
+    struct Recorder
+    {
+        std::mutex mutex;
+        // Keyed by the __func__ of each entry point, which is unique
+        std::unordered_map<const char *, webgpu_mock::CallStatistics> calls;
+        std::atomic<bool> countCalls{true};
+        bool recordCalls = false;
+        std::vector<webgpu_mock::CallRecord> records;
+        Clock::time_point origin = Clock::now();
+
+        std::atomic<uint64_t> objectsCreated{0};
+        std::atomic<uint64_t> objectsAlive{0};
+        std::atomic<uint64_t> bufferBytesAllocated{0};
+        std::atomic<uint64_t> bufferBytesAlive{0};
+        std::atomic<uint64_t> bytesUploaded{0};
+        std::atomic<uint64_t> bytesReadBack{0};
+        std::atomic<uint64_t> submits{0};
+        std::atomic<uint64_t> commandBuffers{0};
+        std::atomic<uint64_t> renderPasses{0};
+        std::atomic<uint64_t> draws{0};
+        std::atomic<uint64_t> presents{0};
+        std::atomic<uint64_t> validationErrors{0};
+    };
+
+    Recorder &recorder()
+    {
+        static Recorder instance;
+        return instance;
+    }
+
+    /**
+     * Times one entry point and adds it to the statistics when it returns.
+     */
+    class CallScope
+    {
+    public:
+        CallScope(const char *function, uint64_t bytes)
+            : m_function(function), m_bytes(bytes), m_counting(recorder().countCalls.load(std::memory_order_relaxed))
+        {
+            if (m_counting)
+            {
+                m_start = Clock::now();
+            }
+        }
+
+        ~CallScope()
+        {
+            if (!m_counting)
+            {
+                return;
+            }
+            Clock::time_point end = Clock::now();
+            uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count();
+            Recorder &r = recorder();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            webgpu_mock::CallStatistics &call = r.calls[m_function];
+            ++call.count;
+            call.bytes += m_bytes;
+            call.nanoseconds += duration;
+            if (r.recordCalls)
+            {
+                uint64_t start = m_start > r.origin ? std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - r.origin).count() : 0;
+                r.records.push_back({m_function, m_bytes, start, duration});
+            }
+        }
+
+        void addBytes(uint64_t bytes) { m_bytes += bytes; }
+
+    private:
+        const char *m_function;
+        uint64_t m_bytes;
+        bool m_counting;
+        Clock::time_point m_start;
+    };
+
+#define MOCK_CALL(bytes) CallScope mockCall(__func__, (bytes))
+
+    /**
+     * Callbacks wait here until the device is polled, as if the GPU took a
+     * while to get to them.
+     */
+    struct PendingCallbacks
+    {
+        std::mutex mutex;
+        std::vector<std::function<void()>> callbacks;
+        // See setCallbacksHeld()
+        bool held = false;
+    };
+
+    PendingCallbacks &pendingCallbacks()
+    {
+        static PendingCallbacks instance;
+        return instance;
+    }
+
+    void defer(std::function<void()> callback)
+    {
+        PendingCallbacks &pending = pendingCallbacks();
+        std::lock_guard<std::mutex> lock(pending.mutex);
+        pending.callbacks.push_back(std::move(callback));
+    }
+
+    // Returns true if nothing was pending
+    bool flushCallbacks()
+    {
+        PendingCallbacks &pending = pendingCallbacks();
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(pending.mutex);
+            if (pending.held)
+            {
+                return pending.callbacks.empty();
+            }
+            std::swap(callbacks, pending.callbacks);
+        }
+        // Callbacks may defer new ones (e.g. map again), which wait for the
+        // next poll
+        for (const std::function<void()> &callback : callbacks)
+        {
+            callback();
+        }
+        return callbacks.empty();
+    }
+
+    WGPULimits defaultLimits()
+    {
+        // The defaults of the WebGPU specification, with a larger buffer
+        // size so that big meshes fit
+        WGPULimits limits = {};
+        limits.maxTextureDimension1D = 8192;
+        limits.maxTextureDimension2D = 8192;
+        limits.maxTextureDimension3D = 2048;
+        limits.maxTextureArrayLayers = 256;
+        limits.maxBindGroups = 4;
+        limits.maxBindingsPerBindGroup = 640;
+        limits.maxDynamicUniformBuffersPerPipelineLayout = 8;
+        limits.maxDynamicStorageBuffersPerPipelineLayout = 4;
+        limits.maxSampledTexturesPerShaderStage = 16;
+        limits.maxSamplersPerShaderStage = 16;
+        limits.maxStorageBuffersPerShaderStage = 8;
+        limits.maxStorageTexturesPerShaderStage = 4;
+        limits.maxUniformBuffersPerShaderStage = 12;
+        limits.maxUniformBufferBindingSize = 65536;
+        limits.maxStorageBufferBindingSize = 134217728;
+        limits.minUniformBufferOffsetAlignment = 256;
+        limits.minStorageBufferOffsetAlignment = 256;
+        limits.maxVertexBuffers = 8;
+        limits.maxBufferSize = uint64_t(1) << 30;
+        limits.maxVertexAttributes = 16;
+        limits.maxVertexBufferArrayStride = 2048;
+        limits.maxInterStageShaderComponents = 60;
+        limits.maxInterStageShaderVariables = 16;
+        limits.maxColorAttachments = 8;
+        limits.maxColorAttachmentBytesPerSample = 32;
+        limits.maxComputeWorkgroupStorageSize = 16384;
+        limits.maxComputeInvocationsPerWorkgroup = 256;
+        limits.maxComputeWorkgroupSizeX = 256;
+        limits.maxComputeWorkgroupSizeY = 256;
+        limits.maxComputeWorkgroupSizeZ = 64;
+        limits.maxComputeWorkgroupsPerDimension = 65535;
+        return limits;
+    }
+
+    uint32_t texelSize(WGPUTextureFormat format)
+    {
+        switch (format)
+        {
+        case WGPUTextureFormat_R8Unorm:
+        case WGPUTextureFormat_R8Snorm:
+        case WGPUTextureFormat_R8Uint:
+        case WGPUTextureFormat_R8Sint:
+        case WGPUTextureFormat_Stencil8:
+            return 1;
+        case WGPUTextureFormat_R16Uint:
+        case WGPUTextureFormat_R16Sint:
+        case WGPUTextureFormat_R16Float:
+        case WGPUTextureFormat_RG8Unorm:
+        case WGPUTextureFormat_RG8Snorm:
+        case WGPUTextureFormat_RG8Uint:
+        case WGPUTextureFormat_RG8Sint:
+        case WGPUTextureFormat_Depth16Unorm:
+            return 2;
+        case WGPUTextureFormat_RG32Float:
+        case WGPUTextureFormat_RG32Uint:
+        case WGPUTextureFormat_RG32Sint:
+        case WGPUTextureFormat_RGBA16Uint:
+        case WGPUTextureFormat_RGBA16Sint:
+        case WGPUTextureFormat_RGBA16Float:
+        case WGPUTextureFormat_Depth32FloatStencil8:
+            return 8;
+        case WGPUTextureFormat_RGBA32Float:
+        case WGPUTextureFormat_RGBA32Uint:
+        case WGPUTextureFormat_RGBA32Sint:
+            return 16;
+        default:
+            // Most color and depth formats, and a fair guess for the others
+            return 4;
+        }
+    }
+
+    std::string labelOf(char const *label)
+    {
+        return label ? label : "";
+    }
+} // namespace
+
+/**
+ * Common part of every object: a reference count (released by the *Drop
+ * functions of wgpu.h) and a label.
+ */
+struct MockObject
+{
+    MockObject()
+    {
+        ++recorder().objectsCreated;
+        ++recorder().objectsAlive;
+    }
+    virtual ~MockObject()
+    {
+        if (!consumed)
+        {
+            --recorder().objectsAlive;
+        }
+    }
+
+    MockObject(const MockObject &) = delete;
+    MockObject &operator=(const MockObject &) = delete;
+
+    /**
+     * Like wgpu-native, passes end, encoders finish and command buffers get
+     * submitted for good, and applications do not always drop them after
+     * that. They no longer count as alive, but their handle stays valid.
+     */
+    void consume()
+    {
+        if (!consumed)
+        {
+            consumed = true;
+            --recorder().objectsAlive;
+        }
+    }
+
+    std::atomic<uint32_t> references{1};
+    std::string label;
+    bool consumed = false;
+};
+
+namespace
+{
+    template <typename T>
+    void release(T *object)
+    {
+        if (object && --object->references == 0)
+        {
+            delete object;
+        }
+    }
+
+    template <typename T>
+    T *reference(T *object)
+    {
+        if (object)
+        {
+            ++object->references;
+        }
+        return object;
+    }
+} // namespace
+
+struct ErrorScope
+{
+    WGPUErrorFilter filter;
+    WGPUErrorType type = WGPUErrorType_NoError;
+    std::string message;
+};
+
+struct WGPUInstanceImpl : MockObject
+{
+};
+
+struct WGPUSurfaceImpl : MockObject
+{
+};
+
+struct WGPUAdapterImpl : MockObject
+{
+};
+
+struct WGPUQueueImpl : MockObject
+{
+    WGPUDevice device = nullptr;
+};
+
+struct WGPUDeviceImpl : MockObject
+{
+    WGPUQueue queue = nullptr;
+    WGPULimits limits = defaultLimits();
+    WGPUErrorCallback errorCallback = nullptr;
+    void *errorUserdata = nullptr;
+    WGPUDeviceLostCallback lostCallback = nullptr;
+    void *lostUserdata = nullptr;
+    std::vector<ErrorScope> errorScopes;
+    // The only optional feature the mock has
+    bool timestampQuery = false;
+
+    ~WGPUDeviceImpl() override
+    {
+        delete queue;
+    }
+
+    void error(WGPUErrorType type, const std::string &message)
+    {
+        ++recorder().validationErrors;
+        WGPUErrorFilter filter = type == WGPUErrorType_OutOfMemory ? WGPUErrorFilter_OutOfMemory
+                                 : type == WGPUErrorType_Validation ? WGPUErrorFilter_Validation
+                                                                     : WGPUErrorFilter_Internal;
+        // The innermost scope catching this kind of error keeps the first one
+        for (auto scope = errorScopes.rbegin(); scope != errorScopes.rend(); ++scope)
+        {
+            if (scope->filter == filter)
+            {
+                if (scope->type == WGPUErrorType_NoError)
+                {
+                    scope->type = type;
+                    scope->message = message;
+                }
+                return;
+            }
+        }
+        if (errorCallback)
+        {
+            errorCallback(type, message.c_str(), errorUserdata);
+        }
+    }
+
+    void validationError(const std::string &message)
+    {
+        error(WGPUErrorType_Validation, message);
+    }
+};
+
+struct WGPUBufferImpl : MockObject
+{
+    WGPUDevice device = nullptr;
+    uint64_t size = 0;
+    WGPUBufferUsageFlags usage = 0;
+    WGPUBufferMapState mapState = WGPUBufferMapState_Unmapped;
+    bool destroyed = false;
+    // Allocated on first use, so that buffers nobody reads back cost nothing
+    std::vector<uint8_t> contents;
+
+    ~WGPUBufferImpl() override
+    {
+        recorder().bufferBytesAlive -= size;
+    }
+
+    uint8_t *data()
+    {
+        if (contents.size() != size)
+        {
+            contents.resize(static_cast<size_t>(size), 0);
+        }
+        return contents.data();
+    }
+};
+
+struct WGPUTextureImpl : MockObject
+{
+    WGPUDevice device = nullptr;
+    WGPUTextureUsageFlags usage = 0;
+    WGPUTextureDimension dimension = WGPUTextureDimension_2D;
+    WGPUExtent3D size = {1, 1, 1};
+    WGPUTextureFormat format = WGPUTextureFormat_Undefined;
+    uint32_t mipLevelCount = 1;
+    uint32_t sampleCount = 1;
+};
+
+struct WGPUTextureViewImpl : MockObject
+{
+    WGPUTexture texture = nullptr;
+
+    ~WGPUTextureViewImpl() override
+    {
+        release(texture);
+    }
+};
+
+struct WGPUSamplerImpl : MockObject
+{
+};
+
+struct WGPUBindGroupLayoutImpl : MockObject
+{
+};
+
+struct WGPUBindGroupImpl : MockObject
+{
+};
+
+struct WGPUPipelineLayoutImpl : MockObject
+{
+};
+
+struct WGPUShaderModuleImpl : MockObject
+{
+};
+
+struct WGPURenderPipelineImpl : MockObject
+{
+};
+
+struct WGPUComputePipelineImpl : MockObject
+{
+};
+
+struct WGPUQuerySetImpl : MockObject
+{
+    WGPUQueryType type = WGPUQueryType_Occlusion;
+    uint32_t count = 0;
+    // Written when the commands run, see gpuTimestamp()
+    std::vector<uint64_t> values;
+};
+
+struct WGPUCommandBufferImpl : MockObject
+{
+    // Copies to run when the command buffer is submitted
+    std::vector<std::function<void()>> commands;
+};
+
+struct WGPUCommandEncoderImpl : MockObject
+{
+    WGPUDevice device = nullptr;
+    std::vector<std::function<void()>> commands;
+};
+
+struct WGPURenderPassEncoderImpl : MockObject
+{
+    WGPUDevice device = nullptr;
+    WGPUCommandEncoder commandEncoder = nullptr;
+    // Timestamp to write when the pass ends, if any
+    WGPUQuerySet endQuerySet = nullptr;
+    uint32_t endQueryIndex = 0;
+};
+
+struct WGPUComputePassEncoderImpl : MockObject
+{
+    WGPUDevice device = nullptr;
+};
+
+struct WGPURenderBundleImpl : MockObject
+{
+};
+
+struct WGPURenderBundleEncoderImpl : MockObject
+{
+    WGPUDevice device = nullptr;
+};
+
+struct WGPUSwapChainImpl : MockObject
+{
+    WGPUTexture texture = nullptr;
+
+    ~WGPUSwapChainImpl() override
+    {
+        release(texture);
+    }
+};
+
+namespace
+{
+    template <typename T>
+    T *create(char const *label)
+    {
+        T *object = new T();
+        object->label = labelOf(label);
+        return object;
+    }
+
+    void checkBufferRange(WGPUDevice device, WGPUBuffer buffer, uint64_t offset, uint64_t size, const char *what)
+    {
+        if (!buffer || offset > buffer->size || size > buffer->size - offset)
+        {
+            device->validationError(std::string(what) + ": range out of the bounds of the buffer");
+        }
+    }
+
+    void checkCopyAlignment(WGPUDevice device, uint64_t offset, uint64_t size, const char *what)
+    {
+        if (offset % 4 != 0 || size % 4 != 0)
+        {
+            device->validationError(std::string(what) + ": offset and size must be multiples of 4");
+        }
+    }
+
+    void checkDynamicOffsets(WGPUDevice device, uint32_t count, uint32_t const *offsets)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (offsets[i] % device->limits.minUniformBufferOffsetAlignment != 0)
+            {
+                device->validationError("setBindGroup: dynamic offset " + std::to_string(offsets[i]) + " is not aligned");
+            }
+        }
+    }
+
+    void drawCall()
+    {
+        ++recorder().draws;
+    }
+
+    /**
+     * The "GPU" clock of timestamp queries, in nanoseconds: the host clock
+     * when the command runs on submit, strictly increasing.
+     */
+    uint64_t gpuTimestamp()
+    {
+        static std::atomic<uint64_t> last{0};
+        uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+        uint64_t previous = last.load();
+        uint64_t next;
+        do
+        {
+            next = std::max(now, previous + 1);
+        } while (!last.compare_exchange_weak(previous, next));
+        return next;
+    }
+
+    void writeTimestamp(WGPUCommandEncoder commandEncoder, WGPUQuerySet querySet, uint32_t queryIndex, const char *what)
+    {
+        if (querySet->type != WGPUQueryType_Timestamp || queryIndex >= querySet->count)
+        {
+            commandEncoder->device->validationError(std::string(what) + ": not a query of a timestamp query set");
+            return;
+        }
+        commandEncoder->commands.push_back([=]()
+                                           { querySet->values[queryIndex] = gpuTimestamp(); });
+    }
+} // namespace
+
+namespace webgpu_mock
+{
+    CallStatistics Statistics::call(const std::string &function) const
+    {
+        auto it = calls.find(function);
+        return it != calls.end() ? it->second : CallStatistics{};
+    }
+
+    Statistics statistics()
+    {
+        Recorder &r = recorder();
+        Statistics statistics;
+        {
+            std::lock_guard<std::mutex> lock(r.mutex);
+            for (const auto &call : r.calls)
+            {
+                statistics.calls[call.first] = call.second;
+            }
+        }
+        statistics.objectsCreated = r.objectsCreated;
+        statistics.objectsAlive = r.objectsAlive;
+        statistics.bufferBytesAllocated = r.bufferBytesAllocated;
+        statistics.bufferBytesAlive = r.bufferBytesAlive;
+        statistics.bytesUploaded = r.bytesUploaded;
+        statistics.bytesReadBack = r.bytesReadBack;
+        statistics.submits = r.submits;
+        statistics.commandBuffers = r.commandBuffers;
+        statistics.renderPasses = r.renderPasses;
+        statistics.draws = r.draws;
+        statistics.presents = r.presents;
+        statistics.validationErrors = r.validationErrors;
+        return statistics;
+    }
+
+    void resetStatistics()
+    {
+        Recorder &r = recorder();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.calls.clear();
+        r.records.clear();
+        r.origin = Clock::now();
+        r.objectsCreated = 0;
+        r.bufferBytesAllocated = 0;
+        r.bytesUploaded = 0;
+        r.bytesReadBack = 0;
+        r.submits = 0;
+        r.commandBuffers = 0;
+        r.renderPasses = 0;
+        r.draws = 0;
+        r.presents = 0;
+        r.validationErrors = 0;
+    }
+
+    void setCallCounting(bool enabled)
+    {
+        recorder().countCalls.store(enabled, std::memory_order_relaxed);
+    }
+
+    void setCallbacksHeld(bool held)
+    {
+        PendingCallbacks &pending = pendingCallbacks();
+        std::lock_guard<std::mutex> lock(pending.mutex);
+        pending.held = held;
+    }
+
+    void setCallRecording(bool enabled)
+    {
+        Recorder &r = recorder();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.recordCalls = enabled;
+    }
+
+    std::vector<CallRecord> takeCallRecords()
+    {
+        Recorder &r = recorder();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        std::vector<CallRecord> records;
+        std::swap(records, r.records);
+        return records;
+    }
+
+    void printStatistics(std::ostream &stream, const Statistics &statistics)
+    {
+        std::vector<std::pair<std::string, CallStatistics>> calls(statistics.calls.begin(), statistics.calls.end());
+        std::sort(calls.begin(), calls.end(), [](const auto &a, const auto &b)
+                  { return a.second.count > b.second.count; });
+
+        std::ios::fmtflags flags = stream.flags();
+        stream << std::left << std::setw(48) << "Call" << std::right << std::setw(10) << "count"
+               << std::setw(14) << "bytes" << std::setw(12) << "ns/call" << std::endl;
+        for (const auto &call : calls)
+        {
+            stream << std::left << std::setw(48) << call.first << std::right << std::setw(10) << call.second.count
+                   << std::setw(14) << call.second.bytes
+                   << std::setw(12) << call.second.nanoseconds / std::max<uint64_t>(1, call.second.count) << std::endl;
+        }
+        stream.flags(flags);
+
+        stream << "Objects created: " << statistics.objectsCreated << " (" << statistics.objectsAlive << " alive)" << std::endl;
+        stream << "Buffer bytes allocated: " << statistics.bufferBytesAllocated << " (" << statistics.bufferBytesAlive << " alive)" << std::endl;
+        stream << "Bytes uploaded: " << statistics.bytesUploaded << ", read back: " << statistics.bytesReadBack << std::endl;
+        stream << "Submits: " << statistics.submits << " (" << statistics.commandBuffers << " command buffers), render passes: "
+               << statistics.renderPasses << ", draws: " << statistics.draws << ", presents: " << statistics.presents << std::endl;
+        stream << "Validation errors: " << statistics.validationErrors << std::endl;
+    }
+} // namespace webgpu_mock
+
+extern "C"
+{
+    // Instance, adapter and device
+
+    WGPUInstance wgpuCreateInstance(WGPUInstanceDescriptor const *)
+    {
+        MOCK_CALL(0);
+        return create<WGPUInstanceImpl>(nullptr);
+    }
+
+    WGPUProc wgpuGetProcAddress(WGPUDevice, char const *)
+    {
+        MOCK_CALL(0);
+        return nullptr;
+    }
+
+    WGPUSurface wgpuInstanceCreateSurface(WGPUInstance, WGPUSurfaceDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPUSurfaceImpl>(descriptor ? descriptor->label : nullptr);
+    }
+
+    void wgpuInstanceProcessEvents(WGPUInstance)
+    {
+        MOCK_CALL(0);
+        flushCallbacks();
+    }
+
+    void wgpuInstanceRequestAdapter(WGPUInstance, WGPURequestAdapterOptions const *, WGPURequestAdapterCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        // Like wgpu-native, answer right away
+        callback(WGPURequestAdapterStatus_Success, create<WGPUAdapterImpl>(nullptr), nullptr, userdata);
+    }
+
+    size_t wgpuAdapterEnumerateFeatures(WGPUAdapter, WGPUFeatureName *features)
+    {
+        MOCK_CALL(0);
+        if (features)
+        {
+            features[0] = WGPUFeatureName_TimestampQuery;
+        }
+        return 1;
+    }
+
+    bool wgpuAdapterGetLimits(WGPUAdapter, WGPUSupportedLimits *limits)
+    {
+        MOCK_CALL(0);
+        limits->limits = defaultLimits();
+        return true;
+    }
+
+    void wgpuAdapterGetProperties(WGPUAdapter, WGPUAdapterProperties *properties)
+    {
+        MOCK_CALL(0);
+        properties->vendorID = 0;
+        properties->vendorName = "webgpu-mock";
+        properties->architecture = "";
+        properties->deviceID = 0;
+        properties->name = "Mock adapter";
+        properties->driverDescription = "Recording stand-in for webgpu.h";
+        properties->adapterType = WGPUAdapterType_CPU;
+        properties->backendType = WGPUBackendType_Null;
+    }
+
+    bool wgpuAdapterHasFeature(WGPUAdapter, WGPUFeatureName feature)
+    {
+        MOCK_CALL(0);
+        return feature == WGPUFeatureName_TimestampQuery;
+    }
+
+    void wgpuAdapterRequestDevice(WGPUAdapter, WGPUDeviceDescriptor const *descriptor, WGPURequestDeviceCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        WGPUDevice device = create<WGPUDeviceImpl>(descriptor ? descriptor->label : nullptr);
+        if (descriptor && descriptor->requiredLimits)
+        {
+            // Alignments are what the application asked for, as long as
+            // they are valid
+            const WGPULimits &required = descriptor->requiredLimits->limits;
+            if (required.minUniformBufferOffsetAlignment != 0)
+            {
+                device->limits.minUniformBufferOffsetAlignment = required.minUniformBufferOffsetAlignment;
+            }
+            if (required.minStorageBufferOffsetAlignment != 0)
+            {
+                device->limits.minStorageBufferOffsetAlignment = required.minStorageBufferOffsetAlignment;
+            }
+        }
+        if (descriptor)
+        {
+            for (uint32_t i = 0; i < descriptor->requiredFeaturesCount; ++i)
+            {
+                device->timestampQuery |= descriptor->requiredFeatures[i] == WGPUFeatureName_TimestampQuery;
+            }
+        }
+        device->queue = new WGPUQueueImpl();
+        device->queue->device = device;
+        callback(WGPURequestDeviceStatus_Success, device, nullptr, userdata);
+    }
+
+    WGPUBindGroup wgpuDeviceCreateBindGroup(WGPUDevice, WGPUBindGroupDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPUBindGroupImpl>(descriptor->label);
+    }
+
+    WGPUBindGroupLayout wgpuDeviceCreateBindGroupLayout(WGPUDevice, WGPUBindGroupLayoutDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPUBindGroupLayoutImpl>(descriptor->label);
+    }
+
+    WGPUBuffer wgpuDeviceCreateBuffer(WGPUDevice device, WGPUBufferDescriptor const *descriptor)
+    {
+        MOCK_CALL(descriptor->size);
+        if (descriptor->size > device->limits.maxBufferSize)
+        {
+            device->validationError("createBuffer: size exceeds maxBufferSize");
+        }
+        if (descriptor->mappedAtCreation && descriptor->size % 4 != 0)
+        {
+            device->validationError("createBuffer: mapped at creation with a size not multiple of 4");
+        }
+
+        WGPUBuffer buffer = create<WGPUBufferImpl>(descriptor->label);
+        buffer->device = device;
+        buffer->size = descriptor->size;
+        buffer->usage = descriptor->usage;
+        if (descriptor->mappedAtCreation)
+        {
+            buffer->mapState = WGPUBufferMapState_Mapped;
+        }
+        recorder().bufferBytesAllocated += descriptor->size;
+        recorder().bufferBytesAlive += descriptor->size;
+        return buffer;
+    }
+
+    WGPUCommandEncoder wgpuDeviceCreateCommandEncoder(WGPUDevice device, WGPUCommandEncoderDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        WGPUCommandEncoder encoder = create<WGPUCommandEncoderImpl>(descriptor ? descriptor->label : nullptr);
+        encoder->device = device;
+        return encoder;
+    }
+
+    WGPUComputePipeline wgpuDeviceCreateComputePipeline(WGPUDevice, WGPUComputePipelineDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPUComputePipelineImpl>(descriptor->label);
+    }
+
+    void wgpuDeviceCreateComputePipelineAsync(WGPUDevice, WGPUComputePipelineDescriptor const *descriptor, WGPUCreateComputePipelineAsyncCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        WGPUComputePipeline pipeline = create<WGPUComputePipelineImpl>(descriptor->label);
+        defer([=]()
+              { callback(WGPUCreatePipelineAsyncStatus_Success, pipeline, nullptr, userdata); });
+    }
+
+    WGPUPipelineLayout wgpuDeviceCreatePipelineLayout(WGPUDevice, WGPUPipelineLayoutDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPUPipelineLayoutImpl>(descriptor->label);
+    }
+
+    WGPUQuerySet wgpuDeviceCreateQuerySet(WGPUDevice device, WGPUQuerySetDescriptor const *descriptor)
+    {
+        MOCK_CALL(static_cast<uint64_t>(descriptor->count) * 8);
+        if (descriptor->type == WGPUQueryType_Timestamp && !device->timestampQuery)
+        {
+            device->validationError("createQuerySet: timestamp queries need the TimestampQuery feature");
+        }
+        WGPUQuerySet querySet = create<WGPUQuerySetImpl>(descriptor->label);
+        querySet->type = descriptor->type;
+        querySet->count = descriptor->count;
+        querySet->values.resize(descriptor->count, 0);
+        return querySet;
+    }
+
+    WGPURenderBundleEncoder wgpuDeviceCreateRenderBundleEncoder(WGPUDevice device, WGPURenderBundleEncoderDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        WGPURenderBundleEncoder encoder = create<WGPURenderBundleEncoderImpl>(descriptor->label);
+        encoder->device = device;
+        return encoder;
+    }
+
+    WGPURenderPipeline wgpuDeviceCreateRenderPipeline(WGPUDevice, WGPURenderPipelineDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPURenderPipelineImpl>(descriptor->label);
+    }
+
+    void wgpuDeviceCreateRenderPipelineAsync(WGPUDevice, WGPURenderPipelineDescriptor const *descriptor, WGPUCreateRenderPipelineAsyncCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        WGPURenderPipeline pipeline = create<WGPURenderPipelineImpl>(descriptor->label);
+        defer([=]()
+              { callback(WGPUCreatePipelineAsyncStatus_Success, pipeline, nullptr, userdata); });
+    }
+
+    WGPUSampler wgpuDeviceCreateSampler(WGPUDevice, WGPUSamplerDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPUSamplerImpl>(descriptor ? descriptor->label : nullptr);
+    }
+
+    WGPUShaderModule wgpuDeviceCreateShaderModule(WGPUDevice, WGPUShaderModuleDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        for (const WGPUChainedStruct *chain = descriptor->nextInChain; chain; chain = chain->next)
+        {
+            if (chain->sType == WGPUSType_ShaderModuleWGSLDescriptor)
+            {
+                const auto *wgsl = reinterpret_cast<const WGPUShaderModuleWGSLDescriptor *>(chain);
+                mockCall.addBytes(wgsl->code ? std::strlen(wgsl->code) : 0);
+            }
+        }
+        return create<WGPUShaderModuleImpl>(descriptor->label);
+    }
+
+    WGPUSwapChain wgpuDeviceCreateSwapChain(WGPUDevice device, WGPUSurface, WGPUSwapChainDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        WGPUSwapChain swapChain = create<WGPUSwapChainImpl>(descriptor->label);
+        swapChain->texture = create<WGPUTextureImpl>("Swap chain texture");
+        swapChain->texture->device = device;
+        swapChain->texture->usage = descriptor->usage;
+        swapChain->texture->size = {descriptor->width, descriptor->height, 1};
+        swapChain->texture->format = descriptor->format;
+        return swapChain;
+    }
+
+    WGPUTexture wgpuDeviceCreateTexture(WGPUDevice device, WGPUTextureDescriptor const *descriptor)
+    {
+        MOCK_CALL(static_cast<uint64_t>(descriptor->size.width) * descriptor->size.height *
+                  descriptor->size.depthOrArrayLayers * texelSize(descriptor->format) * descriptor->sampleCount);
+        if (descriptor->size.width > device->limits.maxTextureDimension2D || descriptor->size.height > device->limits.maxTextureDimension2D)
+        {
+            device->validationError("createTexture: size exceeds maxTextureDimension2D");
+        }
+
+        WGPUTexture texture = create<WGPUTextureImpl>(descriptor->label);
+        texture->device = device;
+        texture->usage = descriptor->usage;
+        texture->dimension = descriptor->dimension;
+        texture->size = descriptor->size;
+        texture->format = descriptor->format;
+        texture->mipLevelCount = descriptor->mipLevelCount;
+        texture->sampleCount = descriptor->sampleCount;
+        return texture;
+    }
+
+    void wgpuDeviceDestroy(WGPUDevice device)
+    {
+        MOCK_CALL(0);
+        if (device->lostCallback)
+        {
+            device->lostCallback(WGPUDeviceLostReason_Destroyed, "Device destroyed", device->lostUserdata);
+        }
+    }
+
+    size_t wgpuDeviceEnumerateFeatures(WGPUDevice device, WGPUFeatureName *features)
+    {
+        MOCK_CALL(0);
+        if (!device->timestampQuery)
+        {
+            return 0;
+        }
+        if (features)
+        {
+            features[0] = WGPUFeatureName_TimestampQuery;
+        }
+        return 1;
+    }
+
+    bool wgpuDeviceGetLimits(WGPUDevice device, WGPUSupportedLimits *limits)
+    {
+        MOCK_CALL(0);
+        limits->limits = device->limits;
+        return true;
+    }
+
+    WGPUQueue wgpuDeviceGetQueue(WGPUDevice device)
+    {
+        MOCK_CALL(0);
+        return device->queue;
+    }
+
+    bool wgpuDeviceHasFeature(WGPUDevice device, WGPUFeatureName feature)
+    {
+        MOCK_CALL(0);
+        return feature == WGPUFeatureName_TimestampQuery && device->timestampQuery;
+    }
+
+    bool wgpuDevicePopErrorScope(WGPUDevice device, WGPUErrorCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        if (device->errorScopes.empty())
+        {
+            return false;
+        }
+        ErrorScope scope = device->errorScopes.back();
+        device->errorScopes.pop_back();
+        callback(scope.type, scope.message.c_str(), userdata);
+        return true;
+    }
+
+    void wgpuDevicePushErrorScope(WGPUDevice device, WGPUErrorFilter filter)
+    {
+        MOCK_CALL(0);
+        device->errorScopes.push_back({filter, WGPUErrorType_NoError, {}});
+    }
+
+    void wgpuDeviceSetDeviceLostCallback(WGPUDevice device, WGPUDeviceLostCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        device->lostCallback = callback;
+        device->lostUserdata = userdata;
+    }
+
+    void wgpuDeviceSetLabel(WGPUDevice device, char const *label)
+    {
+        MOCK_CALL(0);
+        device->label = labelOf(label);
+    }
+
+    void wgpuDeviceSetUncapturedErrorCallback(WGPUDevice device, WGPUErrorCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        device->errorCallback = callback;
+        device->errorUserdata = userdata;
+    }
+
+    // Buffers
+
+    void wgpuBufferDestroy(WGPUBuffer buffer)
+    {
+        MOCK_CALL(0);
+        buffer->destroyed = true;
+        buffer->contents = {};
+    }
+
+    void const *wgpuBufferGetConstMappedRange(WGPUBuffer buffer, size_t offset, size_t size)
+    {
+        MOCK_CALL(size);
+        if (buffer->mapState != WGPUBufferMapState_Mapped || offset + size > buffer->size)
+        {
+            buffer->device->validationError("getConstMappedRange: buffer not mapped, or range out of bounds");
+            return nullptr;
+        }
+        recorder().bytesReadBack += size;
+        return buffer->data() + offset;
+    }
+
+    WGPUBufferMapState wgpuBufferGetMapState(WGPUBuffer buffer)
+    {
+        MOCK_CALL(0);
+        return buffer->mapState;
+    }
+
+    void *wgpuBufferGetMappedRange(WGPUBuffer buffer, size_t offset, size_t size)
+    {
+        MOCK_CALL(size);
+        if (buffer->mapState != WGPUBufferMapState_Mapped || offset + size > buffer->size)
+        {
+            buffer->device->validationError("getMappedRange: buffer not mapped, or range out of bounds");
+            return nullptr;
+        }
+        return buffer->data() + offset;
+    }
+
+    uint64_t wgpuBufferGetSize(WGPUBuffer buffer)
+    {
+        MOCK_CALL(0);
+        return buffer->size;
+    }
+
+    WGPUBufferUsage wgpuBufferGetUsage(WGPUBuffer buffer)
+    {
+        MOCK_CALL(0);
+        return static_cast<WGPUBufferUsage>(buffer->usage);
+    }
+
+    void wgpuBufferMapAsync(WGPUBuffer buffer, WGPUMapModeFlags mode, size_t offset, size_t size, WGPUBufferMapCallback callback, void *userdata)
+    {
+        MOCK_CALL(size);
+        bool validUsage = ((mode & WGPUMapMode_Read) && (buffer->usage & WGPUBufferUsage_MapRead)) ||
+                          ((mode & WGPUMapMode_Write) && (buffer->usage & WGPUBufferUsage_MapWrite));
+        if (!validUsage || buffer->mapState != WGPUBufferMapState_Unmapped || offset + size > buffer->size || buffer->destroyed)
+        {
+            buffer->device->validationError("mapAsync: buffer cannot be mapped");
+            defer([=]()
+                  { callback(WGPUBufferMapAsyncStatus_Error, userdata); });
+            return;
+        }
+
+        buffer->mapState = WGPUBufferMapState_Pending;
+        defer([=]()
+              {
+            if (buffer->mapState != WGPUBufferMapState_Pending)
+            {
+                callback(WGPUBufferMapAsyncStatus_UnmappedBeforeCallback, userdata);
+                return;
+            }
+            buffer->mapState = WGPUBufferMapState_Mapped;
+            callback(WGPUBufferMapAsyncStatus_Success, userdata); });
+    }
+
+    void wgpuBufferSetLabel(WGPUBuffer buffer, char const *label)
+    {
+        MOCK_CALL(0);
+        buffer->label = labelOf(label);
+    }
+
+    void wgpuBufferUnmap(WGPUBuffer buffer)
+    {
+        MOCK_CALL(0);
+        buffer->mapState = WGPUBufferMapState_Unmapped;
+    }
+
+    // Command encoding
+
+    void wgpuCommandBufferSetLabel(WGPUCommandBuffer commandBuffer, char const *label)
+    {
+        MOCK_CALL(0);
+        commandBuffer->label = labelOf(label);
+    }
+
+    WGPUComputePassEncoder wgpuCommandEncoderBeginComputePass(WGPUCommandEncoder commandEncoder, WGPUComputePassDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        WGPUComputePassEncoder pass = create<WGPUComputePassEncoderImpl>(descriptor ? descriptor->label : nullptr);
+        pass->device = commandEncoder->device;
+        return pass;
+    }
+
+    WGPURenderPassEncoder wgpuCommandEncoderBeginRenderPass(WGPUCommandEncoder commandEncoder, WGPURenderPassDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        ++recorder().renderPasses;
+        WGPURenderPassEncoder pass = create<WGPURenderPassEncoderImpl>(descriptor->label);
+        pass->device = commandEncoder->device;
+        pass->commandEncoder = commandEncoder;
+        for (uint32_t i = 0; i < descriptor->timestampWriteCount; ++i)
+        {
+            const WGPURenderPassTimestampWrite &write = descriptor->timestampWrites[i];
+            if (write.location == WGPURenderPassTimestampLocation_Beginning)
+            {
+                writeTimestamp(commandEncoder, write.querySet, write.queryIndex, "beginRenderPass");
+            }
+            else
+            {
+                pass->endQuerySet = write.querySet;
+                pass->endQueryIndex = write.queryIndex;
+            }
+        }
+        return pass;
+    }
+
+    void wgpuCommandEncoderClearBuffer(WGPUCommandEncoder commandEncoder, WGPUBuffer buffer, uint64_t offset, uint64_t size)
+    {
+        MOCK_CALL(size);
+        checkCopyAlignment(commandEncoder->device, offset, size, "clearBuffer");
+        checkBufferRange(commandEncoder->device, buffer, offset, size, "clearBuffer");
+        commandEncoder->commands.push_back([=]()
+                                           { std::memset(buffer->data() + offset, 0, static_cast<size_t>(size)); });
+    }
+
+    void wgpuCommandEncoderCopyBufferToBuffer(WGPUCommandEncoder commandEncoder, WGPUBuffer source, uint64_t sourceOffset, WGPUBuffer destination, uint64_t destinationOffset, uint64_t size)
+    {
+        MOCK_CALL(size);
+        WGPUDevice device = commandEncoder->device;
+        checkCopyAlignment(device, sourceOffset, size, "copyBufferToBuffer");
+        checkCopyAlignment(device, destinationOffset, size, "copyBufferToBuffer");
+        checkBufferRange(device, source, sourceOffset, size, "copyBufferToBuffer");
+        checkBufferRange(device, destination, destinationOffset, size, "copyBufferToBuffer");
+        commandEncoder->commands.push_back([=]()
+                                           { std::memmove(destination->data() + destinationOffset, source->data() + sourceOffset, static_cast<size_t>(size)); });
+    }
+
+    void wgpuCommandEncoderCopyBufferToTexture(WGPUCommandEncoder commandEncoder, WGPUImageCopyBuffer const *source, WGPUImageCopyTexture const *, WGPUExtent3D const *copySize)
+    {
+        MOCK_CALL(static_cast<uint64_t>(source->layout.bytesPerRow) * copySize->height * copySize->depthOrArrayLayers);
+        if (copySize->height > 1 && source->layout.bytesPerRow % 256 != 0)
+        {
+            commandEncoder->device->validationError("copyBufferToTexture: bytesPerRow must be a multiple of 256");
+        }
+    }
+
+    void wgpuCommandEncoderCopyTextureToBuffer(WGPUCommandEncoder commandEncoder, WGPUImageCopyTexture const *source, WGPUImageCopyBuffer const *destination, WGPUExtent3D const *copySize)
+    {
+        uint64_t size = static_cast<uint64_t>(destination->layout.bytesPerRow) * copySize->height * copySize->depthOrArrayLayers;
+        MOCK_CALL(size);
+        WGPUDevice device = commandEncoder->device;
+        if (copySize->height > 1 && destination->layout.bytesPerRow % 256 != 0)
+        {
+            device->validationError("copyTextureToBuffer: bytesPerRow must be a multiple of 256");
+        }
+        if (!(source->texture->usage & WGPUTextureUsage_CopySrc))
+        {
+            device->validationError("copyTextureToBuffer: texture lacks CopySrc usage");
+        }
+        checkBufferRange(device, destination->buffer, destination->layout.offset, size, "copyTextureToBuffer");
+
+        // Textures have no contents, copy zeros
+        WGPUBuffer buffer = destination->buffer;
+        uint64_t offset = destination->layout.offset;
+        commandEncoder->commands.push_back([=]()
+                                           { std::memset(buffer->data() + offset, 0, static_cast<size_t>(std::min(size, buffer->size - offset))); });
+    }
+
+    void wgpuCommandEncoderCopyTextureToTexture(WGPUCommandEncoder, WGPUImageCopyTexture const *source, WGPUImageCopyTexture const *, WGPUExtent3D const *copySize)
+    {
+        MOCK_CALL(static_cast<uint64_t>(copySize->width) * copySize->height * copySize->depthOrArrayLayers * texelSize(source->texture->format));
+    }
+
+    WGPUCommandBuffer wgpuCommandEncoderFinish(WGPUCommandEncoder commandEncoder, WGPUCommandBufferDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        WGPUCommandBuffer commandBuffer = create<WGPUCommandBufferImpl>(descriptor ? descriptor->label : nullptr);
+        commandBuffer->commands = std::move(commandEncoder->commands);
+        commandEncoder->consume();
+        return commandBuffer;
+    }
+
+    void wgpuCommandEncoderInsertDebugMarker(WGPUCommandEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuCommandEncoderPopDebugGroup(WGPUCommandEncoder)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuCommandEncoderPushDebugGroup(WGPUCommandEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuCommandEncoderResolveQuerySet(WGPUCommandEncoder commandEncoder, WGPUQuerySet querySet, uint32_t firstQuery, uint32_t queryCount, WGPUBuffer destination, uint64_t destinationOffset)
+    {
+        uint64_t size = static_cast<uint64_t>(queryCount) * 8;
+        MOCK_CALL(size);
+        WGPUDevice device = commandEncoder->device;
+        if (firstQuery + queryCount > querySet->count)
+        {
+            device->validationError("resolveQuerySet: queries out of the bounds of the query set");
+            return;
+        }
+        if (destinationOffset % 256 != 0)
+        {
+            device->validationError("resolveQuerySet: destination offset must be a multiple of 256");
+        }
+        if (!destination || destinationOffset > destination->size || size > destination->size - destinationOffset)
+        {
+            device->validationError("resolveQuerySet: range out of the bounds of the buffer");
+            return;
+        }
+
+        // Occlusion and pipeline statistics queries are never written and
+        // resolve to 0
+        commandEncoder->commands.push_back([=]()
+                                           { std::memcpy(destination->data() + destinationOffset, querySet->values.data() + firstQuery, static_cast<size_t>(size)); });
+    }
+
+    void wgpuCommandEncoderSetLabel(WGPUCommandEncoder commandEncoder, char const *label)
+    {
+        MOCK_CALL(0);
+        commandEncoder->label = labelOf(label);
+    }
+
+    void wgpuCommandEncoderWriteTimestamp(WGPUCommandEncoder commandEncoder, WGPUQuerySet querySet, uint32_t queryIndex)
+    {
+        MOCK_CALL(0);
+        writeTimestamp(commandEncoder, querySet, queryIndex, "writeTimestamp");
+    }
+
+    void wgpuComputePassEncoderBeginPipelineStatisticsQuery(WGPUComputePassEncoder, WGPUQuerySet, uint32_t)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuComputePassEncoderDispatchWorkgroups(WGPUComputePassEncoder, uint32_t, uint32_t, uint32_t)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuComputePassEncoderDispatchWorkgroupsIndirect(WGPUComputePassEncoder, WGPUBuffer, uint64_t)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuComputePassEncoderEnd(WGPUComputePassEncoder computePassEncoder)
+    {
+        MOCK_CALL(0);
+        computePassEncoder->consume();
+    }
+
+    void wgpuComputePassEncoderEndPipelineStatisticsQuery(WGPUComputePassEncoder)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuComputePassEncoderInsertDebugMarker(WGPUComputePassEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuComputePassEncoderPopDebugGroup(WGPUComputePassEncoder)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuComputePassEncoderPushDebugGroup(WGPUComputePassEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuComputePassEncoderSetBindGroup(WGPUComputePassEncoder computePassEncoder, uint32_t, WGPUBindGroup, uint32_t dynamicOffsetCount, uint32_t const *dynamicOffsets)
+    {
+        MOCK_CALL(0);
+        checkDynamicOffsets(computePassEncoder->device, dynamicOffsetCount, dynamicOffsets);
+    }
+
+    void wgpuComputePassEncoderSetLabel(WGPUComputePassEncoder computePassEncoder, char const *label)
+    {
+        MOCK_CALL(0);
+        computePassEncoder->label = labelOf(label);
+    }
+
+    void wgpuComputePassEncoderSetPipeline(WGPUComputePassEncoder, WGPUComputePipeline)
+    {
+        MOCK_CALL(0);
+    }
+
+    WGPUBindGroupLayout wgpuComputePipelineGetBindGroupLayout(WGPUComputePipeline, uint32_t)
+    {
+        MOCK_CALL(0);
+        return create<WGPUBindGroupLayoutImpl>(nullptr);
+    }
+
+    void wgpuComputePipelineSetLabel(WGPUComputePipeline computePipeline, char const *label)
+    {
+        MOCK_CALL(0);
+        computePipeline->label = labelOf(label);
+    }
+
+    // Render passes and bundles
+
+    void wgpuRenderPassEncoderBeginOcclusionQuery(WGPURenderPassEncoder, uint32_t)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderBeginPipelineStatisticsQuery(WGPURenderPassEncoder, WGPUQuerySet, uint32_t)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderDraw(WGPURenderPassEncoder, uint32_t, uint32_t, uint32_t, uint32_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderPassEncoderDrawIndexed(WGPURenderPassEncoder, uint32_t, uint32_t, uint32_t, int32_t, uint32_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderPassEncoderDrawIndexedIndirect(WGPURenderPassEncoder, WGPUBuffer, uint64_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderPassEncoderDrawIndirect(WGPURenderPassEncoder, WGPUBuffer, uint64_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderPassEncoderEnd(WGPURenderPassEncoder renderPassEncoder)
+    {
+        MOCK_CALL(0);
+        if (renderPassEncoder->endQuerySet)
+        {
+            writeTimestamp(renderPassEncoder->commandEncoder, renderPassEncoder->endQuerySet, renderPassEncoder->endQueryIndex, "renderPassEnd");
+        }
+        renderPassEncoder->consume();
+    }
+
+    void wgpuRenderPassEncoderEndOcclusionQuery(WGPURenderPassEncoder)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderEndPipelineStatisticsQuery(WGPURenderPassEncoder)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderExecuteBundles(WGPURenderPassEncoder, uint32_t, WGPURenderBundle const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderInsertDebugMarker(WGPURenderPassEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderPopDebugGroup(WGPURenderPassEncoder)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderPushDebugGroup(WGPURenderPassEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderSetBindGroup(WGPURenderPassEncoder renderPassEncoder, uint32_t, WGPUBindGroup, uint32_t dynamicOffsetCount, uint32_t const *dynamicOffsets)
+    {
+        MOCK_CALL(0);
+        checkDynamicOffsets(renderPassEncoder->device, dynamicOffsetCount, dynamicOffsets);
+    }
+
+    void wgpuRenderPassEncoderSetBlendConstant(WGPURenderPassEncoder, WGPUColor const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderSetIndexBuffer(WGPURenderPassEncoder renderPassEncoder, WGPUBuffer buffer, WGPUIndexFormat, uint64_t offset, uint64_t size)
+    {
+        MOCK_CALL(0);
+        checkBufferRange(renderPassEncoder->device, buffer, offset, size, "setIndexBuffer");
+    }
+
+    void wgpuRenderPassEncoderSetLabel(WGPURenderPassEncoder renderPassEncoder, char const *label)
+    {
+        MOCK_CALL(0);
+        renderPassEncoder->label = labelOf(label);
+    }
+
+    void wgpuRenderPassEncoderSetPipeline(WGPURenderPassEncoder, WGPURenderPipeline)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderSetScissorRect(WGPURenderPassEncoder, uint32_t, uint32_t, uint32_t, uint32_t)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderSetStencilReference(WGPURenderPassEncoder, uint32_t)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderPassEncoderSetVertexBuffer(WGPURenderPassEncoder renderPassEncoder, uint32_t slot, WGPUBuffer buffer, uint64_t offset, uint64_t size)
+    {
+        MOCK_CALL(0);
+        if (slot >= renderPassEncoder->device->limits.maxVertexBuffers)
+        {
+            renderPassEncoder->device->validationError("setVertexBuffer: slot exceeds maxVertexBuffers");
+        }
+        checkBufferRange(renderPassEncoder->device, buffer, offset, size, "setVertexBuffer");
+    }
+
+    void wgpuRenderPassEncoderSetViewport(WGPURenderPassEncoder, float, float, float, float, float, float)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderBundleEncoderDraw(WGPURenderBundleEncoder, uint32_t, uint32_t, uint32_t, uint32_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderBundleEncoderDrawIndexed(WGPURenderBundleEncoder, uint32_t, uint32_t, uint32_t, int32_t, uint32_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderBundleEncoderDrawIndexedIndirect(WGPURenderBundleEncoder, WGPUBuffer, uint64_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderBundleEncoderDrawIndirect(WGPURenderBundleEncoder, WGPUBuffer, uint64_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    WGPURenderBundle wgpuRenderBundleEncoderFinish(WGPURenderBundleEncoder, WGPURenderBundleDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        return create<WGPURenderBundleImpl>(descriptor ? descriptor->label : nullptr);
+    }
+
+    void wgpuRenderBundleEncoderInsertDebugMarker(WGPURenderBundleEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderBundleEncoderPopDebugGroup(WGPURenderBundleEncoder)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderBundleEncoderPushDebugGroup(WGPURenderBundleEncoder, char const *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderBundleEncoderSetBindGroup(WGPURenderBundleEncoder renderBundleEncoder, uint32_t, WGPUBindGroup, uint32_t dynamicOffsetCount, uint32_t const *dynamicOffsets)
+    {
+        MOCK_CALL(0);
+        checkDynamicOffsets(renderBundleEncoder->device, dynamicOffsetCount, dynamicOffsets);
+    }
+
+    void wgpuRenderBundleEncoderSetIndexBuffer(WGPURenderBundleEncoder renderBundleEncoder, WGPUBuffer buffer, WGPUIndexFormat, uint64_t offset, uint64_t size)
+    {
+        MOCK_CALL(0);
+        checkBufferRange(renderBundleEncoder->device, buffer, offset, size, "setIndexBuffer");
+    }
+
+    void wgpuRenderBundleEncoderSetLabel(WGPURenderBundleEncoder renderBundleEncoder, char const *label)
+    {
+        MOCK_CALL(0);
+        renderBundleEncoder->label = labelOf(label);
+    }
+
+    void wgpuRenderBundleEncoderSetPipeline(WGPURenderBundleEncoder, WGPURenderPipeline)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuRenderBundleEncoderSetVertexBuffer(WGPURenderBundleEncoder renderBundleEncoder, uint32_t, WGPUBuffer buffer, uint64_t offset, uint64_t size)
+    {
+        MOCK_CALL(0);
+        checkBufferRange(renderBundleEncoder->device, buffer, offset, size, "setVertexBuffer");
+    }
+
+    WGPUBindGroupLayout wgpuRenderPipelineGetBindGroupLayout(WGPURenderPipeline, uint32_t)
+    {
+        MOCK_CALL(0);
+        return create<WGPUBindGroupLayoutImpl>(nullptr);
+    }
+
+    void wgpuRenderPipelineSetLabel(WGPURenderPipeline renderPipeline, char const *label)
+    {
+        MOCK_CALL(0);
+        renderPipeline->label = labelOf(label);
+    }
+
+    // Queue
+
+    void wgpuQueueOnSubmittedWorkDone(WGPUQueue, WGPUQueueWorkDoneCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        defer([=]()
+              { callback(WGPUQueueWorkDoneStatus_Success, userdata); });
+    }
+
+    void wgpuQueueSetLabel(WGPUQueue queue, char const *label)
+    {
+        MOCK_CALL(0);
+        queue->label = labelOf(label);
+    }
+
+    void wgpuQueueSubmit(WGPUQueue, uint32_t commandCount, WGPUCommandBuffer const *commands)
+    {
+        MOCK_CALL(0);
+        // Work submitted before has completed by now
+        flushCallbacks();
+        ++recorder().submits;
+        recorder().commandBuffers += commandCount;
+        for (uint32_t i = 0; i < commandCount; ++i)
+        {
+            for (const std::function<void()> &command : commands[i]->commands)
+            {
+                command();
+            }
+            commands[i]->commands.clear();
+            commands[i]->consume();
+        }
+    }
+
+    void wgpuQueueWriteBuffer(WGPUQueue queue, WGPUBuffer buffer, uint64_t bufferOffset, void const *data, size_t size)
+    {
+        MOCK_CALL(size);
+        WGPUDevice device = queue->device;
+        checkCopyAlignment(device, bufferOffset, size, "writeBuffer");
+        if (!(buffer->usage & WGPUBufferUsage_CopyDst))
+        {
+            device->validationError("writeBuffer: buffer lacks CopyDst usage");
+        }
+        if (bufferOffset > buffer->size || size > buffer->size - bufferOffset)
+        {
+            device->validationError("writeBuffer: range out of the bounds of the buffer");
+            return;
+        }
+        recorder().bytesUploaded += size;
+        if (size > 0)
+        {
+            std::memcpy(buffer->data() + bufferOffset, data, size);
+        }
+    }
+
+    void wgpuQueueWriteTexture(WGPUQueue, WGPUImageCopyTexture const *, void const *, size_t dataSize, WGPUTextureDataLayout const *, WGPUExtent3D const *)
+    {
+        MOCK_CALL(dataSize);
+        recorder().bytesUploaded += dataSize;
+    }
+
+    // Query sets, samplers, shaders
+
+    void wgpuPipelineLayoutSetLabel(WGPUPipelineLayout pipelineLayout, char const *label)
+    {
+        MOCK_CALL(0);
+        pipelineLayout->label = labelOf(label);
+    }
+
+    void wgpuQuerySetDestroy(WGPUQuerySet)
+    {
+        MOCK_CALL(0);
+    }
+
+    uint32_t wgpuQuerySetGetCount(WGPUQuerySet querySet)
+    {
+        MOCK_CALL(0);
+        return querySet->count;
+    }
+
+    WGPUQueryType wgpuQuerySetGetType(WGPUQuerySet querySet)
+    {
+        MOCK_CALL(0);
+        return querySet->type;
+    }
+
+    void wgpuQuerySetSetLabel(WGPUQuerySet querySet, char const *label)
+    {
+        MOCK_CALL(0);
+        querySet->label = labelOf(label);
+    }
+
+    void wgpuBindGroupSetLabel(WGPUBindGroup bindGroup, char const *label)
+    {
+        MOCK_CALL(0);
+        bindGroup->label = labelOf(label);
+    }
+
+    void wgpuBindGroupLayoutSetLabel(WGPUBindGroupLayout bindGroupLayout, char const *label)
+    {
+        MOCK_CALL(0);
+        bindGroupLayout->label = labelOf(label);
+    }
+
+    void wgpuSamplerSetLabel(WGPUSampler sampler, char const *label)
+    {
+        MOCK_CALL(0);
+        sampler->label = labelOf(label);
+    }
+
+    void wgpuShaderModuleGetCompilationInfo(WGPUShaderModule, WGPUCompilationInfoCallback callback, void *userdata)
+    {
+        MOCK_CALL(0);
+        WGPUCompilationInfo info = {};
+        callback(WGPUCompilationInfoRequestStatus_Success, &info, userdata);
+    }
+
+    void wgpuShaderModuleSetLabel(WGPUShaderModule shaderModule, char const *label)
+    {
+        MOCK_CALL(0);
+        shaderModule->label = labelOf(label);
+    }
+
+    // Surfaces and swap chains
+
+    WGPUTextureFormat wgpuSurfaceGetPreferredFormat(WGPUSurface, WGPUAdapter)
+    {
+        MOCK_CALL(0);
+        return WGPUTextureFormat_BGRA8UnormSrgb;
+    }
+
+    WGPUTextureView wgpuSwapChainGetCurrentTextureView(WGPUSwapChain swapChain)
+    {
+        MOCK_CALL(0);
+        WGPUTextureView view = create<WGPUTextureViewImpl>(nullptr);
+        view->texture = reference(swapChain->texture);
+        return view;
+    }
+
+    void wgpuSwapChainPresent(WGPUSwapChain)
+    {
+        MOCK_CALL(0);
+        ++recorder().presents;
+    }
+
+    // Textures
+
+    WGPUTextureView wgpuTextureCreateView(WGPUTexture texture, WGPUTextureViewDescriptor const *descriptor)
+    {
+        MOCK_CALL(0);
+        WGPUTextureView view = create<WGPUTextureViewImpl>(descriptor ? descriptor->label : nullptr);
+        view->texture = reference(texture);
+        return view;
+    }
+
+    void wgpuTextureDestroy(WGPUTexture)
+    {
+        MOCK_CALL(0);
+    }
+
+    uint32_t wgpuTextureGetDepthOrArrayLayers(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return texture->size.depthOrArrayLayers;
+    }
+
+    WGPUTextureDimension wgpuTextureGetDimension(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return texture->dimension;
+    }
+
+    WGPUTextureFormat wgpuTextureGetFormat(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return texture->format;
+    }
+
+    uint32_t wgpuTextureGetHeight(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return texture->size.height;
+    }
+
+    uint32_t wgpuTextureGetMipLevelCount(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return texture->mipLevelCount;
+    }
+
+    uint32_t wgpuTextureGetSampleCount(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return texture->sampleCount;
+    }
+
+    WGPUTextureUsage wgpuTextureGetUsage(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return static_cast<WGPUTextureUsage>(texture->usage);
+    }
+
+    uint32_t wgpuTextureGetWidth(WGPUTexture texture)
+    {
+        MOCK_CALL(0);
+        return texture->size.width;
+    }
+
+    void wgpuTextureSetLabel(WGPUTexture texture, char const *label)
+    {
+        MOCK_CALL(0);
+        texture->label = labelOf(label);
+    }
+
+    void wgpuTextureViewSetLabel(WGPUTextureView textureView, char const *label)
+    {
+        MOCK_CALL(0);
+        textureView->label = labelOf(label);
+    }
+
+    // wgpu-native extensions (wgpu.h)
+
+    void wgpuGenerateReport(WGPUInstance, WGPUGlobalReport *report)
+    {
+        MOCK_CALL(0);
+        *report = {};
+    }
+
+    WGPUSubmissionIndex wgpuQueueSubmitForIndex(WGPUQueue queue, uint32_t commandCount, WGPUCommandBuffer const *commands)
+    {
+        wgpuQueueSubmit(queue, commandCount, commands);
+        return recorder().submits;
+    }
+
+    bool wgpuDevicePoll(WGPUDevice, bool, WGPUWrappedSubmissionIndex const *)
+    {
+        MOCK_CALL(0);
+        return flushCallbacks();
+    }
+
+    void wgpuSetLogCallback(WGPULogCallback, void *)
+    {
+        MOCK_CALL(0);
+    }
+
+    void wgpuSetLogLevel(WGPULogLevel)
+    {
+        MOCK_CALL(0);
+    }
+
+    uint32_t wgpuGetVersion(void)
+    {
+        MOCK_CALL(0);
+        return 0;
+    }
+
+    void wgpuSurfaceGetCapabilities(WGPUSurface, WGPUAdapter, WGPUSurfaceCapabilities *capabilities)
+    {
+        MOCK_CALL(0);
+        static const WGPUTextureFormat formats[] = {WGPUTextureFormat_BGRA8UnormSrgb, WGPUTextureFormat_BGRA8Unorm};
+        static const WGPUPresentMode presentModes[] = {WGPUPresentMode_Fifo, WGPUPresentMode_Mailbox, WGPUPresentMode_Immediate};
+        static const WGPUCompositeAlphaMode alphaModes[] = {WGPUCompositeAlphaMode_Opaque};
+        // Fill the arrays the caller provides, and always give the counts
+        if (capabilities->formats)
+        {
+            std::copy(std::begin(formats), std::end(formats), capabilities->formats);
+        }
+        if (capabilities->presentModes)
+        {
+            std::copy(std::begin(presentModes), std::end(presentModes), capabilities->presentModes);
+        }
+        if (capabilities->alphaModes)
+        {
+            std::copy(std::begin(alphaModes), std::end(alphaModes), capabilities->alphaModes);
+        }
+        capabilities->formatCount = std::size(formats);
+        capabilities->presentModeCount = std::size(presentModes);
+        capabilities->alphaModeCount = std::size(alphaModes);
+    }
+
+    void wgpuRenderPassEncoderSetPushConstants(WGPURenderPassEncoder, WGPUShaderStageFlags, uint32_t, uint32_t sizeBytes, void *const)
+    {
+        MOCK_CALL(sizeBytes);
+    }
+
+    void wgpuRenderPassEncoderMultiDrawIndirect(WGPURenderPassEncoder, WGPUBuffer, uint64_t, uint32_t count)
+    {
+        MOCK_CALL(0);
+        recorder().draws += count;
+    }
+
+    void wgpuRenderPassEncoderMultiDrawIndexedIndirect(WGPURenderPassEncoder, WGPUBuffer, uint64_t, uint32_t count)
+    {
+        MOCK_CALL(0);
+        recorder().draws += count;
+    }
+
+    void wgpuRenderPassEncoderMultiDrawIndirectCount(WGPURenderPassEncoder, WGPUBuffer, uint64_t, WGPUBuffer, uint64_t, uint32_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    void wgpuRenderPassEncoderMultiDrawIndexedIndirectCount(WGPURenderPassEncoder, WGPUBuffer, uint64_t, WGPUBuffer, uint64_t, uint32_t)
+    {
+        MOCK_CALL(0);
+        drawCall();
+    }
+
+    // Releasing references (wgpu-native calls these "drop")
+
+#define MOCK_DROP(Type)                 \
+    void wgpu##Type##Drop(WGPU##Type object) \
+    {                                   \
+        MOCK_CALL(0);                   \
+        release(object);                \
+    }
+
+    MOCK_DROP(Instance)
+    MOCK_DROP(Adapter)
+    MOCK_DROP(BindGroup)
+    MOCK_DROP(BindGroupLayout)
+    MOCK_DROP(Buffer)
+    MOCK_DROP(CommandBuffer)
+    MOCK_DROP(CommandEncoder)
+    MOCK_DROP(RenderPassEncoder)
+    MOCK_DROP(ComputePassEncoder)
+    MOCK_DROP(RenderBundleEncoder)
+    MOCK_DROP(ComputePipeline)
+    MOCK_DROP(Device)
+    MOCK_DROP(PipelineLayout)
+    MOCK_DROP(QuerySet)
+    MOCK_DROP(RenderBundle)
+    MOCK_DROP(RenderPipeline)
+    MOCK_DROP(Sampler)
+    MOCK_DROP(ShaderModule)
+    MOCK_DROP(Surface)
+    MOCK_DROP(SwapChain)
+    MOCK_DROP(Texture)
+    MOCK_DROP(TextureView)
+
+#undef MOCK_DROP
+} // extern "C"
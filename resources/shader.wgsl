@@ -1,12 +1,31 @@
-/**
- * A structure holding the value of our uniforms
- */
-struct MyUniforms {
-    color: vec4f,
-    time: f32,
-};
+// This file goes through the preprocessor of wgsl-preprocessor.h. Each
+// combination of the values of its #permutation axes is a specialized
+// module, in which the branches of the other values are compiled out.
+
+// 1: colors are gamma corrected (the default), 0: they are used as is
+#permutation GAMMA_CORRECTION 1 0
+
+// Specialized by the pipeline (see PipelineConstants), without compiling
+// another module. The defaults are those of the original 640x480 window.
+#if PIPELINE_OVERRIDES
+// The width over the height of the target surface
+override aspectRatio: f32 = 640.0 / 480.0;
+// In radians per second of uMyUniforms.time
+override rotationSpeed: f32 = 1.0;
+#else
+// The backend cannot parse overrides, the application defines the values
+// instead and each set of them is a module of its own
+#ifndef ASPECT_RATIO
+#define ASPECT_RATIO (640.0 / 480.0)
+#endif
+#ifndef ROTATION_SPEED
+#define ROTATION_SPEED 1.0
+#endif
+const aspectRatio: f32 = ASPECT_RATIO;
+const rotationSpeed: f32 = ROTATION_SPEED;
+#endif
 
-@group(0) @binding(0) var<uniform> uMyUniforms: MyUniforms;
+#include "uniforms.wgsl"
 
 // The `@location(0)` attribute means that this input variable is described
 // by the vertex buffer layout at index 0 in the `pipelineDesc.vertex.buffers`
@@ -37,17 +56,18 @@ struct VertexOutput {
 @vertex
 fn vs_main(in: VertexInput) -> VertexOutput {
   var out: VertexOutput;
-  let ratio = 640.0 / 480.0; // The width and height of the target surface
-  let angle = uMyUniforms.time; // you can multiply it go rotate faster
+  let angle = uMyUniforms.time * rotationSpeed;
   let alpha = cos(angle);
   let beta = sin(angle);
+  // Undo the vertex quantization, see decodePosition() in the prelude
+  let inPosition = decodePosition(in.position);
   var position = vec3<f32>(
-    in.position.x,
-    alpha * in.position.y + beta * in.position.z,
-    alpha * in.position.z - beta * in.position.y,
+    inPosition.x,
+    alpha * inPosition.y + beta * inPosition.z,
+    alpha * inPosition.z - beta * inPosition.y,
   );
-  out.position = vec4<f32>(position.x, position.y * ratio, position.z * 0.5 + 0.5, 1.0);
-  out.color = in.color; // forward to the fragment shader
+  out.position = vec4<f32>(position.x, position.y * aspectRatio, position.z * 0.5 + 0.5, 1.0);
+  out.color = decodeColor(in.color); // forward to the fragment shader
   return out;
 }
 
@@ -56,7 +76,11 @@ fn fs_main(in: VertexOutput) -> @location(0) vec4f {
     // We multiply the scene's color with our global uniform (this is one
     // possible use of the color uniform, among many others).
     let color = in.color * uMyUniforms.color.rgb;
+#if GAMMA_CORRECTION
     // Gamma-correction
     let corrected_color = pow(color, vec3f(2.2));
+#else
+    let corrected_color = color;
+#endif
     return vec4f(corrected_color, uMyUniforms.color.a);
 }
@@ -0,0 +1,9 @@
+/**
+ * A structure holding the value of our uniforms
+ */
+struct MyUniforms {
+    color: vec4f,
+    time: f32,
+};
+
+@group(0) @binding(0) var<uniform> uMyUniforms: MyUniforms;
@@ -0,0 +1,170 @@
+#include "file-watcher.h"
+
+#include "trace-recorder.h"
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <system_error>
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+FileWatcher::FileWatcher(const fs::path &directory, Callback callback, std::chrono::milliseconds settleTime)
+    : m_directory(directory), m_callback(std::move(callback)), m_settleTime(settleTime)
+{
+#ifdef __linux__
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // Files are complete once closed after writing, or renamed into place
+    if (m_inotify < 0 || inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+        pipe2(m_wakePipe, O_CLOEXEC) != 0)
+    {
+        std::cerr << "Could not watch " << directory << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+#else
+    std::error_code ec;
+    if (!fs::is_directory(directory, ec))
+    {
+        std::cerr << "Could not watch " << directory << ": not a directory" << std::endl;
+        return;
+    }
+#endif
+    m_thread = std::thread([this]()
+                           {
+        TraceRecorder::shared().setThreadName("File watcher");
+        watchLoop(); });
+}
+
+FileWatcher::~FileWatcher()
+{
+    m_stopping = true;
+#ifdef __linux__
+    if (m_wakePipe[1] >= 0)
+    {
+        // The pipe is empty, this cannot fail
+        char wake = 0;
+        ssize_t written = write(m_wakePipe[1], &wake, 1);
+        (void)written;
+    }
+#endif
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+#ifdef __linux__
+    for (int fd : {m_inotify, m_wakePipe[0], m_wakePipe[1]})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+#endif
+}
+
+#ifdef __linux__
+
+void FileWatcher::watchLoop()
+{
+    std::set<fs::path> changed;
+    std::chrono::steady_clock::time_point changeTime;
+    // Room for many events, aligned like the structure they hold
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    while (!m_stopping)
+    {
+        pollfd fds[2] = {{m_inotify, POLLIN, 0}, {m_wakePipe[0], POLLIN, 0}};
+        int timeout = changed.empty() ? -1 : static_cast<int>(m_settleTime.count());
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR)
+        {
+            std::cerr << "Stopped watching " << m_directory << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        if (ready == 0)
+        {
+            // Quiet for settleTime
+            m_callback(std::vector<fs::path>(changed.begin(), changed.end()), changeTime);
+            changed.clear();
+            continue;
+        }
+        if (ready < 0 || !(fds[0].revents & POLLIN))
+        {
+            continue;
+        }
+
+        ssize_t size;
+        while ((size = read(m_inotify, buffer, sizeof(buffer))) > 0)
+        {
+            for (ssize_t offset = 0; offset < size;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                if (event->len > 0)
+                {
+                    changed.insert(m_directory / event->name);
+                }
+                offset += sizeof(inotify_event) + event->len;
+            }
+            changeTime = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+#else
+
+void FileWatcher::watchLoop()
+{
+    auto scan = [this]()
+    {
+        std::map<fs::path, fs::file_time_type> times;
+        std::error_code ec;
+        for (const fs::directory_entry &entry : fs::directory_iterator(m_directory, ec))
+        {
+            if (entry.is_regular_file(ec))
+            {
+                times[entry.path()] = entry.last_write_time(ec);
+            }
+        }
+        return times;
+    };
+
+    std::map<fs::path, fs::file_time_type> times = scan();
+    std::set<fs::path> changed;
+    std::chrono::steady_clock::time_point changeTime;
+    while (!m_stopping)
+    {
+        std::this_thread::sleep_for(m_settleTime);
+        std::map<fs::path, fs::file_time_type> current = scan();
+        bool quiet = true;
+        for (const auto &file : current)
+        {
+            auto previous = times.find(file.first);
+            if (previous == times.end() || previous->second != file.second)
+            {
+                changed.insert(file.first);
+                quiet = false;
+            }
+        }
+        times = std::move(current);
+        if (!quiet)
+        {
+            changeTime = std::chrono::steady_clock::now();
+        }
+        else if (!changed.empty())
+        {
+            m_callback(std::vector<fs::path>(changed.begin(), changed.end()), changeTime);
+            changed.clear();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * Watches the files of a directory (not its subdirectories) for changes,
+ * on a thread of its own.
+ *
+ * Editors save in bursts (truncate then write, or write a temporary file
+ * then rename it), so changes are gathered until the directory has been
+ * quiet for `settleTime`, then reported all at once, on the watcher's
+ * thread, with the time the last one was seen.
+ *
+ * On Linux this uses inotify and wakes up only on changes. Elsewhere it
+ * compares the modification times of the files every `settleTime`.
+ */
+class FileWatcher
+{
+public:
+    using Callback = std::function<void(const std::vector<std::filesystem::path> &files, std::chrono::steady_clock::time_point changeTime)>;
+
+    FileWatcher(const std::filesystem::path &directory, Callback callback,
+                std::chrono::milliseconds settleTime = std::chrono::milliseconds(5));
+    /**
+     * Returns once the watcher's thread has stopped, after the callback if
+     * it was running.
+     */
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    /**
+     * False if the directory could not be watched.
+     */
+    bool watching() const { return m_thread.joinable(); }
+
+private:
+    void watchLoop();
+
+    std::filesystem::path m_directory;
+    Callback m_callback;
+    std::chrono::milliseconds m_settleTime;
+    std::atomic<bool> m_stopping{false};
+#ifdef __linux__
+    int m_inotify = -1;
+    // Written to on destruction, to wake the thread up
+    int m_wakePipe[2] = {-1, -1};
+#endif
+    std::thread m_thread;
+};
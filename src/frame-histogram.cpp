@@ -0,0 +1,45 @@
+#include "frame-histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+FrameHistogram::FrameHistogram()
+    : m_buckets(BucketCount + 1, 0)
+{
+}
+
+void FrameHistogram::add(double seconds)
+{
+    seconds = std::max(seconds, 0.0);
+    // The last bucket holds everything past the range
+    size_t bucket = static_cast<size_t>(std::min(std::floor(seconds / BucketSeconds), static_cast<double>(BucketCount)));
+    ++m_buckets[bucket];
+    ++m_count;
+    m_max = std::max(m_max, seconds);
+}
+
+double FrameHistogram::percentile(double fraction) const
+{
+    if (m_count == 0)
+    {
+        return 0.0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * m_count));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += m_buckets[bucket];
+        if (seen >= rank)
+        {
+            return std::min((bucket + 1) * BucketSeconds, m_max);
+        }
+    }
+    return m_max;
+}
+
+void FrameHistogram::print(std::ostream &out, const char *name) const
+{
+    out << name << ": " << m_count << " samples, p50 " << percentile(0.5) * 1000.0 << " ms, p99 "
+        << percentile(0.99) * 1000.0 << " ms, max " << m_max * 1000.0 << " ms" << std::endl;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/**
+ * A histogram of frame times (or of any other durations of a few
+ * milliseconds), to compare present modes and pacing policies by their
+ * median, tail and worst case rather than by their average.
+ *
+ * Durations go in buckets of 0.1 ms up to 100 ms, longer ones in a last
+ * bucket, so that recording is constant time and memory however long the
+ * run. Percentiles are the upper bound of their bucket, the maximum is
+ * exact.
+ */
+class FrameHistogram
+{
+public:
+    static constexpr double BucketSeconds = 0.0001;
+    static constexpr uint32_t BucketCount = 1000;
+
+    FrameHistogram();
+
+    void add(double seconds);
+
+    uint64_t count() const { return m_count; }
+    double max() const { return m_max; }
+
+    /**
+     * The duration `fraction` (e.g. 0.99) of the samples are shorter than
+     * or equal to, 0 without samples.
+     */
+    double percentile(double fraction) const;
+
+    /**
+     * One line, e.g. "Present intervals: 600 samples, p50 16.7 ms, p99
+     * 17.2 ms, max 33.5 ms".
+     */
+    void print(std::ostream &out, const char *name) const;
+
+private:
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_count = 0;
+    double m_max = 0.0;
+};
@@ -0,0 +1,162 @@
+#include "frame-pacer.h"
+
+#include "trace-recorder.h"
+
+#include <algorithm>
+
+#ifdef WEBGPU_BACKEND_WGPU
+#include <webgpu/wgpu.h>
+#endif
+
+using namespace wgpu;
+
+FramePacer::FramePacer(Device device, Queue queue, uint32_t framesInFlight, uint32_t uniformAlignment,
+                       uint64_t uniformFrameCapacity, FramePacing pacing)
+    : m_device(device), m_queue(queue), m_pacing(pacing), m_state(std::make_shared<State>(std::max(1u, framesInFlight)))
+{
+    m_uniforms = std::make_unique<UniformRing>(device, uniformAlignment, uniformFrameCapacity, this->framesInFlight());
+}
+
+FramePacer::~FramePacer()
+{
+    waitIdle();
+    // Fences that are still pending hold the state, which lives on until
+    // they are called back (and is leaked then, with them)
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->fences.remove_if([](const Fence &fence)
+                              { return fence.called; });
+}
+
+bool FramePacer::beginFrame()
+{
+    uint32_t next = static_cast<uint32_t>(m_frameIndex % m_state->slots.size());
+    Slot &slot = m_state->slots[next];
+    if (slot.busy)
+    {
+        poll(&slot, false);
+    }
+    if (slot.busy)
+    {
+        if (m_pacing == FramePacing::Skip)
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            ++m_state->statistics.skippedFrames;
+            return false;
+        }
+        TRACE_SCOPE("Wait for frame slot");
+        auto start = std::chrono::steady_clock::now();
+        while (slot.busy)
+        {
+            poll(&slot, true);
+        }
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        ++m_state->statistics.blockedFrames;
+        m_state->statistics.blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    m_currentSlot = next;
+    m_uniforms->beginFrame(next);
+    CommandEncoderDescriptor encoderDesc;
+    encoderDesc.label = "Frame encoder";
+    m_encoder = m_device.createCommandEncoder(encoderDesc);
+    return true;
+}
+
+void FramePacer::submit()
+{
+    CommandBufferDescriptor commandsDesc;
+    commandsDesc.label = "Frame commands";
+    CommandBuffer commands = m_encoder.finish(commandsDesc);
+    m_encoder = nullptr;
+    m_uniforms->upload(m_queue);
+
+    Slot &slot = m_state->slots[m_currentSlot];
+    uint64_t submissionIndex = 0;
+    {
+        TRACE_SCOPE("Queue submit");
+#ifdef WEBGPU_BACKEND_WGPU
+        WGPUCommandBuffer commandBuffer = commands;
+        submissionIndex = wgpuQueueSubmitForIndex(m_queue, 1, &commandBuffer);
+#else
+        m_queue.submit(commands);
+#endif
+    }
+
+    Fence *fence = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        // The fences of earlier frames are dropped once called back. The
+        // slot's may not have been, if poll() could not wait for it.
+        m_state->fences.remove_if([](const Fence &fence)
+                                  { return fence.called; });
+        slot.frame = m_frameIndex;
+        slot.submissionIndex = submissionIndex;
+        slot.busy = true;
+        ++m_state->statistics.submittedFrames;
+        fence = &m_state->fences.emplace_back();
+    }
+
+    // Not under the lock, in case the backend calls back right away
+    auto submitTime = std::chrono::steady_clock::now();
+    fence->callback = m_queue.onSubmittedWorkDone([state = m_state, &slot, fence, frame = m_frameIndex, submitTime](QueueWorkDoneStatus)
+                                                  {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - submitTime).count();
+        std::lock_guard<std::mutex> lock(state->mutex);
+        // Unless the slot was given to a later frame already
+        if (slot.frame == frame)
+        {
+            slot.busy = false;
+        }
+        fence->called = true;
+        ++state->statistics.completedFrames;
+        state->statistics.maxGpuSeconds = std::max(state->statistics.maxGpuSeconds, seconds); });
+    ++m_frameIndex;
+}
+
+void FramePacer::waitIdle()
+{
+    for (Slot &slot : m_state->slots)
+    {
+        while (slot.busy)
+        {
+            poll(&slot, true);
+        }
+    }
+}
+
+uint32_t FramePacer::pendingFrames() const
+{
+    return static_cast<uint32_t>(std::count_if(m_state->slots.begin(), m_state->slots.end(), [](const Slot &slot)
+                                               { return slot.busy.load(); }));
+}
+
+FramePacerStatistics FramePacer::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->statistics;
+}
+
+void FramePacer::poll(Slot *slot, bool wait)
+{
+#ifdef WEBGPU_BACKEND_WGPU
+    if (slot && wait)
+    {
+        // Only wait for that frame, not for the ones submitted after it
+        WGPUWrappedSubmissionIndex submission = {m_queue, slot->submissionIndex};
+        wgpuDevicePoll(m_device, true, &submission);
+    }
+    else
+    {
+        wgpuDevicePoll(m_device, wait, nullptr);
+    }
+#else
+    // Without a way to wait here, rely on writeBuffer and submit being
+    // ordered after the work already submitted. The slot's fence stays
+    // pending until the queue calls it back.
+    (void)wait;
+    if (slot)
+    {
+        slot->busy = false;
+    }
+#endif
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "uniform-ring.h"
+
+#include <webgpu/webgpu.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * What beginFrame() does when all frames are in flight.
+ */
+enum class FramePacing
+{
+    // Wait for the oldest frame to complete
+    Block,
+    // Return right away, the caller does something else (e.g. handles
+    // input) and tries again
+    Skip,
+};
+
+struct FramePacerStatistics
+{
+    uint64_t submittedFrames = 0;
+    uint64_t completedFrames = 0;
+    // beginFrame() calls that returned false
+    uint64_t skippedFrames = 0;
+    // Frames that waited for a slot, and for how long in total
+    uint64_t blockedFrames = 0;
+    double blockedSeconds = 0.0;
+    // From submission to the queue calling back
+    double maxGpuSeconds = 0.0;
+};
+
+/**
+ * Keeps the CPU at most `framesInFlight` frames ahead of the GPU, so that
+ * they overlap without the queue growing (and the latency from input to
+ * display with it).
+ *
+ * Each frame in flight has a slot with the resources the CPU writes while
+ * the GPU may still read those of the other slots: a region of the uniform
+ * ring and the command encoder. A slot is fenced with
+ * Queue::onSubmittedWorkDone when its frame is submitted, and reused once
+ * the queue calls back.
+ *
+ *     if (pacer.beginFrame())
+ *     {
+ *         uint32_t offset = pacer.uniforms().push(uniforms);
+ *         RenderPassEncoder pass = pacer.encoder().beginRenderPass(...);
+ *         ...
+ *         pacer.submit();
+ *     }
+ *
+ * Frames are begun and submitted from one thread, but the queue calls the
+ * fences back from whichever thread polls the device: they only update the
+ * slots' busy flags and the statistics, under a lock. A fence is kept until
+ * it is called back, even once its slot is reused, since the backend holds
+ * a pointer to it.
+ */
+class FramePacer
+{
+public:
+    /**
+     * The uniform ring has one region per frame in flight, see UniformRing
+     * for `uniformAlignment` and `uniformFrameCapacity`.
+     */
+    FramePacer(wgpu::Device device, wgpu::Queue queue, uint32_t framesInFlight, uint32_t uniformAlignment,
+               uint64_t uniformFrameCapacity, FramePacing pacing = FramePacing::Block);
+    /**
+     * Waits for the frames in flight.
+     */
+    ~FramePacer();
+
+    FramePacer(const FramePacer &) = delete;
+    FramePacer &operator=(const FramePacer &) = delete;
+
+    /**
+     * Start a frame in the next slot. Returns false, with Skip pacing, if
+     * the GPU is still using it.
+     */
+    bool beginFrame();
+
+    /**
+     * The resources of the current frame, between beginFrame() and
+     * submit().
+     */
+    wgpu::CommandEncoder encoder() const { return m_encoder; }
+    UniformRing &uniforms() { return *m_uniforms; }
+    uint32_t slot() const { return m_currentSlot; }
+
+    /**
+     * Upload the frame's uniforms, submit its commands and fence its slot.
+     */
+    void submit();
+
+    /**
+     * Wait until the GPU is done with every submitted frame.
+     */
+    void waitIdle();
+
+    uint32_t framesInFlight() const { return static_cast<uint32_t>(m_state->slots.size()); }
+    // Frames submitted and not completed yet
+    uint32_t pendingFrames() const;
+    FramePacerStatistics statistics() const;
+
+private:
+    struct Slot
+    {
+        // Set by submit(), cleared by the fence of `frame`
+        std::atomic<bool> busy{false};
+        uint64_t frame = 0;
+        uint64_t submissionIndex = 0;
+    };
+
+    struct Fence
+    {
+        std::unique_ptr<wgpu::QueueWorkDoneCallback> callback;
+        bool called = false;
+    };
+
+    /**
+     * What the fences update. Shared with their callbacks, so that fences
+     * still pending when we are destroyed (where the backend cannot wait
+     * for them, see poll()) call back into it rather than into us.
+     */
+    struct State
+    {
+        std::mutex mutex;
+        // The busy flags are also read without the mutex
+        std::vector<Slot> slots;
+        // Kept alive until the queue calls them back, see submit()
+        std::list<Fence> fences;
+        FramePacerStatistics statistics;
+
+        explicit State(uint32_t framesInFlight) : slots(framesInFlight) {}
+    };
+
+    /**
+     * Process the callbacks of completed work, waiting for the submission
+     * of `slot` if `wait`.
+     */
+    void poll(Slot *slot, bool wait);
+
+    wgpu::Device m_device;
+    wgpu::Queue m_queue;
+    FramePacing m_pacing;
+    std::unique_ptr<UniformRing> m_uniforms;
+    std::shared_ptr<State> m_state;
+    uint32_t m_currentSlot = 0;
+    uint64_t m_frameIndex = 0;
+    wgpu::CommandEncoder m_encoder = nullptr;
+};
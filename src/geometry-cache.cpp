@@ -0,0 +1,216 @@
+#include "geometry-cache.h"
+#include "index-format.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr char Magic[8] = {'W', 'G', 'P', 'U', 'G', 'E', 'O', '\0'};
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    WGPUVertexFormat floatFormat(int componentCount)
+    {
+        switch (componentCount)
+        {
+        case 1:
+            return WGPUVertexFormat_Float32;
+        case 2:
+            return WGPUVertexFormat_Float32x2;
+        case 3:
+            return WGPUVertexFormat_Float32x3;
+        default:
+            return WGPUVertexFormat_Float32x4;
+        }
+    }
+} // namespace
+
+fs::path GeometryCache::pathFor(const fs::path &sourcePath)
+{
+    fs::path path = sourcePath;
+    path += ".geocache";
+    return path;
+}
+
+bool GeometryCache::open(const fs::path &path, uint64_t sourceHash, int dimensions)
+{
+    m_header = nullptr;
+    m_file = MappedFile(path);
+    if (!m_file.isOpen() || m_file.size() < sizeof(GeometryCacheHeader))
+    {
+        return false;
+    }
+
+    const auto *header = reinterpret_cast<const GeometryCacheHeader *>(m_file.data());
+    if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+        header->version != GeometryCacheVersion ||
+        header->headerSize != sizeof(GeometryCacheHeader) ||
+        header->sourceHash != sourceHash ||
+        header->vertexStride != (dimensions + 3) * sizeof(float) ||
+        header->indexStride != indexFormatSize(static_cast<WGPUIndexFormat>(header->indexFormat)))
+    {
+        return false;
+    }
+
+    // Never trust sizes read from disk
+    uint64_t fileSize = m_file.size();
+    if (header->vertexDataOffset > fileSize || header->vertexDataSize > fileSize - header->vertexDataOffset ||
+        header->indexDataOffset > fileSize || header->indexDataSize > fileSize - header->indexDataOffset ||
+        static_cast<uint64_t>(header->vertexCount) * header->vertexStride > header->vertexDataSize ||
+        static_cast<uint64_t>(header->indexCount) * header->indexStride > header->indexDataSize)
+    {
+        return false;
+    }
+
+    m_header = header;
+    return true;
+}
+
+bool GeometryCache::write(
+    const fs::path &path,
+    uint64_t sourceHash,
+    int dimensions,
+    const std::vector<float> &pointData,
+    const std::vector<uint32_t> &indexData)
+{
+    uint32_t vertexCount = static_cast<uint32_t>(pointData.size() / (dimensions + 3));
+    uint32_t indexCount = static_cast<uint32_t>(indexData.size());
+    WGPUIndexFormat indexFormat = chooseIndexFormat(vertexCount);
+    std::vector<uint8_t> indexBytes = packIndices(indexData.data(), indexData.size(), indexFormat);
+
+    GeometryCacheWriter writer;
+    return writer.begin(path, sourceHash, dimensions, vertexCount, indexCount, indexFormat) &&
+           writer.writeVertices(0, pointData.data(), pointData.size() * sizeof(float)) &&
+           writer.writeIndices(0, indexBytes.data(), indexBytes.size()) &&
+           writer.finish();
+}
+
+GeometryCacheWriter::~GeometryCacheWriter()
+{
+    if (m_file.is_open())
+    {
+        abandon();
+    }
+}
+
+bool GeometryCacheWriter::begin(
+    const fs::path &path,
+    uint64_t sourceHash,
+    int dimensions,
+    uint32_t vertexCount,
+    uint32_t indexCount,
+    WGPUIndexFormat indexFormat)
+{
+    GeometryCacheHeader &header = m_header;
+    header = {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = GeometryCacheVersion;
+    header.headerSize = sizeof(GeometryCacheHeader);
+    header.sourceHash = sourceHash;
+    header.vertexStride = static_cast<uint32_t>((dimensions + 3) * sizeof(float));
+    header.vertexCount = vertexCount;
+    header.indexFormat = static_cast<uint32_t>(indexFormat);
+    header.indexStride = indexFormatSize(indexFormat);
+    header.indexCount = indexCount;
+
+    // Same layout as the interleaved vertex buffer ("Option A")
+    header.attributeCount = 2;
+    header.attributes[0] = {static_cast<uint32_t>(floatFormat(dimensions)), 0, 0, 0};
+    header.attributes[1] = {static_cast<uint32_t>(WGPUVertexFormat_Float32x3),
+                            static_cast<uint32_t>(dimensions * sizeof(float)), 1, 0};
+
+    // Buffer copies must be a multiple of 4 bytes
+    header.vertexDataOffset = alignUp(sizeof(GeometryCacheHeader), GeometryCachePayloadAlignment);
+    header.vertexDataSize = alignUp(static_cast<uint64_t>(vertexCount) * header.vertexStride, 4);
+    header.indexDataOffset = alignUp(header.vertexDataOffset + header.vertexDataSize, GeometryCachePayloadAlignment);
+    header.indexDataSize = indexBufferSize(indexCount, indexFormat);
+
+    m_path = path;
+    m_tmpPath = path;
+    m_tmpPath += ".tmp";
+    m_end = 0;
+    m_file.open(m_tmpPath, std::ios::binary | std::ios::trunc);
+    m_ok = m_file.is_open();
+    return writeAt(0, &header, sizeof(header));
+}
+
+bool GeometryCacheWriter::writeVertices(uint64_t offset, const void *data, uint64_t size)
+{
+    if (offset + size > m_header.vertexDataSize)
+    {
+        m_ok = false;
+    }
+    return writeAt(m_header.vertexDataOffset + offset, data, size);
+}
+
+bool GeometryCacheWriter::writeIndices(uint64_t offset, const void *data, uint64_t size)
+{
+    if (offset + size > m_header.indexDataSize)
+    {
+        m_ok = false;
+    }
+    return writeAt(m_header.indexDataOffset + offset, data, size);
+}
+
+bool GeometryCacheWriter::writeAt(uint64_t position, const void *data, uint64_t size)
+{
+    if (!m_ok)
+    {
+        return false;
+    }
+    if (size > 0)
+    {
+        // Seeking past the end and writing zero-fills the gap
+        m_file.seekp(static_cast<std::streamoff>(position));
+        m_file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        m_end = std::max(m_end, position + size);
+    }
+    m_ok = static_cast<bool>(m_file);
+    return m_ok;
+}
+
+bool GeometryCacheWriter::finish()
+{
+    if (!m_file.is_open())
+    {
+        return false;
+    }
+
+    // Write the trailing padding, if the last block did not already
+    static const char zeros[GeometryCachePayloadAlignment] = {};
+    uint64_t fileSize = m_header.indexDataOffset + m_header.indexDataSize;
+    while (m_ok && m_end < fileSize)
+    {
+        writeAt(m_end, zeros, std::min<uint64_t>(sizeof(zeros), fileSize - m_end));
+    }
+
+    m_file.close();
+    if (!m_ok || m_file.fail())
+    {
+        abandon();
+        return false;
+    }
+
+    std::error_code ec;
+    fs::rename(m_tmpPath, m_path, ec);
+    if (ec)
+    {
+        abandon();
+        return false;
+    }
+    return true;
+}
+
+void GeometryCacheWriter::abandon()
+{
+    m_file.close();
+    m_ok = false;
+    std::error_code ec;
+    fs::remove(m_tmpPath, ec);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "mapped-file.h"
+
+#include <webgpu/webgpu.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+constexpr uint32_t GeometryCacheVersion = 2;
+// Both payload sections start on this boundary, which also satisfies the
+// offset alignment of any buffer binding
+constexpr uint64_t GeometryCachePayloadAlignment = 256;
+constexpr uint32_t GeometryCacheMaxAttributes = 4;
+
+struct GeometryCacheAttribute
+{
+    // A WGPUVertexFormat, stored with a fixed size
+    uint32_t format;
+    uint32_t offset;
+    uint32_t shaderLocation;
+    uint32_t _pad;
+};
+
+/**
+ * The fixed-size header at the beginning of a binary geometry file. It is
+ * followed by the vertex then the index payload, each starting on a
+ * GeometryCachePayloadAlignment boundary and padded to a multiple of 4
+ * bytes, so that either can be handed to `queue.writeBuffer` as is.
+ */
+struct GeometryCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    // Hash of the text file this cache was built from
+    uint64_t sourceHash;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    // Bytes between two consecutive vertices in the vertex payload
+    uint32_t vertexStride;
+    // A WGPUIndexFormat, chosen from the vertex count
+    uint32_t indexFormat;
+    // Bytes per index in the index payload
+    uint32_t indexStride;
+    uint32_t attributeCount;
+    GeometryCacheAttribute attributes[GeometryCacheMaxAttributes];
+    uint64_t vertexDataOffset;
+    uint64_t vertexDataSize;
+    uint64_t indexDataOffset;
+    uint64_t indexDataSize;
+};
+
+/**
+ * A binary geometry file mapped in memory. Loading one is a single mmap,
+ * and the payloads are read straight from the mapping.
+ */
+class GeometryCache
+{
+public:
+    /**
+     * Map a cache file, and check that it was built from a source with the
+     * given hash and for the same number of dimensions. Returns false when
+     * the cache is missing, stale or corrupt.
+     */
+    bool open(const std::filesystem::path &path, uint64_t sourceHash, int dimensions);
+
+    /**
+     * Write a cache file for already loaded geometry. Indices are stored
+     * in the format given by chooseIndexFormat().
+     */
+    static bool write(
+        const std::filesystem::path &path,
+        uint64_t sourceHash,
+        int dimensions,
+        const std::vector<float> &pointData,
+        const std::vector<uint32_t> &indexData);
+
+    /**
+     * Where the cache of a given text geometry file lives.
+     */
+    static std::filesystem::path pathFor(const std::filesystem::path &sourcePath);
+
+    const GeometryCacheHeader &header() const { return *m_header; }
+    const void *vertexData() const { return m_file.data() + m_header->vertexDataOffset; }
+    uint64_t vertexDataSize() const { return m_header->vertexDataSize; }
+    const void *indexData() const { return m_file.data() + m_header->indexDataOffset; }
+    uint64_t indexDataSize() const { return m_header->indexDataSize; }
+
+private:
+    MappedFile m_file;
+    const GeometryCacheHeader *m_header = nullptr;
+};
+
+/**
+ * Writes a cache file piece by piece, for producers that never hold the
+ * whole mesh in memory. The counts must be known up front since they fix
+ * the layout of the file.
+ *
+ * The file is written next to its final location then renamed by finish(),
+ * so that a concurrent reader never sees a partial file. A writer destroyed
+ * before finish() removes what it wrote.
+ */
+class GeometryCacheWriter
+{
+public:
+    GeometryCacheWriter() = default;
+    ~GeometryCacheWriter();
+
+    GeometryCacheWriter(const GeometryCacheWriter &) = delete;
+    GeometryCacheWriter &operator=(const GeometryCacheWriter &) = delete;
+
+    bool begin(
+        const std::filesystem::path &path,
+        uint64_t sourceHash,
+        int dimensions,
+        uint32_t vertexCount,
+        uint32_t indexCount,
+        WGPUIndexFormat indexFormat);
+
+    // Offsets are relative to the start of the vertex (resp. index) payload,
+    // and indices must already be in the format given to begin()
+    bool writeVertices(uint64_t offset, const void *data, uint64_t size);
+    bool writeIndices(uint64_t offset, const void *data, uint64_t size);
+
+    /**
+     * Move the file into place. Returns false if anything failed on the way,
+     * in which case no cache file is left behind.
+     */
+    bool finish();
+
+private:
+    bool writeAt(uint64_t position, const void *data, uint64_t size);
+    void abandon();
+
+    std::ofstream m_file;
+    std::filesystem::path m_path;
+    std::filesystem::path m_tmpPath;
+    GeometryCacheHeader m_header{};
+    uint64_t m_end = 0;
+    bool m_ok = false;
+};
@@ -0,0 +1,559 @@
+#include "geometry.h"
+#include "geometry-cache.h"
+#include "hash.h"
+#include "mapped-file.h"
+#include "thread-pool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    enum class Section
+    {
+        None,
+        Points,
+        Indices,
+    };
+
+    bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    const char *skipBlanks(const char *first, const char *last)
+    {
+        while (first != last && isBlank(*first))
+        {
+            ++first;
+        }
+        return first;
+    }
+
+    /**
+     * Parse one float starting at `first`. Returns the position right after
+     * the number, or nullptr if there is no number there.
+     */
+    const char *parseFloat(const char *first, const char *last, float &value)
+    {
+        // Like `std::istream >> float`, accept an explicit '+' sign
+        if (first != last && *first == '+')
+        {
+            ++first;
+        }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        auto [ptr, ec] = std::from_chars(first, last, value);
+        return ec == std::errc() ? ptr : nullptr;
+#else
+        // Floating point from_chars is not available on every standard
+        // library yet, fall back to strtof on a small null-terminated copy
+        // of the token.
+        char token[64];
+        size_t length = 0;
+        while (first + length != last && !isBlank(first[length]) && length + 1 < sizeof(token))
+        {
+            token[length] = first[length];
+            ++length;
+        }
+        token[length] = '\0';
+        char *tokenEnd = nullptr;
+        value = std::strtof(token, &tokenEnd);
+        return tokenEnd == token ? nullptr : first + (tokenEnd - token);
+#endif
+    }
+
+    const char *parseIndex(const char *first, const char *last, uint32_t &index)
+    {
+        if (first != last && *first == '+')
+        {
+            ++first;
+        }
+        auto [ptr, ec] = std::from_chars(first, last, index);
+        return ec == std::errc() ? ptr : nullptr;
+    }
+
+    /**
+     * Parse `count` numbers from a line. As with `std::istream`, once a read
+     * fails the remaining values of the row are read as zero.
+     */
+    template <typename T, typename Parser>
+    void parseRow(std::string_view line, int count, std::vector<T> &out, Parser parse)
+    {
+        const char *cursor = line.data();
+        const char *last = line.data() + line.size();
+        for (int i = 0; i < count; ++i)
+        {
+            T value = 0;
+            if (cursor)
+            {
+                cursor = skipBlanks(cursor, last);
+                cursor = parse(cursor, last, value);
+                if (!cursor)
+                {
+                    value = 0;
+                }
+            }
+            out.push_back(value);
+        }
+    }
+
+    /**
+     * Walk a run of whole lines of a geometry file, starting in the given
+     * section, and call onRow(section, row, rowEnd) for every data row, where
+     * rowEnd points past the row's newline. Returns the section active at the
+     * end of the run.
+     */
+    template <typename RowCallback>
+    Section forEachRow(std::string_view text, Section currentSection, RowCallback onRow)
+    {
+        const char *cursor = text.data();
+        const char *end = text.data() + text.size();
+        while (cursor < end)
+        {
+            const char *eol = static_cast<const char *>(std::memchr(cursor, '\n', end - cursor));
+            const char *lineEnd = eol ? eol : end;
+            std::string_view line(cursor, lineEnd - cursor);
+            cursor = eol ? eol + 1 : end;
+
+            // overcome the `CRLF` problem
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.remove_suffix(1);
+            }
+
+            if (line == "[points]")
+            {
+                currentSection = Section::Points;
+            }
+            else if (line == "[indices]")
+            {
+                currentSection = Section::Indices;
+            }
+            else if (line.empty() || line[0] == '#' || skipBlanks(line.data(), lineEnd) == lineEnd)
+            {
+                // Do nothing, this is a comment or a blank line
+            }
+            else if (currentSection != Section::None)
+            {
+                onRow(currentSection, line, cursor);
+            }
+        }
+        return currentSection;
+    }
+
+    /**
+     * Parse a run of whole lines of a geometry file, starting in the given
+     * section. Returns the section active at the end of the run.
+     */
+    Section parseGeometry(
+        std::string_view text,
+        Section currentSection,
+        std::vector<float> &pointData,
+        std::vector<uint32_t> &indexData,
+        int dimensions)
+    {
+        return forEachRow(text, currentSection, [&](Section section, std::string_view row, const char *)
+                          {
+            if (section == Section::Points)
+            {
+                // Get x, y, z, r, g, b
+                parseRow(row, dimensions + 3, pointData, parseFloat);
+            }
+            else
+            {
+                // Get corners #0 #1 and #2
+                parseRow(row, 3, indexData, parseIndex);
+            } });
+    }
+
+    /**
+     * Find the last section header in a run of whole lines, or Section::None
+     * if there is none. Only a '[' at the start of a line can open a section,
+     * so this skips from bracket to bracket rather than looking at every line.
+     */
+    Section lastSectionHeader(std::string_view text)
+    {
+        Section lastSection = Section::None;
+        const char *cursor = text.data();
+        const char *end = text.data() + text.size();
+        while (cursor < end)
+        {
+            const char *bracket = static_cast<const char *>(std::memchr(cursor, '[', end - cursor));
+            if (!bracket)
+            {
+                break;
+            }
+            cursor = bracket + 1;
+            if (bracket != text.data() && bracket[-1] != '\n')
+            {
+                continue;
+            }
+
+            const char *eol = static_cast<const char *>(std::memchr(bracket, '\n', end - bracket));
+            std::string_view line(bracket, (eol ? eol : end) - bracket);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.remove_suffix(1);
+            }
+            if (line == "[points]")
+            {
+                lastSection = Section::Points;
+            }
+            else if (line == "[indices]")
+            {
+                lastSection = Section::Indices;
+            }
+        }
+        return lastSection;
+    }
+
+    /**
+     * Split the text in chunks of whole lines, parse them concurrently and
+     * join the per-chunk results. Since each chunk is parsed by the same
+     * sequential code and the results are concatenated in order, the output
+     * is identical to parsing the whole text at once.
+     */
+    void parseGeometryChunked(
+        std::string_view text,
+        ThreadPool &threadPool,
+        std::vector<float> &pointData,
+        std::vector<uint32_t> &indexData,
+        int dimensions)
+    {
+        // Below this, splitting costs more than it saves
+        constexpr size_t MinChunkSize = 1 << 20;
+        // A few chunks per thread balances uneven rows (comments, sections)
+        size_t chunkCount = std::min<size_t>(threadPool.threadCount() * 4, text.size() / MinChunkSize);
+        if (threadPool.threadCount() == 1 || chunkCount <= 1)
+        {
+            parseGeometry(text, Section::None, pointData, indexData, dimensions);
+            return;
+        }
+
+        // Cut at the first newline after each evenly spaced boundary
+        std::vector<std::string_view> chunks;
+        chunks.reserve(chunkCount);
+        size_t chunkStart = 0;
+        for (size_t i = 1; i <= chunkCount && chunkStart < text.size(); ++i)
+        {
+            size_t chunkEnd = i == chunkCount ? text.size() : std::max(chunkStart, text.size() * i / chunkCount);
+            chunkEnd = std::min(text.find('\n', chunkEnd), text.size() - 1) + 1;
+            chunks.push_back(text.substr(chunkStart, chunkEnd - chunkStart));
+            chunkStart = chunkEnd;
+        }
+        chunkCount = chunks.size();
+
+        // The section a chunk starts in is the last one opened before it
+        std::vector<Section> lastHeaders(chunkCount);
+        threadPool.parallelFor(chunkCount, [&](size_t i)
+                               { lastHeaders[i] = lastSectionHeader(chunks[i]); });
+        std::vector<Section> startSections(chunkCount, Section::None);
+        for (size_t i = 1; i < chunkCount; ++i)
+        {
+            startSections[i] = lastHeaders[i - 1] != Section::None ? lastHeaders[i - 1] : startSections[i - 1];
+        }
+
+        std::vector<std::vector<float>> chunkPoints(chunkCount);
+        std::vector<std::vector<uint32_t>> chunkIndices(chunkCount);
+        threadPool.parallelFor(chunkCount, [&](size_t i)
+                               { parseGeometry(chunks[i], startSections[i], chunkPoints[i], chunkIndices[i], dimensions); });
+
+        // Join everything with a single pre-sized copy
+        std::vector<size_t> pointOffsets(chunkCount + 1, 0);
+        std::vector<size_t> indexOffsets(chunkCount + 1, 0);
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            pointOffsets[i + 1] = pointOffsets[i] + chunkPoints[i].size();
+            indexOffsets[i + 1] = indexOffsets[i] + chunkIndices[i].size();
+        }
+        pointData.resize(pointOffsets[chunkCount]);
+        indexData.resize(indexOffsets[chunkCount]);
+        threadPool.parallelFor(chunkCount, [&](size_t i)
+                               {
+            std::copy(chunkPoints[i].begin(), chunkPoints[i].end(), pointData.begin() + pointOffsets[i]);
+            std::copy(chunkIndices[i].begin(), chunkIndices[i].end(), indexData.begin() + indexOffsets[i]);
+            chunkPoints[i] = {};
+            chunkIndices[i] = {}; });
+    }
+} // namespace
+
+bool loadGeometry(
+    const fs::path &path,
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int dimensions,
+    const GeometryLoadOptions &options)
+{
+    // Check if the file exists
+    if (!fs::exists(path))
+    {
+        std::cout << "File does not exist" << std::endl;
+        std::cout << path << std::endl;
+        return false;
+    }
+
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        return false;
+    }
+
+    pointData.clear();
+    indexData.clear();
+
+    uint64_t sourceHash = 0;
+    fs::path cachePath;
+    if (options.cacheMode == GeometryCacheMode::ReadWrite)
+    {
+        sourceHash = hashBytes(file.data(), file.size());
+        cachePath = GeometryCache::pathFor(path);
+
+        GeometryCache cache;
+        if (cache.open(cachePath, sourceHash, dimensions))
+        {
+            const GeometryCacheHeader &header = cache.header();
+            const float *points = static_cast<const float *>(cache.vertexData());
+            pointData.assign(points, points + static_cast<size_t>(header.vertexCount) * header.vertexStride / sizeof(float));
+            if (header.indexFormat == WGPUIndexFormat_Uint16)
+            {
+                const uint16_t *indices = static_cast<const uint16_t *>(cache.indexData());
+                indexData.assign(indices, indices + header.indexCount);
+            }
+            else
+            {
+                const uint32_t *indices = static_cast<const uint32_t *>(cache.indexData());
+                indexData.assign(indices, indices + header.indexCount);
+            }
+            return true;
+        }
+    }
+
+    ThreadPool &threadPool = options.threadPool ? *options.threadPool : ThreadPool::shared();
+    parseGeometryChunked(file.view(), threadPool, pointData, indexData, dimensions);
+
+    if (options.cacheMode == GeometryCacheMode::ReadWrite)
+    {
+        // Failing to write the cache (e.g. read-only resources) is not an
+        // error, we will simply parse the text again next time.
+        GeometryCache::write(cachePath, sourceHash, dimensions, pointData, indexData);
+    }
+    return true;
+}
+
+bool saveGeometry(
+    const fs::path &path,
+    const std::vector<float> &pointData,
+    const std::vector<uint32_t> &indexData,
+    int dimensions)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+
+    // Enough digits for every float to read back bitwise identical
+    file << std::setprecision(std::numeric_limits<float>::max_digits10);
+
+    size_t floatsPerVertex = dimensions + 3;
+    file << "[points]" << std::endl;
+    for (size_t i = 0; i + floatsPerVertex <= pointData.size(); i += floatsPerVertex)
+    {
+        for (size_t j = 0; j < floatsPerVertex; ++j)
+        {
+            file << (j > 0 ? " " : "") << pointData[i + j];
+        }
+        file << '\n';
+    }
+
+    file << std::endl << "[indices]" << std::endl;
+    for (size_t i = 0; i + 3 <= indexData.size(); i += 3)
+    {
+        file << indexData[i] << ' ' << indexData[i + 1] << ' ' << indexData[i + 2] << '\n';
+    }
+
+    return static_cast<bool>(file.flush());
+}
+
+bool GeometryStream::open(const fs::path &path, int dimensions, GeometryCacheMode cacheMode)
+{
+    m_file = MappedFile(path);
+    if (!m_file.isOpen())
+    {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+    m_dimensions = dimensions;
+    m_cacheMode = cacheMode;
+    m_cacheIsValid = false;
+
+    if (cacheMode == GeometryCacheMode::ReadWrite)
+    {
+        m_sourceHash = hashBytes(m_file.data(), m_file.size());
+        m_cachePath = GeometryCache::pathFor(path);
+        m_cacheIsValid = m_cache.open(m_cachePath, m_sourceHash, dimensions);
+    }
+
+    if (m_cacheIsValid)
+    {
+        m_vertexCount = m_cache.header().vertexCount;
+        m_indexCount = m_cache.header().indexCount;
+        m_indexFormat = static_cast<WGPUIndexFormat>(m_cache.header().indexFormat);
+    }
+    else
+    {
+        // Counting touches every page, let them go as we pass them until
+        // read() needs them again
+        constexpr size_t discardInterval = 1 << 22;
+        size_t pointRows = 0;
+        size_t indexRows = 0;
+        size_t countedBytes = 0;
+        forEachRow(m_file.view(), Section::None, [&](Section section, std::string_view, const char *rowEnd)
+                   {
+            ++(section == Section::Points ? pointRows : indexRows);
+            size_t offset = rowEnd - m_file.data();
+            if (offset - countedBytes >= discardInterval)
+            {
+                m_file.discard(countedBytes, offset);
+                countedBytes = offset;
+            } });
+        m_file.discard(countedBytes, m_file.size());
+        m_vertexCount = static_cast<uint32_t>(pointRows);
+        m_indexCount = static_cast<uint32_t>(indexRows * 3);
+        m_indexFormat = chooseIndexFormat(m_vertexCount);
+    }
+    return true;
+}
+
+uint64_t GeometryStream::vertexBufferSize() const
+{
+    return static_cast<uint64_t>(m_vertexCount) * (m_dimensions + 3) * sizeof(float);
+}
+
+uint64_t GeometryStream::indexBufferSize() const
+{
+    return ::indexBufferSize(m_indexCount, m_indexFormat);
+}
+
+bool GeometryStream::read(uint64_t blockSize, const BlockCallback &onVertices, const BlockCallback &onIndices)
+{
+    if (m_cacheIsValid)
+    {
+        return readCache(blockSize, onVertices, onIndices);
+    }
+
+    // Blocks hold whole vertices, and whole 4-byte words of indices so that
+    // every index block starts on a copy-aligned offset
+    const size_t floatsPerVertex = m_dimensions + 3;
+    const size_t blockFloats = std::max<size_t>(1, blockSize / (floatsPerVertex * sizeof(float))) * floatsPerVertex;
+    const size_t indexSize = indexFormatSize(m_indexFormat);
+    const size_t blockIndices = std::max<size_t>(4, blockSize / 4 * 4) / indexSize;
+
+    // Writing the cache as we go keeps it in sync without holding the mesh.
+    // Unmap the stale cache first, as it is about to be replaced.
+    m_cache = GeometryCache();
+    GeometryCacheWriter cacheWriter;
+    bool writeCache = m_cacheMode == GeometryCacheMode::ReadWrite &&
+                      cacheWriter.begin(m_cachePath, m_sourceHash, m_dimensions, m_vertexCount, m_indexCount, m_indexFormat);
+
+    std::vector<float> pointBlock;
+    std::vector<uint32_t> indexBlock;
+    pointBlock.reserve(blockFloats + floatsPerVertex);
+    indexBlock.reserve(blockIndices + 3);
+    uint64_t pointOffset = 0;
+    uint64_t indexOffset = 0;
+    size_t parsedBytes = 0;
+    // Everything before a flushed row has been copied out of the mapping
+    auto discardParsed = [&](const char *rowEnd)
+    {
+        size_t offset = rowEnd - m_file.data();
+        m_file.discard(parsedBytes, offset);
+        parsedBytes = offset;
+    };
+
+    auto flushPoints = [&]()
+    {
+        GeometryBlock block{pointBlock.data(), pointOffset, pointBlock.size() * sizeof(float)};
+        onVertices(block);
+        writeCache = writeCache && cacheWriter.writeVertices(block.offset, block.data, block.size);
+        pointOffset += block.size;
+        pointBlock.clear();
+    };
+    // Rows come 3 indices at a time, so emit exactly one block's worth and
+    // keep the rest for the next one. The last block is padded to 4 bytes.
+    auto flushIndices = [&](bool last)
+    {
+        size_t emitted = last ? indexBlock.size() : blockIndices;
+        std::vector<uint8_t> bytes = packIndices(indexBlock.data(), emitted, m_indexFormat);
+        GeometryBlock block{bytes.data(), indexOffset, bytes.size()};
+        onIndices(block);
+        writeCache = writeCache && cacheWriter.writeIndices(block.offset, block.data, block.size);
+        indexOffset += block.size;
+        indexBlock.erase(indexBlock.begin(), indexBlock.begin() + emitted);
+    };
+
+    forEachRow(m_file.view(), Section::None, [&](Section section, std::string_view row, const char *rowEnd)
+               {
+        if (section == Section::Points)
+        {
+            parseRow(row, static_cast<int>(floatsPerVertex), pointBlock, parseFloat);
+            if (pointBlock.size() >= blockFloats)
+            {
+                flushPoints();
+                discardParsed(rowEnd);
+            }
+        }
+        else
+        {
+            parseRow(row, 3, indexBlock, parseIndex);
+            if (indexBlock.size() >= blockIndices)
+            {
+                flushIndices(false);
+                discardParsed(rowEnd);
+            }
+        } });
+
+    if (!pointBlock.empty())
+    {
+        flushPoints();
+    }
+    if (!indexBlock.empty())
+    {
+        flushIndices(true);
+    }
+
+    if (writeCache && cacheWriter.finish())
+    {
+        // Later reads (e.g. a second pass) slice the fresh cache instead of
+        // parsing the text again
+        m_cacheIsValid = m_cache.open(m_cachePath, m_sourceHash, m_dimensions);
+    }
+    return true;
+}
+
+bool GeometryStream::readCache(uint64_t blockSize, const BlockCallback &onVertices, const BlockCallback &onIndices)
+{
+    // The payloads are already laid out for upload, hand out slices of the
+    // mapping without copying anything
+    auto slice = [blockSize](const void *data, uint64_t size, uint64_t granularity, const BlockCallback &onBlock)
+    {
+        uint64_t step = std::max<uint64_t>(granularity, blockSize / granularity * granularity);
+        for (uint64_t offset = 0; offset < size; offset += step)
+        {
+            onBlock({static_cast<const char *>(data) + offset, offset, std::min(step, size - offset)});
+        }
+    };
+    slice(m_cache.vertexData(), m_cache.vertexDataSize(), m_cache.header().vertexStride, onVertices);
+    slice(m_cache.indexData(), m_cache.indexDataSize(), 4, onIndices);
+    return true;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "geometry-cache.h"
+#include "index-format.h"
+#include "mapped-file.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+enum class GeometryCacheMode
+{
+    // Always parse the text file
+    Disabled,
+    // Load from the binary cache when it is up to date, refresh it otherwise
+    ReadWrite,
+};
+
+class ThreadPool;
+
+struct GeometryLoadOptions
+{
+    GeometryCacheMode cacheMode = GeometryCacheMode::ReadWrite;
+    // Large files are parsed in chunks on this pool, defaults to
+    // ThreadPool::shared(). A pool of one thread parses sequentially.
+    ThreadPool *threadPool = nullptr;
+};
+
+/**
+ * Load a text geometry file such as `resources/pyramid.txt`.
+ *
+ * Rows of the `[points]` section hold `dimensions` coordinates followed by
+ * an r g b color, rows of the `[indices]` section hold the three corners of
+ * a triangle. Empty lines and lines starting with `#` are ignored.
+ *
+ * Indices are always returned as 32-bit values; use chooseIndexFormat() and
+ * packIndices() to get the buffer to upload.
+ *
+ * The file is memory-mapped and parsed in place, so no per-line string is
+ * ever built. Large files are cut in chunks of whole lines that are parsed
+ * concurrently, with exactly the same result as a sequential parse. With
+ * GeometryCacheMode::ReadWrite, the parsed result is also stored in a
+ * binary cache next to the file (see geometry-cache.h) and later loads read
+ * that cache instead, as long as the text has not changed.
+ */
+bool loadGeometry(
+    const std::filesystem::path &path,
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int dimensions,
+    const GeometryLoadOptions &options = {});
+
+/**
+ * Write geometry back in the text format read by loadGeometry(), e.g. after
+ * running it through optimizeMesh(). Floats are written with enough digits
+ * to load back exactly.
+ */
+bool saveGeometry(
+    const std::filesystem::path &path,
+    const std::vector<float> &pointData,
+    const std::vector<uint32_t> &indexData,
+    int dimensions);
+
+/**
+ * A contiguous piece of a vertex or index buffer, as handed out by
+ * GeometryStream.
+ */
+struct GeometryBlock
+{
+    const void *data;
+    // Where the block goes in the vertex (resp. index) buffer, in bytes
+    uint64_t offset;
+    // Always a multiple of 4 bytes, so that it can go to queue.writeBuffer
+    uint64_t size;
+};
+
+/**
+ * Reads a geometry file block by block, so that the caller can upload each
+ * block to its buffer as it arrives. Host memory is then bounded by the
+ * block size rather than by the size of the mesh.
+ *
+ * open() only counts rows, so that the caller can size its buffers and
+ * pick the index format before anything is parsed. read() then parses the
+ * file in a single pass and hands out blocks in file order. With
+ * GeometryCacheMode::ReadWrite, blocks come straight from the binary cache
+ * when it is up to date, and the cache is written as the text is parsed
+ * otherwise.
+ */
+class GeometryStream
+{
+public:
+    using BlockCallback = std::function<void(const GeometryBlock &)>;
+
+    bool open(
+        const std::filesystem::path &path,
+        int dimensions,
+        GeometryCacheMode cacheMode = GeometryCacheMode::ReadWrite);
+
+    uint32_t vertexCount() const { return m_vertexCount; }
+    uint32_t indexCount() const { return m_indexCount; }
+    // The format of index blocks, chosen from the vertex count
+    WGPUIndexFormat indexFormat() const { return m_indexFormat; }
+    // Buffer sizes able to receive every block, in bytes
+    uint64_t vertexBufferSize() const;
+    uint64_t indexBufferSize() const;
+
+    /**
+     * Hand out blocks of at most `blockSize` bytes (rounded down to whole
+     * vertices). The data of a block is only valid during the callback.
+     * Reading again starts over from the first block, from the cache if
+     * the previous read could write it.
+     */
+    bool read(uint64_t blockSize, const BlockCallback &onVertices, const BlockCallback &onIndices);
+
+private:
+    bool readCache(uint64_t blockSize, const BlockCallback &onVertices, const BlockCallback &onIndices);
+
+    std::filesystem::path m_cachePath;
+    MappedFile m_file;
+    GeometryCache m_cache;
+    bool m_cacheIsValid = false;
+    GeometryCacheMode m_cacheMode = GeometryCacheMode::ReadWrite;
+    uint64_t m_sourceHash = 0;
+    int m_dimensions = 0;
+    uint32_t m_vertexCount = 0;
+    uint32_t m_indexCount = 0;
+    WGPUIndexFormat m_indexFormat = WGPUIndexFormat_Uint16;
+};
@@ -0,0 +1,317 @@
+#include "gpu-profiler.h"
+
+#include "webgpu-release.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace wgpu;
+
+GpuProfiler::GpuProfiler(Device device, bool useTimestamps, uint32_t maxScopesPerFrame, uint32_t readbackLatency, uint32_t window)
+    : m_device(device), m_maxScopes(std::max(1u, maxScopesPerFrame)), m_window(std::max(1u, window)),
+      m_passWrites(m_maxScopes), m_cpuBegin(m_maxScopes)
+{
+    if (!useTimestamps || !device.hasFeature(FeatureName::TimestampQuery))
+    {
+        return;
+    }
+
+    // A beginning and an end per scope
+    QuerySetDescriptor querySetDesc;
+    querySetDesc.label = "Profiler timestamps";
+    querySetDesc.type = QueryType::Timestamp;
+    querySetDesc.count = 2 * m_maxScopes;
+    querySetDesc.pipelineStatistics = nullptr;
+    querySetDesc.pipelineStatisticsCount = 0;
+    m_querySet = device.createQuerySet(querySetDesc);
+
+    BufferDescriptor bufferDesc;
+    bufferDesc.label = "Profiler resolve";
+    bufferDesc.size = 2 * m_maxScopes * sizeof(uint64_t);
+    bufferDesc.usage = BufferUsage::QueryResolve | BufferUsage::CopySrc;
+    bufferDesc.mappedAtCreation = false;
+    m_resolveBuffer = device.createBuffer(bufferDesc);
+
+    bufferDesc.label = "Profiler readback";
+    bufferDesc.usage = BufferUsage::MapRead | BufferUsage::CopyDst;
+    m_readbacks.resize(std::max(1u, readbackLatency));
+    for (Readback &readback : m_readbacks)
+    {
+        readback.buffer = device.createBuffer(bufferDesc);
+    }
+    m_trace = &TraceRecorder::shared().addTrack("GPU");
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    for (Readback &readback : m_readbacks)
+    {
+        // The map callbacks point to the readbacks
+#ifdef WEBGPU_BACKEND_WGPU
+        while (readback.state == ReadbackState::Mapping)
+        {
+            poll(true);
+        }
+#endif
+        if (readback.state == ReadbackState::Mapping || readback.state == ReadbackState::Mapped)
+        {
+            // Calls back right away if still mapping
+            readback.buffer.unmap();
+        }
+        readback.buffer.destroy();
+        wgpuBufferRelease(readback.buffer);
+    }
+    if (m_resolveBuffer)
+    {
+        m_resolveBuffer.destroy();
+        wgpuBufferRelease(m_resolveBuffer);
+    }
+    if (m_querySet)
+    {
+        m_querySet.destroy();
+        wgpuQuerySetRelease(m_querySet);
+    }
+}
+
+void GpuProfiler::beginFrame()
+{
+    collect();
+    m_frameScopes.clear();
+    m_current = InvalidScope;
+    if (!usesTimestamps())
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < m_readbacks.size(); ++i)
+    {
+        if (m_readbacks[i].state == ReadbackState::Free)
+        {
+            m_current = i;
+            return;
+        }
+    }
+    ++m_statistics.droppedFrames;
+}
+
+uint32_t GpuProfiler::beginPass(const char *name, WGPURenderPassDescriptor &renderPassDesc)
+{
+    uint32_t scope = openScope(name);
+    if (scope == InvalidScope || !usesTimestamps())
+    {
+        renderPassDesc.timestampWriteCount = 0;
+        renderPassDesc.timestampWrites = nullptr;
+        return scope;
+    }
+    m_passWrites[scope][0] = {m_querySet, 2 * scope, WGPURenderPassTimestampLocation_Beginning};
+    m_passWrites[scope][1] = {m_querySet, 2 * scope + 1, WGPURenderPassTimestampLocation_End};
+    renderPassDesc.timestampWriteCount = 2;
+    renderPassDesc.timestampWrites = m_passWrites[scope].data();
+    return scope;
+}
+
+void GpuProfiler::endPass(uint32_t scope)
+{
+    if (scope != InvalidScope && !usesTimestamps())
+    {
+        addSample(m_frameScopes[scope], std::chrono::duration<double>(std::chrono::steady_clock::now() - m_cpuBegin[scope]).count());
+    }
+}
+
+uint32_t GpuProfiler::beginScope(CommandEncoder encoder, const char *name)
+{
+    uint32_t scope = openScope(name);
+    if (scope != InvalidScope && usesTimestamps())
+    {
+        encoder.writeTimestamp(m_querySet, 2 * scope);
+    }
+    return scope;
+}
+
+void GpuProfiler::endScope(CommandEncoder encoder, uint32_t scope)
+{
+    if (scope != InvalidScope && usesTimestamps())
+    {
+        encoder.writeTimestamp(m_querySet, 2 * scope + 1);
+    }
+    else
+    {
+        endPass(scope);
+    }
+}
+
+void GpuProfiler::resolve(CommandEncoder encoder)
+{
+    if (m_current == InvalidScope || m_frameScopes.empty())
+    {
+        return;
+    }
+    Readback &readback = m_readbacks[m_current];
+    uint32_t queryCount = 2 * static_cast<uint32_t>(m_frameScopes.size());
+    encoder.resolveQuerySet(m_querySet, 0, queryCount, m_resolveBuffer, 0);
+    encoder.copyBufferToBuffer(m_resolveBuffer, 0, readback.buffer, 0, queryCount * sizeof(uint64_t));
+    readback.scopes = m_frameScopes;
+    readback.state = ReadbackState::Resolved;
+}
+
+void GpuProfiler::afterSubmit()
+{
+    if (m_current == InvalidScope || m_readbacks[m_current].state != ReadbackState::Resolved)
+    {
+        return;
+    }
+    Readback &readback = m_readbacks[m_current];
+    readback.state = ReadbackState::Mapping;
+    readback.submitTime = TraceRecorder::shared().now();
+    readback.callback = readback.buffer.mapAsync(MapMode::Read, 0, 2 * readback.scopes.size() * sizeof(uint64_t),
+                                                 [&readback](BufferMapAsyncStatus status)
+                                                 { readback.state = status == BufferMapAsyncStatus::Success ? ReadbackState::Mapped
+                                                                                                            : ReadbackState::Failed; });
+    m_current = InvalidScope;
+}
+
+std::vector<GpuScopeStatistics> GpuProfiler::scopeStatistics() const
+{
+    std::vector<GpuScopeStatistics> statistics;
+    for (const ScopeHistory &history : m_histories)
+    {
+        GpuScopeStatistics scope;
+        scope.name = history.name;
+        scope.samples = history.samples;
+        if (!history.seconds.empty())
+        {
+            scope.lastSeconds = history.seconds[(history.samples - 1) % m_window];
+            scope.minSeconds = *std::min_element(history.seconds.begin(), history.seconds.end());
+            scope.maxSeconds = *std::max_element(history.seconds.begin(), history.seconds.end());
+            for (double seconds : history.seconds)
+            {
+                scope.averageSeconds += seconds;
+            }
+            scope.averageSeconds /= history.seconds.size();
+        }
+        statistics.push_back(scope);
+    }
+    return statistics;
+}
+
+void GpuProfiler::print(std::ostream &out) const
+{
+    const char *source = usesTimestamps() ? "GPU " : "CPU (encoding) ";
+    for (const GpuScopeStatistics &scope : scopeStatistics())
+    {
+        out << source << scope.name << ": " << scope.samples << " samples, last " << scope.lastSeconds * 1000.0 << " ms, average "
+            << scope.averageSeconds * 1000.0 << " ms, min " << scope.minSeconds * 1000.0 << " ms, max " << scope.maxSeconds * 1000.0
+            << " ms" << std::endl;
+    }
+    if (usesTimestamps())
+    {
+        out << "GPU profiler: " << m_statistics.resolvedFrames << " frames read back, " << m_statistics.droppedFrames
+            << " not measured, " << m_statistics.droppedScopes << " scopes dropped, " << m_statistics.failedReadbacks
+            << " failed readbacks" << std::endl;
+    }
+}
+
+uint32_t GpuProfiler::openScope(const char *name)
+{
+    if (usesTimestamps() && m_current == InvalidScope)
+    {
+        return InvalidScope;
+    }
+    if (m_frameScopes.size() >= m_maxScopes)
+    {
+        ++m_statistics.droppedScopes;
+        return InvalidScope;
+    }
+    uint32_t scope = static_cast<uint32_t>(m_frameScopes.size());
+    m_frameScopes.push_back(historyOf(name));
+    m_cpuBegin[scope] = std::chrono::steady_clock::now();
+    return scope;
+}
+
+uint32_t GpuProfiler::historyOf(const char *name)
+{
+    // A handful of scopes, looked up by name once per frame
+    for (uint32_t i = 0; i < m_histories.size(); ++i)
+    {
+        if (std::strcmp(m_histories[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    m_histories.push_back({name, 0, {}});
+    return static_cast<uint32_t>(m_histories.size() - 1);
+}
+
+void GpuProfiler::addSample(uint32_t history, double seconds)
+{
+    ScopeHistory &scope = m_histories[history];
+    if (scope.seconds.size() < m_window)
+    {
+        scope.seconds.push_back(seconds);
+    }
+    else
+    {
+        scope.seconds[scope.samples % m_window] = seconds;
+    }
+    ++scope.samples;
+}
+
+void GpuProfiler::collect()
+{
+    if (!usesTimestamps())
+    {
+        return;
+    }
+    poll(false);
+    for (Readback &readback : m_readbacks)
+    {
+        if (readback.state == ReadbackState::Mapped)
+        {
+            size_t size = 2 * readback.scopes.size() * sizeof(uint64_t);
+            const uint64_t *timestamps = static_cast<const uint64_t *>(readback.buffer.getConstMappedRange(0, size));
+            uint64_t frameStart = ~uint64_t(0);
+            for (size_t i = 0; i < readback.scopes.size(); ++i)
+            {
+                frameStart = std::min(frameStart, timestamps[2 * i]);
+            }
+            for (size_t i = 0; i < readback.scopes.size(); ++i)
+            {
+                uint64_t begin = timestamps[2 * i];
+                uint64_t end = timestamps[2 * i + 1];
+                // E.g. a scope that was never ended, or a timestamp counter
+                // that was reset in between
+                if (end < begin)
+                {
+                    ++m_statistics.droppedScopes;
+                    continue;
+                }
+                addSample(readback.scopes[i], (end - begin) * 1e-9);
+                if (TraceRecorder::shared().enabled())
+                {
+                    m_trace->record(m_histories[readback.scopes[i]].name, readback.submitTime + (begin - frameStart), end - begin);
+                }
+            }
+            readback.buffer.unmap();
+            ++m_statistics.resolvedFrames;
+        }
+        else if (readback.state == ReadbackState::Failed)
+        {
+            ++m_statistics.failedReadbacks;
+        }
+        else
+        {
+            continue;
+        }
+        readback.state = ReadbackState::Free;
+        readback.callback.reset();
+    }
+}
+
+void GpuProfiler::poll(bool wait)
+{
+#ifdef WEBGPU_BACKEND_WGPU
+    wgpuDevicePoll(m_device, wait, nullptr);
+#else
+    // Other backends call back when the application processes events
+    (void)wait;
+#endif
+}
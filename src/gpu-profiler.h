@@ -0,0 +1,199 @@
+#pragma once
+
+#include "trace-recorder.h"
+
+#include <webgpu/webgpu.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Rolling statistics of one scope, over its last samples.
+ */
+struct GpuScopeStatistics
+{
+    std::string name;
+    // Every sample so far, the times only cover the last ones
+    uint64_t samples = 0;
+    double lastSeconds = 0.0;
+    double averageSeconds = 0.0;
+    double minSeconds = 0.0;
+    double maxSeconds = 0.0;
+};
+
+struct GpuProfilerStatistics
+{
+    // Frames whose timestamps were read back
+    uint64_t resolvedFrames = 0;
+    // Frames not measured because every readback buffer was still in use,
+    // rather than waiting for one
+    uint64_t droppedFrames = 0;
+    // Scopes past maxScopesPerFrame, or whose end came before their
+    // beginning
+    uint64_t droppedScopes = 0;
+    uint64_t failedReadbacks = 0;
+};
+
+/**
+ * Measures how long the GPU spends in each pass (or any span of a command
+ * encoder) with timestamp queries, without ever waiting for the GPU.
+ *
+ * Each frame writes the timestamps of its scopes to a QuerySet, resolves
+ * them into a buffer and copies that into one of `readbackLatency`
+ * readback buffers, which is mapped once the frame is submitted. The
+ * mapping completes a few frames later, when the device is polled, and
+ * the next beginFrame() turns the timestamps into durations. Queue order
+ * keeps a frame's timestamps from being overwritten before they are
+ * resolved, so a single query set and resolve buffer are enough. A frame
+ * that finds no readback buffer free is not measured.
+ *
+ * Scopes read back are also recorded to a "GPU" timeline of the
+ * TraceRecorder. The GPU clock is not calibrated against the CPU one, so
+ * a frame's scopes are placed from the time it was submitted, keeping
+ * their offsets from its first timestamp.
+ *
+ * Without the TimestampQuery feature, scopes fall back to the CPU time
+ * between their begin and end calls, i.e. the time spent encoding them.
+ *
+ * Timestamps are taken as nanoseconds, as the WebGPU specification has
+ * them. The only calls made are those of webgpu.hpp, so libs/webgpu-mock
+ * (which supports timestamp queries) can stand in for the queue and
+ * buffers to check the bookkeeping on the CPU.
+ *
+ *     profiler.beginFrame();
+ *     uint32_t scope = profiler.beginPass("Color pass", renderPassDesc);
+ *     RenderPassEncoder pass = encoder.beginRenderPass(renderPassDesc);
+ *     ...
+ *     pass.end();
+ *     profiler.endPass(scope);
+ *     profiler.resolve(encoder);
+ *     queue.submit(encoder.finish(...));
+ *     profiler.afterSubmit();
+ */
+class GpuProfiler
+{
+public:
+    static constexpr uint32_t InvalidScope = ~uint32_t(0);
+
+    /**
+     * Timestamps are used if the device has the TimestampQuery feature
+     * (and `useTimestamps`). Statistics cover the last `window` samples of
+     * each scope.
+     */
+    GpuProfiler(wgpu::Device device, bool useTimestamps = true, uint32_t maxScopesPerFrame = 8, uint32_t readbackLatency = 3,
+                uint32_t window = 120);
+    /**
+     * Waits for the readbacks in progress.
+     */
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    bool usesTimestamps() const { return m_querySet != nullptr; }
+
+    /**
+     * Collect the readbacks that completed and start a frame.
+     */
+    void beginFrame();
+
+    /**
+     * Measure the render pass `renderPassDesc` describes, by pointing its
+     * timestampWrites to the profiler's queries (valid until the next
+     * beginFrame()). Returns the scope to end with endPass(), or
+     * InvalidScope if the frame is not measured. `name` must outlive the
+     * profiler's trace timeline, e.g. a string literal.
+     */
+    uint32_t beginPass(const char *name, WGPURenderPassDescriptor &renderPassDesc);
+    void endPass(uint32_t scope);
+
+    /**
+     * Measure the commands recorded in `encoder` between the two calls,
+     * outside of any pass.
+     */
+    uint32_t beginScope(wgpu::CommandEncoder encoder, const char *name);
+    void endScope(wgpu::CommandEncoder encoder, uint32_t scope);
+
+    /**
+     * Record the copy of the frame's timestamps to its readback buffer,
+     * last in the frame's encoder.
+     */
+    void resolve(wgpu::CommandEncoder encoder);
+
+    /**
+     * Start reading the frame's timestamps back, once it is submitted.
+     */
+    void afterSubmit();
+
+    /**
+     * Scopes in the order they were first seen.
+     */
+    std::vector<GpuScopeStatistics> scopeStatistics() const;
+    const GpuProfilerStatistics &statistics() const { return m_statistics; }
+
+    /**
+     * One line per scope, e.g. "GPU Color pass: 600 samples, last 0.41 ms,
+     * average 0.40 ms, min 0.38 ms, max 0.52 ms".
+     */
+    void print(std::ostream &out) const;
+
+private:
+    enum class ReadbackState
+    {
+        Free,
+        // Written by a frame, submitted or about to be
+        Resolved,
+        Mapping,
+        Mapped,
+        Failed,
+    };
+
+    struct Readback
+    {
+        wgpu::Buffer buffer = nullptr;
+        ReadbackState state = ReadbackState::Free;
+        // Scope of each pair of timestamps
+        std::vector<uint32_t> scopes;
+        // TraceRecorder time
+        uint64_t submitTime = 0;
+        std::unique_ptr<wgpu::BufferMapCallback> callback;
+    };
+
+    struct ScopeHistory
+    {
+        const char *name;
+        uint64_t samples = 0;
+        // The last `window` durations, oldest overwritten first
+        std::vector<double> seconds;
+    };
+
+    uint32_t openScope(const char *name);
+    uint32_t historyOf(const char *name);
+    void addSample(uint32_t history, double seconds);
+    void collect();
+    void poll(bool wait);
+
+    wgpu::Device m_device;
+    uint32_t m_maxScopes;
+    uint32_t m_window;
+    wgpu::QuerySet m_querySet = nullptr;
+    wgpu::Buffer m_resolveBuffer = nullptr;
+    std::vector<Readback> m_readbacks;
+
+    // Current frame: its readback buffer (none if not measured or without
+    // timestamps), and the history of each of its scopes
+    uint32_t m_current = InvalidScope;
+    std::vector<uint32_t> m_frameScopes;
+    std::vector<std::array<WGPURenderPassTimestampWrite, 2>> m_passWrites;
+    // CPU fallback: when each open scope began
+    std::vector<std::chrono::steady_clock::time_point> m_cpuBegin;
+
+    std::vector<ScopeHistory> m_histories;
+    GpuProfilerStatistics m_statistics;
+    TraceBuffer *m_trace = nullptr;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * A fast non-cryptographic 64-bit hash, used to detect when a source file
+ * changed under one of our caches. It consumes 8 bytes per step so hashing
+ * a file stays much cheaper than parsing it.
+ */
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0x9E3779B97F4A7C15ull)
+{
+    constexpr uint64_t prime = 0x100000001B3ull;
+    auto mix = [](uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    };
+
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t h = seed ^ (size * prime);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        h = (h ^ mix(word)) * prime;
+    }
+    uint64_t tail = 0;
+    if (i < size)
+    {
+        std::memcpy(&tail, bytes + i, size - i);
+    }
+    h = (h ^ mix(tail)) * prime;
+    return mix(h);
+}
+
+/**
+ * Fold a value into a running hash, boost::hash_combine style.
+ */
+inline uint64_t hashCombine(uint64_t seed, uint64_t value)
+{
+    return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+}
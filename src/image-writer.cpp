@@ -0,0 +1,137 @@
+#include "image-writer.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+    {
+        static const std::array<uint32_t, 256> table = []()
+        {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                table[n] = c;
+            }
+            return table;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void appendBigEndian(std::vector<uint8_t> &out, uint32_t value)
+    {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void writeChunk(std::ofstream &file, const char type[4], const std::vector<uint8_t> &data)
+    {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        // The CRC covers the type and the data
+        appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+        file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+    }
+} // namespace
+
+bool writePng(const fs::path &path, uint32_t width, uint32_t height, const uint8_t *pixels, size_t bytesPerRow)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    writeChunk(file, "IHDR", header);
+
+    // Each scanline starts with its filter type (0, none)
+    size_t rowSize = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t *row = pixels + y * bytesPerRow;
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), row, row + rowSize);
+    }
+
+    // A zlib stream of stored (uncompressed) deflate blocks
+    std::vector<uint8_t> data;
+    data.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+    data.push_back(0x78);
+    data.push_back(0x01);
+    size_t offset = 0;
+    do
+    {
+        size_t blockSize = std::min<size_t>(65535, scanlines.size() - offset);
+        bool last = offset + blockSize == scanlines.size();
+        data.push_back(last ? 1 : 0);
+        data.push_back(static_cast<uint8_t>(blockSize));
+        data.push_back(static_cast<uint8_t>(blockSize >> 8));
+        data.push_back(static_cast<uint8_t>(~blockSize));
+        data.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        data.insert(data.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < scanlines.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t byte : scanlines)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(data, (b << 16) | a);
+    writeChunk(file, "IDAT", data);
+    writeChunk(file, "IEND", {});
+
+    return static_cast<bool>(file.flush());
+}
+
+bool writeRaw(const fs::path &path, uint32_t width, uint32_t height, const uint8_t *pixels, size_t bytesPerRow)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+
+    size_t rowSize = static_cast<size_t>(width) * 4;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        file.write(reinterpret_cast<const char *>(pixels + y * bytesPerRow), rowSize);
+    }
+    return static_cast<bool>(file.flush());
+}
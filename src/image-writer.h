@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * Write 8-bit RGBA pixels to a PNG file. Rows start every `bytesPerRow`
+ * bytes, which may be more than 4 * width (e.g. the 256-byte aligned rows
+ * of a texture to buffer copy).
+ *
+ * The image data is stored without compression: this is meant for dumping
+ * frames quickly, not for small files.
+ */
+bool writePng(
+    const std::filesystem::path &path,
+    uint32_t width,
+    uint32_t height,
+    const uint8_t *pixels,
+    size_t bytesPerRow);
+
+/**
+ * Write the same pixels as tightly packed RGBA rows, with no header.
+ */
+bool writeRaw(
+    const std::filesystem::path &path,
+    uint32_t width,
+    uint32_t height,
+    const uint8_t *pixels,
+    size_t bytesPerRow);
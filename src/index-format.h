@@ -0,0 +1,53 @@
+#pragma once
+
+#include <webgpu/webgpu.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * The narrowest index format able to address `vertexCount` vertices. 16-bit
+ * indices halve the index memory and fetch bandwidth, so they are used
+ * whenever the mesh is small enough.
+ */
+inline WGPUIndexFormat chooseIndexFormat(uint64_t vertexCount)
+{
+    return vertexCount <= 0x10000 ? WGPUIndexFormat_Uint16 : WGPUIndexFormat_Uint32;
+}
+
+inline uint32_t indexFormatSize(WGPUIndexFormat format)
+{
+    return format == WGPUIndexFormat_Uint16 ? 2 : 4;
+}
+
+/**
+ * Buffer copies must be a multiple of 4 bytes, so an odd number of 16-bit
+ * indices needs two bytes of padding.
+ */
+inline uint64_t indexBufferSize(uint64_t indexCount, WGPUIndexFormat format)
+{
+    return (indexCount * indexFormatSize(format) + 3) & ~uint64_t(3);
+}
+
+/**
+ * Pack indices in the given format, padded to indexBufferSize() bytes so
+ * that the result can be given to queue.writeBuffer as is.
+ */
+inline std::vector<uint8_t> packIndices(const uint32_t *indices, size_t count, WGPUIndexFormat format)
+{
+    std::vector<uint8_t> bytes(indexBufferSize(count, format), 0);
+    if (format == WGPUIndexFormat_Uint16)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint16_t index = static_cast<uint16_t>(indices[i]);
+            std::memcpy(bytes.data() + 2 * i, &index, sizeof(index));
+        }
+    }
+    else if (count > 0)
+    {
+        std::memcpy(bytes.data(), indices, count * sizeof(uint32_t));
+    }
+    return bytes;
+}
@@ -29,13 +29,39 @@
 
 #define WEBGPU_CPP_IMPLEMENTATION
 #include <webgpu/webgpu.hpp>
+#ifdef WEBGPU_BACKEND_MOCK
+#include <webgpu-mock.h>
+#endif
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <cassert>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
 
 #include "webgpu-release.h"
 #include "utils.h"
+#include "pipeline-cache.h"
+#include "pipeline-constants.h"
+#include "pipeline-scheduler.h"
+#include "shader-cache.h"
+#include "shader-reloader.h"
+#include "surface-manager.h"
+#include "frame-histogram.h"
+#include "frame-pacer.h"
+#include "gpu-profiler.h"
+#include "trace-recorder.h"
+#include "geometry.h"
+#include "image-writer.h"
+#include "vertex-layout.h"
+#include "vertex-quantization.h"
 
 using namespace wgpu;
 
@@ -54,32 +80,247 @@ struct MyUniforms
 // Have the compiler check byte alignment
 static_assert(sizeof(MyUniforms) % 16 == 0);
 
-int main(int, char **)
+// Room for this many draws, each with its own MyUniforms, in each frame
+constexpr uint32_t maxDrawsPerFrame = 1024;
+// The render loop pushes the uniforms of two draws per frame, which then
+// always fit in the uniform ring
+static_assert(maxDrawsPerFrame >= 2);
+
+// Initial size of the window, or size of the offscreen frames in headless
+// mode
+constexpr uint32_t frameWidth = 640;
+constexpr uint32_t frameHeight = 480;
+
+/**
+ * Command line options:
+ *   --headless <frameCount>  render this many frames offscreen, without
+ *                            opening a window, then exit
+ *   --output <directory>     write the headless frames in this directory
+ *   --format png|raw         format of the written frames (default: png)
+ *   --shader-cache <directory>
+ *                            where shader sources and validation results
+ *                            are kept between runs (default: the user's
+ *                            cache directory, "none" to keep nothing)
+ *   --permutation <NAME=VALUE>
+ *                            the permutation of shader.wgsl to draw with
+ *                            (default: the first value of each axis), all
+ *                            of them are compiled
+ *   --rotation-speed <radians/s>
+ *                            how fast the pyramid turns (default: 1)
+ *   --frames-in-flight <N>   how many frames the CPU may be ahead of the
+ *                            GPU (default: 2)
+ *   --pacing block|skip      whether a frame waits for the GPU when N frames
+ *                            are in flight, or is skipped (default: block)
+ *   --present-mode fifo|mailbox|immediate
+ *                            how frames are presented, if the surface
+ *                            supports it (default: fifo)
+ *   --low-latency            poll input and update uniforms after waiting
+ *                            for a frame slot and swap chain texture, just
+ *                            before encoding
+ *   --no-gpu-timestamps      time passes on the CPU, even if the adapter
+ *                            has timestamp queries
+ *   --trace <file>           write the last scopes of every thread (and of
+ *                            the GPU) there as Chrome trace JSON on exit;
+ *                            pressing T in the window writes it right away
+ *                            (default: trace.json)
+ *   --watch                  reload shader.wgsl when a file of its directory
+ *                            changes, even when headless (windows always do)
+ */
+struct AppOptions
 {
-  Instance instance = createInstance(InstanceDescriptor{});
-  if (!instance)
+  bool headless = false;
+  uint32_t frameCount = 0;
+  std::filesystem::path outputDirectory;
+  bool rawFrames = false;
+  std::filesystem::path shaderCacheDirectory = ShaderCache::defaultDirectory();
+  WgslDefines permutation;
+  bool watch = false;
+  double rotationSpeed = 1.0;
+  uint32_t framesInFlight = 2;
+  FramePacing pacing = FramePacing::Block;
+  PresentMode presentMode = PresentMode::Fifo;
+  bool lowLatency = false;
+  bool gpuTimestamps = true;
+  std::filesystem::path tracePath = "trace.json";
+  bool traceOnExit = false;
+};
+
+static void printUsage()
+{
+  std::cerr << "Usage: App [--headless <frameCount> [--output <directory>] [--format png|raw]]" << std::endl
+            << "           [--shader-cache <directory>|none] [--permutation NAME=VALUE]..." << std::endl
+            << "           [--rotation-speed <radians/s>] [--frames-in-flight <N>] [--pacing block|skip]" << std::endl
+            << "           [--present-mode fifo|mailbox|immediate] [--low-latency]" << std::endl
+            << "           [--no-gpu-timestamps] [--trace <file>] [--watch]" << std::endl;
+}
+
+/**
+ * Parse the options into `options`, throwing std::invalid_argument or
+ * std::out_of_range when the value of a number option is not one.
+ */
+static bool parseOptionList(int argc, char **argv, AppOptions &options)
+{
+  for (int i = 1; i < argc; ++i)
   {
-    std::cerr << "Could not initialize WebGPU!" << std::endl;
-    return 1;
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--headless" && hasValue)
+    {
+      options.headless = true;
+      options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+    else if (arg == "--output" && hasValue)
+    {
+      options.outputDirectory = argv[++i];
+    }
+    else if (arg == "--format" && hasValue && (std::strcmp(argv[i + 1], "png") == 0 || std::strcmp(argv[i + 1], "raw") == 0))
+    {
+      options.rawFrames = std::strcmp(argv[++i], "raw") == 0;
+    }
+    else if (arg == "--shader-cache" && hasValue)
+    {
+      options.shaderCacheDirectory = std::strcmp(argv[++i], "none") == 0 ? std::filesystem::path() : std::filesystem::path(argv[i]);
+    }
+    else if (arg == "--permutation" && hasValue && std::strchr(argv[i + 1], '=') != nullptr)
+    {
+      std::string define = argv[++i];
+      size_t equal = define.find('=');
+      options.permutation[define.substr(0, equal)] = define.substr(equal + 1);
+    }
+    else if (arg == "--rotation-speed" && hasValue)
+    {
+      options.rotationSpeed = std::stod(argv[++i]);
+      // Also rejects inf and nan, which have no WGSL literal (see
+      // PipelineConstants::literal()), the shader takes it as an f32
+      if (!(std::abs(options.rotationSpeed) <= std::numeric_limits<float>::max()))
+      {
+        printUsage();
+        return false;
+      }
+    }
+    else if (arg == "--frames-in-flight" && hasValue)
+    {
+      options.framesInFlight = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+    }
+    else if (arg == "--pacing" && hasValue && (std::strcmp(argv[i + 1], "block") == 0 || std::strcmp(argv[i + 1], "skip") == 0))
+    {
+      options.pacing = std::strcmp(argv[++i], "skip") == 0 ? FramePacing::Skip : FramePacing::Block;
+    }
+    else if (arg == "--present-mode" && hasValue &&
+             (std::strcmp(argv[i + 1], "fifo") == 0 || std::strcmp(argv[i + 1], "mailbox") == 0 || std::strcmp(argv[i + 1], "immediate") == 0))
+    {
+      std::string mode = argv[++i];
+      options.presentMode = mode == "mailbox" ? PresentMode::Mailbox : mode == "immediate" ? PresentMode::Immediate : PresentMode::Fifo;
+    }
+    else if (arg == "--low-latency")
+    {
+      options.lowLatency = true;
+    }
+    else if (arg == "--no-gpu-timestamps")
+    {
+      options.gpuTimestamps = false;
+    }
+    else if (arg == "--trace" && hasValue)
+    {
+      options.tracePath = argv[++i];
+      options.traceOnExit = true;
+    }
+    else if (arg == "--watch")
+    {
+      options.watch = true;
+    }
+    else
+    {
+      printUsage();
+      return false;
+    }
   }
+  return true;
+}
 
-  if (!glfwInit())
+static bool parseOptions(int argc, char **argv, AppOptions &options)
+{
+  try
+  {
+    return parseOptionList(argc, argv, options);
+  }
+  catch (const std::exception &)
+  {
+    // A number option whose value is not a number (or is out of range)
+    printUsage();
+    return false;
+  }
+}
+
+/**
+ * Let the device process its callbacks, waiting for submitted work.
+ */
+static void waitForDevice(Instance instance, Device device)
+{
+#ifdef WEBGPU_BACKEND_WGPU
+  (void)instance;
+  wgpuDevicePoll(device, true, nullptr);
+#else
+  (void)device;
+  instance.processEvents();
+#endif
+}
+
+/**
+ * Let the device process the callbacks that are ready, without waiting.
+ */
+static void pollDevice(Instance instance, Device device)
+{
+#ifdef WEBGPU_BACKEND_WGPU
+  (void)instance;
+  wgpuDevicePoll(device, false, nullptr);
+#else
+  (void)device;
+  instance.processEvents();
+#endif
+}
+
+int main(int argc, char **argv)
+{
+  AppOptions options;
+  if (!parseOptions(argc, argv, options))
   {
-    std::cerr << "Could not initialize GLFW!" << std::endl;
     return 1;
   }
+  // Scopes are always recorded, and only written when asked
+  TraceRecorder &trace = TraceRecorder::shared();
+  trace.setThreadName("Main");
 
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-  GLFWwindow *window = glfwCreateWindow(640, 480, "Learn WebGPU", NULL, NULL);
-  if (!window)
+  Instance instance = createInstance(InstanceDescriptor{});
+  if (!instance)
   {
-    std::cerr << "Could not open window!" << std::endl;
+    std::cerr << "Could not initialize WebGPU!" << std::endl;
     return 1;
   }
 
+  // Headless mode renders to a texture, and needs neither GLFW nor a surface
+  GLFWwindow *window = nullptr;
+  Surface surface = nullptr;
+  if (!options.headless)
+  {
+    if (!glfwInit())
+    {
+      std::cerr << "Could not initialize GLFW!" << std::endl;
+      return 1;
+    }
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    window = glfwCreateWindow(frameWidth, frameHeight, "Learn WebGPU", NULL, NULL);
+    if (!window)
+    {
+      std::cerr << "Could not open window!" << std::endl;
+      return 1;
+    }
+    surface = glfwGetWGPUSurface(instance, window);
+  }
+
   std::cout << "Requesting adapter..." << std::endl;
-  Surface surface = glfwGetWGPUSurface(instance, window);
   RequestAdapterOptions adapterOpts;
   adapterOpts.compatibleSurface = surface;
   Adapter adapter = instance.requestAdapter(adapterOpts);
@@ -88,14 +329,48 @@ int main(int, char **)
   SupportedLimits supportedLimits;
   adapter.getLimits(&supportedLimits);
 
+  // Open the geometry early: its size decides the buffer size limit and
+  // its vertex count the index format
+  GeometryStream geometry;
+  if (!geometry.open(RESOURCE_DIR "pyramid.txt", 3))
+  {
+    std::cerr << "Could not load geometry!" << std::endl;
+    return 1;
+  }
+  std::cout << "Loading " << geometry.vertexCount() << " vertices and "
+            << geometry.indexCount() << (geometry.indexFormat() == IndexFormat::Uint16 ? " 16-bit" : " 32-bit")
+            << " indices." << std::endl;
+
+  // A first pass over the vertices measures their ranges, from which we
+  // derive a packed vertex format (and the shader code decoding it)
+  constexpr uint64_t geometryBlockSize = 1 << 20;
+  VertexRanges vertexRanges(3);
+  geometry.read(
+      geometryBlockSize,
+      [&](const GeometryBlock &block)
+      { vertexRanges.add(static_cast<const float *>(block.data), block.size / (6 * sizeof(float))); },
+      [](const GeometryBlock &) {});
+  PackedVertexFormat vertexFormat = choosePackedVertexFormat(vertexRanges);
+  std::cout << "Packed vertex stride: " << vertexFormat.stride << " bytes (was " << 6 * sizeof(float) << ")" << std::endl;
+
+  // Our single pass reads every attribute, so interleaved vertices fetch
+  // the least memory. Passes reading only positions (depth prepass,
+  // shadows) would rather use VertexLayoutMode::Deinterleaved.
+  VertexLayout vertexLayout(vertexFormat, VertexLayoutMode::Interleaved);
+
   std::cout << "Requesting device..." << std::endl;
   // Don't forget to = Default
   RequiredLimits requiredLimits = Default;
   requiredLimits.limits.maxVertexAttributes = 2;
-  // We should also tell that we use 1 vertex buffers
-  requiredLimits.limits.maxVertexBuffers = 1;
-  // Maximum size of a buffer is 4 vertices of 5 float each
-  requiredLimits.limits.maxBufferSize = 15 * 6 * sizeof(float);
+  // We should also tell how many vertex buffers we use (1 when interleaved)
+  requiredLimits.limits.maxVertexBuffers = vertexLayout.bufferCount();
+  // Maximum size of a buffer is the largest of the geometry buffers and of
+  // the uniform ring (which holds the uniform blocks of every draw of the
+  // frames in flight, see below)
+  uint32_t uniformAlignment = supportedLimits.limits.minUniformBufferOffsetAlignment;
+  uint64_t uniformFrameCapacity = maxDrawsPerFrame * std::max<uint64_t>(sizeof(MyUniforms), uniformAlignment);
+  uint64_t uniformBufferSize = UniformRing::bufferSize(uniformAlignment, uniformFrameCapacity, options.framesInFlight);
+  requiredLimits.limits.maxBufferSize = std::max({vertexFormat.packedSize(geometry.vertexCount()), geometry.indexBufferSize(), uniformBufferSize});
   // Maximum stride between consecutive vertices in the vertex buffer
   requiredLimits.limits.maxVertexBufferArrayStride = 6 * sizeof(float);
   requiredLimits.limits.maxInterStageShaderComponents = 3;
@@ -112,13 +387,19 @@ int main(int, char **)
   // Uniform structs have a size of maximum 16 float (more than what we need)
   requiredLimits.limits.maxUniformBufferBindingSize = 16 * 4;
 
-  // Set the max limits on the texture's GPUExtent3D width and number of array layers
-  requiredLimits.limits.maxTextureDimension2D = 640;
+  // Set the max limits on the texture's GPUExtent3D width and number of array layers,
+  // windows can be resized up to what the adapter supports
+  requiredLimits.limits.maxTextureDimension2D = options.headless ? std::max(frameWidth, frameHeight)
+                                                                 : supportedLimits.limits.maxTextureDimension2D;
   requiredLimits.limits.maxTextureArrayLayers = 1;
 
   DeviceDescriptor deviceDesc;
   deviceDesc.label = "My Device";
-  deviceDesc.requiredFeaturesCount = 0;
+  // Timestamp queries, to profile passes on the GPU
+  FeatureName timestampFeature = FeatureName::TimestampQuery;
+  bool timestamps = options.gpuTimestamps && adapter.hasFeature(timestampFeature);
+  deviceDesc.requiredFeaturesCount = timestamps ? 1 : 0;
+  deviceDesc.requiredFeatures = timestamps ? (WGPUFeatureName *)&timestampFeature : nullptr;
   // FIXME: following causes runtime error...
   deviceDesc.requiredLimits = &requiredLimits;
   // Could not get WebGPU adapter: LimitsExceeded(FailedLimit { name: "min_storage_buffer_offset_alignment", requested: 0, allowed: 256 })
@@ -153,57 +434,129 @@ int main(int, char **)
 
   Queue queue = device.getQueue();
 
-  std::cout << "Creating swapchain..." << std::endl;
+  TextureFormat swapChainFormat = TextureFormat::Undefined;
+  // Headless frames are rendered here, then copied to the readback buffer
+  // when they are written out
+  Texture offscreenTexture = nullptr;
+  TextureView offscreenTextureView = nullptr;
+  Buffer readbackBuffer = nullptr;
+  // Texture to buffer copies need rows aligned to 256 bytes
+  uint32_t readbackBytesPerRow = (frameWidth * 4 + 255) / 256 * 256;
+  bool readback = options.headless && !options.outputDirectory.empty();
+  if (options.headless)
+  {
+    std::cout << "Creating offscreen target..." << std::endl;
+    // 8-bit RGBA, so that frames are written out as they are read back, and
+    // sRGB like the swapchain usually is
+    swapChainFormat = TextureFormat::RGBA8UnormSrgb;
+    TextureDescriptor offscreenTextureDesc;
+    offscreenTextureDesc.label = "Offscreen target";
+    offscreenTextureDesc.dimension = TextureDimension::_2D;
+    offscreenTextureDesc.format = swapChainFormat;
+    offscreenTextureDesc.mipLevelCount = 1;
+    offscreenTextureDesc.sampleCount = 1;
+    offscreenTextureDesc.size = {frameWidth, frameHeight, 1};
+    offscreenTextureDesc.usage = TextureUsage::RenderAttachment | TextureUsage::CopySrc;
+    offscreenTextureDesc.viewFormatCount = 0;
+    offscreenTextureDesc.viewFormats = nullptr;
+    offscreenTexture = device.createTexture(offscreenTextureDesc);
+    TextureViewDescriptor offscreenTextureViewDesc;
+    offscreenTextureViewDesc.aspect = TextureAspect::All;
+    offscreenTextureViewDesc.baseArrayLayer = 0;
+    offscreenTextureViewDesc.arrayLayerCount = 1;
+    offscreenTextureViewDesc.baseMipLevel = 0;
+    offscreenTextureViewDesc.mipLevelCount = 1;
+    offscreenTextureViewDesc.dimension = TextureViewDimension::_2D;
+    offscreenTextureViewDesc.format = swapChainFormat;
+    offscreenTextureView = offscreenTexture.createView(offscreenTextureViewDesc);
+
+    if (readback)
+    {
+      BufferDescriptor readbackBufferDesc;
+      readbackBufferDesc.label = "Readback buffer";
+      readbackBufferDesc.size = static_cast<uint64_t>(readbackBytesPerRow) * frameHeight;
+      readbackBufferDesc.usage = BufferUsage::CopyDst | BufferUsage::MapRead;
+      readbackBufferDesc.mappedAtCreation = false;
+      readbackBuffer = device.createBuffer(readbackBufferDesc);
+      std::filesystem::create_directories(options.outputDirectory);
+    }
+  }
+  else
+  {
 #ifdef WEBGPU_BACKEND_WGPU
-  TextureFormat swapChainFormat = surface.getPreferredFormat(adapter);
+    swapChainFormat = surface.getPreferredFormat(adapter);
 #else
-  TextureFormat swapChainFormat = TextureFormat::BGRA8Unorm;
+    swapChainFormat = TextureFormat::BGRA8Unorm;
 #endif
-  SwapChainDescriptor swapChainDesc;
-  swapChainDesc.width = 640;
-  swapChainDesc.height = 480;
-  swapChainDesc.usage = TextureUsage::RenderAttachment;
-  swapChainDesc.format = swapChainFormat;
-  swapChainDesc.presentMode = PresentMode::Fifo;
-  SwapChain swapChain = device.createSwapChain(surface, swapChainDesc);
-  std::cout << "Swapchain: " << swapChain << std::endl;
-  std::cout << "Swapchain format: " << swapChainFormat << std::endl;
+    std::cout << "Swapchain format: " << swapChainFormat << std::endl;
+  }
   std::cout << "Creating shader module..." << std::endl;
 
-  ShaderModule shaderModule = loadShaderModule(RESOURCE_DIR "shader.wgsl", device);
-  std::cout << "Shader module: " << shaderModule << std::endl;
-
-  std::cout << "Creating render pipeline..." << std::endl;
-  RenderPipelineDescriptor pipelineDesc;
+  // Shaders go through the on-disk cache, which skips reading and
+  // validating them again when they have not changed since the last run
+  auto shaderCache = std::make_unique<ShaderCache>(options.shaderCacheDirectory, ShaderCache::adapterIdentity(adapter));
+  // Values of the overrides of the shader, folded when the pipeline
+  // compiles rather than computed for every vertex
+  PipelineConstants pipelineConstants;
+  pipelineConstants.set("aspectRatio", static_cast<double>(frameWidth) / frameHeight);
+  pipelineConstants.set("rotationSpeed", options.rotationSpeed);
+
+  // Every permutation of the shader is a module of its own, what varies
+  // with the window is specialized by the pipeline instead, or folded into
+  // the modules where the backend has no overrides
+  WgslDefines shaderDefines;
+  if (PipelineConstants::supported())
+  {
+    shaderDefines["PIPELINE_OVERRIDES"] = "1";
+  }
+  else
+  {
+    shaderDefines["ASPECT_RATIO"] = pipelineConstants.literal("aspectRatio");
+    shaderDefines["ROTATION_SPEED"] = pipelineConstants.literal("rotationSpeed");
+  }
+  std::vector<ShaderPermutation> shaderPermutations;
+  if (!shaderCache->loadPermutations(RESOURCE_DIR "shader.wgsl", device, vertexFormat.wgslDecode(), shaderDefines, shaderPermutations))
+  {
+    return 1;
+  }
+  std::cout << "Shader modules: " << shaderPermutations.size() << " permutations (shader cache: "
+            << shaderCache->statistics().hits << " hits, " << shaderCache->statistics().misses << " misses)" << std::endl;
 
-  // Vertex fetch interleaved attributes ("Option A")
-  std::vector<VertexAttribute> vertexAttribs(2);
+  // The permutation to draw with, the first one matching the options
+  size_t drawnPermutation = shaderPermutations.size();
+  for (size_t i = 0; i < shaderPermutations.size() && drawnPermutation == shaderPermutations.size(); ++i)
+  {
+    const WgslDefines &permutation = shaderPermutations[i].permutation;
+    bool matches = std::all_of(options.permutation.begin(), options.permutation.end(), [&](const auto &option)
+                               {
+      auto value = permutation.find(option.first);
+      return value != permutation.end() && value->second == option.second; });
+    drawnPermutation = matches ? i : drawnPermutation;
+  }
+  if (drawnPermutation == shaderPermutations.size())
+  {
+    std::cerr << "shader.wgsl has no permutation " << permutationName(options.permutation) << std::endl;
+    return 1;
+  }
 
-  // Position attribute
-  vertexAttribs[0].shaderLocation = 0;
-  vertexAttribs[0].format = VertexFormat::Float32x3;
-  vertexAttribs[0].offset = 0;
+  // Layouts and pipelines come from the cache, which hands out the same
+  // object for equivalent descriptors, so that variants of the pipeline
+  // only have to change the state they differ in
+  auto pipelineCache = std::make_unique<PipelineCache>(device);
 
-  // Color attribute
-  vertexAttribs[1].shaderLocation = 1;
-  vertexAttribs[1].format = VertexFormat::Float32x3; // different type!
-  vertexAttribs[1].offset = 3 * sizeof(float);       // non null offset!
+  std::cout << "Creating render pipeline..." << std::endl;
+  RenderPipelineDescriptor pipelineDesc;
 
-  VertexBufferLayout vertexBufferLayout;
-  // [...] Build vertex buffer layout
-  vertexBufferLayout.attributeCount = (uint32_t)vertexAttribs.size();
-  vertexBufferLayout.attributes = vertexAttribs.data();
-  // Bigger stride
-  vertexBufferLayout.arrayStride = 6 * sizeof(float);
-  vertexBufferLayout.stepMode = VertexStepMode::Vertex;
+  // Vertex fetch of the attributes this pass reads, in the packed format
+  // (e.g. Snorm16x4 position and Unorm8x4 color) and the buffers of the
+  // vertex layout
+  VertexPassInput colorPassInput = vertexLayout.passInput(AllAttributes);
 
-  pipelineDesc.vertex.bufferCount = 1;
-  pipelineDesc.vertex.buffers = &vertexBufferLayout;
+  pipelineDesc.vertex.bufferCount = static_cast<uint32_t>(colorPassInput.bufferLayouts.size());
+  pipelineDesc.vertex.buffers = colorPassInput.bufferLayouts.data();
 
-  pipelineDesc.vertex.module = shaderModule;
   pipelineDesc.vertex.entryPoint = "vs_main";
-  pipelineDesc.vertex.constantCount = 0;
-  pipelineDesc.vertex.constants = nullptr;
+  pipelineConstants.apply(pipelineDesc.vertex);
 
   pipelineDesc.primitive.topology = PrimitiveTopology::TriangleList;
   pipelineDesc.primitive.stripIndexFormat = IndexFormat::Undefined;
@@ -212,10 +565,8 @@ int main(int, char **)
 
   FragmentState fragmentState;
   pipelineDesc.fragment = &fragmentState;
-  fragmentState.module = shaderModule;
   fragmentState.entryPoint = "fs_main";
-  fragmentState.constantCount = 0;
-  fragmentState.constants = nullptr;
+  pipelineConstants.apply(fragmentState);
 
   BlendState blendState;
   blendState.color.srcFactor = BlendFactor::SrcAlpha;
@@ -245,28 +596,34 @@ int main(int, char **)
   depthStencilState.stencilWriteMask = 0;
   pipelineDesc.depthStencil = &depthStencilState;
 
-  // Create the depth texture
-  TextureDescriptor depthTextureDesc;
-  depthTextureDesc.dimension = TextureDimension::_2D;
-  depthTextureDesc.format = depthTextureFormat;
-  depthTextureDesc.mipLevelCount = 1;
-  depthTextureDesc.sampleCount = 1;
-  depthTextureDesc.size = {640, 480, 1};
-  depthTextureDesc.usage = TextureUsage::RenderAttachment;
-  depthTextureDesc.viewFormatCount = 1;
-  depthTextureDesc.viewFormats = (WGPUTextureFormat *)&depthTextureFormat;
-  Texture depthTexture = device.createTexture(depthTextureDesc);
-
-  // Create the view of the depth texture manipulated by the rasterizer
-  TextureViewDescriptor depthTextureViewDesc;
-  depthTextureViewDesc.aspect = TextureAspect::DepthOnly;
-  depthTextureViewDesc.baseArrayLayer = 0;
-  depthTextureViewDesc.arrayLayerCount = 1;
-  depthTextureViewDesc.baseMipLevel = 0;
-  depthTextureViewDesc.mipLevelCount = 1;
-  depthTextureViewDesc.dimension = TextureViewDimension::_2D;
-  depthTextureViewDesc.format = depthTextureFormat;
-  TextureView depthTextureView = depthTexture.createView(depthTextureViewDesc);
+  // The swap chain and depth texture, allocated again when the window is
+  // resized. The pipelines keep the aspect ratio they were specialized
+  // for, frames of other proportions draw to a centered viewport.
+  int framebufferWidth = frameWidth;
+  int framebufferHeight = frameHeight;
+  if (window)
+  {
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+  }
+  PresentMode presentMode = PresentMode::Fifo;
+  if (surface)
+  {
+    presentMode = SurfaceManager::choosePresentMode(surface, adapter, options.presentMode);
+    if (presentMode != options.presentMode)
+    {
+      std::cout << "Present mode " << SurfaceManager::presentModeName(options.presentMode) << " is not supported, using "
+                << SurfaceManager::presentModeName(presentMode) << std::endl;
+    }
+  }
+  auto surfaceManager = std::make_unique<SurfaceManager>(device, surface, swapChainFormat, depthTextureFormat,
+                                                         framebufferWidth, framebufferHeight, presentMode);
+  float pipelineAspectRatio = static_cast<float>(frameWidth) / frameHeight;
+  if (window)
+  {
+    glfwSetWindowUserPointer(window, surfaceManager.get());
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow *window, int width, int height)
+                                   { static_cast<SurfaceManager *>(glfwGetWindowUserPointer(window))->resize(width, height); });
+  }
 
   pipelineDesc.multisample.count = 1;
   pipelineDesc.multisample.mask = ~0u;
@@ -287,79 +644,127 @@ int main(int, char **)
   BindGroupLayoutDescriptor bindGroupLayoutDesc;
   bindGroupLayoutDesc.entryCount = 1;
   bindGroupLayoutDesc.entries = &bindingLayout;
-  BindGroupLayout bindGroupLayout = device.createBindGroupLayout(bindGroupLayoutDesc);
+  BindGroupLayout bindGroupLayout = pipelineCache->bindGroupLayout(bindGroupLayoutDesc);
 
   PipelineLayoutDescriptor layoutDesc{};
   layoutDesc.bindGroupLayoutCount = 1;
   layoutDesc.bindGroupLayouts = (WGPUBindGroupLayout *)&bindGroupLayout;
 
-  PipelineLayout layout = device.createPipelineLayout(layoutDesc);
+  PipelineLayout layout = pipelineCache->pipelineLayout(layoutDesc);
   pipelineDesc.layout = layout;
 
-  RenderPipeline pipeline = device.createRenderPipeline(pipelineDesc);
-  std::cout << "Render pipeline: " << pipeline << std::endl;
-  std::vector<float> pointData;
-  std::vector<uint16_t> indexData;
-
-  bool success = loadGeometry(RESOURCE_DIR "pyramid.txt", pointData, indexData, 3);
-  if (!success)
+  // Compile the pipelines of all permutations in the background, while the
+  // geometry uploads and the first frames render without them
+  PipelineScheduler pipelineScheduler(*pipelineCache);
+  // Then rebuild them whenever the shader is edited
+  std::unique_ptr<ShaderReloader> shaderReloader;
+  if (!options.headless || options.watch)
   {
-    std::cerr << "Could not load geometry!" << std::endl;
-    return 1;
+    shaderReloader = std::make_unique<ShaderReloader>(*shaderCache, *pipelineCache, device, RESOURCE_DIR "shader.wgsl",
+                                                      vertexFormat.wgslDecode(), shaderDefines);
   }
-  else
+  uint32_t colorPipeline = 0;
+  for (size_t i = 0; i < shaderPermutations.size(); ++i)
   {
-    std::cout << "Loaded " << pointData.size() / 5 << " vertices and "
-              << indexData.size() << " indices." << std::endl;
-
-    for (int i = 0; i < static_cast<int>(pointData.size()); i++)
+    pipelineDesc.vertex.module = shaderPermutations[i].module;
+    fragmentState.module = shaderPermutations[i].module;
+    std::string name = permutationName(shaderPermutations[i].permutation);
+    uint32_t variant = pipelineScheduler.add(name.empty() ? "color" : "color " + name, pipelineDesc);
+    colorPipeline = i == drawnPermutation ? variant : colorPipeline;
+    if (shaderReloader)
     {
-      std::cout << pointData[i] << " ";
+      shaderReloader->addPipeline(variant, shaderPermutations[i].permutation, pipelineDesc);
     }
-    std::cout << std::endl;
   }
+  if (shaderReloader && !shaderReloader->start())
+  {
+    shaderReloader.reset();
+  }
+  bool pipelinesReported = false;
 
-  // Create vertex buffer
+  // Create vertex buffers
   BufferDescriptor bufferDesc;
-  bufferDesc.size = pointData.size() * sizeof(float);
-  bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Vertex;
-  bufferDesc.mappedAtCreation = false;
-  Buffer vertexBuffer = device.createBuffer(bufferDesc);
-  queue.writeBuffer(vertexBuffer, 0, pointData.data(), bufferDesc.size);
+  std::vector<Buffer> vertexBuffers;
+  for (uint32_t i = 0; i < vertexLayout.bufferCount(); ++i)
+  {
+    bufferDesc.size = vertexLayout.bufferSize(i, geometry.vertexCount());
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Vertex;
+    bufferDesc.mappedAtCreation = false;
+    vertexBuffers.push_back(device.createBuffer(bufferDesc));
+  }
 
-  int indexCount = static_cast<int>(indexData.size());
+  int indexCount = static_cast<int>(geometry.indexCount());
 
   // Create index buffer
-  // TODO: Find out why this is type float and not uint16_t.
-  //       Type uint16_t causes crash:
-  //       thread '<unnamed>' panicked at 'Unable to write buffer: Transfer(UnalignedCopySize(30))', src/device.rs:747:10
-  bufferDesc.size = indexData.size() * sizeof(float);
+  // Its size is padded to a multiple of 4 bytes, because buffer copies must
+  // be, even with an odd number of uint16_t indices.
+  bufferDesc.size = geometry.indexBufferSize();
   bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Index;
   bufferDesc.mappedAtCreation = false;
   Buffer indexBuffer = device.createBuffer(bufferDesc);
 
-  // Upload geometry data to the buffer
-  queue.writeBuffer(indexBuffer, 0, indexData.data(), bufferDesc.size);
-
-  // Create uniform buffer
-  // The stride of the uniform buffer is the largest of sizeof(MyUniforms)
-  // and device limits' minUniformBufferOffsetAlignment
-  uint32_t uniformStride = std::max(
-      (uint32_t)sizeof(MyUniforms),
-      (uint32_t)deviceLimits.minUniformBufferOffsetAlignment);
-  // The buffer will only contain 1 float with the value of MyUniforms
-  bufferDesc.size = uniformStride + sizeof(MyUniforms);
-  // Make sure to flag the buffer as BufferUsage::Uniform
-  bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Uniform;
-  bufferDesc.mappedAtCreation = false;
-  Buffer uniformBuffer = device.createBuffer(bufferDesc);
+  // Upload geometry data to the buffers block by block, as it is parsed, so
+  // that the whole mesh never sits in host memory. The driver keeps a staged
+  // copy of each write until the submission after it completes and the
+  // device is polled, so every stagingBudget bytes submit and wait, which
+  // keeps its staging memory bounded too. Vertices are packed on the way,
+  // and each block checks that the packing stays within its error bound.
+  constexpr uint64_t stagingBudget = 64 << 20;
+  uint64_t stagedBytes = 0;
+  auto staged = [&](uint64_t size)
+  {
+    stagedBytes += size;
+    if (stagedBytes >= stagingBudget)
+    {
+      queue.submit(0, nullptr);
+      waitForDevice(instance, device);
+      stagedBytes = 0;
+    }
+  };
+  std::vector<std::vector<uint8_t>> packedBlocks;
+  QuantizationError quantizationError;
+  geometry.read(
+      geometryBlockSize,
+      [&](const GeometryBlock &block)
+      {
+        const float *vertices = static_cast<const float *>(block.data);
+        size_t blockVertexCount = block.size / (6 * sizeof(float));
+        size_t firstVertex = block.offset / (6 * sizeof(float));
+        vertexLayout.pack(vertices, blockVertexCount, packedBlocks);
+        quantizationError.merge(measureQuantizationError(vertexFormat, vertices, blockVertexCount));
+        for (uint32_t i = 0; i < vertexLayout.bufferCount(); ++i)
+        {
+          queue.writeBuffer(vertexBuffers[i], vertexLayout.bufferOffset(i, firstVertex), packedBlocks[i].data(), packedBlocks[i].size());
+          staged(packedBlocks[i].size());
+        }
+      },
+      [&](const GeometryBlock &block)
+      {
+        queue.writeBuffer(indexBuffer, block.offset, block.data, block.size);
+        staged(block.size);
+      });
+  if (!validateQuantizationError(vertexFormat, quantizationError))
+  {
+    return 1;
+  }
+
+  // Create the frame pacer, which keeps the CPU a bounded number of frames
+  // ahead of the GPU, and its uniform ring, from which each draw of each
+  // frame allocates its MyUniforms block. Allocations are aligned on the
+  // device's minUniformBufferOffsetAlignment, so that they can be bound
+  // with dynamic offsets.
+  auto framePacer = std::make_unique<FramePacer>(device, queue, options.framesInFlight, deviceLimits.minUniformBufferOffsetAlignment,
+                                                 uniformFrameCapacity, options.pacing);
+  // Time spent in each pass, on the GPU if it has timestamp queries
+  auto gpuProfiler = std::make_unique<GpuProfiler>(device, options.gpuTimestamps);
+  std::cout << "Profiling passes with " << (gpuProfiler->usesTimestamps() ? "GPU timestamps" : "CPU timers") << std::endl;
 
   // Create a binding
   BindGroupEntry binding{};
   // The index of the binding (the entries in bindGroupDesc can be in any order)
   binding.binding = 0;
   // The buffer it is actually bound to
-  binding.buffer = uniformBuffer;
+  binding.buffer = framePacer->uniforms().buffer();
   // We can specify an offset within the buffer, so that a single buffer can hold
   // multiple uniform blocks.
   binding.offset = 0;
@@ -374,30 +779,121 @@ int main(int, char **)
   bindGroupDesc.entries = &binding;
   BindGroup bindGroup = device.createBindGroup(bindGroupDesc);
 
-  // Upload the initial value of the uniforms
+  // The uniforms of the first draw
   MyUniforms uniforms;
   uniforms.time = 1.0f;
   uniforms.color = {0.0f, 1.0f, 0.4f, 1.0f};
-  // Upload only the time, whichever its order in the struct
-  queue.writeBuffer(uniformBuffer, 0, &uniforms, sizeof(MyUniforms));
+  // The second draw has always been given a block of zeros (fully
+  // transparent), keep it that way
+  MyUniforms secondUniforms{};
 
-  while (!glfwWindowShouldClose(window))
+  if (options.headless)
   {
-    glfwPollEvents();
+    // Headless frames must not depend on how fast pipelines compile
+    while (!pipelineScheduler.allSettled())
+    {
+      waitForDevice(instance, device);
+    }
+  }
 
-    TextureView nextTexture = swapChain.getCurrentTextureView();
-    if (!nextTexture)
+  uint32_t frame = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  // Time between consecutive presents, and from sampling the input of a
+  // frame to presenting it
+  FrameHistogram presentIntervals;
+  FrameHistogram inputToPresent;
+  std::chrono::steady_clock::time_point lastPresentTime;
+  std::chrono::steady_clock::time_point inputTime;
+  bool traceKeyDown = false;
+  while (options.headless ? frame < options.frameCount : !glfwWindowShouldClose(window))
+  {
+    TRACE_SCOPE("Frame");
+    if (!pipelinesReported)
     {
-      std::cerr << "Cannot acquire next swap chain texture" << std::endl;
-      return 1;
+      pollDevice(instance, device);
+      if (pipelineScheduler.allSettled())
+      {
+        pipelineScheduler.printReport(std::cout);
+        pipelinesReported = true;
+        if (pipelineScheduler.status(colorPipeline).state == PipelineVariantState::Failed)
+        {
+          return 1;
+        }
+      }
+    }
+
+    if (shaderReloader)
+    {
+      shaderReloader->apply(pipelineScheduler);
+    }
+
+    // Input, and the time the frame shows, are sampled here, or just
+    // before encoding in low latency mode
+    auto sampleInput = [&]()
+    {
+      if (!options.headless)
+      {
+        TRACE_SCOPE("Poll events");
+        glfwPollEvents();
+        // Write what was recorded so far, e.g. right after a stall
+        bool traceKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+        if (traceKey && !traceKeyDown)
+        {
+          trace.writeChromeTrace(options.tracePath);
+        }
+        traceKeyDown = traceKey;
+      }
+      inputTime = std::chrono::steady_clock::now();
+      // Headless frames follow a fixed 60 Hz clock, so that they do not
+      // depend on how fast they render
+      uniforms.time = options.headless
+                          ? static_cast<float>(frame) / 60.0f
+                          : static_cast<float>(glfwGetTime()); // glfwGetTime returns a double
+    };
+
+    TextureView nextTexture = offscreenTextureView;
+    if (!options.lowLatency)
+    {
+      sampleInput();
+    }
+    if (!surfaceManager->beginFrame())
+    {
+      // Minimized, wait to be visible again
+      TRACE_SCOPE("Wait for events");
+      glfwWaitEvents();
+      continue;
+    }
+    // Wait for a frame slot before acquiring the swap chain texture, so
+    // that it is not held while waiting. With skip pacing, go back to the
+    // events instead.
+    if (!framePacer->beginFrame())
+    {
+      pollDevice(instance, device);
+      continue;
+    }
+    if (!options.headless)
+    {
+      nextTexture = surfaceManager->acquireColorView();
+      if (!nextTexture)
+      {
+        std::cerr << "Cannot acquire next swap chain texture" << std::endl;
+        return 1;
+      }
+    }
+    if (options.lowLatency)
+    {
+      sampleInput();
     }
+    gpuProfiler->beginFrame();
 
-    // Update uniform buffer
-    uniforms.time = static_cast<float>(glfwGetTime()); // glfwGetTime returns a double
-    queue.writeBuffer(uniformBuffer, offsetof(MyUniforms, time), &uniforms.time, sizeof(MyUniforms::time));
-    CommandEncoderDescriptor commandEncoderDesc;
-    commandEncoderDesc.label = "Command Encoder";
-    CommandEncoder encoder = device.createCommandEncoder(commandEncoderDesc);
+    // Allocate this frame's uniforms, they are uploaded all at once when
+    // the frame is submitted
+    uint64_t encodeStart = trace.now();
+    uint32_t firstDrawOffset = framePacer->uniforms().push(uniforms);
+    uint32_t secondDrawOffset = framePacer->uniforms().push(secondUniforms);
+    assert(firstDrawOffset != UniformRing::InvalidOffset && secondDrawOffset != UniformRing::InvalidOffset);
+    trace.record("Write uniforms", encodeStart);
+    CommandEncoder encoder = framePacer->encoder();
 
     RenderPassDescriptor renderPassDesc;
 
@@ -413,7 +909,7 @@ int main(int, char **)
     // Setup depth/stencil attachment
     RenderPassDepthStencilAttachment depthStencilAttachment;
     // The view of the depth texture
-    depthStencilAttachment.view = depthTextureView;
+    depthStencilAttachment.view = surfaceManager->depthView();
     // The initial value of the depth buffer, meaning "far"
     depthStencilAttachment.depthClearValue = 1.0f;
     // Operation settings comparable to the color attachment
@@ -428,50 +924,173 @@ int main(int, char **)
     depthStencilAttachment.stencilReadOnly = true;
 
     renderPassDesc.depthStencilAttachment = &depthStencilAttachment;
-    renderPassDesc.timestampWriteCount = 0;
-    renderPassDesc.timestampWrites = nullptr;
+    // Sets the pass's timestampWrites
+    uint32_t colorPassScope = gpuProfiler->beginPass("Color pass", renderPassDesc);
     RenderPassEncoder renderPass = encoder.beginRenderPass(renderPassDesc);
 
-    renderPass.setPipeline(pipeline);
+    // Until the pipeline has compiled, frames are only cleared
+    RenderPipeline pipeline = pipelineScheduler.pipeline(colorPipeline);
+    if (pipeline)
+    {
+      renderPass.setPipeline(pipeline);
+      SurfaceViewport viewport = surfaceManager->viewport(pipelineAspectRatio);
+      renderPass.setViewport(viewport.x, viewport.y, viewport.width, viewport.height, 0.0f, 1.0f);
+
+      // Set vertex buffers while encoding the render pass, in the slots the
+      // pipeline expects them
+      for (uint32_t slot = 0; slot < colorPassInput.buffers.size(); ++slot)
+      {
+        uint32_t buffer = colorPassInput.buffers[slot];
+        renderPass.setVertexBuffer(slot, vertexBuffers[buffer], 0, vertexLayout.bufferSize(buffer, geometry.vertexCount()));
+      }
+      // The second argument must correspond to the choice of uint16_t or uint32_t
+      // the geometry stream has done when filling the index buffer.
+      renderPass.setIndexBuffer(indexBuffer, geometry.indexFormat(), 0, geometry.indexBufferSize());
+
+      // Set binding group
+      renderPass.setBindGroup(0, bindGroup, 1, &firstDrawOffset);
+
+      // Replace `draw()` with `drawIndexed()` and `vertexCount` with `indexCount`
+      // The extra argument is an offset within the index buffer.
+      renderPass.drawIndexed(indexCount, 1, 0, 0, 0);
+
+      // Set binding group with a different uniform offset
+      renderPass.setBindGroup(0, bindGroup, 1, &secondDrawOffset);
+      renderPass.drawIndexed(indexCount, 1, 0, 0, 0);
+    }
+    renderPass.end();
+    gpuProfiler->endPass(colorPassScope);
 
-    uint32_t dynamicOffset = 0;
+    if (!options.headless)
+    {
+      wgpuTextureViewRelease(nextTexture);
+    }
 
-    // Set vertex buffer while encoding the render pass
-    renderPass.setVertexBuffer(0, vertexBuffer, 0, pointData.size() * sizeof(float));
-    // The second argument must correspond to the choice of uint16_t or uint32_t
-    // we've done when creating the index buffer.
-    renderPass.setIndexBuffer(indexBuffer, IndexFormat::Uint16, 0, indexData.size() * sizeof(uint16_t));
+    if (readback)
+    {
+      ImageCopyTexture source;
+      source.texture = offscreenTexture;
+      source.mipLevel = 0;
+      source.origin = {0, 0, 0};
+      source.aspect = TextureAspect::All;
+      ImageCopyBuffer destination;
+      destination.buffer = readbackBuffer;
+      destination.layout.offset = 0;
+      destination.layout.bytesPerRow = readbackBytesPerRow;
+      destination.layout.rowsPerImage = frameHeight;
+      uint32_t readbackScope = gpuProfiler->beginScope(encoder, "Readback copy");
+      encoder.copyTextureToBuffer(source, destination, {frameWidth, frameHeight, 1});
+      gpuProfiler->endScope(encoder, readbackScope);
+    }
 
-    // Set binding group
-    dynamicOffset = 0 * uniformStride;
-    renderPass.setBindGroup(0, bindGroup, 1, &dynamicOffset);
+    gpuProfiler->resolve(encoder);
+    trace.record("Encode frame", encodeStart);
+    framePacer->submit();
+    gpuProfiler->afterSubmit();
 
-    // Replace `draw()` with `drawIndexed()` and `vertexCount` with `indexCount`
-    // The extra argument is an offset within the index buffer.
-    renderPass.drawIndexed(indexCount, 1, 0, 0, 0);
+    if (readback)
+    {
+      // Wait for the copy, then write the frame out
+      TRACE_SCOPE("Write frame");
+      bool mapped = false;
+      bool mapSucceeded = false;
+      uint64_t readbackSize = static_cast<uint64_t>(readbackBytesPerRow) * frameHeight;
+      auto mapCallback = readbackBuffer.mapAsync(MapMode::Read, 0, readbackSize, [&](BufferMapAsyncStatus status)
+                                                 {
+        mapped = true;
+        mapSucceeded = status == BufferMapAsyncStatus::Success; });
+      while (!mapped)
+      {
+        waitForDevice(instance, device);
+      }
+      if (!mapSucceeded)
+      {
+        std::cerr << "Could not map the readback buffer" << std::endl;
+        return 1;
+      }
+
+      const uint8_t *pixels = static_cast<const uint8_t *>(readbackBuffer.getConstMappedRange(0, readbackSize));
+      char frameName[32];
+      std::snprintf(frameName, sizeof(frameName), "frame-%05u", frame);
+      bool written = options.rawFrames
+                         ? writeRaw(options.outputDirectory / (std::string(frameName) + ".rgba"), frameWidth, frameHeight, pixels, readbackBytesPerRow)
+                         : writePng(options.outputDirectory / (std::string(frameName) + ".png"), frameWidth, frameHeight, pixels, readbackBytesPerRow);
+      readbackBuffer.unmap();
+      if (!written)
+      {
+        return 1;
+      }
+    }
 
-    // Set binding group with a different uniform offset
-    dynamicOffset = 1 * uniformStride;
-    renderPass.setBindGroup(0, bindGroup, 1, &dynamicOffset);
-    renderPass.drawIndexed(indexCount, 1, 0, 0, 0);
-    renderPass.end();
+    surfaceManager->present();
+    auto presentTime = std::chrono::steady_clock::now();
+    if (frame > 0)
+    {
+      presentIntervals.add(std::chrono::duration<double>(presentTime - lastPresentTime).count());
+    }
+    inputToPresent.add(std::chrono::duration<double>(presentTime - inputTime).count());
+    lastPresentTime = presentTime;
+    ++frame;
+  }
 
-    wgpuTextureViewRelease(nextTexture);
+  // To compare present modes and pacing policies
+  std::cout << "Present mode: " << (surface ? SurfaceManager::presentModeName(surfaceManager->presentMode()) : "offscreen")
+            << (options.lowLatency ? ", low latency" : "") << std::endl;
+  presentIntervals.print(std::cout, "Present intervals");
+  inputToPresent.print(std::cout, "Input to present");
+  gpuProfiler->print(std::cout);
 
-    CommandBufferDescriptor cmdBufferDescriptor;
-    cmdBufferDescriptor.label = "Command buffer";
-    CommandBuffer command = encoder.finish(cmdBufferDescriptor);
-    queue.submit(command);
+  if (options.headless)
+  {
+    // Only count frames once the GPU is done with all of them
+    waitForDevice(instance, device);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Rendered " << frame << " frames in " << seconds << " s ("
+              << (seconds > 0.0 ? frame / seconds : 0.0) << " frames/s)" << std::endl;
+    PipelineCacheStatistics pipelineStatistics = pipelineCache->statistics();
+    std::cout << "Pipeline cache: " << pipelineCache->size() << " objects, render pipelines "
+              << pipelineStatistics.renderPipelines.hits << " hits / " << pipelineStatistics.renderPipelines.misses
+              << " misses (" << pipelineStatistics.renderPipelines.creationSeconds * 1000.0 << " ms creating), layouts "
+              << pipelineStatistics.bindGroupLayouts.hits + pipelineStatistics.pipelineLayouts.hits << " hits / "
+              << pipelineStatistics.bindGroupLayouts.misses + pipelineStatistics.pipelineLayouts.misses << " misses"
+              << std::endl;
+    FramePacerStatistics pacerStatistics = framePacer->statistics();
+    std::cout << "Frame pacing: " << framePacer->framesInFlight() << " frames in flight, " << pacerStatistics.blockedFrames
+              << " frames blocked (" << pacerStatistics.blockedSeconds * 1000.0 << " ms), " << pacerStatistics.skippedFrames
+              << " skipped, at most " << pacerStatistics.maxGpuSeconds * 1000.0 << " ms from submit to completion" << std::endl;
+    std::cout << "Render targets: allocated " << surfaceManager->reallocations().size() << " times over "
+              << surfaceManager->frameCount() << " frames" << std::endl;
+    if (shaderReloader)
+    {
+      ShaderReloadStatistics reloadStatistics = shaderReloader->statistics();
+      std::cout << "Shader reloads: " << reloadStatistics.reloads << " (" << reloadStatistics.failures << " failed), at most "
+                << reloadStatistics.maxLatencySeconds * 1000.0 << " ms from change to swap" << std::endl;
+    }
+#ifdef WEBGPU_BACKEND_MOCK
+    // What the host side did, per call (see libs/webgpu-mock)
+    webgpu_mock::printStatistics(std::cout, webgpu_mock::statistics());
+#endif
+  }
 
-    swapChain.present();
+  if (options.traceOnExit)
+  {
+    trace.writeChromeTrace(options.tracePath);
   }
 
-  wgpuSwapChainRelease(swapChain);
+  gpuProfiler.reset();
+  framePacer.reset();
+  shaderReloader.reset();
+  pipelineCache.reset();
+  shaderCache.reset();
+  surfaceManager.reset();
   wgpuDeviceRelease(device);
   wgpuAdapterRelease(adapter);
   wgpuInstanceRelease(instance);
-  glfwDestroyWindow(window);
-  glfwTerminate();
+  if (window)
+  {
+    glfwDestroyWindow(window);
+    glfwTerminate();
+  }
 
   return 0;
 }
\ No newline at end of file
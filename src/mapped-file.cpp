@@ -0,0 +1,188 @@
+#include "mapped-file.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const fs::path &path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    m_fileHandle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        close();
+        return;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_open = true;
+
+    // Mapping an empty file is an error on Windows, but an empty file is
+    // still a valid (empty) input.
+    if (m_size == 0)
+    {
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        close();
+        return;
+    }
+    m_mappingHandle = mapping;
+
+    m_data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr)
+    {
+        close();
+    }
+}
+
+void MappedFile::discard(size_t begin, size_t end) const
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size_t pageSize = info.dwPageSize;
+    begin = begin / pageSize * pageSize;
+    end = std::min(end, m_size) / pageSize * pageSize;
+    if (m_data && begin < end)
+    {
+        // Unlocking pages that are not locked removes them from the working set
+        VirtualUnlock(const_cast<char *>(m_data) + begin, end - begin);
+    }
+}
+
+void MappedFile::close()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mappingHandle)
+    {
+        CloseHandle(m_mappingHandle);
+    }
+    if (m_fileHandle)
+    {
+        CloseHandle(m_fileHandle);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+    m_mappingHandle = nullptr;
+    m_fileHandle = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile(const fs::path &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return;
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    m_open = true;
+
+    // mmap refuses zero-length mappings, but an empty file is still a valid
+    // (empty) input.
+    if (m_size > 0)
+    {
+        void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            m_size = 0;
+            m_open = false;
+        }
+        else
+        {
+            m_data = static_cast<const char *>(data);
+            // The parsers walk the file front to back exactly once
+            madvise(data, m_size, MADV_SEQUENTIAL);
+        }
+    }
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+}
+
+void MappedFile::discard(size_t begin, size_t end) const
+{
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    begin = begin / pageSize * pageSize;
+    end = std::min(end, m_size) / pageSize * pageSize;
+    if (m_data && begin < end)
+    {
+        // The mapping is read-only, so dropped pages are simply read from
+        // the file again if they are ever touched
+        madvise(const_cast<char *>(m_data) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+void MappedFile::close()
+{
+    if (m_data)
+    {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_open, other.m_open);
+#ifdef _WIN32
+        std::swap(m_fileHandle, other.m_fileHandle);
+        std::swap(m_mappingHandle, other.m_mappingHandle);
+#endif
+    }
+    return *this;
+}
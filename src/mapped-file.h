@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+/**
+ * A read-only view of a whole file mapped in memory. The bytes stay valid
+ * for as long as the MappedFile object lives, and nothing is copied: the
+ * OS pages the file in on demand as the parser walks through it.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    bool isOpen() const { return m_open; }
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    std::string_view view() const { return {m_data, m_size}; }
+
+    /**
+     * Tell the OS that the bytes in [begin, end) will not be read again, so
+     * that their pages can leave the resident set right away. The range is
+     * widened down to a page boundary at both ends, so the bytes just before
+     * `begin` must be done with as well. Streaming readers call this as they
+     * go to keep their footprint bounded.
+     */
+    void discard(size_t begin, size_t end) const;
+
+private:
+    void close();
+
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_open = false;
+#ifdef _WIN32
+    void *m_fileHandle = nullptr;
+    void *m_mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,386 @@
+#include "mesh-optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+namespace
+{
+    // Tuning of the Forsyth scores, from the original article
+    constexpr int ForsythCacheSize = 32;
+    constexpr float CacheDecayPower = 1.5f;
+    constexpr float LastTriangleScore = 0.75f;
+    constexpr float ValenceBoostScale = 2.0f;
+    constexpr float ValenceBoostPower = 0.5f;
+
+    float vertexScore(int cachePosition, uint32_t remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+        {
+            // Nothing left to draw with this vertex
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+            {
+                // The vertices of the last triangle get a fixed score, so
+                // that we do not always pick a triangle sharing an edge with
+                // it (this tends to produce long strips, which do not use the
+                // cache as well as compact patches)
+                score = LastTriangleScore;
+            }
+            else
+            {
+                float scaler = 1.0f / (ForsythCacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, CacheDecayPower);
+            }
+        }
+
+        // Favor vertices with few triangles left, so that we do not leave
+        // isolated triangles behind to be drawn at the very end
+        score += ValenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -ValenceBoostPower);
+        return score;
+    }
+
+    size_t hashVertex(const float *vertex, int floatsPerVertex)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (int i = 0; i < floatsPerVertex; ++i)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, vertex + i, sizeof(bits));
+            h = (h ^ bits) * 1099511628211ull;
+        }
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+} // namespace
+
+bool indicesInRange(const std::vector<uint32_t> &indexData, size_t vertexCount)
+{
+    return std::all_of(indexData.begin(), indexData.end(), [vertexCount](uint32_t index)
+                       { return index < vertexCount; });
+}
+
+VertexCacheStatistics analyzeVertexCache(
+    const std::vector<uint32_t> &indexData,
+    size_t vertexCount,
+    uint32_t cacheSize)
+{
+    VertexCacheStatistics statistics;
+
+    // A vertex is in the FIFO if fewer than cacheSize misses happened since
+    // it was last loaded, which a miss counter used as a clock tells us
+    // without simulating the queue itself
+    std::vector<uint32_t> loadTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    for (uint32_t index : indexData)
+    {
+        if (time - loadTime[index] > cacheSize)
+        {
+            loadTime[index] = time++;
+            ++statistics.transformedVertexCount;
+        }
+    }
+
+    size_t triangleCount = indexData.size() / 3;
+    statistics.acmr = triangleCount ? static_cast<double>(statistics.transformedVertexCount) / triangleCount : 0.0;
+    statistics.atvr = vertexCount ? static_cast<double>(statistics.transformedVertexCount) / vertexCount : 0.0;
+    return statistics;
+}
+
+VertexFetchStatistics analyzeVertexFetch(
+    const std::vector<uint32_t> &indexData,
+    size_t vertexCount,
+    size_t vertexSize,
+    size_t cacheLineSize,
+    size_t cacheLineCount)
+{
+    VertexFetchStatistics statistics;
+
+    constexpr uint64_t EmptyLine = ~uint64_t(0);
+    std::vector<uint64_t> cachedLines(cacheLineCount, EmptyLine);
+    for (uint32_t index : indexData)
+    {
+        uint64_t start = static_cast<uint64_t>(index) * vertexSize;
+        uint64_t end = start + vertexSize;
+        for (uint64_t line = start / cacheLineSize; line * cacheLineSize < end; ++line)
+        {
+            uint64_t &slot = cachedLines[line % cacheLineCount];
+            if (slot != line)
+            {
+                slot = line;
+                statistics.bytesFetched += cacheLineSize;
+            }
+        }
+    }
+
+    size_t bufferSize = vertexCount * vertexSize;
+    statistics.overfetch = bufferSize ? static_cast<double>(statistics.bytesFetched) / bufferSize : 0.0;
+    return statistics;
+}
+
+MeshStatistics analyzeMesh(
+    const std::vector<float> &pointData,
+    const std::vector<uint32_t> &indexData,
+    int floatsPerVertex)
+{
+    MeshStatistics statistics;
+    statistics.vertexCount = pointData.size() / floatsPerVertex;
+    statistics.triangleCount = indexData.size() / 3;
+    statistics.vertexCache = analyzeVertexCache(indexData, statistics.vertexCount);
+    statistics.vertexFetch = analyzeVertexFetch(indexData, statistics.vertexCount, floatsPerVertex * sizeof(float));
+    return statistics;
+}
+
+size_t weldVertices(
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int floatsPerVertex)
+{
+    size_t vertexCount = pointData.size() / floatsPerVertex;
+    size_t vertexBytes = floatsPerVertex * sizeof(float);
+
+    // Open addressing table of unique vertex ids, at most half full
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+    {
+        tableSize *= 2;
+    }
+    constexpr uint32_t EmptySlot = ~uint32_t(0);
+    std::vector<uint32_t> table(tableSize, EmptySlot);
+
+    std::vector<uint32_t> remap(vertexCount);
+    size_t uniqueCount = 0;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const float *vertex = pointData.data() + v * floatsPerVertex;
+        size_t slot = hashVertex(vertex, floatsPerVertex) & (tableSize - 1);
+        while (table[slot] != EmptySlot &&
+               std::memcmp(pointData.data() + table[slot] * floatsPerVertex, vertex, vertexBytes) != 0)
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if (table[slot] == EmptySlot)
+        {
+            // Unique vertices move down, never over one not yet visited
+            std::memmove(pointData.data() + uniqueCount * floatsPerVertex, vertex, vertexBytes);
+            table[slot] = static_cast<uint32_t>(uniqueCount);
+            ++uniqueCount;
+        }
+        remap[v] = table[slot];
+    }
+
+    pointData.resize(uniqueCount * floatsPerVertex);
+    for (uint32_t &index : indexData)
+    {
+        index = remap[index];
+    }
+    return uniqueCount;
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indexData, size_t vertexCount)
+{
+    size_t triangleCount = indexData.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangles adjacent to each vertex, the first remainingTriangles[v] of
+    // each list being the ones not emitted yet
+    std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        ++remainingTriangles[indexData[i]];
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remainingTriangles[v];
+    }
+    std::vector<uint32_t> adjacency(adjacencyOffsets[vertexCount]);
+    {
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            adjacency[cursor[indexData[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        vertexScores[v] = vertexScore(-1, remainingTriangles[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    int64_t bestTriangle = 0;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const uint32_t *corners = indexData.data() + 3 * t;
+        triangleScores[t] = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+        if (triangleScores[t] > triangleScores[bestTriangle])
+        {
+            bestTriangle = static_cast<int64_t>(t);
+        }
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve(ForsythCacheSize + 3);
+    newCache.reserve(ForsythCacheSize + 3);
+    size_t fallbackCursor = 0;
+
+    while (output.size() < triangleCount * 3)
+    {
+        if (bestTriangle < 0)
+        {
+            // Nothing in the cache leads anywhere, start over from the first
+            // triangle not drawn yet
+            while (emitted[fallbackCursor])
+            {
+                ++fallbackCursor;
+            }
+            bestTriangle = static_cast<int64_t>(fallbackCursor);
+        }
+
+        const uint32_t corners[3] = {
+            indexData[3 * bestTriangle + 0],
+            indexData[3 * bestTriangle + 1],
+            indexData[3 * bestTriangle + 2],
+        };
+        output.insert(output.end(), corners, corners + 3);
+        emitted[bestTriangle] = true;
+
+        // Remove the triangle from the adjacency of its corners
+        for (uint32_t v : corners)
+        {
+            uint32_t *first = adjacency.data() + adjacencyOffsets[v];
+            uint32_t *last = first + remainingTriangles[v];
+            uint32_t *it = std::find(first, last, static_cast<uint32_t>(bestTriangle));
+            if (it != last)
+            {
+                std::swap(*it, *(last - 1));
+                --remainingTriangles[v];
+            }
+        }
+
+        // Push the corners at the front of the LRU cache
+        newCache.assign(corners, corners + 3);
+        for (uint32_t v : cache)
+        {
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        // Rescore every vertex that moved in (or out of) the cache, then the
+        // triangles they still belong to
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < newCache.size(); ++i)
+        {
+            uint32_t v = newCache[i];
+            cachePosition[v] = i < static_cast<size_t>(ForsythCacheSize) ? static_cast<int>(i) : -1;
+            vertexScores[v] = vertexScore(cachePosition[v], remainingTriangles[v]);
+        }
+        for (uint32_t v : newCache)
+        {
+            const uint32_t *first = adjacency.data() + adjacencyOffsets[v];
+            for (uint32_t k = 0; k < remainingTriangles[v]; ++k)
+            {
+                uint32_t t = first[k];
+                const uint32_t *tc = indexData.data() + 3 * t;
+                triangleScores[t] = vertexScores[tc[0]] + vertexScores[tc[1]] + vertexScores[tc[2]];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.size() > static_cast<size_t>(ForsythCacheSize))
+        {
+            newCache.resize(ForsythCacheSize);
+        }
+        std::swap(cache, newCache);
+    }
+
+    indexData = std::move(output);
+}
+
+size_t optimizeVertexFetch(
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int floatsPerVertex)
+{
+    size_t vertexCount = pointData.size() / floatsPerVertex;
+    constexpr uint32_t Unassigned = ~uint32_t(0);
+    std::vector<uint32_t> remap(vertexCount, Unassigned);
+
+    std::vector<float> reordered;
+    reordered.reserve(pointData.size());
+    uint32_t nextVertex = 0;
+    for (uint32_t &index : indexData)
+    {
+        if (remap[index] == Unassigned)
+        {
+            remap[index] = nextVertex++;
+            const float *vertex = pointData.data() + static_cast<size_t>(index) * floatsPerVertex;
+            reordered.insert(reordered.end(), vertex, vertex + floatsPerVertex);
+        }
+        index = remap[index];
+    }
+
+    pointData = std::move(reordered);
+    return nextVertex;
+}
+
+bool optimizeMesh(
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int floatsPerVertex,
+    MeshOptimizationReport &report)
+{
+    size_t vertexCount = pointData.size() / floatsPerVertex;
+    if (!indicesInRange(indexData, vertexCount))
+    {
+        std::cerr << "Cannot optimize the mesh: an index is out of range of its " << vertexCount << " vertices" << std::endl;
+        return false;
+    }
+
+    report.before = analyzeMesh(pointData, indexData, floatsPerVertex);
+
+    vertexCount = weldVertices(pointData, indexData, floatsPerVertex);
+    optimizeVertexCache(indexData, vertexCount);
+    optimizeVertexFetch(pointData, indexData, floatsPerVertex);
+
+    report.after = analyzeMesh(pointData, indexData, floatsPerVertex);
+    return true;
+}
+
+std::ostream &operator<<(std::ostream &stream, const MeshOptimizationReport &report)
+{
+    const MeshStatistics &before = report.before;
+    const MeshStatistics &after = report.after;
+    std::ios::fmtflags flags = stream.flags();
+    stream << std::fixed << std::setprecision(3);
+    stream << "Mesh optimization (" << before.triangleCount << " triangles)" << std::endl;
+    stream << "  vertices:  " << before.vertexCount << " -> " << after.vertexCount << std::endl;
+    stream << "  ACMR:      " << before.vertexCache.acmr << " -> " << after.vertexCache.acmr << std::endl;
+    stream << "  ATVR:      " << before.vertexCache.atvr << " -> " << after.vertexCache.atvr << std::endl;
+    stream << "  overfetch: " << before.vertexFetch.overfetch << " -> " << after.vertexFetch.overfetch << std::endl;
+    stream.flags(flags);
+    return stream;
+}
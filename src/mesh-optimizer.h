@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+/**
+ * How well an index buffer uses the post-transform vertex cache, measured
+ * by replaying it through a FIFO cache like the ones found on GPUs.
+ */
+struct VertexCacheStatistics
+{
+    // Vertex shader invocations
+    size_t transformedVertexCount = 0;
+    // Average cache miss ratio: invocations per triangle, from 0.5 (best
+    // case on a regular grid) to 3 (no reuse at all)
+    double acmr = 0.0;
+    // Average transform to vertex ratio: invocations per vertex, 1 is best
+    double atvr = 0.0;
+};
+
+/**
+ * How much memory the vertex fetch stage reads, measured by replaying the
+ * index buffer through a small direct-mapped cache of memory lines.
+ */
+struct VertexFetchStatistics
+{
+    size_t bytesFetched = 0;
+    // Bytes fetched over the size of the vertex buffer, 1 is best
+    double overfetch = 0.0;
+};
+
+struct MeshStatistics
+{
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    VertexCacheStatistics vertexCache;
+    VertexFetchStatistics vertexFetch;
+};
+
+struct MeshOptimizationReport
+{
+    MeshStatistics before;
+    MeshStatistics after;
+};
+
+std::ostream &operator<<(std::ostream &stream, const MeshOptimizationReport &report);
+
+/**
+ * Whether every index refers to one of the `vertexCount` vertices. The
+ * functions below index per-vertex arrays with the indices and expect
+ * this to hold; optimizeMesh() checks it.
+ */
+bool indicesInRange(const std::vector<uint32_t> &indexData, size_t vertexCount);
+
+constexpr uint32_t DefaultVertexCacheSize = 16;
+constexpr size_t DefaultFetchCacheLineSize = 64;
+constexpr size_t DefaultFetchCacheLineCount = 256;
+
+VertexCacheStatistics analyzeVertexCache(
+    const std::vector<uint32_t> &indexData,
+    size_t vertexCount,
+    uint32_t cacheSize = DefaultVertexCacheSize);
+
+VertexFetchStatistics analyzeVertexFetch(
+    const std::vector<uint32_t> &indexData,
+    size_t vertexCount,
+    size_t vertexSize,
+    size_t cacheLineSize = DefaultFetchCacheLineSize,
+    size_t cacheLineCount = DefaultFetchCacheLineCount);
+
+MeshStatistics analyzeMesh(
+    const std::vector<float> &pointData,
+    const std::vector<uint32_t> &indexData,
+    int floatsPerVertex);
+
+/**
+ * Merge vertices whose attributes are bitwise identical, and rewrite the
+ * indices accordingly. Returns the new vertex count.
+ */
+size_t weldVertices(
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int floatsPerVertex);
+
+/**
+ * Reorder triangles so that consecutive triangles share vertices, using Tom
+ * Forsyth's linear-speed vertex cache optimization. Only the order of the
+ * triangles changes, never their winding.
+ */
+void optimizeVertexCache(std::vector<uint32_t> &indexData, size_t vertexCount);
+
+/**
+ * Renumber vertices in the order the index buffer first uses them, so that
+ * vertex fetch walks the vertex buffer mostly forward. Vertices that no
+ * triangle uses are dropped. Returns the new vertex count.
+ */
+size_t optimizeVertexFetch(
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int floatsPerVertex);
+
+/**
+ * Run the three stages above in order (welding, triangle order, vertex
+ * order) and measure the mesh before and after. Returns false, leaving the
+ * mesh untouched, if an index is out of range.
+ */
+bool optimizeMesh(
+    std::vector<float> &pointData,
+    std::vector<uint32_t> &indexData,
+    int floatsPerVertex,
+    MeshOptimizationReport &report);
@@ -0,0 +1,528 @@
+#include "pipeline-cache.h"
+
+#include "hash.h"
+#include "webgpu-release.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+using namespace wgpu;
+
+namespace
+{
+    /**
+     * Appends the fields of a descriptor to a key. Every variable-length
+     * part is preceded by its length, and every nullable part by whether it
+     * is there, so that two different descriptors never give the same
+     * words.
+     */
+    class KeyWriter
+    {
+    public:
+        KeyWriter(std::vector<uint64_t> &words, bool &cacheable) : m_words(words), m_cacheable(cacheable) {}
+
+        void add(uint64_t value) { m_words.push_back(value); }
+
+        void addFloat(double value)
+        {
+            // By bits: -0 and 0 are different descriptors as far as we know
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            add(bits);
+        }
+
+        void addHandle(const void *handle) { add(reinterpret_cast<uintptr_t>(handle)); }
+
+        void addString(const char *string)
+        {
+            if (!string)
+            {
+                add(~uint64_t(0));
+                return;
+            }
+            size_t length = std::strlen(string);
+            add(length);
+            for (size_t i = 0; i < length; i += 8)
+            {
+                uint64_t word = 0;
+                std::memcpy(&word, string + i, std::min<size_t>(8, length - i));
+                add(word);
+            }
+        }
+
+        bool addPresence(const void *pointer)
+        {
+            add(pointer ? 1 : 0);
+            return pointer != nullptr;
+        }
+
+        /**
+         * Extensions can hold anything, we do not try to key them.
+         */
+        void addChain(const WGPUChainedStruct *chain)
+        {
+            if (chain)
+            {
+                m_cacheable = false;
+            }
+        }
+
+        /**
+         * Constants are a set, keyed in the order of their names so that
+         * the same values given in another order share a pipeline.
+         */
+        void addConstants(uint32_t count, const WGPUConstantEntry *constants)
+        {
+            std::vector<const WGPUConstantEntry *> sorted;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                sorted.push_back(&constants[i]);
+            }
+            std::sort(sorted.begin(), sorted.end(), [](const WGPUConstantEntry *a, const WGPUConstantEntry *b)
+                      { return std::strcmp(a->key ? a->key : "", b->key ? b->key : "") < 0; });
+            add(count);
+            for (const WGPUConstantEntry *constant : sorted)
+            {
+                addChain(constant->nextInChain);
+                addString(constant->key);
+                addFloat(constant->value);
+            }
+        }
+
+        void addStencilFace(const WGPUStencilFaceState &face)
+        {
+            add(face.compare);
+            add(face.failOp);
+            add(face.depthFailOp);
+            add(face.passOp);
+        }
+
+        void addBlendComponent(const WGPUBlendComponent &component)
+        {
+            add(component.operation);
+            add(component.srcFactor);
+            add(component.dstFactor);
+        }
+
+    private:
+        std::vector<uint64_t> &m_words;
+        bool &m_cacheable;
+    };
+
+    void releaseObject(BindGroupLayout layout) { wgpuBindGroupLayoutRelease(layout); }
+    void releaseObject(PipelineLayout layout) { wgpuPipelineLayoutRelease(layout); }
+    void releaseObject(RenderPipeline pipeline) { wgpuRenderPipelineRelease(pipeline); }
+} // namespace
+
+size_t PipelineCache::KeyHash::operator()(const Key &key) const
+{
+    return static_cast<size_t>(hashBytes(key.words.data(), key.words.size() * sizeof(uint64_t)));
+}
+
+PipelineCache::PipelineCache(Device device)
+    : m_device(device)
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+    // Asynchronous creations point to us, wait for them to be called
+    // without calling anyone else back
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_destroying = true;
+        m_pendingPipelines.clear();
+    }
+#ifdef WEBGPU_BACKEND_WGPU
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_pendingCount > 0)
+    {
+        // The callbacks take the lock
+        lock.unlock();
+        wgpuDevicePoll(m_device, true, nullptr);
+        lock.lock();
+    }
+    lock.unlock();
+#else
+    // Other backends call back from their own event processing
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pendingDone.wait(lock, [this]()
+                           { return m_pendingCount == 0; });
+    }
+#endif
+
+    // Pipelines before the layouts they were created with
+    for (auto &entry : m_renderPipelines)
+    {
+        releaseObject(entry.second);
+    }
+    for (RenderPipeline pipeline : m_uncachedRenderPipelines)
+    {
+        releaseObject(pipeline);
+    }
+    for (auto &entry : m_pipelineLayouts)
+    {
+        releaseObject(entry.second);
+    }
+    for (PipelineLayout layout : m_uncachedPipelineLayouts)
+    {
+        releaseObject(layout);
+    }
+    for (auto &entry : m_bindGroupLayouts)
+    {
+        releaseObject(entry.second);
+    }
+    for (BindGroupLayout layout : m_uncachedBindGroupLayouts)
+    {
+        releaseObject(layout);
+    }
+}
+
+BindGroupLayout PipelineCache::bindGroupLayout(const BindGroupLayoutDescriptor &descriptor)
+{
+    return lookup(m_bindGroupLayouts, m_uncachedBindGroupLayouts, m_statistics.bindGroupLayouts, makeKey(descriptor),
+                  [&]()
+                  { return m_device.createBindGroupLayout(descriptor); });
+}
+
+PipelineLayout PipelineCache::pipelineLayout(const PipelineLayoutDescriptor &descriptor)
+{
+    return lookup(m_pipelineLayouts, m_uncachedPipelineLayouts, m_statistics.pipelineLayouts, makeKey(descriptor),
+                  [&]()
+                  { return m_device.createPipelineLayout(descriptor); });
+}
+
+RenderPipeline PipelineCache::renderPipeline(const RenderPipelineDescriptor &descriptor)
+{
+    return lookup(m_renderPipelines, m_uncachedRenderPipelines, m_statistics.renderPipelines, makeKey(descriptor),
+                  [&]()
+                  { return m_device.createRenderPipeline(descriptor); },
+                  &m_renderPipelineReferences);
+}
+
+void PipelineCache::renderPipelineAsync(const RenderPipelineDescriptor &descriptor, RenderPipelineCallback callback)
+{
+    Key key = makeKey(descriptor);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (key.cacheable)
+    {
+        auto it = m_renderPipelines.find(key);
+        if (it != m_renderPipelines.end())
+        {
+            ++m_statistics.renderPipelines.hits;
+            RenderPipeline pipeline = it->second;
+            ++m_renderPipelineReferences[pipeline];
+            lock.unlock();
+            callback(pipeline, nullptr);
+            return;
+        }
+        auto pending = m_pendingPipelines.find(key);
+        if (pending != m_pendingPipelines.end())
+        {
+            ++m_statistics.renderPipelines.hits;
+            pending->second.callbacks.push_back(std::move(callback));
+            return;
+        }
+        m_pendingPipelines[key].callbacks.push_back(std::move(callback));
+        callback = nullptr;
+    }
+    ++m_statistics.renderPipelines.misses;
+    ++m_pendingCount;
+    // Some implementations call back before returning, which takes the lock
+    lock.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+#if defined(WEBGPU_BACKEND_WGPU) && !defined(WEBGPU_BACKEND_MOCK)
+    // wgpu-native before 0.19 (the one in libs/webgpu) does not implement
+    // createRenderPipelineAsync and aborts. Create the pipeline on this
+    // thread instead, its errors go to the uncaptured error callback.
+    RenderPipeline pipeline = m_device.createRenderPipeline(descriptor);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    {
+        std::lock_guard<std::mutex> creationLock(m_mutex);
+        m_statistics.renderPipelines.creationSeconds += seconds;
+    }
+    finishAsync(key, pipeline, "createRenderPipeline failed", callback);
+#else
+    auto handle = m_device.createRenderPipelineAsync(
+        descriptor,
+        [this, key, callback](CreatePipelineAsyncStatus status, RenderPipeline pipeline, const char *message)
+        { finishAsync(key, status == CreatePipelineAsyncStatus::Success ? pipeline : nullptr, message, callback); });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    lock.lock();
+    m_statistics.renderPipelines.creationSeconds += seconds;
+    m_asyncCallbacks.push_back(std::move(handle));
+#endif
+}
+
+void PipelineCache::release(RenderPipeline pipeline)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto references = m_renderPipelineReferences.find(pipeline);
+    if (references == m_renderPipelineReferences.end() || --references->second > 0)
+    {
+        return;
+    }
+    m_renderPipelineReferences.erase(references);
+    WGPURenderPipeline handle = pipeline;
+    auto isPipeline = [handle](RenderPipeline other)
+    { return static_cast<WGPURenderPipeline>(other) == handle; };
+    for (auto it = m_renderPipelines.begin(); it != m_renderPipelines.end(); ++it)
+    {
+        if (isPipeline(it->second))
+        {
+            m_renderPipelines.erase(it);
+            break;
+        }
+    }
+    m_uncachedRenderPipelines.erase(std::remove_if(m_uncachedRenderPipelines.begin(), m_uncachedRenderPipelines.end(), isPipeline),
+                                    m_uncachedRenderPipelines.end());
+    releaseObject(pipeline);
+}
+
+PipelineCacheStatistics PipelineCache::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+void PipelineCache::resetStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_statistics = {};
+}
+
+size_t PipelineCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bindGroupLayouts.size() + m_pipelineLayouts.size() + m_renderPipelines.size() +
+           m_uncachedBindGroupLayouts.size() + m_uncachedPipelineLayouts.size() + m_uncachedRenderPipelines.size();
+}
+
+void PipelineCache::finishAsync(const Key &key, RenderPipeline pipeline, const char *message,
+                                const RenderPipelineCallback &uncachedCallback)
+{
+    std::vector<RenderPipelineCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pendingCount == 0)
+        {
+            m_pendingDone.notify_all();
+        }
+        if (m_destroying)
+        {
+            if (pipeline)
+            {
+                releaseObject(pipeline);
+            }
+            return;
+        }
+        if (key.cacheable)
+        {
+            auto it = m_pendingPipelines.find(key);
+            callbacks = std::move(it->second.callbacks);
+            m_pendingPipelines.erase(it);
+            if (pipeline)
+            {
+                m_renderPipelines.emplace(key, pipeline);
+            }
+        }
+        else
+        {
+            if (pipeline)
+            {
+                ++m_statistics.uncacheable;
+                m_uncachedRenderPipelines.push_back(pipeline);
+            }
+            callbacks.push_back(uncachedCallback);
+        }
+        if (pipeline)
+        {
+            m_renderPipelineReferences[pipeline] += static_cast<uint32_t>(callbacks.size());
+        }
+    }
+    // Outside of the lock, callbacks may ask us for more
+    for (const RenderPipelineCallback &callback : callbacks)
+    {
+        callback(pipeline, pipeline ? nullptr : message);
+    }
+}
+
+template <typename Handle, typename Create>
+Handle PipelineCache::lookup(std::unordered_map<Key, Handle, KeyHash> &map, std::vector<Handle> &uncached,
+                             PipelineCacheCounters &counters, Key key, Create &&create,
+                             std::unordered_map<typename Handle::W, uint32_t> *references)
+{
+    // Creation stays under the lock, so that two threads asking for the
+    // same object do not both create it
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (key.cacheable)
+    {
+        auto it = map.find(key);
+        if (it != map.end())
+        {
+            ++counters.hits;
+            if (references)
+            {
+                ++(*references)[it->second];
+            }
+            return it->second;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Handle handle = create();
+    counters.creationSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ++counters.misses;
+    if (!handle)
+    {
+        // Not cached, the next request tries again
+        return handle;
+    }
+    if (key.cacheable)
+    {
+        map.emplace(std::move(key), handle);
+    }
+    else
+    {
+        ++m_statistics.uncacheable;
+        uncached.push_back(handle);
+    }
+    if (references)
+    {
+        ++(*references)[handle];
+    }
+    return handle;
+}
+
+PipelineCache::Key PipelineCache::makeKey(const WGPUBindGroupLayoutDescriptor &descriptor)
+{
+    Key key;
+    KeyWriter writer(key.words, key.cacheable);
+    writer.addChain(descriptor.nextInChain);
+    writer.add(descriptor.entryCount);
+    for (uint32_t i = 0; i < descriptor.entryCount; ++i)
+    {
+        const WGPUBindGroupLayoutEntry &entry = descriptor.entries[i];
+        writer.addChain(entry.nextInChain);
+        writer.add(entry.binding);
+        writer.add(entry.visibility);
+
+        writer.addChain(entry.buffer.nextInChain);
+        writer.add(entry.buffer.type);
+        writer.add(entry.buffer.hasDynamicOffset);
+        writer.add(entry.buffer.minBindingSize);
+
+        writer.addChain(entry.sampler.nextInChain);
+        writer.add(entry.sampler.type);
+
+        writer.addChain(entry.texture.nextInChain);
+        writer.add(entry.texture.sampleType);
+        writer.add(entry.texture.viewDimension);
+        writer.add(entry.texture.multisampled);
+
+        writer.addChain(entry.storageTexture.nextInChain);
+        writer.add(entry.storageTexture.access);
+        writer.add(entry.storageTexture.format);
+        writer.add(entry.storageTexture.viewDimension);
+    }
+    return key;
+}
+
+PipelineCache::Key PipelineCache::makeKey(const WGPUPipelineLayoutDescriptor &descriptor)
+{
+    Key key;
+    KeyWriter writer(key.words, key.cacheable);
+    writer.addChain(descriptor.nextInChain);
+    writer.add(descriptor.bindGroupLayoutCount);
+    for (uint32_t i = 0; i < descriptor.bindGroupLayoutCount; ++i)
+    {
+        writer.addHandle(descriptor.bindGroupLayouts[i]);
+    }
+    return key;
+}
+
+PipelineCache::Key PipelineCache::makeKey(const WGPURenderPipelineDescriptor &descriptor)
+{
+    Key key;
+    KeyWriter writer(key.words, key.cacheable);
+    writer.addChain(descriptor.nextInChain);
+    // A null layout asks for one derived from the shaders
+    writer.addHandle(descriptor.layout);
+
+    const WGPUVertexState &vertex = descriptor.vertex;
+    writer.addChain(vertex.nextInChain);
+    writer.addHandle(vertex.module);
+    writer.addString(vertex.entryPoint);
+    writer.addConstants(vertex.constantCount, vertex.constants);
+    writer.add(vertex.bufferCount);
+    for (uint32_t i = 0; i < vertex.bufferCount; ++i)
+    {
+        const WGPUVertexBufferLayout &buffer = vertex.buffers[i];
+        writer.add(buffer.arrayStride);
+        writer.add(buffer.stepMode);
+        writer.add(buffer.attributeCount);
+        for (uint32_t j = 0; j < buffer.attributeCount; ++j)
+        {
+            writer.add(buffer.attributes[j].format);
+            writer.add(buffer.attributes[j].offset);
+            writer.add(buffer.attributes[j].shaderLocation);
+        }
+    }
+
+    const WGPUPrimitiveState &primitive = descriptor.primitive;
+    writer.addChain(primitive.nextInChain);
+    writer.add(primitive.topology);
+    writer.add(primitive.stripIndexFormat);
+    writer.add(primitive.frontFace);
+    writer.add(primitive.cullMode);
+
+    if (writer.addPresence(descriptor.depthStencil))
+    {
+        const WGPUDepthStencilState &depthStencil = *descriptor.depthStencil;
+        writer.addChain(depthStencil.nextInChain);
+        writer.add(depthStencil.format);
+        writer.add(depthStencil.depthWriteEnabled);
+        writer.add(depthStencil.depthCompare);
+        writer.addStencilFace(depthStencil.stencilFront);
+        writer.addStencilFace(depthStencil.stencilBack);
+        writer.add(depthStencil.stencilReadMask);
+        writer.add(depthStencil.stencilWriteMask);
+        writer.add(static_cast<uint32_t>(depthStencil.depthBias));
+        writer.addFloat(depthStencil.depthBiasSlopeScale);
+        writer.addFloat(depthStencil.depthBiasClamp);
+    }
+
+    const WGPUMultisampleState &multisample = descriptor.multisample;
+    writer.addChain(multisample.nextInChain);
+    writer.add(multisample.count);
+    writer.add(multisample.mask);
+    writer.add(multisample.alphaToCoverageEnabled);
+
+    if (writer.addPresence(descriptor.fragment))
+    {
+        const WGPUFragmentState &fragment = *descriptor.fragment;
+        writer.addChain(fragment.nextInChain);
+        writer.addHandle(fragment.module);
+        writer.addString(fragment.entryPoint);
+        writer.addConstants(fragment.constantCount, fragment.constants);
+        writer.add(fragment.targetCount);
+        for (uint32_t i = 0; i < fragment.targetCount; ++i)
+        {
+            const WGPUColorTargetState &target = fragment.targets[i];
+            writer.addChain(target.nextInChain);
+            writer.add(target.format);
+            writer.add(target.writeMask);
+            if (writer.addPresence(target.blend))
+            {
+                writer.addBlendComponent(target.blend->color);
+                writer.addBlendComponent(target.blend->alpha);
+            }
+        }
+    }
+    return key;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <webgpu/webgpu.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct PipelineCacheCounters
+{
+    // Requests answered with an existing object
+    uint64_t hits = 0;
+    // Requests that created an object
+    uint64_t misses = 0;
+    // Time spent in the device's create functions on misses
+    double creationSeconds = 0.0;
+};
+
+struct PipelineCacheStatistics
+{
+    PipelineCacheCounters bindGroupLayouts;
+    PipelineCacheCounters pipelineLayouts;
+    PipelineCacheCounters renderPipelines;
+    // Descriptors with a nextInChain extension, which are not keyed and
+    // always create a new object (counted as misses too)
+    uint64_t uncacheable = 0;
+};
+
+/**
+ * Called with the pipeline, or with null and the device's message when its
+ * creation failed.
+ */
+using RenderPipelineCallback = std::function<void(wgpu::RenderPipeline pipeline, const char *message)>;
+
+/**
+ * Deduplicates the creation of bind group layouts, pipeline layouts and
+ * render pipelines. Each descriptor is turned into a key covering all of
+ * its state (vertex layout, primitive, depth-stencil, multisample, blend,
+ * color targets, entry points, override constants) and the identity of the
+ * objects it refers to (shader modules, layouts), and requesting an
+ * equivalent descriptor again returns the object created the first time.
+ *
+ * Labels are not part of the key: an object keeps the label it was created
+ * with. Objects referred to by a descriptor are keyed by handle, so a shader
+ * module or layout must not be released while the cache may still match
+ * descriptors using it (layouts from this cache live as long as the cache).
+ *
+ * The cache owns everything it hands out, and releases it when destroyed,
+ * which must happen before the device is released. Render pipelines that
+ * are no longer needed, e.g. replaced by a shader reload, can be handed
+ * back with release() before that. It can be used from
+ * several threads, and asynchronous creations call back from whichever
+ * thread polls the device.
+ */
+class PipelineCache
+{
+public:
+    explicit PipelineCache(wgpu::Device device);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache &) = delete;
+    PipelineCache &operator=(const PipelineCache &) = delete;
+
+    wgpu::BindGroupLayout bindGroupLayout(const wgpu::BindGroupLayoutDescriptor &descriptor);
+    wgpu::PipelineLayout pipelineLayout(const wgpu::PipelineLayoutDescriptor &descriptor);
+    wgpu::RenderPipeline renderPipeline(const wgpu::RenderPipelineDescriptor &descriptor);
+
+    /**
+     * The same with createRenderPipelineAsync, which does not block on
+     * shader compilation. `callback` is called right away on a hit, and
+     * otherwise once the device is polled after the pipeline is ready.
+     * With wgpu-native before 0.19, which has no asynchronous creation,
+     * the pipeline is created right away instead, on the calling thread.
+     * Requests for a pipeline that is already being created share that
+     * creation. A failed creation is not cached.
+     */
+    void renderPipelineAsync(const wgpu::RenderPipelineDescriptor &descriptor, RenderPipelineCallback callback);
+
+    /**
+     * Hand back a render pipeline obtained from renderPipeline() or
+     * renderPipelineAsync(). Once every request that returned it has
+     * released it, it leaves the cache and is released. Requests that never
+     * release (most of them) keep it for the lifetime of the cache.
+     */
+    void release(wgpu::RenderPipeline pipeline);
+
+    PipelineCacheStatistics statistics() const;
+    void resetStatistics();
+
+    /**
+     * Number of distinct objects created so far, of all types.
+     */
+    size_t size() const;
+
+private:
+    /**
+     * A descriptor flattened into 64-bit words, compared as a whole so that
+     * hash collisions cannot return the wrong object.
+     */
+    struct Key
+    {
+        std::vector<uint64_t> words;
+        // False when the descriptor had an extension we cannot key
+        bool cacheable = true;
+
+        bool operator==(const Key &other) const { return words == other.words; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const;
+    };
+
+    static Key makeKey(const WGPUBindGroupLayoutDescriptor &descriptor);
+    static Key makeKey(const WGPUPipelineLayoutDescriptor &descriptor);
+    static Key makeKey(const WGPURenderPipelineDescriptor &descriptor);
+
+    struct PendingPipeline
+    {
+        std::vector<RenderPipelineCallback> callbacks;
+    };
+
+    void finishAsync(const Key &key, wgpu::RenderPipeline pipeline, const char *message,
+                     const RenderPipelineCallback &uncachedCallback);
+
+    /**
+     * Find or create an object. When `references` is given, counts the
+     * object returned in it, see release().
+     */
+    template <typename Handle, typename Create>
+    Handle lookup(std::unordered_map<Key, Handle, KeyHash> &map, std::vector<Handle> &uncached,
+                  PipelineCacheCounters &counters, Key key, Create &&create,
+                  std::unordered_map<typename Handle::W, uint32_t> *references = nullptr);
+
+    wgpu::Device m_device;
+    mutable std::mutex m_mutex;
+    std::unordered_map<Key, wgpu::BindGroupLayout, KeyHash> m_bindGroupLayouts;
+    std::unordered_map<Key, wgpu::PipelineLayout, KeyHash> m_pipelineLayouts;
+    std::unordered_map<Key, wgpu::RenderPipeline, KeyHash> m_renderPipelines;
+    std::unordered_map<Key, PendingPipeline, KeyHash> m_pendingPipelines;
+    // Kept alive until the device calls them back, and then until we are
+    // destroyed since they may still be running when they call us
+    std::vector<std::unique_ptr<wgpu::CreateRenderPipelineAsyncCallback>> m_asyncCallbacks;
+    // Creations the device has not called back yet, notified when none are
+    // left
+    size_t m_pendingCount = 0;
+    std::condition_variable m_pendingDone;
+    bool m_destroying = false;
+    // Objects created from uncacheable descriptors, released with the rest
+    std::vector<wgpu::BindGroupLayout> m_uncachedBindGroupLayouts;
+    std::vector<wgpu::PipelineLayout> m_uncachedPipelineLayouts;
+    std::vector<wgpu::RenderPipeline> m_uncachedRenderPipelines;
+    // Requests that returned each render pipeline, see release()
+    std::unordered_map<WGPURenderPipeline, uint32_t> m_renderPipelineReferences;
+    PipelineCacheStatistics m_statistics;
+};
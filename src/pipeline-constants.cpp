@@ -0,0 +1,57 @@
+#include "pipeline-constants.h"
+
+#include <iomanip>
+#include <limits>
+#include <locale>
+#include <sstream>
+
+bool PipelineConstants::supported()
+{
+#if defined(WEBGPU_BACKEND_WGPU) && !defined(WEBGPU_BACKEND_MOCK)
+    return false;
+#else
+    return true;
+#endif
+}
+
+PipelineConstants &PipelineConstants::set(const std::string &name, double value)
+{
+    m_values[name] = value;
+    m_entries.clear();
+    for (const auto &constant : m_values)
+    {
+        WGPUConstantEntry entry = {};
+        entry.key = constant.first.c_str();
+        entry.value = constant.second;
+        m_entries.push_back(entry);
+    }
+    return *this;
+}
+
+std::string PipelineConstants::literal(const std::string &name) const
+{
+    auto value = m_values.find(name);
+    if (value == m_values.end())
+    {
+        return "";
+    }
+    // Enough digits to round-trip the f32, and always a decimal point or an
+    // exponent so that WGSL does not take it for an integer
+    std::ostringstream literal;
+    literal.imbue(std::locale::classic());
+    literal << std::showpoint << std::setprecision(std::numeric_limits<float>::max_digits10)
+            << static_cast<float>(value->second);
+    return literal.str();
+}
+
+void PipelineConstants::apply(WGPUVertexState &stage) const
+{
+    stage.constantCount = supported() ? count() : 0;
+    stage.constants = supported() ? entries() : nullptr;
+}
+
+void PipelineConstants::apply(WGPUFragmentState &stage) const
+{
+    stage.constantCount = supported() ? count() : 0;
+    stage.constants = supported() ? entries() : nullptr;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <webgpu/webgpu.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Values for the `override` declarations of a shader, which the pipeline
+ * specializes the shader with, e.g.
+ *
+ *     override aspectRatio: f32 = 1.0;
+ *
+ * in WGSL, and set("aspectRatio", 640.0 / 480.0) here. They are folded when
+ * the pipeline compiles, like constants, but without a new shader module:
+ * each set of values is a pipeline of its own, which the pipeline cache
+ * shares between equal sets.
+ *
+ * The entries handed to the descriptors point into this object, it must
+ * outlive the descriptors and the pipelines' creation.
+ *
+ * Where the backend cannot parse overrides (see supported()), shaders
+ * declare constants instead, defined by the preprocessor to literal() of
+ * the values, and apply() leaves the stages without constants.
+ */
+class PipelineConstants
+{
+public:
+    PipelineConstants() = default;
+
+    PipelineConstants(const PipelineConstants &) = delete;
+    PipelineConstants &operator=(const PipelineConstants &) = delete;
+
+    /**
+     * Whether the backend specializes overrides. The naga of wgpu-native
+     * before 0.19, the one in libs/webgpu, rejects their declarations.
+     */
+    static bool supported();
+
+    /**
+     * `name` is the name of an override of the shader, or its @id.
+     */
+    PipelineConstants &set(const std::string &name, double value);
+
+    uint32_t count() const { return static_cast<uint32_t>(m_entries.size()); }
+
+    /**
+     * The value of `name` as a WGSL f32 literal, e.g. "1.33333337", or an
+     * empty string if it was not set.
+     */
+    std::string literal(const std::string &name) const;
+
+    /**
+     * Set the constants of a stage. The same constants can go to both
+     * stages of a pipeline when they share a module. None if overrides are
+     * not supported().
+     */
+    void apply(WGPUVertexState &stage) const;
+    void apply(WGPUFragmentState &stage) const;
+
+private:
+    const WGPUConstantEntry *entries() const { return m_entries.empty() ? nullptr : m_entries.data(); }
+
+    // Ordered by name, entries point to its keys
+    std::map<std::string, double> m_values;
+    std::vector<WGPUConstantEntry> m_entries;
+};
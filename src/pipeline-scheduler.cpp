@@ -0,0 +1,148 @@
+#include "pipeline-scheduler.h"
+
+#include "pipeline-cache.h"
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using namespace wgpu;
+
+struct PipelineScheduler::State
+{
+    struct Variant
+    {
+        PipelineVariantStatus status;
+        RenderPipeline pipeline = nullptr;
+        uint32_t fallback = NoFallback;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Variant> variants;
+    uint32_t compilingCount = 0;
+};
+
+PipelineScheduler::PipelineScheduler(PipelineCache &cache)
+    : m_cache(cache), m_state(std::make_shared<State>())
+{
+}
+
+PipelineScheduler::~PipelineScheduler() = default;
+
+uint32_t PipelineScheduler::add(const std::string &name, const RenderPipelineDescriptor &descriptor, uint32_t fallback)
+{
+    uint32_t variant;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        variant = static_cast<uint32_t>(m_state->variants.size());
+        State::Variant &entry = m_state->variants.emplace_back();
+        entry.status.name = name;
+        entry.fallback = fallback < variant ? fallback : NoFallback;
+        entry.start = std::chrono::steady_clock::now();
+        ++m_state->compilingCount;
+    }
+
+    // May call back right away, on a cache hit
+    std::shared_ptr<State> state = m_state;
+    m_cache.renderPipelineAsync(
+        descriptor,
+        [state, variant, cache = &m_cache](RenderPipeline pipeline, const char *message)
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            State::Variant &entry = state->variants[variant];
+            if (entry.status.state != PipelineVariantState::Compiling)
+            {
+                // Replaced in the meantime, hand our reference back (the
+                // cache calls us, so it is still there)
+                lock.unlock();
+                if (pipeline)
+                {
+                    cache->release(pipeline);
+                }
+                return;
+            }
+            entry.pipeline = pipeline;
+            entry.status.latencySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - entry.start).count();
+            entry.status.state = pipeline ? PipelineVariantState::Ready : PipelineVariantState::Failed;
+            entry.status.message = message ? message : "";
+            --state->compilingCount;
+        });
+    return variant;
+}
+
+RenderPipeline PipelineScheduler::pipeline(uint32_t variant) const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    while (variant < m_state->variants.size())
+    {
+        const State::Variant &entry = m_state->variants[variant];
+        if (entry.pipeline)
+        {
+            return entry.pipeline;
+        }
+        variant = entry.fallback;
+    }
+    return nullptr;
+}
+
+void PipelineScheduler::replace(uint32_t variant, RenderPipeline pipeline)
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    State::Variant &entry = m_state->variants[variant];
+    if (entry.status.state == PipelineVariantState::Compiling)
+    {
+        --m_state->compilingCount;
+    }
+    entry.pipeline = pipeline;
+    entry.status.state = PipelineVariantState::Ready;
+    entry.status.message.clear();
+}
+
+bool PipelineScheduler::settled(uint32_t variant) const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->variants[variant].status.state != PipelineVariantState::Compiling;
+}
+
+bool PipelineScheduler::allSettled() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->compilingCount == 0;
+}
+
+PipelineVariantStatus PipelineScheduler::status(uint32_t variant) const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->variants[variant].status;
+}
+
+uint32_t PipelineScheduler::variantCount() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return static_cast<uint32_t>(m_state->variants.size());
+}
+
+void PipelineScheduler::printReport(std::ostream &out) const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    for (const State::Variant &entry : m_state->variants)
+    {
+        const PipelineVariantStatus &status = entry.status;
+        out << "Pipeline " << status.name << ": ";
+        switch (status.state)
+        {
+        case PipelineVariantState::Compiling:
+            out << "compiling for "
+                << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entry.start).count() << " ms";
+            break;
+        case PipelineVariantState::Ready:
+            out << "compiled in " << status.latencySeconds * 1000.0 << " ms";
+            break;
+        case PipelineVariantState::Failed:
+            out << "failed after " << status.latencySeconds * 1000.0 << " ms (" << status.message << ")";
+            break;
+        }
+        out << std::endl;
+    }
+}
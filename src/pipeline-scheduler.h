@@ -0,0 +1,96 @@
+#pragma once
+
+#include <webgpu/webgpu.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+class PipelineCache;
+
+enum class PipelineVariantState
+{
+    Compiling,
+    Ready,
+    Failed,
+};
+
+struct PipelineVariantStatus
+{
+    std::string name;
+    PipelineVariantState state = PipelineVariantState::Compiling;
+    // From add() to the device calling back
+    double latencySeconds = 0.0;
+    // The device's error when the compilation failed
+    std::string message;
+};
+
+/**
+ * Compiles the render pipeline variants of the application in the
+ * background, so that startup does not wait for shader compilation.
+ *
+ * Each variant starts compiling with createRenderPipelineAsync as soon as
+ * it is added, through the pipeline cache (so variants with the same state
+ * share one compilation). Frames ask for the pipeline of a variant every
+ * time they draw with it: until it is ready they get its fallback, a
+ * variant added earlier (e.g. a generic version of a specialized
+ * pipeline), or null, in which case they skip the draws.
+ *
+ * Compilations complete when the device is polled. Callbacks may run after
+ * the scheduler is gone, they only keep its state alive.
+ */
+class PipelineScheduler
+{
+public:
+    static constexpr uint32_t NoFallback = ~uint32_t(0);
+
+    explicit PipelineScheduler(PipelineCache &cache);
+    ~PipelineScheduler();
+
+    PipelineScheduler(const PipelineScheduler &) = delete;
+    PipelineScheduler &operator=(const PipelineScheduler &) = delete;
+
+    /**
+     * Start compiling a variant, and return its index. `fallback` must be
+     * an earlier variant.
+     */
+    uint32_t add(const std::string &name, const wgpu::RenderPipelineDescriptor &descriptor, uint32_t fallback = NoFallback);
+
+    /**
+     * The pipeline to draw `variant` with right now: its own once compiled,
+     * otherwise the first ready one along its fallbacks, or null.
+     */
+    wgpu::RenderPipeline pipeline(uint32_t variant) const;
+
+    /**
+     * Draw `variant` with `pipeline` from now on, e.g. one rebuilt from a
+     * reloaded shader. The variant is ready, and its compilation, if still
+     * running, is ignored.
+     */
+    void replace(uint32_t variant, wgpu::RenderPipeline pipeline);
+
+    /**
+     * Whether `variant` has compiled, successfully or not.
+     */
+    bool settled(uint32_t variant) const;
+
+    /**
+     * Whether all variants have.
+     */
+    bool allSettled() const;
+
+    PipelineVariantStatus status(uint32_t variant) const;
+    uint32_t variantCount() const;
+
+    /**
+     * One line per variant, with its state and compilation latency.
+     */
+    void printReport(std::ostream &out) const;
+
+private:
+    struct State;
+
+    PipelineCache &m_cache;
+    std::shared_ptr<State> m_state;
+};
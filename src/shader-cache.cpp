@@ -0,0 +1,682 @@
+#include "shader-cache.h"
+
+#include "hash.h"
+#include "webgpu-release.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace wgpu;
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr char ReferenceMagic[8] = {'W', 'G', 'S', 'L', 'R', 'E', 'F', '\0'};
+    constexpr char EntryMagic[8] = {'W', 'G', 'S', 'L', 'O', 'B', 'J', '\0'};
+    // Bump when the format of the files, or what goes in the final source,
+    // changes
+    constexpr uint32_t ShaderCacheVersion = 2;
+
+    const char *const ReferenceExtension = ".ref";
+    const char *const EntryExtension = ".wgsl";
+
+    long long processId()
+    {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return getpid();
+#endif
+    }
+
+    /**
+     * Appends fixed-size values and length-prefixed strings.
+     */
+    class Writer
+    {
+    public:
+        void bytes(const void *data, size_t size) { m_data.append(static_cast<const char *>(data), size); }
+
+        template <typename T>
+        void value(T v) { bytes(&v, sizeof(v)); }
+
+        void string(const std::string &s)
+        {
+            value(static_cast<uint64_t>(s.size()));
+            bytes(s.data(), s.size());
+        }
+
+        const std::string &data() const { return m_data; }
+
+    private:
+        std::string m_data;
+    };
+
+    /**
+     * Reads what Writer wrote, and fails rather than reading past the end.
+     */
+    class Reader
+    {
+    public:
+        explicit Reader(const std::string &data) : m_data(data) {}
+
+        bool bytes(void *out, size_t size)
+        {
+            if (size > m_data.size() - m_position)
+            {
+                return false;
+            }
+            std::memcpy(out, m_data.data() + m_position, size);
+            m_position += size;
+            return true;
+        }
+
+        template <typename T>
+        bool value(T &v) { return bytes(&v, sizeof(v)); }
+
+        bool string(std::string &s)
+        {
+            uint64_t size;
+            if (!value(size) || size > m_data.size() - m_position)
+            {
+                return false;
+            }
+            s.assign(m_data.data() + m_position, size);
+            m_position += size;
+            return true;
+        }
+
+        bool magic(const char (&expected)[8])
+        {
+            char magic[8];
+            uint32_t version;
+            return bytes(magic, sizeof(magic)) && std::memcmp(magic, expected, sizeof(magic)) == 0 &&
+                   value(version) && version == ShaderCacheVersion;
+        }
+
+    private:
+        const std::string &m_data;
+        size_t m_position = 0;
+    };
+
+    bool readFile(const fs::path &path, std::string &data)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        file.seekg(0, std::ios::end);
+        std::streamoff size = file.tellg();
+        if (size < 0)
+        {
+            return false;
+        }
+        data.resize(static_cast<size_t>(size));
+        file.seekg(0);
+        return static_cast<bool>(file.read(data.data(), size));
+    }
+
+    /**
+     * The size and time of a file, to notice it changed without reading it.
+     */
+    bool stamp(const fs::path &path, uint64_t &size, int64_t &modificationTime)
+    {
+        std::error_code ec;
+        size = fs::file_size(path, ec);
+        if (ec)
+        {
+            return false;
+        }
+        fs::file_time_type time = fs::last_write_time(path, ec);
+        modificationTime = static_cast<int64_t>(time.time_since_epoch().count());
+        return !ec;
+    }
+
+    ShaderModule createShaderModule(Device device, const std::string &source)
+    {
+        ShaderModuleWGSLDescriptor shaderCodeDesc;
+        shaderCodeDesc.chain.next = nullptr;
+        shaderCodeDesc.chain.sType = SType::ShaderModuleWGSLDescriptor;
+        ShaderModuleDescriptor shaderDesc;
+        shaderDesc.nextInChain = &shaderCodeDesc.chain;
+#ifdef WEBGPU_BACKEND_WGPU
+        shaderDesc.hintCount = 0;
+        shaderDesc.hints = nullptr;
+        shaderCodeDesc.code = source.c_str();
+#else
+        shaderCodeDesc.source = source.c_str();
+#endif
+        return device.createShaderModule(shaderDesc);
+    }
+
+    /**
+     * Create a module and wait for the device's verdict on it. Returns false
+     * when the verdict is not known (the backend did not call back), in
+     * which case the module is assumed valid but nothing should be stored.
+     */
+    bool createValidatedShaderModule(Device device, const std::string &source, ShaderModule &module, bool &valid, std::string &messages)
+    {
+        device.pushErrorScope(ErrorFilter::Validation);
+        module = createShaderModule(device, source);
+        bool called = false;
+        valid = true;
+        auto callback = device.popErrorScope([&](ErrorType type, const char *message)
+                                             {
+            called = true;
+            valid = type == ErrorType::NoError;
+            messages = message && !valid ? message : ""; });
+#ifdef WEBGPU_BACKEND_WGPU
+        while (!called)
+        {
+            wgpuDevicePoll(device, true, nullptr);
+        }
+#endif
+        return called;
+    }
+} // namespace
+
+ShaderCache::ShaderCache(const fs::path &directory, const std::string &adapterIdentity, uint64_t maxBytes)
+    : m_directory(directory), m_adapterIdentity(adapterIdentity), m_maxBytes(maxBytes)
+{
+    if (!m_directory.empty())
+    {
+        std::error_code ec;
+        fs::create_directories(m_directory, ec);
+        if (ec)
+        {
+            std::cerr << "Could not create the shader cache " << m_directory << ": " << ec.message() << std::endl;
+            m_directory.clear();
+        }
+    }
+}
+
+ShaderCache::~ShaderCache()
+{
+    for (auto &entry : m_modules)
+    {
+        wgpuShaderModuleRelease(entry.second.module);
+    }
+}
+
+fs::path ShaderCache::defaultDirectory()
+{
+#ifdef _WIN32
+    const char *base = std::getenv("LOCALAPPDATA");
+    if (base && *base)
+    {
+        return fs::path(base) / "webgpu-cpp" / "shaders";
+    }
+#else
+    const char *base = std::getenv("XDG_CACHE_HOME");
+    if (base && *base)
+    {
+        return fs::path(base) / "webgpu-cpp" / "shaders";
+    }
+    const char *home = std::getenv("HOME");
+    if (home && *home)
+    {
+        return fs::path(home) / ".cache" / "webgpu-cpp" / "shaders";
+    }
+#endif
+    std::error_code ec;
+    return fs::temp_directory_path(ec) / "webgpu-cpp-shaders";
+}
+
+std::string ShaderCache::adapterIdentity(Adapter adapter)
+{
+    AdapterProperties properties = {};
+    adapter.getProperties(&properties);
+    std::ostringstream identity;
+#ifdef WEBGPU_BACKEND_WGPU
+    identity << "wgpu";
+#else
+    identity << "dawn";
+#endif
+    identity << ";" << properties.backendType << ";" << properties.vendorID << ";" << properties.deviceID
+             << ";" << (properties.name ? properties.name : "")
+             << ";" << (properties.driverDescription ? properties.driverDescription : "");
+    return identity.str();
+}
+
+ShaderModule ShaderCache::load(const fs::path &path, Device device, const std::string &prelude, const WgslDefines &defines,
+                               bool validate)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<WgslPermutationAxis> axes;
+    ShaderModule module = loadModule(path, device, prelude, defines, validate, axes);
+    addReference(module);
+    return module;
+}
+
+bool ShaderCache::loadPermutations(const fs::path &path, Device device, const std::string &prelude,
+                                   const WgslDefines &defines, std::vector<ShaderPermutation> &permutations, bool validate)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // The default permutation tells which axes there are
+    permutations.clear();
+    std::vector<WgslPermutationAxis> axes;
+    ShaderModule defaultModule = loadModule(path, device, prelude, defines, validate, axes);
+    if (!defaultModule)
+    {
+        return false;
+    }
+    bool loaded = true;
+    for (const WgslDefines &permutation : expandPermutations(axes))
+    {
+        WgslDefines permutationDefines = defines;
+        for (const auto &define : permutation)
+        {
+            permutationDefines[define.first] = define.second;
+        }
+        std::vector<WgslPermutationAxis> permutationAxes;
+        ShaderModule module = loadModule(path, device, prelude, permutationDefines, validate, permutationAxes);
+        if (!module)
+        {
+            std::cerr << "Permutation " << permutationName(permutation) << " of " << path << " failed" << std::endl;
+            loaded = false;
+            break;
+        }
+        addReference(module);
+        permutations.push_back({permutation, module});
+    }
+    if (!loaded)
+    {
+        for (const ShaderPermutation &permutation : permutations)
+        {
+            removeReference(permutation.module);
+        }
+        permutations.clear();
+    }
+    // Unless it is one of the permutations, nobody holds the default one
+    releaseUnreferenced(defaultModule);
+    return loaded;
+}
+
+void ShaderCache::release(ShaderModule module)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    removeReference(module);
+}
+
+ShaderModule ShaderCache::loadModule(const fs::path &path, Device device, const std::string &prelude,
+                                     const WgslDefines &defines, bool validate, std::vector<WgslPermutationAxis> &axes)
+{
+    // What was asked for, to find the content without reading the files
+    std::string request = m_adapterIdentity + '\0' + path.lexically_normal().string() + '\0' + prelude;
+    for (const auto &define : defines)
+    {
+        request += '\0' + define.first + '=' + define.second;
+    }
+    uint64_t requestKey = hashBytes(request.data(), request.size());
+
+    Entry entry;
+    uint64_t contentKey = 0;
+    bool hit = !m_directory.empty() && readReference(requestKey, contentKey, axes) && readEntry(contentKey, entry);
+    bool entryKnown = hit;
+    if (hit)
+    {
+        ++m_statistics.hits;
+        touch(filePath(requestKey, ReferenceExtension));
+        touch(filePath(contentKey, EntryExtension));
+    }
+    else
+    {
+        ++m_statistics.misses;
+        WgslSource source;
+        std::string error;
+        std::vector<Dependency> dependencies;
+        if (!preprocessWgsl(path, defines, source, error))
+        {
+            std::cerr << "Could not preprocess shader " << path << ": " << error << std::endl;
+            return nullptr;
+        }
+        // A file saved again between our read and its stamp would go
+        // unnoticed until its next change, editors save well apart
+        for (const fs::path &file : source.dependencies)
+        {
+            Dependency dependency;
+            dependency.path = file.string();
+            if (!stamp(file, dependency.size, dependency.modificationTime))
+            {
+                std::cerr << "Could not read shader " << file << std::endl;
+                return nullptr;
+            }
+            dependencies.push_back(std::move(dependency));
+        }
+        axes = source.permutationAxes;
+        entry.source = prelude + source.code;
+        std::string content = m_adapterIdentity + '\0' + entry.source;
+        contentKey = hashBytes(content.data(), content.size());
+
+        // Another request may have built the same source
+        entryKnown = !m_directory.empty() && readEntry(contentKey, entry);
+        if (!m_directory.empty())
+        {
+            writeReference(requestKey, contentKey, dependencies, axes);
+        }
+    }
+
+    auto compiled = m_modules.find(contentKey);
+    if (compiled != m_modules.end())
+    {
+        ++m_statistics.moduleReuses;
+        return compiled->second.module;
+    }
+
+    if (entryKnown && !entry.valid)
+    {
+        // Do not compile again what the device already rejected
+        std::cerr << "Shader " << path << " is invalid (cached result): " << entry.messages << std::endl;
+        return nullptr;
+    }
+
+    ShaderModule module = nullptr;
+    if (entryKnown)
+    {
+        module = createShaderModule(device, entry.source);
+    }
+    else if (!validate)
+    {
+        // Without a verdict, there is nothing to store
+        module = createShaderModule(device, entry.source);
+    }
+    else
+    {
+        bool known = createValidatedShaderModule(device, entry.source, module, entry.valid, entry.messages);
+        if (known && !m_directory.empty())
+        {
+            writeEntry(contentKey, entry);
+        }
+        if (!entry.valid)
+        {
+            std::cerr << "Shader " << path << " is invalid: " << entry.messages << std::endl;
+            if (module)
+            {
+                wgpuShaderModuleRelease(module);
+            }
+            return nullptr;
+        }
+    }
+    if (module)
+    {
+        m_modules[contentKey].module = module;
+    }
+    return module;
+}
+
+void ShaderCache::addReference(WGPUShaderModule module)
+{
+    for (auto &entry : m_modules)
+    {
+        if (static_cast<WGPUShaderModule>(entry.second.module) == module)
+        {
+            ++entry.second.references;
+            return;
+        }
+    }
+}
+
+void ShaderCache::removeReference(WGPUShaderModule module)
+{
+    for (auto &entry : m_modules)
+    {
+        if (static_cast<WGPUShaderModule>(entry.second.module) == module && entry.second.references > 0)
+        {
+            --entry.second.references;
+            releaseUnreferenced(module);
+            return;
+        }
+    }
+}
+
+void ShaderCache::releaseUnreferenced(WGPUShaderModule module)
+{
+    for (auto it = m_modules.begin(); it != m_modules.end(); ++it)
+    {
+        if (static_cast<WGPUShaderModule>(it->second.module) == module)
+        {
+            if (it->second.references == 0)
+            {
+                wgpuShaderModuleRelease(module);
+                m_modules.erase(it);
+            }
+            return;
+        }
+    }
+}
+
+bool ShaderCache::readReference(uint64_t requestKey, uint64_t &contentKey, std::vector<WgslPermutationAxis> &axes)
+{
+    std::string data;
+    if (!readFile(filePath(requestKey, ReferenceExtension), data))
+    {
+        return false;
+    }
+    Reader reader(data);
+    uint32_t dependencyCount;
+    if (!reader.magic(ReferenceMagic) || !reader.value(contentKey) || !reader.value(dependencyCount))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < dependencyCount; ++i)
+    {
+        Dependency recorded;
+        Dependency current;
+        if (!reader.string(recorded.path) || !reader.value(recorded.size) || !reader.value(recorded.modificationTime) ||
+            !stamp(recorded.path, current.size, current.modificationTime) ||
+            current.size != recorded.size || current.modificationTime != recorded.modificationTime)
+        {
+            return false;
+        }
+    }
+    uint32_t axisCount;
+    // Bounded like the value counts below, so that a corrupt file is a
+    // miss rather than a huge allocation
+    if (!reader.value(axisCount) || axisCount > data.size())
+    {
+        return false;
+    }
+    axes.assign(axisCount, {});
+    for (WgslPermutationAxis &axis : axes)
+    {
+        uint32_t valueCount;
+        if (!reader.string(axis.name) || !reader.value(valueCount) || valueCount > data.size())
+        {
+            return false;
+        }
+        axis.values.resize(valueCount);
+        for (std::string &value : axis.values)
+        {
+            if (!reader.string(value))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ShaderCache::writeReference(uint64_t requestKey, uint64_t contentKey, const std::vector<Dependency> &dependencies,
+                                 const std::vector<WgslPermutationAxis> &axes)
+{
+    Writer writer;
+    writer.bytes(ReferenceMagic, sizeof(ReferenceMagic));
+    writer.value(ShaderCacheVersion);
+    writer.value(contentKey);
+    writer.value(static_cast<uint32_t>(dependencies.size()));
+    for (const Dependency &dependency : dependencies)
+    {
+        writer.string(dependency.path);
+        writer.value(dependency.size);
+        writer.value(dependency.modificationTime);
+    }
+    writer.value(static_cast<uint32_t>(axes.size()));
+    for (const WgslPermutationAxis &axis : axes)
+    {
+        writer.string(axis.name);
+        writer.value(static_cast<uint32_t>(axis.values.size()));
+        for (const std::string &value : axis.values)
+        {
+            writer.string(value);
+        }
+    }
+    if (writeFile(filePath(requestKey, ReferenceExtension), writer.data()))
+    {
+        evict();
+    }
+}
+
+bool ShaderCache::readEntry(uint64_t contentKey, Entry &entry)
+{
+    std::string data;
+    if (!readFile(filePath(contentKey, EntryExtension), data))
+    {
+        return false;
+    }
+    Reader reader(data);
+    uint8_t valid;
+    Entry read;
+    if (!reader.magic(EntryMagic) || !reader.value(valid) || !reader.string(read.messages) || !reader.string(read.source))
+    {
+        return false;
+    }
+    // The name of the file is the hash of its content, which also catches
+    // a corrupt file
+    std::string content = m_adapterIdentity + '\0' + read.source;
+    if (hashBytes(content.data(), content.size()) != contentKey)
+    {
+        return false;
+    }
+    read.valid = valid != 0;
+    entry = std::move(read);
+    return true;
+}
+
+void ShaderCache::writeEntry(uint64_t contentKey, const Entry &entry)
+{
+    Writer writer;
+    writer.bytes(EntryMagic, sizeof(EntryMagic));
+    writer.value(ShaderCacheVersion);
+    writer.value(static_cast<uint8_t>(entry.valid ? 1 : 0));
+    writer.string(entry.messages);
+    writer.string(entry.source);
+    if (writeFile(filePath(contentKey, EntryExtension), writer.data()))
+    {
+        evict();
+    }
+}
+
+ShaderCacheStatistics ShaderCache::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+uint64_t ShaderCache::diskUsage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_diskUsage;
+}
+
+fs::path ShaderCache::filePath(uint64_t key, const char *extension) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(key), extension);
+    return m_directory / name;
+}
+
+bool ShaderCache::writeFile(const fs::path &path, const std::string &data)
+{
+    // A name no other run writes to (the clock alone could be the same in
+    // two processes), renamed over the final one
+    fs::path tmpPath = path;
+    tmpPath += ".tmp" + std::to_string(processId()) + "-" +
+               std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(data.data(), data.size()))
+        {
+            file.close();
+            std::error_code ec;
+            fs::remove(tmpPath, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+void ShaderCache::touch(const fs::path &path)
+{
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+}
+
+void ShaderCache::evict()
+{
+    struct CacheFile
+    {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type time;
+    };
+    std::vector<CacheFile> files;
+    m_diskUsage = 0;
+    std::error_code ec;
+    for (fs::directory_iterator it(m_directory, ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::string extension = it->path().extension().string();
+        if (extension != ReferenceExtension && extension != EntryExtension)
+        {
+            continue;
+        }
+        std::error_code fileError;
+        CacheFile file{it->path(), it->file_size(fileError), it->last_write_time(fileError)};
+        if (!fileError)
+        {
+            m_diskUsage += file.size;
+            files.push_back(std::move(file));
+        }
+    }
+    if (m_diskUsage <= m_maxBytes)
+    {
+        return;
+    }
+
+    // Least recently used first. A reference whose entry goes away, or the
+    // other way around, is simply a miss next time.
+    std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b)
+              { return a.time < b.time; });
+    for (const CacheFile &file : files)
+    {
+        if (m_diskUsage <= m_maxBytes)
+        {
+            break;
+        }
+        if (fs::remove(file.path, ec))
+        {
+            m_diskUsage -= file.size;
+            ++m_statistics.evictions;
+        }
+    }
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "wgsl-preprocessor.h"
+
+#include <webgpu/webgpu.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderCacheStatistics
+{
+    // Loads served from the directory, without reading the sources
+    uint64_t hits = 0;
+    // Loads that read and validated the sources
+    uint64_t misses = 0;
+    // Loads of a shader already compiled by this cache
+    uint64_t moduleReuses = 0;
+    // Files removed to stay under the size cap
+    uint64_t evictions = 0;
+};
+
+/**
+ * A specialized module of a shader, see ShaderCache::loadPermutations().
+ */
+struct ShaderPermutation
+{
+    // The values of the permutation axes
+    WgslDefines permutation;
+    wgpu::ShaderModule module = nullptr;
+};
+
+/**
+ * A persistent cache of the WGSL shaders the application loads, in a
+ * directory shared by all runs.
+ *
+ * WebGPU does not give access to compiled shaders, so what is kept is
+ * everything we do before the driver compiles: the final source (the
+ * prelude, then the file run through preprocessWgsl()) and whether the
+ * device accepted it. The cache is content addressed: results are stored
+ * under a hash of the final source and of the adapter and backend, so that
+ * identical sources share one entry and changing GPU or driver does not
+ * reuse stale validation results. A small reference per request (file, prelude, definitions,
+ * adapter) points to its content and records the size and modification
+ * time of the files it was built from (includes too) and its permutation
+ * axes, so that a warm load reads none of them.
+ *
+ * On a warm load, a shader known to be invalid is not compiled again (its
+ * errors are printed instead) and a valid one is compiled without waiting
+ * for its validation. Within a run, loading the same source twice returns
+ * the same module.
+ *
+ * Files are written next to their final name then renamed, so concurrent
+ * runs never see partial files. Loads refresh the time of the files they
+ * use, and the least recently used ones are removed when the directory
+ * grows above `maxBytes`.
+ *
+ * Loads may come from several threads, e.g. a shader reloader's. The cache
+ * owns the modules it returns, it must be destroyed after the pipelines
+ * using them and before the device. Modules that are no longer needed can
+ * be handed back with release() before that.
+ */
+class ShaderCache
+{
+public:
+    static constexpr uint64_t DefaultMaxBytes = 16 << 20;
+
+    /**
+     * `adapterIdentity` is typically adapterIdentity(adapter). An empty
+     * `directory` keeps nothing on disk.
+     */
+    ShaderCache(const std::filesystem::path &directory, const std::string &adapterIdentity, uint64_t maxBytes = DefaultMaxBytes);
+    ~ShaderCache();
+
+    ShaderCache(const ShaderCache &) = delete;
+    ShaderCache &operator=(const ShaderCache &) = delete;
+
+    /**
+     * A user cache directory for this application, or one in the
+     * temporary directory.
+     */
+    static std::filesystem::path defaultDirectory();
+
+    /**
+     * What differentiates adapters, drivers and backends, to key entries.
+     */
+    static std::string adapterIdentity(wgpu::Adapter adapter);
+
+    /**
+     * Load a WGSL shader preprocessed with `defines`, with `prelude`
+     * inserted before its code, like loadShaderModule(). Returns null if a
+     * file cannot be read, or the shader cannot be preprocessed or is
+     * invalid.
+     *
+     * A new source is validated with an error scope, waiting on the device,
+     * which catches the errors of anything else the device does meanwhile.
+     * Threads that are not the one driving the device should pass
+     * `validate` false: the module is then created without waiting, its
+     * errors go to the device's uncaptured error callback (and make the
+     * pipelines using it fail), and nothing is stored for it.
+     */
+    wgpu::ShaderModule load(const std::filesystem::path &path, wgpu::Device device, const std::string &prelude = {},
+                            const WgslDefines &defines = {}, bool validate = true);
+
+    /**
+     * Load one module per combination of the #permutation axes the shader
+     * declares, in the order of expandPermutations(), each preprocessed
+     * with `defines` and its own values. Returns false if any fails.
+     */
+    bool loadPermutations(const std::filesystem::path &path, wgpu::Device device, const std::string &prelude,
+                          const WgslDefines &defines, std::vector<ShaderPermutation> &permutations, bool validate = true);
+
+    /**
+     * Hand back a module returned by a load. Once every load that returned
+     * it has released it, the module is released, so pipelines must not be
+     * created with it anymore. Loads that never release (most of them) keep
+     * it for the lifetime of the cache.
+     */
+    void release(wgpu::ShaderModule module);
+
+    /**
+     * Copies, taken under the lock since a reloader thread may be loading.
+     */
+    ShaderCacheStatistics statistics() const;
+
+    /**
+     * Bytes the directory holds, as of the last write.
+     */
+    uint64_t diskUsage() const;
+
+private:
+    /**
+     * A file the final source was built from.
+     */
+    struct Dependency
+    {
+        std::string path;
+        uint64_t size = 0;
+        int64_t modificationTime = 0;
+    };
+
+    /**
+     * What the directory keeps for a given source.
+     */
+    struct Entry
+    {
+        std::string source;
+        bool valid = false;
+        std::string messages;
+    };
+
+    /**
+     * A module compiled during this run, and the loads that returned it.
+     */
+    struct CompiledModule
+    {
+        wgpu::ShaderModule module = nullptr;
+        uint32_t references = 0;
+    };
+
+    wgpu::ShaderModule loadModule(const std::filesystem::path &path, wgpu::Device device, const std::string &prelude,
+                                  const WgslDefines &defines, bool validate, std::vector<WgslPermutationAxis> &axes);
+    // With m_mutex held, count the loads that returned a module
+    void addReference(WGPUShaderModule module);
+    void removeReference(WGPUShaderModule module);
+    // Release the module if no load holds it
+    void releaseUnreferenced(WGPUShaderModule module);
+    bool readReference(uint64_t requestKey, uint64_t &contentKey, std::vector<WgslPermutationAxis> &axes);
+    void writeReference(uint64_t requestKey, uint64_t contentKey, const std::vector<Dependency> &dependencies,
+                        const std::vector<WgslPermutationAxis> &axes);
+    bool readEntry(uint64_t contentKey, Entry &entry);
+    void writeEntry(uint64_t contentKey, const Entry &entry);
+    std::filesystem::path filePath(uint64_t key, const char *extension) const;
+    bool writeFile(const std::filesystem::path &path, const std::string &data);
+    void touch(const std::filesystem::path &path);
+    void evict();
+
+    std::filesystem::path m_directory;
+    std::string m_adapterIdentity;
+    uint64_t m_maxBytes;
+    uint64_t m_diskUsage = 0;
+    ShaderCacheStatistics m_statistics;
+    // Serializes loads, and guards the statistics
+    mutable std::mutex m_mutex;
+    // Modules compiled during this run, by content key
+    std::unordered_map<uint64_t, CompiledModule> m_modules;
+};
@@ -0,0 +1,229 @@
+#include "shader-reloader.h"
+
+#include "file-watcher.h"
+#include "pipeline-cache.h"
+#include "pipeline-scheduler.h"
+#include "shader-cache.h"
+#include "trace-recorder.h"
+#include "webgpu-release.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace wgpu;
+namespace fs = std::filesystem;
+
+namespace
+{
+    // What a reload should stay under, to show up on the next frame
+    constexpr double FrameSeconds = 1.0 / 60.0;
+} // namespace
+
+ShaderReloader::ShaderReloader(ShaderCache &shaderCache, PipelineCache &pipelineCache, Device device,
+                               const fs::path &path, const std::string &prelude, const WgslDefines &defines)
+    : m_shaderCache(shaderCache), m_pipelineCache(pipelineCache), m_device(device), m_path(path),
+      m_prelude(prelude), m_defines(defines)
+{
+}
+
+ShaderReloader::~ShaderReloader()
+{
+    // Stops the thread running reload() first
+    m_watcher.reset();
+}
+
+void ShaderReloader::addPipeline(uint32_t variant, const WgslDefines &permutation, const RenderPipelineDescriptor &descriptor)
+{
+    m_pipelines.push_back({variant, permutation, descriptor});
+}
+
+bool ShaderReloader::start()
+{
+    fs::path directory = m_path.parent_path().empty() ? fs::path(".") : m_path.parent_path();
+    m_watcher = std::make_unique<FileWatcher>(directory, [this](const std::vector<fs::path> &files, std::chrono::steady_clock::time_point changeTime)
+                                              { reload(files, changeTime); });
+    if (!m_watcher->watching())
+    {
+        m_watcher.reset();
+        return false;
+    }
+    std::cout << "Watching " << directory << " for shader changes" << std::endl;
+    return true;
+}
+
+bool ShaderReloader::apply(PipelineScheduler &scheduler)
+{
+    if (!m_pending.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+#ifdef WEBGPU_BACKEND_WGPU
+    // Let the pipeline creations of the reloads call back, here rather than
+    // on the watcher's thread. Other backends call back when the
+    // application processes events.
+    wgpuDevicePoll(m_device, false, nullptr);
+#endif
+
+    bool applied = false;
+    while (true)
+    {
+        std::shared_ptr<Reload> reload;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_reloads.empty())
+            {
+                break;
+            }
+            // In order, so that an older reload never replaces a newer one
+            {
+                std::lock_guard<std::mutex> reloadLock(m_reloads.front()->mutex);
+                if (m_reloads.front()->remaining > 0)
+                {
+                    break;
+                }
+            }
+            reload = m_reloads.front();
+            m_reloads.pop_front();
+            m_pending = !m_reloads.empty();
+        }
+
+        // Every creation called back, nothing else touches the reload
+        if (!reload->error.empty())
+        {
+            std::cerr << "Could not reload " << m_path.filename().string() << " (" << reload->error
+                      << "), keeping the last good pipelines" << std::endl;
+            release(reload->pipelines, reload->modules);
+            countFailure();
+            continue;
+        }
+        for (size_t i = 0; i < m_pipelines.size(); ++i)
+        {
+            scheduler.replace(m_pipelines[i].variant, reload->pipelines[i]);
+        }
+        // The frames already submitted keep what they use alive
+        release(m_installedPipelines, m_installedModules);
+        m_installedPipelines = reload->pipelines;
+        m_installedModules = reload->modules;
+
+        double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - reload->changeTime).count();
+        double compileSeconds = std::chrono::duration<double>(reload->compiledTime - reload->startTime).count();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_statistics.reloads;
+            m_statistics.lastLatencySeconds = latency;
+            m_statistics.maxLatencySeconds = std::max(m_statistics.maxLatencySeconds, latency);
+        }
+        std::cout << "Reloaded " << m_path.filename().string() << " in " << latency * 1000.0 << " ms from change to swap ("
+                  << compileSeconds * 1000.0 << " ms compiling), " << (latency <= FrameSeconds ? "within" : "over")
+                  << " a 60 Hz frame" << std::endl;
+        applied = true;
+    }
+    return applied;
+}
+
+ShaderReloadStatistics ShaderReloader::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+void ShaderReloader::reload(const std::vector<fs::path> &files, std::chrono::steady_clock::time_point changeTime)
+{
+    if (std::none_of(files.begin(), files.end(), [](const fs::path &file)
+                     { return file.extension() == ".wgsl"; }))
+    {
+        return;
+    }
+
+    TRACE_SCOPE("Reload shader");
+    auto fail = [&](const std::string &reason)
+    {
+        std::cerr << "Could not reload " << m_path.filename().string() << " (" << reason
+                  << "), keeping the last good pipelines" << std::endl;
+        countFailure();
+    };
+
+    auto reload = std::make_shared<Reload>();
+    reload->changeTime = changeTime;
+    reload->startTime = std::chrono::steady_clock::now();
+
+    // Without waiting for the device, errors were printed by the cache
+    std::vector<ShaderPermutation> permutations;
+    if (!m_shaderCache.loadPermutations(m_path, m_device, m_prelude, m_defines, permutations, false))
+    {
+        return fail("invalid shader");
+    }
+    for (const ShaderPermutation &permutation : permutations)
+    {
+        reload->modules.push_back(permutation.module);
+    }
+
+    std::vector<ShaderModule> modules;
+    for (const Pipeline &pipeline : m_pipelines)
+    {
+        auto permutation = std::find_if(permutations.begin(), permutations.end(), [&](const ShaderPermutation &p)
+                                        { return p.permutation == pipeline.permutation; });
+        if (permutation == permutations.end())
+        {
+            release({}, reload->modules);
+            return fail("no permutation " + permutationName(pipeline.permutation) + " anymore");
+        }
+        modules.push_back(permutation->module);
+    }
+
+    reload->pipelines.assign(m_pipelines.size(), nullptr);
+    reload->remaining = m_pipelines.size();
+    reload->compiledTime = reload->startTime;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reloads.push_back(reload);
+        m_pending.store(true, std::memory_order_release);
+    }
+
+    for (size_t i = 0; i < m_pipelines.size(); ++i)
+    {
+        RenderPipelineDescriptor descriptor = m_pipelines[i].descriptor;
+        descriptor.vertex.module = modules[i];
+        FragmentState fragment;
+        if (descriptor.fragment)
+        {
+            fragment = *descriptor.fragment;
+            fragment.module = modules[i];
+            descriptor.fragment = &fragment;
+        }
+        m_pipelineCache.renderPipelineAsync(descriptor, [reload, i](RenderPipeline pipeline, const char *message)
+                                            {
+            std::lock_guard<std::mutex> lock(reload->mutex);
+            reload->pipelines[i] = pipeline;
+            if (!pipeline && reload->error.empty())
+            {
+                reload->error = std::string("invalid pipeline: ") + (message ? message : "");
+            }
+            if (--reload->remaining == 0)
+            {
+                reload->compiledTime = std::chrono::steady_clock::now();
+            } });
+    }
+}
+
+void ShaderReloader::release(const std::vector<RenderPipeline> &pipelines, const std::vector<ShaderModule> &modules)
+{
+    // Pipelines first, the cache keys them by module
+    for (RenderPipeline pipeline : pipelines)
+    {
+        if (pipeline)
+        {
+            m_pipelineCache.release(pipeline);
+        }
+    }
+    for (ShaderModule module : modules)
+    {
+        m_shaderCache.release(module);
+    }
+}
+
+void ShaderReloader::countFailure()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_statistics.failures;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "wgsl-preprocessor.h"
+
+#include <webgpu/webgpu.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class FileWatcher;
+class PipelineCache;
+class PipelineScheduler;
+class ShaderCache;
+
+struct ShaderReloadStatistics
+{
+    // Reloads applied to the scheduler
+    uint64_t reloads = 0;
+    // Reloads that kept the previous pipelines
+    uint64_t failures = 0;
+    // From the change of a file to the frame drawing with the new pipelines
+    double lastLatencySeconds = 0.0;
+    double maxLatencySeconds = 0.0;
+};
+
+/**
+ * Reloads a shader, and rebuilds the pipelines that use it, when a WGSL
+ * file of its directory changes (its includes are usually next to it).
+ *
+ * The file watcher's thread preprocesses the shader, creates its modules
+ * and starts creating the pipelines asynchronously, through the shader and
+ * pipeline caches, while frames keep drawing with the current pipelines.
+ * It never polls the device nor uses error scopes, which would run the
+ * callbacks of the frames or catch their errors: the pipelines complete
+ * when the thread driving the device polls it, and their creation reports
+ * their errors (those of an invalid module too). Once they all compiled,
+ * apply() hands them to the scheduler in one go, between frames, so a
+ * frame never mixes old and new pipelines, and hands the pipelines and
+ * modules they replace back to the caches. If the shader or any of the
+ * pipelines fails, the errors are printed and the last good pipelines stay.
+ */
+class ShaderReloader
+{
+public:
+    /**
+     * Reloads `path` like ShaderCache::loadPermutations(). The caches must
+     * outlive the reloader.
+     */
+    ShaderReloader(ShaderCache &shaderCache, PipelineCache &pipelineCache, wgpu::Device device,
+                   const std::filesystem::path &path, const std::string &prelude, const WgslDefines &defines);
+    /**
+     * Waits for a running reload.
+     */
+    ~ShaderReloader();
+
+    ShaderReloader(const ShaderReloader &) = delete;
+    ShaderReloader &operator=(const ShaderReloader &) = delete;
+
+    /**
+     * Rebuild `variant` of the scheduler from `descriptor` with the module
+     * of `permutation` (in both its vertex and fragment stages) on reloads.
+     * What the descriptor points to must outlive the reloader. Call before
+     * start().
+     */
+    void addPipeline(uint32_t variant, const WgslDefines &permutation, const wgpu::RenderPipelineDescriptor &descriptor);
+
+    /**
+     * Start watching. Returns false if the directory cannot be watched.
+     */
+    bool start();
+
+    /**
+     * Called between frames, on the thread that polls the device: replace
+     * the pipelines of `scheduler` with the ones of the reloads that have
+     * compiled since, if any succeeded, and print how long it took. Returns
+     * whether it did.
+     */
+    bool apply(PipelineScheduler &scheduler);
+
+    ShaderReloadStatistics statistics() const;
+
+private:
+    struct Pipeline
+    {
+        uint32_t variant;
+        WgslDefines permutation;
+        wgpu::RenderPipelineDescriptor descriptor;
+    };
+
+    /**
+     * The modules and pipelines of one reload. Pipeline creations call back
+     * from whichever thread polls the device, possibly after the reloader
+     * is gone, so they share it and lock its mutex.
+     */
+    struct Reload
+    {
+        std::mutex mutex;
+        std::chrono::steady_clock::time_point changeTime;
+        std::chrono::steady_clock::time_point startTime;
+        std::chrono::steady_clock::time_point compiledTime;
+        std::vector<wgpu::ShaderModule> modules;
+        // Per entry of m_pipelines, null until created (or if it failed)
+        std::vector<wgpu::RenderPipeline> pipelines;
+        // Creations that have not called back yet
+        size_t remaining = 0;
+        std::string error;
+    };
+
+    void reload(const std::vector<std::filesystem::path> &files, std::chrono::steady_clock::time_point changeTime);
+    void release(const std::vector<wgpu::RenderPipeline> &pipelines, const std::vector<wgpu::ShaderModule> &modules);
+    void countFailure();
+
+    ShaderCache &m_shaderCache;
+    PipelineCache &m_pipelineCache;
+    wgpu::Device m_device;
+    std::filesystem::path m_path;
+    std::string m_prelude;
+    WgslDefines m_defines;
+    std::vector<Pipeline> m_pipelines;
+
+    mutable std::mutex m_mutex;
+    // Reloads started, oldest first, guarded by m_mutex
+    std::deque<std::shared_ptr<Reload>> m_reloads;
+    ShaderReloadStatistics m_statistics;
+    // Whether m_reloads has any, to check every frame without locking
+    std::atomic<bool> m_pending{false};
+
+    // What the last applied reload installed, only used by apply()
+    std::vector<wgpu::RenderPipeline> m_installedPipelines;
+    std::vector<wgpu::ShaderModule> m_installedModules;
+
+    std::unique_ptr<FileWatcher> m_watcher;
+};
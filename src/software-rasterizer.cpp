@@ -0,0 +1,624 @@
+#include "software-rasterizer.h"
+#include "thread-pool.h"
+#include "vertex-transform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Vertex positions are snapped to 1/16th of a pixel
+    constexpr int SubpixelBits = 4;
+    constexpr int64_t SubpixelScale = 1 << SubpixelBits;
+    // Screen positions are clamped to this many pixels around the origin,
+    // which keeps edge functions within 32 bits inside a tile
+    constexpr float GuardBand = 8192.0f;
+    constexpr uint32_t MaxTargetSize = 4096;
+    constexpr size_t VertexChunkSize = 16384;
+    constexpr size_t TriangleChunkSize = 4096;
+
+    /**
+     * Four lanes of floats or 32-bit integers, with only the operations the
+     * rasterizer needs. Masks are integers with all bits set in true lanes.
+     */
+#ifdef RASTER_SSE2
+    struct Float4
+    {
+        __m128 v;
+    };
+    struct Int4
+    {
+        __m128i v;
+    };
+
+    inline Float4 splat(float x) { return {_mm_set1_ps(x)}; }
+    inline Int4 splat(int32_t x) { return {_mm_set1_epi32(x)}; }
+    inline Float4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+    inline void store(float *p, Float4 a) { _mm_storeu_ps(p, a.v); }
+    inline Int4 load(const uint8_t *p) { return {_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))}; }
+    inline void store(uint8_t *p, Int4 a) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), a.v); }
+    inline Int4 lanes(int32_t a, int32_t b, int32_t c, int32_t d) { return {_mm_setr_epi32(a, b, c, d)}; }
+
+    inline Float4 operator+(Float4 a, Float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+    inline Float4 operator-(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+    inline Float4 operator*(Float4 a, Float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+    inline Float4 min(Float4 a, Float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+    inline Float4 max(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+    inline Int4 operator<(Float4 a, Float4 b) { return {_mm_castps_si128(_mm_cmplt_ps(a.v, b.v))}; }
+    inline Int4 operator<=(Float4 a, Float4 b) { return {_mm_castps_si128(_mm_cmple_ps(a.v, b.v))}; }
+
+    inline Int4 operator+(Int4 a, Int4 b) { return {_mm_add_epi32(a.v, b.v)}; }
+    inline Int4 operator-(Int4 a, Int4 b) { return {_mm_sub_epi32(a.v, b.v)}; }
+    inline Int4 operator&(Int4 a, Int4 b) { return {_mm_and_si128(a.v, b.v)}; }
+    inline Int4 operator|(Int4 a, Int4 b) { return {_mm_or_si128(a.v, b.v)}; }
+    inline Int4 operator>(Int4 a, Int4 b) { return {_mm_cmpgt_epi32(a.v, b.v)}; }
+    template <int Count>
+    inline Int4 shiftLeft(Int4 a) { return {_mm_slli_epi32(a.v, Count)}; }
+    template <int Count>
+    inline Int4 shiftRight(Int4 a) { return {_mm_srli_epi32(a.v, Count)}; }
+
+    inline Float4 toFloat(Int4 a) { return {_mm_cvtepi32_ps(a.v)}; }
+    inline Int4 truncate(Float4 a) { return {_mm_cvttps_epi32(a.v)}; }
+    inline Float4 asFloat(Int4 a) { return {_mm_castsi128_ps(a.v)}; }
+    inline Int4 asInt(Float4 a) { return {_mm_castps_si128(a.v)}; }
+
+    inline Float4 select(Int4 mask, Float4 a, Float4 b)
+    {
+        __m128 m = _mm_castsi128_ps(mask.v);
+        return {_mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v))};
+    }
+    inline Int4 select(Int4 mask, Int4 a, Int4 b)
+    {
+        return {_mm_or_si128(_mm_and_si128(mask.v, a.v), _mm_andnot_si128(mask.v, b.v))};
+    }
+    // One bit per lane
+    inline int laneBits(Int4 mask) { return _mm_movemask_ps(_mm_castsi128_ps(mask.v)); }
+#else
+    struct Float4
+    {
+        float v[4];
+    };
+    struct Int4
+    {
+        int32_t v[4];
+    };
+
+    template <typename R, typename F>
+    inline R map(F f)
+    {
+        R r;
+        for (int i = 0; i < 4; ++i)
+        {
+            r.v[i] = f(i);
+        }
+        return r;
+    }
+
+    inline Float4 splat(float x) { return {{x, x, x, x}}; }
+    inline Int4 splat(int32_t x) { return {{x, x, x, x}}; }
+    inline Float4 load(const float *p) { return map<Float4>([&](int i) { return p[i]; }); }
+    inline void store(float *p, Float4 a) { std::memcpy(p, a.v, sizeof(a.v)); }
+    inline Int4 load(const uint8_t *p)
+    {
+        Int4 r;
+        std::memcpy(r.v, p, sizeof(r.v));
+        return r;
+    }
+    inline void store(uint8_t *p, Int4 a) { std::memcpy(p, a.v, sizeof(a.v)); }
+    inline Int4 lanes(int32_t a, int32_t b, int32_t c, int32_t d) { return {{a, b, c, d}}; }
+
+    inline Float4 operator+(Float4 a, Float4 b) { return map<Float4>([&](int i) { return a.v[i] + b.v[i]; }); }
+    inline Float4 operator-(Float4 a, Float4 b) { return map<Float4>([&](int i) { return a.v[i] - b.v[i]; }); }
+    inline Float4 operator*(Float4 a, Float4 b) { return map<Float4>([&](int i) { return a.v[i] * b.v[i]; }); }
+    // Same NaN behavior as minps/maxps: the second operand wins
+    inline Float4 min(Float4 a, Float4 b) { return map<Float4>([&](int i) { return a.v[i] < b.v[i] ? a.v[i] : b.v[i]; }); }
+    inline Float4 max(Float4 a, Float4 b) { return map<Float4>([&](int i) { return a.v[i] > b.v[i] ? a.v[i] : b.v[i]; }); }
+    inline Int4 operator<(Float4 a, Float4 b) { return map<Int4>([&](int i) { return a.v[i] < b.v[i] ? -1 : 0; }); }
+    inline Int4 operator<=(Float4 a, Float4 b) { return map<Int4>([&](int i) { return a.v[i] <= b.v[i] ? -1 : 0; }); }
+
+    inline Int4 operator+(Int4 a, Int4 b) { return map<Int4>([&](int i) { return static_cast<int32_t>(static_cast<uint32_t>(a.v[i]) + static_cast<uint32_t>(b.v[i])); }); }
+    inline Int4 operator-(Int4 a, Int4 b) { return map<Int4>([&](int i) { return static_cast<int32_t>(static_cast<uint32_t>(a.v[i]) - static_cast<uint32_t>(b.v[i])); }); }
+    inline Int4 operator&(Int4 a, Int4 b) { return map<Int4>([&](int i) { return a.v[i] & b.v[i]; }); }
+    inline Int4 operator|(Int4 a, Int4 b) { return map<Int4>([&](int i) { return a.v[i] | b.v[i]; }); }
+    inline Int4 operator>(Int4 a, Int4 b) { return map<Int4>([&](int i) { return a.v[i] > b.v[i] ? -1 : 0; }); }
+    template <int Count>
+    inline Int4 shiftLeft(Int4 a) { return map<Int4>([&](int i) { return static_cast<int32_t>(static_cast<uint32_t>(a.v[i]) << Count); }); }
+    template <int Count>
+    inline Int4 shiftRight(Int4 a) { return map<Int4>([&](int i) { return static_cast<int32_t>(static_cast<uint32_t>(a.v[i]) >> Count); }); }
+
+    inline Float4 toFloat(Int4 a) { return map<Float4>([&](int i) { return static_cast<float>(a.v[i]); }); }
+    inline Int4 truncate(Float4 a) { return map<Int4>([&](int i) { return static_cast<int32_t>(a.v[i]); }); }
+    inline Float4 asFloat(Int4 a)
+    {
+        Float4 r;
+        std::memcpy(r.v, a.v, sizeof(r.v));
+        return r;
+    }
+    inline Int4 asInt(Float4 a)
+    {
+        Int4 r;
+        std::memcpy(r.v, a.v, sizeof(r.v));
+        return r;
+    }
+
+    inline Float4 select(Int4 mask, Float4 a, Float4 b) { return map<Float4>([&](int i) { return mask.v[i] ? a.v[i] : b.v[i]; }); }
+    inline Int4 select(Int4 mask, Int4 a, Int4 b) { return map<Int4>([&](int i) { return mask.v[i] ? a.v[i] : b.v[i]; }); }
+    inline int laneBits(Int4 mask)
+    {
+        return (mask.v[0] ? 1 : 0) | (mask.v[1] ? 2 : 0) | (mask.v[2] ? 4 : 0) | (mask.v[3] ? 8 : 0);
+    }
+#endif
+
+    inline int laneCount(int bits)
+    {
+        static const int counts[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+        return counts[bits & 15];
+    }
+
+    /**
+     * log2(x) for x >= 2^-126, within 2e-7.
+     */
+    inline Float4 log2Approx(Float4 x)
+    {
+        Int4 bits = asInt(x);
+        Float4 exponent = toFloat(shiftRight<23>(bits) - splat(127));
+        // Mantissa in [1, 2), and log2(1 + t) = t * q(t)
+        Float4 t = asFloat((bits & splat(0x007fffff)) | splat(0x3f800000)) - splat(1.0f);
+        Float4 q = splat(-0.0120770203f);
+        q = q * t + splat(0.0627484336f);
+        q = q * t + splat(-0.154152006f);
+        q = q * t + splat(0.255176349f);
+        q = q * t + splat(-0.353096353f);
+        q = q * t + splat(0.480012461f);
+        q = q * t + splat(-0.721306757f);
+        q = q * t + splat(1.44269472f);
+        return exponent + t * q;
+    }
+
+    /**
+     * 2^y for y in [-126, 0], within a relative 1e-7.
+     */
+    inline Float4 exp2Approx(Float4 y)
+    {
+        y = max(y, splat(-126.0f));
+        // Truncation rounds up for negative values, step down to the floor
+        Int4 n = truncate(y);
+        Int4 above = y < toFloat(n);
+        n = n + above; // -1 in lanes where truncation went up
+        Float4 f = y - toFloat(n);
+        Float4 p = splat(0.00189375406f);
+        p = p * f + splat(0.00894959042f);
+        p = p * f + splat(0.0558603371f);
+        p = p * f + splat(0.240141818f);
+        p = p * f + splat(0.69315449f);
+        p = p * f + splat(0.999999898f);
+        return p * asFloat(shiftLeft<23>(n + splat(127)));
+    }
+
+    /**
+     * x^e for x in [0, 1], 0 for x = 0, as WGSL's pow() computes it.
+     */
+    inline Float4 powApprox(Float4 x, float e)
+    {
+        Int4 tiny = x < splat(1e-30f);
+        Float4 result = exp2Approx(splat(e) * log2Approx(max(x, splat(1e-30f))));
+        return select(tiny, splat(0.0f), result);
+    }
+
+    inline Float4 linearToSrgb(Float4 x)
+    {
+        Float4 curve = splat(1.055f) * powApprox(x, 1.0f / 2.4f) - splat(0.055f);
+        return select(x <= splat(0.0031308f), x * splat(12.92f), curve);
+    }
+
+    inline Float4 srgbToLinear(Float4 x)
+    {
+        Float4 curve = powApprox((x + splat(0.055f)) * splat(1.0f / 1.055f), 2.4f);
+        return select(x <= splat(0.04045f), x * splat(1.0f / 12.92f), curve);
+    }
+
+    // Channel of 4 packed RGBA8 pixels, in [0, 1]
+    template <int Shift>
+    inline Float4 unpackChannel(Int4 pixels)
+    {
+        return toFloat(shiftRight<24>(shiftLeft<24 - Shift>(pixels))) * splat(1.0f / 255.0f);
+    }
+
+    // Round [0, 1] values to 8 bits
+    inline Int4 packChannel(Float4 x)
+    {
+        return truncate(min(max(x, splat(0.0f)), splat(1.0f)) * splat(255.0f) + splat(0.5f));
+    }
+
+    uint8_t encodeSrgb(float linear)
+    {
+        linear = std::min(std::max(linear, 0.0f), 1.0f);
+        float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(srgb * 255.0f + 0.5f);
+    }
+
+    int64_t floorDivide(int64_t value, int64_t divisor)
+    {
+        int64_t quotient = value / divisor;
+        return quotient * divisor > value ? quotient - 1 : quotient;
+    }
+
+    uint32_t roundUp(uint32_t value, uint32_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+} // namespace
+
+void RasterStatistics::merge(const RasterStatistics &other)
+{
+    triangles += other.triangles;
+    trianglesRasterized += other.trianglesRasterized;
+    fragments += other.fragments;
+    fragmentsWritten += other.fragmentsWritten;
+}
+
+RasterTarget::RasterTarget(uint32_t width, uint32_t height)
+    : width(std::min(width, MaxTargetSize)), height(std::min(height, MaxTargetSize)), stride(roundUp(this->width, 4))
+{
+    color.resize(bytesPerRow() * this->height);
+    depth.resize(static_cast<size_t>(stride) * this->height);
+}
+
+/**
+ * The output of vs_main, already in framebuffer coordinates.
+ */
+struct SoftwareRasterizer::ShadedVertex
+{
+    float x;
+    float y;
+    float z;
+    float color[3];
+};
+
+/**
+ * A triangle ready to rasterize. Its corners are ordered so that the
+ * edge functions are positive inside.
+ */
+struct SoftwareRasterizer::Triangle
+{
+    // Edge i is opposite to corner i: E_i(x, y) = a * x + b * y + c, in
+    // subpixel units
+    int64_t a[3];
+    int64_t b[3];
+    int64_t c[3];
+    // Samples with E_i == 0 are inside for top-left edges only, i.e. a
+    // sample is covered when E_i > threshold[i] for all i
+    int32_t threshold[3];
+    // Pixels covered by the bounding box, inclusive
+    int32_t minX;
+    int32_t minY;
+    int32_t maxX;
+    int32_t maxY;
+    // Attributes are corner 0 plus the barycentric coordinates of corners 1
+    // and 2 times these differences
+    float invArea;
+    float z;
+    float dz[2];
+    float color[3];
+    float dcolor[2][3];
+};
+
+SoftwareRasterizer::SoftwareRasterizer(ThreadPool &threadPool, uint32_t tileSize)
+    : m_threadPool(threadPool), m_tileSize(std::min<uint32_t>(std::max<uint32_t>(roundUp(tileSize, 4), 4), 128))
+{
+}
+
+SoftwareRasterizer::~SoftwareRasterizer() = default;
+
+void SoftwareRasterizer::clear(RasterTarget &target, const std::array<float, 4> &color, float depth) const
+{
+    uint8_t pixel[4] = {encodeSrgb(color[0]), encodeSrgb(color[1]), encodeSrgb(color[2]),
+                        static_cast<uint8_t>(std::min(std::max(color[3], 0.0f), 1.0f) * 255.0f + 0.5f)};
+    for (size_t i = 0; i < target.color.size(); i += 4)
+    {
+        std::memcpy(&target.color[i], pixel, 4);
+    }
+    std::fill(target.depth.begin(), target.depth.end(), depth);
+}
+
+void SoftwareRasterizer::draw(RasterTarget &target, const RasterDraw &draw)
+{
+    RasterUniforms uniforms;
+    std::memcpy(&uniforms, draw.uniformBuffer + draw.uniformOffset, sizeof(uniforms));
+
+    // Vertex shading (vs_main), then the viewport transform. Positions go
+    // through the SIMD transform kernel in structure of arrays layout.
+    m_vertices.resize(draw.vertexCount);
+    m_positions.resize(3 * draw.vertexCount);
+    int floatsPerVertex = draw.dimensions + 3; // + r g b
+    // The App sets aspectRatio to that of its target, see PipelineConstants
+    VertexTransform transform = VertexTransform::fromTime(uniforms.time, static_cast<float>(target.width) / target.height);
+    float halfWidth = 0.5f * target.width;
+    float halfHeight = 0.5f * target.height;
+    size_t vertexChunks = (draw.vertexCount + VertexChunkSize - 1) / VertexChunkSize;
+    m_threadPool.parallelFor(
+        vertexChunks,
+        [&](size_t chunk)
+        {
+            size_t begin = chunk * VertexChunkSize;
+            size_t end = std::min(draw.vertexCount, begin + VertexChunkSize);
+            float *x = m_positions.data() + begin;
+            float *y = x + draw.vertexCount;
+            float *z = y + draw.vertexCount;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const float *in = draw.vertices + i * floatsPerVertex;
+                x[i - begin] = in[0];
+                y[i - begin] = in[1];
+                z[i - begin] = draw.dimensions > 2 ? in[2] : 0.0f;
+            }
+
+            // out.position, w = 1
+            transformVertices(transform, {x, y, z}, {x, y, z}, end - begin);
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                const float *in = draw.vertices + i * floatsPerVertex;
+                ShadedVertex &out = m_vertices[i];
+                out.x = (x[i - begin] + 1.0f) * halfWidth;
+                out.y = (1.0f - y[i - begin]) * halfHeight;
+                out.z = z[i - begin];
+                std::memcpy(out.color, in + draw.dimensions, sizeof(out.color));
+            }
+        });
+
+    // Triangle setup and binning
+    uint32_t tilesX = (target.width + m_tileSize - 1) / m_tileSize;
+    uint32_t tilesY = (target.height + m_tileSize - 1) / m_tileSize;
+    size_t tileCount = static_cast<size_t>(tilesX) * tilesY;
+    size_t triangleCount = draw.indexCount / 3;
+    size_t triangleChunks = (triangleCount + TriangleChunkSize - 1) / TriangleChunkSize;
+    m_triangles.resize(triangleCount);
+    if (m_bins.size() < triangleChunks * tileCount)
+    {
+        m_bins.resize(triangleChunks * tileCount);
+    }
+    std::vector<uint64_t> setupCounts(triangleChunks, 0);
+    m_threadPool.parallelFor(
+        triangleChunks,
+        [&](size_t chunk)
+        {
+            std::vector<uint32_t> *bins = &m_bins[chunk * tileCount];
+            for (size_t tile = 0; tile < tileCount; ++tile)
+            {
+                bins[tile].clear();
+            }
+
+            size_t end = std::min(triangleCount, (chunk + 1) * TriangleChunkSize);
+            for (size_t t = chunk * TriangleChunkSize; t < end; ++t)
+            {
+                const uint32_t *corners = draw.indices + 3 * t;
+                if (corners[0] >= draw.vertexCount || corners[1] >= draw.vertexCount || corners[2] >= draw.vertexCount)
+                {
+                    continue;
+                }
+                const ShadedVertex *v[3] = {&m_vertices[corners[0]], &m_vertices[corners[1]], &m_vertices[corners[2]]};
+
+                int64_t x[3];
+                int64_t y[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    x[i] = std::llround(std::min(std::max(v[i]->x, -GuardBand), GuardBand) * SubpixelScale);
+                    y[i] = std::llround(std::min(std::max(v[i]->y, -GuardBand), GuardBand) * SubpixelScale);
+                }
+                // Twice the signed area, seen from corner 0. Without culling,
+                // both windings are drawn: flip negative ones.
+                int64_t area = (x[2] - x[1]) * (y[0] - y[1]) - (y[2] - y[1]) * (x[0] - x[1]);
+                if (area == 0)
+                {
+                    continue;
+                }
+                if (area < 0)
+                {
+                    std::swap(x[1], x[2]);
+                    std::swap(y[1], y[2]);
+                    std::swap(v[1], v[2]);
+                    area = -area;
+                }
+
+                // Pixel p is sampled at its center, p + 0.5: these are the
+                // first and last pixels sampled within a subpixel range
+                auto firstPixel = [](int64_t value)
+                { return static_cast<int32_t>(floorDivide(value - SubpixelScale / 2 + SubpixelScale - 1, SubpixelScale)); };
+                auto lastPixel = [](int64_t value)
+                { return static_cast<int32_t>(floorDivide(value - SubpixelScale / 2, SubpixelScale)); };
+                Triangle &triangle = m_triangles[t];
+                triangle.minX = std::max(firstPixel(std::min({x[0], x[1], x[2]})), 0);
+                triangle.minY = std::max(firstPixel(std::min({y[0], y[1], y[2]})), 0);
+                triangle.maxX = std::min(lastPixel(std::max({x[0], x[1], x[2]})), static_cast<int32_t>(target.width) - 1);
+                triangle.maxY = std::min(lastPixel(std::max({y[0], y[1], y[2]})), static_cast<int32_t>(target.height) - 1);
+                if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+                {
+                    continue;
+                }
+
+                for (int i = 0; i < 3; ++i)
+                {
+                    int from = (i + 1) % 3;
+                    int to = (i + 2) % 3;
+                    // Positive on the side of corner i, and the gradient
+                    // (a, b) points inside
+                    triangle.a[i] = y[from] - y[to];
+                    triangle.b[i] = x[to] - x[from];
+                    triangle.c[i] = -(triangle.a[i] * x[from] + triangle.b[i] * y[from]);
+                    // Left edges have the inside on their right, top edges
+                    // are horizontal with the inside below (y points down)
+                    bool topLeft = triangle.a[i] > 0 || (triangle.a[i] == 0 && triangle.b[i] > 0);
+                    triangle.threshold[i] = topLeft ? -1 : 0;
+                }
+
+                triangle.invArea = 1.0f / static_cast<float>(area);
+                triangle.z = v[0]->z;
+                triangle.dz[0] = v[1]->z - v[0]->z;
+                triangle.dz[1] = v[2]->z - v[0]->z;
+                for (int k = 0; k < 3; ++k)
+                {
+                    triangle.color[k] = v[0]->color[k];
+                    triangle.dcolor[0][k] = v[1]->color[k] - v[0]->color[k];
+                    triangle.dcolor[1][k] = v[2]->color[k] - v[0]->color[k];
+                }
+
+                for (uint32_t ty = triangle.minY / m_tileSize; ty <= triangle.maxY / m_tileSize; ++ty)
+                {
+                    for (uint32_t tx = triangle.minX / m_tileSize; tx <= triangle.maxX / m_tileSize; ++tx)
+                    {
+                        bins[ty * tilesX + tx].push_back(static_cast<uint32_t>(t));
+                    }
+                }
+                ++setupCounts[chunk];
+            }
+        });
+
+    // Rasterization and fragment shading (fs_main), one tile per task. Each
+    // tile goes through its bins in chunk order, hence in triangle order.
+    //
+    // The blend only depends on the source alpha, which is uniform: at 1 the
+    // destination is never read, at 0 colors are left untouched.
+    float sourceAlpha = std::min(std::max(uniforms.color[3], 0.0f), 1.0f);
+    bool writeColor = sourceAlpha > 0.0f;
+    bool readColor = sourceAlpha < 1.0f;
+    std::vector<RasterStatistics> tileStatistics(tileCount);
+    m_threadPool.parallelFor(
+        tileCount,
+        [&](size_t tile)
+        {
+            int32_t tileX = static_cast<int32_t>(tile % tilesX * m_tileSize);
+            int32_t tileY = static_cast<int32_t>(tile / tilesX * m_tileSize);
+            int32_t tileMaxX = std::min(tileX + static_cast<int32_t>(m_tileSize), static_cast<int32_t>(target.width)) - 1;
+            int32_t tileMaxY = std::min(tileY + static_cast<int32_t>(m_tileSize), static_cast<int32_t>(target.height)) - 1;
+            RasterStatistics &statistics = tileStatistics[tile];
+
+            for (size_t chunk = 0; chunk < triangleChunks; ++chunk)
+            {
+                for (uint32_t t : m_bins[chunk * tileCount + tile])
+                {
+                    const Triangle &triangle = m_triangles[t];
+                    int32_t minX = std::max(triangle.minX, tileX) & ~3;
+                    int32_t maxX = std::min(triangle.maxX, tileMaxX);
+                    int32_t minY = std::max(triangle.minY, tileY);
+                    int32_t maxY = std::min(triangle.maxY, tileMaxY);
+                    if (minX > maxX || minY > maxY)
+                    {
+                        continue;
+                    }
+
+                    // Lanes of the first group that are within the box
+                    Int4 laneX = lanes(minX, minX + 1, minX + 2, minX + 3);
+                    Int4 boxMinX = splat(std::max(triangle.minX, tileX) - 1);
+                    Int4 boxMaxX = splat(maxX + 1);
+
+                    Int4 threshold[3];
+                    Int4 laneStep[3];
+                    Int4 groupStep[3];
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        int32_t a = static_cast<int32_t>(triangle.a[i] * SubpixelScale);
+                        threshold[i] = splat(triangle.threshold[i]);
+                        laneStep[i] = lanes(0, a, 2 * a, 3 * a);
+                        groupStep[i] = splat(4 * a);
+                    }
+
+                    Float4 invArea = splat(triangle.invArea);
+                    for (int32_t py = minY; py <= maxY; ++py)
+                    {
+                        // Edge functions at the first sample of the row. Far
+                        // from the tile, only their sign matters: clamp them
+                        // so that stepping across the tile stays in 32 bits.
+                        Int4 e[3];
+                        int64_t sampleX = minX * SubpixelScale + SubpixelScale / 2;
+                        int64_t sampleY = py * SubpixelScale + SubpixelScale / 2;
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            int64_t value = triangle.a[i] * sampleX + triangle.b[i] * sampleY + triangle.c[i];
+                            value = std::min<int64_t>(std::max<int64_t>(value, -(int64_t(1) << 29)), int64_t(1) << 29);
+                            e[i] = splat(static_cast<int32_t>(value)) + laneStep[i];
+                        }
+
+                        float *depthRow = target.depth.data() + static_cast<size_t>(py) * target.stride;
+                        uint8_t *colorRow = target.color.data() + static_cast<size_t>(py) * target.bytesPerRow();
+                        Int4 x = laneX;
+                        for (int32_t px = minX; px <= maxX; px += 4)
+                        {
+                            Int4 covered = (e[0] > threshold[0]) & (e[1] > threshold[1]) & (e[2] > threshold[2]) &
+                                           (x > boxMinX) & (boxMaxX > x);
+                            int coveredBits = laneBits(covered);
+                            if (coveredBits != 0)
+                            {
+                                statistics.fragments += laneCount(coveredBits);
+
+                                Float4 l1 = toFloat(e[1]) * invArea;
+                                Float4 l2 = toFloat(e[2]) * invArea;
+                                Float4 z = splat(triangle.z) + l1 * splat(triangle.dz[0]) + l2 * splat(triangle.dz[1]);
+                                Float4 depth = load(depthRow + px);
+                                // Depth clip, then depth test (Less)
+                                Int4 passed = covered & (splat(0.0f) <= z) & (z <= splat(1.0f)) & (z < depth);
+                                int passedBits = laneBits(passed);
+                                if (passedBits != 0)
+                                {
+                                    statistics.fragmentsWritten += laneCount(passedBits);
+                                    store(depthRow + px, select(passed, z, depth));
+
+                                    if (writeColor)
+                                    {
+                                        uint8_t *pixels = colorRow + static_cast<size_t>(px) * 4;
+                                        Int4 destination = load(pixels);
+                                        Float4 rgb[3];
+                                        for (int k = 0; k < 3; ++k)
+                                        {
+                                            // fs_main: pow(in.color * uMyUniforms.color.rgb, 2.2)
+                                            Float4 color = splat(triangle.color[k]) + l1 * splat(triangle.dcolor[0][k]) + l2 * splat(triangle.dcolor[1][k]);
+                                            color = color * splat(uniforms.color[k]);
+                                            rgb[k] = min(powApprox(max(color, splat(0.0f)), 2.2f), splat(1.0f));
+                                        }
+                                        if (readColor)
+                                        {
+                                            Float4 srcFactor = splat(sourceAlpha);
+                                            Float4 dstFactor = splat(1.0f - sourceAlpha);
+                                            rgb[0] = rgb[0] * srcFactor + srgbToLinear(unpackChannel<0>(destination)) * dstFactor;
+                                            rgb[1] = rgb[1] * srcFactor + srgbToLinear(unpackChannel<8>(destination)) * dstFactor;
+                                            rgb[2] = rgb[2] * srcFactor + srgbToLinear(unpackChannel<16>(destination)) * dstFactor;
+                                        }
+                                        // Alpha blends with Zero / One: keep the destination's
+                                        Int4 result = packChannel(linearToSrgb(rgb[0])) |
+                                                      shiftLeft<8>(packChannel(linearToSrgb(rgb[1]))) |
+                                                      shiftLeft<16>(packChannel(linearToSrgb(rgb[2]))) |
+                                                      shiftLeft<24>(shiftRight<24>(destination));
+                                        store(pixels, select(passed, result, destination));
+                                    }
+                                }
+                            }
+
+                            for (int i = 0; i < 3; ++i)
+                            {
+                                e[i] = e[i] + groupStep[i];
+                            }
+                            x = x + splat(4);
+                        }
+                    }
+                }
+            }
+        });
+
+    RasterStatistics drawStatistics;
+    drawStatistics.triangles = triangleCount;
+    for (uint64_t count : setupCounts)
+    {
+        drawStatistics.trianglesRasterized += count;
+    }
+    for (const RasterStatistics &statistics : tileStatistics)
+    {
+        drawStatistics.merge(statistics);
+    }
+    m_statistics.merge(drawStatistics);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * The uniforms of shader.wgsl (MyUniforms), as laid out in the uniform
+ * buffer.
+ */
+struct RasterUniforms
+{
+    std::array<float, 4> color;
+    float time;
+    float _pad[3];
+};
+
+static_assert(sizeof(RasterUniforms) == 32, "RasterUniforms must match MyUniforms");
+
+/**
+ * The attachments of the render pass: an RGBA8UnormSrgb color target and a
+ * depth target. Depth is kept as 32-bit floats, which is what Depth24Plus
+ * maps to on most implementations.
+ *
+ * Rows are padded to a multiple of 4 pixels, so rasterization always works
+ * on whole groups of 4. Targets are at most 4096 pixels wide and high.
+ */
+struct RasterTarget
+{
+    RasterTarget(uint32_t width, uint32_t height);
+
+    size_t bytesPerRow() const { return static_cast<size_t>(stride) * 4; }
+
+    uint32_t width;
+    uint32_t height;
+    // Pixels per row, including padding
+    uint32_t stride;
+    // sRGB encoded RGBA, bytesPerRow() per row
+    std::vector<uint8_t> color;
+    std::vector<float> depth;
+};
+
+/**
+ * One drawIndexed() of the pyramid pipeline, with its bind group.
+ */
+struct RasterDraw
+{
+    // Vertices as laid out by loadGeometry(): `dimensions` coordinates
+    // followed by r g b. They must already be decoded, e.g. by
+    // PackedVertexFormat::unpack(), to see what the vertex shader sees.
+    const float *vertices = nullptr;
+    size_t vertexCount = 0;
+    int dimensions = 3;
+    const uint32_t *indices = nullptr;
+    size_t indexCount = 0;
+    // The uniform buffer, and the dynamic offset of this draw's
+    // RasterUniforms in it
+    const uint8_t *uniformBuffer = nullptr;
+    uint32_t uniformOffset = 0;
+};
+
+struct RasterStatistics
+{
+    uint64_t triangles = 0;
+    // Triangles left after dropping degenerate and off-screen ones
+    uint64_t trianglesRasterized = 0;
+    // Covered samples, before the depth test
+    uint64_t fragments = 0;
+    // Samples that passed the depth test, and were shaded and written
+    uint64_t fragmentsWritten = 0;
+
+    void merge(const RasterStatistics &other);
+};
+
+/**
+ * A CPU implementation of the subset of the pipeline state main.cpp uses,
+ * running the vertex and fragment logic of shader.wgsl:
+ *
+ *  - TriangleList topology, counter-clockwise front faces, no culling.
+ *  - Depth24Plus with the Less compare function and depth writes.
+ *  - SrcAlpha / OneMinusSrcAlpha color blending (alpha: Zero / One) into an
+ *    sRGB target, blending in linear space.
+ *  - A uniform binding with a dynamic offset per draw.
+ *
+ * vs_main always outputs w = 1, so attributes are interpolated linearly in
+ * screen space (which is then exact) and there is no clipping besides the
+ * per-fragment depth clip to [0, 1]. Coverage uses the top-left rule on
+ * vertex positions snapped to 1/16th of a pixel.
+ *
+ * Work is split across the thread pool in three passes per draw: vertex
+ * shading, triangle setup with binning into screen tiles, then one task per
+ * tile that rasterizes its triangles in submission order, so the result
+ * does not depend on the number of threads. The inner loops shade groups of
+ * 4 pixels with SSE2 where available, and with the same operations in
+ * scalar code otherwise.
+ */
+class SoftwareRasterizer
+{
+public:
+    /**
+     * `tileSize` is in pixels, a multiple of 4 no larger than 128.
+     */
+    explicit SoftwareRasterizer(ThreadPool &threadPool, uint32_t tileSize = 64);
+    ~SoftwareRasterizer();
+
+    SoftwareRasterizer(const SoftwareRasterizer &) = delete;
+    SoftwareRasterizer &operator=(const SoftwareRasterizer &) = delete;
+
+    /**
+     * The render pass load operations: `color` is a linear color, like the
+     * clear value of a color attachment.
+     */
+    void clear(RasterTarget &target, const std::array<float, 4> &color, float depth) const;
+
+    void draw(RasterTarget &target, const RasterDraw &draw);
+
+    const RasterStatistics &statistics() const { return m_statistics; }
+    void resetStatistics() { m_statistics = {}; }
+
+private:
+    struct ShadedVertex;
+    struct Triangle;
+
+    ThreadPool &m_threadPool;
+    uint32_t m_tileSize;
+    RasterStatistics m_statistics;
+
+    // Kept between draws to avoid reallocating them
+    std::vector<ShadedVertex> m_vertices;
+    // Positions to transform, all x then all y then all z
+    std::vector<float> m_positions;
+    std::vector<Triangle> m_triangles;
+    // Triangle indices per setup chunk, then per tile
+    std::vector<std::vector<uint32_t>> m_bins;
+};
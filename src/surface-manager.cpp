@@ -0,0 +1,221 @@
+#include "surface-manager.h"
+
+#include "trace-recorder.h"
+#include "webgpu-release.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace wgpu;
+
+SurfaceManager::SurfaceManager(Device device, Surface surface, TextureFormat colorFormat, TextureFormat depthFormat,
+                               uint32_t width, uint32_t height, PresentMode presentMode, std::chrono::milliseconds debounce)
+    : m_device(device), m_surface(surface), m_colorFormat(colorFormat), m_depthFormat(depthFormat),
+      m_presentMode(presentMode), m_debounce(debounce)
+{
+    SupportedLimits limits;
+    device.getLimits(&limits);
+    m_maxDimension = limits.limits.maxTextureDimension2D;
+    m_requestedWidth = std::min(width, m_maxDimension);
+    m_requestedHeight = std::min(height, m_maxDimension);
+    m_requestTime = std::chrono::steady_clock::now();
+}
+
+SurfaceManager::~SurfaceManager()
+{
+    releaseTargets();
+}
+
+PresentMode SurfaceManager::choosePresentMode(Surface surface, Adapter adapter, PresentMode preferred)
+{
+#ifdef WEBGPU_BACKEND_WGPU
+    WGPUSurfaceCapabilities capabilities = {};
+    wgpuSurfaceGetCapabilities(surface, adapter, &capabilities);
+    std::vector<WGPUPresentMode> supported(capabilities.presentModeCount);
+    capabilities.presentModes = supported.data();
+    wgpuSurfaceGetCapabilities(surface, adapter, &capabilities);
+
+    std::vector<PresentMode> candidates;
+    switch (preferred)
+    {
+    case PresentMode::Immediate:
+        candidates = {PresentMode::Immediate, PresentMode::Mailbox, PresentMode::Fifo};
+        break;
+    case PresentMode::Mailbox:
+        candidates = {PresentMode::Mailbox, PresentMode::Fifo};
+        break;
+    default:
+        candidates = {PresentMode::Fifo};
+        break;
+    }
+    for (PresentMode candidate : candidates)
+    {
+        if (std::find(supported.begin(), supported.end(), static_cast<WGPUPresentMode>(candidate)) != supported.end())
+        {
+            return candidate;
+        }
+    }
+    return PresentMode::Fifo;
+#else
+    (void)surface;
+    (void)adapter;
+    return preferred;
+#endif
+}
+
+const char *SurfaceManager::presentModeName(PresentMode mode)
+{
+    switch (mode)
+    {
+    case PresentMode::Immediate:
+        return "immediate";
+    case PresentMode::Mailbox:
+        return "mailbox";
+    case PresentMode::Fifo:
+        return "fifo";
+    default:
+        return "unknown";
+    }
+}
+
+void SurfaceManager::resize(uint32_t width, uint32_t height)
+{
+    ++m_resizeEventCount;
+    m_requestedWidth = std::min(width, m_maxDimension);
+    m_requestedHeight = std::min(height, m_maxDimension);
+    m_requestTime = std::chrono::steady_clock::now();
+}
+
+bool SurfaceManager::beginFrame()
+{
+    bool visible = m_requestedWidth > 0 && m_requestedHeight > 0;
+    bool changed = m_requestedWidth != m_width || m_requestedHeight != m_height;
+    // The first allocation has nothing to wait for
+    if (visible && changed && (!m_depthTexture || std::chrono::steady_clock::now() - m_requestTime >= m_debounce))
+    {
+        allocate(false);
+    }
+    ++m_frameCount;
+    return visible;
+}
+
+TextureView SurfaceManager::acquireColorView()
+{
+    TRACE_SCOPE("Acquire swap chain texture");
+    if (!m_swapChain)
+    {
+        return nullptr;
+    }
+    TextureView view = m_swapChain.getCurrentTextureView();
+    if (!view && m_requestedWidth > 0 && m_requestedHeight > 0)
+    {
+        allocate(true);
+        view = m_swapChain.getCurrentTextureView();
+    }
+    return view;
+}
+
+void SurfaceManager::present()
+{
+    if (m_swapChain)
+    {
+        TRACE_SCOPE("Present");
+        m_swapChain.present();
+    }
+}
+
+SurfaceViewport SurfaceManager::viewport(float aspectRatio) const
+{
+    SurfaceViewport viewport;
+    viewport.width = static_cast<float>(m_width);
+    viewport.height = static_cast<float>(m_height);
+    if (aspectRatio <= 0.0f || m_width == 0 || m_height == 0)
+    {
+        return viewport;
+    }
+    if (viewport.width > viewport.height * aspectRatio)
+    {
+        viewport.width = viewport.height * aspectRatio;
+        viewport.x = (m_width - viewport.width) / 2.0f;
+    }
+    else
+    {
+        viewport.height = viewport.width / aspectRatio;
+        viewport.y = (m_height - viewport.height) / 2.0f;
+    }
+    return viewport;
+}
+
+void SurfaceManager::allocate(bool forced)
+{
+    auto start = std::chrono::steady_clock::now();
+    releaseTargets();
+    m_width = m_requestedWidth;
+    m_height = m_requestedHeight;
+
+    if (m_surface)
+    {
+        SwapChainDescriptor swapChainDesc;
+        swapChainDesc.width = m_width;
+        swapChainDesc.height = m_height;
+        swapChainDesc.usage = TextureUsage::RenderAttachment;
+        swapChainDesc.format = m_colorFormat;
+        swapChainDesc.presentMode = m_presentMode;
+        m_swapChain = m_device.createSwapChain(m_surface, swapChainDesc);
+    }
+
+    TextureDescriptor depthTextureDesc;
+    depthTextureDesc.label = "Depth target";
+    depthTextureDesc.dimension = TextureDimension::_2D;
+    depthTextureDesc.format = m_depthFormat;
+    depthTextureDesc.mipLevelCount = 1;
+    depthTextureDesc.sampleCount = 1;
+    depthTextureDesc.size = {m_width, m_height, 1};
+    depthTextureDesc.usage = TextureUsage::RenderAttachment;
+    depthTextureDesc.viewFormatCount = 1;
+    depthTextureDesc.viewFormats = (WGPUTextureFormat *)&m_depthFormat;
+    m_depthTexture = m_device.createTexture(depthTextureDesc);
+
+    // The view of the depth texture manipulated by the rasterizer
+    TextureViewDescriptor depthTextureViewDesc;
+    depthTextureViewDesc.aspect = TextureAspect::DepthOnly;
+    depthTextureViewDesc.baseArrayLayer = 0;
+    depthTextureViewDesc.arrayLayerCount = 1;
+    depthTextureViewDesc.baseMipLevel = 0;
+    depthTextureViewDesc.mipLevelCount = 1;
+    depthTextureViewDesc.dimension = TextureViewDimension::_2D;
+    depthTextureViewDesc.format = m_depthFormat;
+    m_depthView = m_depthTexture.createView(depthTextureViewDesc);
+
+    SurfaceReallocation reallocation;
+    reallocation.frame = m_frameCount;
+    reallocation.width = m_width;
+    reallocation.height = m_height;
+    reallocation.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    reallocation.forced = forced;
+    m_reallocations.push_back(reallocation);
+    std::cout << "Render targets: " << m_width << "x" << m_height << " at frame " << reallocation.frame << " ("
+              << reallocation.seconds * 1000.0 << " ms" << (forced ? ", swap chain out of date" : "") << ")" << std::endl;
+}
+
+void SurfaceManager::releaseTargets()
+{
+    // Work already submitted keeps using them until it completes
+    if (m_depthView)
+    {
+        wgpuTextureViewRelease(m_depthView);
+        m_depthView = nullptr;
+    }
+    if (m_depthTexture)
+    {
+        m_depthTexture.destroy();
+        wgpuTextureRelease(m_depthTexture);
+        m_depthTexture = nullptr;
+    }
+    if (m_swapChain)
+    {
+        wgpuSwapChainRelease(m_swapChain);
+        m_swapChain = nullptr;
+    }
+}
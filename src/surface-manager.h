@@ -0,0 +1,152 @@
+#pragma once
+
+#include <webgpu/webgpu.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * When and why the targets were allocated again.
+ */
+struct SurfaceReallocation
+{
+    // Frames begun before it, see SurfaceManager::beginFrame()
+    uint64_t frame = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    double seconds = 0.0;
+    // Whether the swap chain could not be used anymore, which skips the
+    // debounce
+    bool forced = false;
+};
+
+/**
+ * A part of the target, e.g. to keep the proportions the pipelines were
+ * specialized for.
+ */
+struct SurfaceViewport
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float width = 0.0f;
+    float height = 0.0f;
+};
+
+/**
+ * The render targets whose size follows the framebuffer: the swap chain of
+ * a surface (if any) and the depth texture and its view.
+ *
+ * resize() only records the size, the targets are allocated again in
+ * beginFrame(), once the size has not changed for `debounce`. Resizing a
+ * window gives a burst of size events, one per mouse move, and only the
+ * last one matters; frames in the meantime draw to the previous targets.
+ * A swap chain that cannot give textures anymore (e.g. the swap chain
+ * is out of date) is recreated right away. Pipelines do not depend on the
+ * size and are left alone.
+ *
+ * Every allocation is recorded, to check that the targets are not
+ * allocated again every frame.
+ *
+ * The swap chain presents with a fixed mode, see choosePresentMode().
+ */
+class SurfaceManager
+{
+public:
+    static constexpr std::chrono::milliseconds DefaultDebounce{50};
+
+    /**
+     * A null `surface` manages the depth target only, e.g. for offscreen
+     * frames. The targets are allocated on the first beginFrame().
+     */
+    SurfaceManager(wgpu::Device device, wgpu::Surface surface, wgpu::TextureFormat colorFormat, wgpu::TextureFormat depthFormat,
+                   uint32_t width, uint32_t height, wgpu::PresentMode presentMode = wgpu::PresentMode::Fifo,
+                   std::chrono::milliseconds debounce = DefaultDebounce);
+    ~SurfaceManager();
+
+    SurfaceManager(const SurfaceManager &) = delete;
+    SurfaceManager &operator=(const SurfaceManager &) = delete;
+
+    /**
+     * `preferred` if the adapter can present to `surface` with it,
+     * otherwise the closest supported mode:
+     *  - Fifo waits for vertical blank, queueing frames: no tearing, but
+     *    the most latency. Every surface supports it.
+     *  - Mailbox waits for vertical blank, replacing the queued frame with
+     *    the newest: no tearing and little latency, falls back to Fifo.
+     *  - Immediate does not wait: the least latency, with tearing, falls
+     *    back to Mailbox then Fifo.
+     * Backends that cannot tell what a surface supports get `preferred`.
+     */
+    static wgpu::PresentMode choosePresentMode(wgpu::Surface surface, wgpu::Adapter adapter, wgpu::PresentMode preferred);
+
+    static const char *presentModeName(wgpu::PresentMode mode);
+
+    wgpu::PresentMode presentMode() const { return m_presentMode; }
+
+    /**
+     * The framebuffer is now `width` x `height` (0 when minimized). Sizes
+     * are clamped to the device's maxTextureDimension2D.
+     */
+    void resize(uint32_t width, uint32_t height);
+
+    /**
+     * Allocate the targets again if needed, before drawing a frame.
+     * Returns false when there is nothing to draw to (minimized window).
+     */
+    bool beginFrame();
+
+    /**
+     * The texture to draw the frame to, from the swap chain. Null if it
+     * cannot give one, even once recreated.
+     */
+    wgpu::TextureView acquireColorView();
+
+    void present();
+
+    wgpu::TextureView depthView() const { return m_depthView; }
+
+    /**
+     * Size of the targets, which lags behind resize() while debouncing.
+     */
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+
+    /**
+     * The largest centered part of the targets with the given width over
+     * height ratio.
+     */
+    SurfaceViewport viewport(float aspectRatio) const;
+
+    uint64_t frameCount() const { return m_frameCount; }
+    uint64_t resizeEventCount() const { return m_resizeEventCount; }
+    const std::vector<SurfaceReallocation> &reallocations() const { return m_reallocations; }
+
+private:
+    void allocate(bool forced);
+    void releaseTargets();
+
+    wgpu::Device m_device;
+    wgpu::Surface m_surface;
+    wgpu::TextureFormat m_colorFormat;
+    wgpu::TextureFormat m_depthFormat;
+    wgpu::PresentMode m_presentMode;
+    std::chrono::milliseconds m_debounce;
+    uint32_t m_maxDimension;
+
+    // Size of the framebuffer, and when it last changed
+    uint32_t m_requestedWidth;
+    uint32_t m_requestedHeight;
+    std::chrono::steady_clock::time_point m_requestTime;
+
+    // Size of the targets, 0 until allocated
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    wgpu::SwapChain m_swapChain = nullptr;
+    wgpu::Texture m_depthTexture = nullptr;
+    wgpu::TextureView m_depthView = nullptr;
+
+    uint64_t m_frameCount = 0;
+    uint64_t m_resizeEventCount = 0;
+    std::vector<SurfaceReallocation> m_reallocations;
+};
@@ -0,0 +1,106 @@
+#include "thread-pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_workers.reserve(threadCount - 1);
+    for (unsigned i = 1; i < threadCount; ++i)
+    {
+        m_workers.emplace_back([this]()
+                               { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeWorkers.notify_all();
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (m_workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> loopLock(m_loopMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_pending = count;
+        ++m_generation;
+    }
+    m_wakeWorkers.notify_all();
+
+    runTasks();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_loopDone.wait(lock, [this]()
+                    { return m_pending == 0; });
+    m_task = nullptr;
+}
+
+void ThreadPool::runTasks()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_task && m_next < m_count)
+    {
+        size_t i = m_next++;
+        const std::function<void(size_t)> &task = *m_task;
+        lock.unlock();
+        task(i);
+        lock.lock();
+        if (--m_pending == 0)
+        {
+            m_loopDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    uint64_t seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeWorkers.wait(lock, [&]()
+                               { return m_stopping || m_generation != seenGeneration; });
+            if (m_stopping)
+            {
+                return;
+            }
+            seenGeneration = m_generation;
+        }
+        runTasks();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads that run data-parallel loops. The calling
+ * thread takes part in the work, so a pool of N threads spawns N - 1
+ * workers and a pool of 1 runs everything inline.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * A threadCount of 0 means one thread per hardware thread.
+     */
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * Number of threads working on a loop, including the caller.
+     */
+    unsigned threadCount() const { return static_cast<unsigned>(m_workers.size()) + 1; }
+
+    /**
+     * Call task(i) for every i in [0, count) and return once all of them
+     * are done. Iterations are handed out one at a time, so tasks should be
+     * coarse (a chunk of work each, not a single element).
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+    /**
+     * A process-wide pool sized to the hardware, created on first use.
+     */
+    static ThreadPool &shared();
+
+private:
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeWorkers;
+    std::condition_variable m_loopDone;
+    // Serializes concurrent calls to parallelFor
+    std::mutex m_loopMutex;
+
+    // State of the loop currently running, guarded by m_mutex
+    const std::function<void(size_t)> *m_task = nullptr;
+    size_t m_count = 0;
+    size_t m_next = 0;
+    size_t m_pending = 0;
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+};
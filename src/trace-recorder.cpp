@@ -0,0 +1,148 @@
+#include "trace-recorder.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    void writeString(std::ostream &out, const std::string &text)
+    {
+        out << '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out << escaped;
+            }
+            else
+            {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    // Trace event times are in microseconds
+    void writeMicroseconds(std::ostream &out, uint64_t nanoseconds)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%llu.%03u", static_cast<unsigned long long>(nanoseconds / 1000),
+                      static_cast<unsigned>(nanoseconds % 1000));
+        out << text;
+    }
+} // namespace
+
+TraceBuffer::TraceBuffer(std::string name, uint32_t capacity)
+    : m_name(std::move(name))
+{
+    uint64_t size = 1;
+    while (size < capacity)
+    {
+        size *= 2;
+    }
+    m_events = std::make_unique<Event[]>(size);
+    m_mask = size - 1;
+}
+
+std::vector<TraceBuffer::Snapshot> TraceBuffer::snapshot() const
+{
+    uint64_t capacity = m_mask + 1;
+    uint64_t written = m_written.load(std::memory_order_acquire);
+    uint64_t first = written > capacity ? written - capacity : 0;
+    std::vector<Snapshot> events;
+    events.reserve(written - first);
+    for (uint64_t index = first; index < written; ++index)
+    {
+        const Event &event = m_events[index & m_mask];
+        events.push_back({event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed),
+                          event.duration.load(std::memory_order_relaxed)});
+    }
+
+    // The writer may have overwritten the oldest events while they were
+    // copied, including the one it is writing now
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t writtenAfter = m_written.load(std::memory_order_relaxed);
+    uint64_t firstIntact = writtenAfter + 1 > capacity ? writtenAfter + 1 - capacity : 0;
+    if (firstIntact > first)
+    {
+        events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(firstIntact - first, static_cast<uint64_t>(events.size()))));
+    }
+    return events;
+}
+
+TraceRecorder::TraceRecorder()
+    : m_origin(std::chrono::steady_clock::now())
+{
+}
+
+TraceRecorder &TraceRecorder::shared()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+void TraceRecorder::setThreadName(const std::string &name)
+{
+    TraceBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer.m_name = name;
+}
+
+TraceBuffer &TraceRecorder::addBuffer(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffers.push_back(std::make_unique<TraceBuffer>(name, DefaultCapacity));
+    return *m_buffers.back();
+}
+
+bool TraceRecorder::writeChromeTrace(const std::filesystem::path &path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    uint64_t eventCount = out ? writeChromeTrace(out) : 0;
+    if (!out)
+    {
+        std::cerr << "Could not write trace " << path << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << eventCount << " trace events to " << path << std::endl;
+    return true;
+}
+
+uint64_t TraceRecorder::writeChromeTrace(std::ostream &out) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t eventCount = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"App\"}}";
+    for (size_t tid = 0; tid < m_buffers.size(); ++tid)
+    {
+        const TraceBuffer &buffer = *m_buffers[tid];
+        // Timelines in the order they were created, the main thread first
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":";
+        writeString(out, buffer.m_name);
+        out << "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"sort_index\":" << tid
+            << "}}";
+        for (const TraceBuffer::Snapshot &event : buffer.snapshot())
+        {
+            out << ",\n{\"name\":";
+            writeString(out, event.name ? event.name : "");
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":";
+            writeMicroseconds(out, event.start);
+            out << ",\"dur\":";
+            writeMicroseconds(out, event.duration);
+            out << "}";
+            ++eventCount;
+        }
+    }
+    out << "\n]}\n";
+    return eventCount;
+}
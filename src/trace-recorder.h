@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A fixed number of the latest events of one timeline (a thread, or the
+ * GPU), overwritten oldest first.
+ *
+ * Only one thread writes to it, without locking: the event is stored, then
+ * published by bumping the write count. Readers copy events while it may
+ * be writing, and drop those the writer may have overwritten in the
+ * meantime, so that recording never waits for a flush.
+ */
+class TraceBuffer
+{
+public:
+    /**
+     * `capacity` is rounded up to a power of two.
+     */
+    TraceBuffer(std::string name, uint32_t capacity);
+
+    /**
+     * `name` must outlive the buffer, e.g. a string literal.
+     */
+    void record(const char *name, uint64_t startNanoseconds, uint64_t durationNanoseconds)
+    {
+        uint64_t index = m_written.load(std::memory_order_relaxed);
+        // Keeps the stores below after the previous event's m_written on
+        // weakly ordered CPUs too: a snapshot() that reads any of them
+        // (its acquire fence pairs with this one) then sees m_written at
+        // least at `index`, and drops the slot as overwritten
+        std::atomic_thread_fence(std::memory_order_release);
+        Event &event = m_events[index & m_mask];
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(startNanoseconds, std::memory_order_relaxed);
+        event.duration.store(durationNanoseconds, std::memory_order_relaxed);
+        m_written.store(index + 1, std::memory_order_release);
+    }
+
+    struct Snapshot
+    {
+        const char *name;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    /**
+     * The events still in the buffer, oldest first. Can be called from
+     * any thread.
+     */
+    std::vector<Snapshot> snapshot() const;
+
+private:
+    friend class TraceRecorder;
+
+    struct Event
+    {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> start{0};
+        std::atomic<uint64_t> duration{0};
+    };
+
+    // Guarded by the recorder's mutex
+    std::string m_name;
+    std::unique_ptr<Event[]> m_events;
+    uint64_t m_mask;
+    // On its own cache line, as the buffers of other threads are next to
+    // this one
+    alignas(64) std::atomic<uint64_t> m_written{0};
+};
+
+/**
+ * Records named scopes of the host (and the GPU, see GpuProfiler) for the
+ * whole process, to look at stalls after the fact in chrome://tracing or
+ * https://ui.perfetto.dev.
+ *
+ * Each thread records to its own TraceBuffer, created on its first scope,
+ * so recording a scope takes two clock reads and a few stores (well under
+ * 100 ns) and is cheap enough to leave enabled. Buffers outlive their
+ * threads, and keep the last `capacity` events each, which writeChromeTrace()
+ * writes as Chrome trace event JSON whenever asked.
+ *
+ *     void upload()
+ *     {
+ *         TRACE_SCOPE("Upload");
+ *         ...
+ *     }
+ */
+class TraceRecorder
+{
+public:
+    static constexpr uint32_t DefaultCapacity = 1 << 16;
+
+    /**
+     * The process-wide recorder, enabled from the start.
+     */
+    static TraceRecorder &shared();
+
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Nanoseconds since the recorder was created, the time of every event.
+     */
+    uint64_t now() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin).count());
+    }
+
+    /**
+     * Record a span of the calling thread from `start` (a now()) to now,
+     * for spans that are not a block.
+     */
+    void record(const char *name, uint64_t start)
+    {
+        if (enabled())
+        {
+            threadBuffer().record(name, start, now() - start);
+        }
+    }
+
+    /**
+     * The calling thread's buffer.
+     */
+    TraceBuffer &threadBuffer()
+    {
+        thread_local TraceBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            buffer = &addBuffer("Thread");
+        }
+        return *buffer;
+    }
+
+    /**
+     * Name the calling thread's timeline, e.g. "Main".
+     */
+    void setThreadName(const std::string &name);
+
+    /**
+     * A timeline that is not a thread (e.g. the GPU), for one thread to
+     * record to.
+     */
+    TraceBuffer &addTrack(const std::string &name) { return addBuffer(name); }
+
+    /**
+     * Write every buffer to `path`, in the Chrome trace event format.
+     * Recording goes on meanwhile.
+     */
+    bool writeChromeTrace(const std::filesystem::path &path) const;
+    // Returns the number of events written
+    uint64_t writeChromeTrace(std::ostream &out) const;
+
+private:
+    TraceRecorder();
+
+    TraceBuffer &addBuffer(const std::string &name);
+
+    std::chrono::steady_clock::time_point m_origin;
+    std::atomic<bool> m_enabled{true};
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> m_buffers;
+};
+
+/**
+ * Records the time from its creation to its destruction in the calling
+ * thread's buffer.
+ */
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : m_name(name), m_start(TraceRecorder::shared().enabled() ? TraceRecorder::shared().now() : NotRecording)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_start != NotRecording)
+        {
+            TraceRecorder &recorder = TraceRecorder::shared();
+            recorder.threadBuffer().record(m_name, m_start, recorder.now() - m_start);
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    static constexpr uint64_t NotRecording = ~uint64_t(0);
+
+    const char *m_name;
+    uint64_t m_start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Records the rest of the enclosing block under `name`, a string literal
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,73 @@
+#include "uniform-ring.h"
+
+#include "trace-recorder.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace wgpu;
+
+namespace
+{
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+} // namespace
+
+UniformRing::UniformRing(Device device, uint32_t alignment, uint64_t frameCapacity, uint32_t framesInFlight)
+    : m_alignment(alignment), m_frameCapacity(alignUp(frameCapacity, alignment)), m_regionCount(framesInFlight)
+{
+    BufferDescriptor bufferDesc;
+    bufferDesc.label = "Uniform ring";
+    bufferDesc.size = bufferSize(alignment, frameCapacity, framesInFlight);
+    bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Uniform;
+    bufferDesc.mappedAtCreation = false;
+    m_buffer = device.createBuffer(bufferDesc);
+
+    m_staging.resize(m_frameCapacity);
+}
+
+UniformRing::~UniformRing()
+{
+    if (m_buffer)
+    {
+        m_buffer.destroy();
+    }
+}
+
+uint64_t UniformRing::bufferSize(uint32_t alignment, uint64_t frameCapacity, uint32_t framesInFlight)
+{
+    return alignUp(frameCapacity, alignment) * framesInFlight;
+}
+
+void UniformRing::beginFrame(uint32_t region)
+{
+    m_currentRegion = region % m_regionCount;
+    m_frameUsage = 0;
+}
+
+uint32_t UniformRing::allocate(const void *data, size_t size)
+{
+    uint64_t offset = m_frameUsage;
+    uint64_t allocationSize = alignUp(size, m_alignment);
+    if (offset + allocationSize > m_frameCapacity)
+    {
+        std::cerr << "Uniform ring out of space (" << m_frameCapacity << " bytes per frame)" << std::endl;
+        return InvalidOffset;
+    }
+
+    std::memcpy(m_staging.data() + offset, data, size);
+    m_frameUsage += allocationSize;
+    return static_cast<uint32_t>(m_currentRegion * m_frameCapacity + offset);
+}
+
+void UniformRing::upload(Queue queue)
+{
+    TRACE_SCOPE("Upload uniforms");
+    if (m_frameUsage > 0)
+    {
+        // Offsets and sizes are multiples of the alignment, so of 4 too
+        queue.writeBuffer(m_buffer, m_currentRegion * m_frameCapacity, m_staging.data(), m_frameUsage);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <webgpu/webgpu.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Streams per-draw uniforms through a single buffer bound with a dynamic
+ * offset.
+ *
+ * The buffer is split in one region per frame in flight. Each frame
+ * sub-allocates aligned blocks from its region and gets their dynamic
+ * offsets right away, while the data is gathered on the CPU and sent in a
+ * single writeBuffer before the frame is submitted. The caller (usually a
+ * FramePacer) only starts a region once the GPU is done with the frame
+ * that last read it, so that writing it never has to wait for (or shadow)
+ * data still in use.
+ *
+ * Typical frame:
+ *
+ *     ring.beginFrame(slot);
+ *     uint32_t offset = ring.push(uniforms); // for each draw
+ *     renderPass.setBindGroup(0, bindGroup, 1, &offset);
+ *     ...
+ *     ring.upload(queue);
+ *     queue.submit(encoder.finish(...));
+ */
+class UniformRing
+{
+public:
+    static constexpr uint32_t InvalidOffset = ~uint32_t(0);
+
+    /**
+     * `alignment` is the device's minUniformBufferOffsetAlignment, and
+     * `frameCapacity` the bytes each frame can allocate (e.g. the number of
+     * draws times the aligned size of their uniforms).
+     */
+    UniformRing(wgpu::Device device, uint32_t alignment, uint64_t frameCapacity, uint32_t framesInFlight = 3);
+    ~UniformRing();
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    /**
+     * The size of the buffer such a ring creates, to check it against (or
+     * request) the device's maxBufferSize limit.
+     */
+    static uint64_t bufferSize(uint32_t alignment, uint64_t frameCapacity, uint32_t framesInFlight = 3);
+
+    wgpu::Buffer buffer() const { return m_buffer; }
+    uint32_t framesInFlight() const { return m_regionCount; }
+    // Bytes allocated so far in the current frame, padding included
+    uint64_t frameUsage() const { return m_frameUsage; }
+
+    /**
+     * Start allocating from `region`, which the GPU must be done with.
+     */
+    void beginFrame(uint32_t region);
+
+    /**
+     * Copy `size` bytes for this frame and return the dynamic offset to
+     * bind them with, or InvalidOffset if the frame is out of space.
+     */
+    uint32_t allocate(const void *data, size_t size);
+
+    template <typename T>
+    uint32_t push(const T &value) { return allocate(&value, sizeof(T)); }
+
+    /**
+     * Upload everything allocated during the frame in one write, to be
+     * submitted before the frame's commands.
+     */
+    void upload(wgpu::Queue queue);
+
+private:
+    wgpu::Buffer m_buffer = nullptr;
+    uint32_t m_alignment;
+    uint64_t m_frameCapacity;
+    uint32_t m_regionCount;
+    uint32_t m_currentRegion = 0;
+    uint64_t m_frameUsage = 0;
+    // CPU copy of the current region, sent as a whole by upload()
+    std::vector<uint8_t> m_staging;
+};
@@ -1,12 +1,11 @@
 
 #include "utils.cpp"
 
-bool loadGeometry(
-    const std::filesystem::path &path,
-    std::vector<float> &pointData,
-    std::vector<uint16_t> &indexData,
-    int dimensions);
-
+/**
+ * Load a WGSL shader, with `prelude` (e.g. generated definitions) inserted
+ * before the code of the file.
+ */
 wgpu::ShaderModule loadShaderModule(
     const std::filesystem::path &path,
-    wgpu::Device device);
+    wgpu::Device device,
+    const std::string &prelude = {});
@@ -0,0 +1,87 @@
+#include "vertex-layout.h"
+
+#include <cstring>
+
+namespace
+{
+    constexpr VertexAttributeMask AttributeBits[2] = {PositionAttribute, ColorAttribute};
+} // namespace
+
+VertexLayout::VertexLayout(const PackedVertexFormat &format, VertexLayoutMode mode)
+    : m_format(format), m_mode(mode), m_attributes(format.attributes)
+{
+    if (mode == VertexLayoutMode::Interleaved)
+    {
+        m_strides = {format.stride};
+        m_attributeBuffers = {0, 0};
+    }
+    else
+    {
+        // The color follows the position in the packed format, so the
+        // position buffer stride is the offset of the color
+        uint32_t colorOffset = static_cast<uint32_t>(format.attributes[1].offset);
+        m_strides = {colorOffset, format.stride - colorOffset};
+        m_attributeBuffers = {0, 1};
+        m_attributes[1].offset = 0;
+    }
+}
+
+VertexPassInput VertexLayout::passInput(VertexAttributeMask attributes) const
+{
+    VertexPassInput input;
+    // Reserve up front so that the layouts can point into the vector
+    input.attributes.reserve(m_attributes.size());
+
+    for (uint32_t buffer = 0; buffer < bufferCount(); ++buffer)
+    {
+        size_t first = input.attributes.size();
+        for (size_t i = 0; i < m_attributes.size(); ++i)
+        {
+            if (m_attributeBuffers[i] == buffer && (attributes & AttributeBits[i]))
+            {
+                input.attributes.push_back(m_attributes[i]);
+            }
+        }
+        if (input.attributes.size() == first)
+        {
+            // The pass does not read this buffer at all
+            continue;
+        }
+
+        WGPUVertexBufferLayout layout = {};
+        layout.arrayStride = m_strides[buffer];
+        layout.stepMode = WGPUVertexStepMode_Vertex;
+        layout.attributeCount = static_cast<uint32_t>(input.attributes.size() - first);
+        layout.attributes = input.attributes.data() + first;
+        input.bufferLayouts.push_back(layout);
+        input.buffers.push_back(buffer);
+    }
+    return input;
+}
+
+void VertexLayout::pack(const float *vertices, size_t vertexCount, std::vector<std::vector<uint8_t>> &blocks) const
+{
+    blocks.resize(bufferCount());
+    if (m_mode == VertexLayoutMode::Interleaved)
+    {
+        blocks[0].resize(bufferSize(0, vertexCount));
+        m_format.pack(vertices, vertexCount, blocks[0].data());
+        return;
+    }
+
+    m_interleaved.resize(m_format.packedSize(vertexCount));
+    m_format.pack(vertices, vertexCount, m_interleaved.data());
+
+    uint32_t sourceOffset = 0;
+    for (uint32_t buffer = 0; buffer < bufferCount(); ++buffer)
+    {
+        uint32_t bufferStride = m_strides[buffer];
+        std::vector<uint8_t> &block = blocks[buffer];
+        block.resize(bufferSize(buffer, vertexCount));
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            std::memcpy(block.data() + i * bufferStride, m_interleaved.data() + i * m_format.stride + sourceOffset, bufferStride);
+        }
+        sourceOffset += bufferStride;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "vertex-quantization.h"
+
+#include <webgpu/webgpu.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class VertexLayoutMode
+{
+    // One buffer holding whole vertices ("Option A")
+    Interleaved,
+    // One buffer per attribute, so that a pass reading only positions (depth
+    // prepass, shadows) fetches nothing else
+    Deinterleaved,
+};
+
+// The attributes a pass reads, as a combination of the bits below
+using VertexAttributeMask = uint32_t;
+constexpr VertexAttributeMask PositionAttribute = 1 << 0;
+constexpr VertexAttributeMask ColorAttribute = 1 << 1;
+constexpr VertexAttributeMask AllAttributes = PositionAttribute | ColorAttribute;
+
+/**
+ * What the pipeline of a given pass needs: `bufferLayouts` goes to
+ * `pipelineDesc.vertex.buffers`, and the buffer of the VertexLayout to bind
+ * at slot i of the pass is `buffers[i]`.
+ *
+ * The layouts point into `attributes`, so this can be moved but not copied.
+ */
+struct VertexPassInput
+{
+    VertexPassInput() = default;
+    VertexPassInput(const VertexPassInput &) = delete;
+    VertexPassInput &operator=(const VertexPassInput &) = delete;
+    VertexPassInput(VertexPassInput &&) = default;
+    VertexPassInput &operator=(VertexPassInput &&) = default;
+
+    std::vector<WGPUVertexAttribute> attributes;
+    std::vector<WGPUVertexBufferLayout> bufferLayouts;
+    std::vector<uint32_t> buffers;
+};
+
+/**
+ * How the vertices of a PackedVertexFormat are spread over vertex buffers.
+ * It packs the loader output into one block per buffer, and gives each
+ * pipeline the layouts of only the attributes its pass reads.
+ */
+class VertexLayout
+{
+public:
+    VertexLayout(const PackedVertexFormat &format, VertexLayoutMode mode);
+
+    const PackedVertexFormat &format() const { return m_format; }
+    VertexLayoutMode mode() const { return m_mode; }
+
+    uint32_t bufferCount() const { return static_cast<uint32_t>(m_strides.size()); }
+    uint32_t stride(uint32_t buffer) const { return m_strides[buffer]; }
+    uint64_t bufferSize(uint32_t buffer, size_t vertexCount) const { return static_cast<uint64_t>(vertexCount) * m_strides[buffer]; }
+    // Where the vertex at `vertexIndex` starts in `buffer`
+    uint64_t bufferOffset(uint32_t buffer, size_t vertexIndex) const { return bufferSize(buffer, vertexIndex); }
+
+    /**
+     * The layouts of the buffers holding `attributes`. Interleaved buffers
+     * keep their full stride, so a position only pass still fetches the
+     * other attributes along.
+     */
+    VertexPassInput passInput(VertexAttributeMask attributes) const;
+
+    /**
+     * Pack vertices as laid out by loadGeometry() into `blocks`, resized to
+     * one block of bufferSize(b, vertexCount) bytes per buffer b.
+     */
+    void pack(const float *vertices, size_t vertexCount, std::vector<std::vector<uint8_t>> &blocks) const;
+
+private:
+    PackedVertexFormat m_format;
+    VertexLayoutMode m_mode;
+    std::vector<uint32_t> m_strides;
+    // Attributes of the format, their offsets relative to their own buffer
+    std::array<WGPUVertexAttribute, 2> m_attributes = {};
+    std::array<uint32_t, 2> m_attributeBuffers = {};
+    // Scratch space for deinterleaving
+    mutable std::vector<uint8_t> m_interleaved;
+};
@@ -0,0 +1,423 @@
+#include "vertex-quantization.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    constexpr float Snorm16Max = 32767.0f;
+    constexpr float Unorm8Max = 255.0f;
+    constexpr float Float16Max = 65504.0f;
+
+    /**
+     * Round to the nearest half float, ties to even, like the GPU would.
+     */
+    uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        uint32_t magnitude = bits & 0x7fffffff;
+
+        if (magnitude >= 0x7f800000)
+        {
+            // Infinity and NaN
+            return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x0200 : 0);
+        }
+        if (magnitude >= 0x477ff000)
+        {
+            // Rounds above the largest half
+            return sign | 0x7c00;
+        }
+        if (magnitude < 0x38800000)
+        {
+            // Subnormal half, whose unit is 2^-24
+            float absolute;
+            std::memcpy(&absolute, &magnitude, sizeof(absolute));
+            return sign | static_cast<uint16_t>(std::nearbyint(absolute * 16777216.0f));
+        }
+        // Rebias the exponent (127 -> 15) and round the mantissa to 10 bits,
+        // a carry correctly bumping the exponent
+        uint32_t rounded = magnitude + 0x0fff + ((magnitude >> 13) & 1);
+        return sign | static_cast<uint16_t>((rounded - 0x38000000) >> 13);
+    }
+
+    float halfToFloat(uint16_t half)
+    {
+        uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x03ff;
+
+        if (exponent == 0)
+        {
+            float value = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -value : value;
+        }
+
+        uint32_t bits = exponent == 0x1f
+                            ? sign | 0x7f800000 | (mantissa << 13)
+                            : sign | ((exponent + 112) << 23) | (mantissa << 13);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    int16_t floatToSnorm16(float value)
+    {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * Snorm16Max));
+    }
+
+    float snorm16ToFloat(int16_t value)
+    {
+        return std::max(value / Snorm16Max, -1.0f);
+    }
+
+    uint8_t floatToUnorm8(float value)
+    {
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * Unorm8Max));
+    }
+
+    uint32_t positionSize(PositionEncoding encoding, int dimensions)
+    {
+        // There are no 3-component 16-bit formats, so 3D positions take 4
+        switch (encoding)
+        {
+        case PositionEncoding::Float16:
+        case PositionEncoding::Snorm16:
+            return dimensions == 2 ? 4 : 8;
+        default:
+            return dimensions * sizeof(float);
+        }
+    }
+
+    WGPUVertexFormat positionFormat(PositionEncoding encoding, int dimensions)
+    {
+        switch (encoding)
+        {
+        case PositionEncoding::Float16:
+            return dimensions == 2 ? WGPUVertexFormat_Float16x2 : WGPUVertexFormat_Float16x4;
+        case PositionEncoding::Snorm16:
+            return dimensions == 2 ? WGPUVertexFormat_Snorm16x2 : WGPUVertexFormat_Snorm16x4;
+        default:
+            return dimensions == 2 ? WGPUVertexFormat_Float32x2 : WGPUVertexFormat_Float32x3;
+        }
+    }
+
+    // Shortest decimal form that reads back as the same float, which WGSL
+    // accepts as a literal (e.g. "0.5", "2", "1e-05")
+    std::string wgslFloat(float value)
+    {
+        std::ostringstream stream;
+        stream.imbue(std::locale::classic());
+        stream.precision(std::numeric_limits<float>::max_digits10);
+        stream << value;
+        return stream.str();
+    }
+} // namespace
+
+VertexRanges::VertexRanges(int dimensions)
+    : dimensions(dimensions)
+{
+    positionMin.fill(0.0f);
+    positionMax.fill(0.0f);
+    for (int k = 0; k < dimensions; ++k)
+    {
+        positionMin[k] = std::numeric_limits<float>::infinity();
+        positionMax[k] = -std::numeric_limits<float>::infinity();
+    }
+    colorMin = std::numeric_limits<float>::infinity();
+    colorMax = -std::numeric_limits<float>::infinity();
+}
+
+void VertexRanges::add(const float *vertices, size_t count)
+{
+    int floatsPerVertex = dimensions + 3; // + r g b
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float *vertex = vertices + i * floatsPerVertex;
+        for (int k = 0; k < dimensions; ++k)
+        {
+            positionMin[k] = std::min(positionMin[k], vertex[k]);
+            positionMax[k] = std::max(positionMax[k], vertex[k]);
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            colorMin = std::min(colorMin, vertex[dimensions + k]);
+            colorMax = std::max(colorMax, vertex[dimensions + k]);
+        }
+    }
+    vertexCount += count;
+}
+
+void QuantizationError::merge(const QuantizationError &other)
+{
+    position = std::max(position, other.position);
+    color = std::max(color, other.color);
+}
+
+WGPUVertexBufferLayout PackedVertexFormat::vertexBufferLayout() const
+{
+    WGPUVertexBufferLayout layout = {};
+    layout.arrayStride = stride;
+    layout.stepMode = WGPUVertexStepMode_Vertex;
+    layout.attributeCount = static_cast<uint32_t>(attributes.size());
+    layout.attributes = attributes.data();
+    return layout;
+}
+
+void PackedVertexFormat::pack(const float *vertices, size_t vertexCount, void *packed) const
+{
+    int floatsPerVertex = dimensions + 3;
+    uint32_t colorOffset = static_cast<uint32_t>(attributes[1].offset);
+    uint8_t *out = static_cast<uint8_t *>(packed);
+    std::memset(out, 0, packedSize(vertexCount));
+
+    for (size_t i = 0; i < vertexCount; ++i, out += stride)
+    {
+        const float *vertex = vertices + i * floatsPerVertex;
+        for (int k = 0; k < dimensions; ++k)
+        {
+            float value = (vertex[k] - positionOffset[k]) / positionScale[k];
+            switch (positionEncoding)
+            {
+            case PositionEncoding::Snorm16:
+            {
+                int16_t snorm = floatToSnorm16(value);
+                std::memcpy(out + 2 * k, &snorm, sizeof(snorm));
+                break;
+            }
+            case PositionEncoding::Float16:
+            {
+                uint16_t half = floatToHalf(value);
+                std::memcpy(out + 2 * k, &half, sizeof(half));
+                break;
+            }
+            default:
+                std::memcpy(out + 4 * k, &value, sizeof(value));
+                break;
+            }
+        }
+
+        const float *color = vertex + dimensions;
+        if (colorEncoding == ColorEncoding::Unorm8)
+        {
+            uint8_t rgba[4] = {floatToUnorm8(color[0]), floatToUnorm8(color[1]), floatToUnorm8(color[2]), 255};
+            std::memcpy(out + colorOffset, rgba, sizeof(rgba));
+        }
+        else
+        {
+            std::memcpy(out + colorOffset, color, 3 * sizeof(float));
+        }
+    }
+}
+
+void PackedVertexFormat::unpack(const void *packed, size_t vertexCount, float *vertices) const
+{
+    int floatsPerVertex = dimensions + 3;
+    uint32_t colorOffset = static_cast<uint32_t>(attributes[1].offset);
+    const uint8_t *in = static_cast<const uint8_t *>(packed);
+
+    for (size_t i = 0; i < vertexCount; ++i, in += stride)
+    {
+        float *vertex = vertices + i * floatsPerVertex;
+        for (int k = 0; k < dimensions; ++k)
+        {
+            float fetched;
+            switch (positionEncoding)
+            {
+            case PositionEncoding::Snorm16:
+            {
+                int16_t snorm;
+                std::memcpy(&snorm, in + 2 * k, sizeof(snorm));
+                fetched = snorm16ToFloat(snorm);
+                break;
+            }
+            case PositionEncoding::Float16:
+            {
+                uint16_t half;
+                std::memcpy(&half, in + 2 * k, sizeof(half));
+                fetched = halfToFloat(half);
+                break;
+            }
+            default:
+                std::memcpy(&fetched, in + 4 * k, sizeof(fetched));
+                break;
+            }
+            vertex[k] = fetched * positionScale[k] + positionOffset[k];
+        }
+
+        float *color = vertex + dimensions;
+        if (colorEncoding == ColorEncoding::Unorm8)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                color[k] = in[colorOffset + k] / Unorm8Max;
+            }
+        }
+        else
+        {
+            std::memcpy(color, in + colorOffset, 3 * sizeof(float));
+        }
+    }
+}
+
+std::string PackedVertexFormat::wgslDecode() const
+{
+    auto vec3f = [](const std::array<float, 3> &v)
+    {
+        return "vec3f(" + wgslFloat(v[0]) + ", " + wgslFloat(v[1]) + ", " + wgslFloat(v[2]) + ")";
+    };
+
+    std::ostringstream code;
+    code << "// Vertex decoding, generated by PackedVertexFormat::wgslDecode()\n";
+    code << "const quantizedPositionScale = " << vec3f(positionScale) << ";\n";
+    code << "const quantizedPositionOffset = " << vec3f(positionOffset) << ";\n";
+    code << "\n";
+    code << "fn decodePosition(position: vec3f) -> vec3f {\n";
+    code << "    return position * quantizedPositionScale + quantizedPositionOffset;\n";
+    code << "}\n";
+    code << "\n";
+    code << "fn decodeColor(color: vec3f) -> vec3f {\n";
+    // Unorm8 is already back in [0, 1] when fetched
+    code << "    return color;\n";
+    code << "}\n";
+    code << "\n";
+    return code.str();
+}
+
+PackedVertexFormat choosePackedVertexFormat(const VertexRanges &ranges, const VertexQuantizationOptions &options)
+{
+    PackedVertexFormat format;
+    format.dimensions = ranges.dimensions;
+
+    if (ranges.vertexCount > 0)
+    {
+        // Center and half extent of the bounding box
+        float halfExtent = 0.0f;
+        float magnitude = 0.0f;
+        std::array<float, 3> center = {0.0f, 0.0f, 0.0f};
+        std::array<float, 3> halfExtents = {0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < ranges.dimensions; ++k)
+        {
+            center[k] = 0.5f * (ranges.positionMin[k] + ranges.positionMax[k]);
+            halfExtents[k] = 0.5f * (ranges.positionMax[k] - ranges.positionMin[k]);
+            halfExtent = std::max(halfExtent, halfExtents[k]);
+            magnitude = std::max({magnitude, std::abs(ranges.positionMin[k]), std::abs(ranges.positionMax[k])});
+        }
+
+        // Worst case rounding of each encoding, plus a few float ulps for
+        // the arithmetic of the transform itself
+        float tolerance = options.maxRelativePositionError * 2.0f * halfExtent;
+        float snorm16Error = 0.5f / Snorm16Max * halfExtent;
+        float float16Error = std::ldexp(halfExtent, -11);
+        float arithmeticError = 4.0f * FLT_EPSILON * magnitude;
+
+        PositionEncoding encoding = options.positionEncoding;
+        if (encoding == PositionEncoding::Auto)
+        {
+            // Both 16-bit encodings take the same space, and spreading the
+            // codes evenly over the box always has the smallest worst case
+            encoding = snorm16Error <= tolerance ? PositionEncoding::Snorm16 : PositionEncoding::Float32;
+        }
+        if (encoding == PositionEncoding::Float16 && halfExtent > Float16Max)
+        {
+            std::cerr << "Positions out of the half float range, keeping 32-bit floats" << std::endl;
+            encoding = PositionEncoding::Float32;
+        }
+
+        format.positionEncoding = encoding;
+        if (encoding == PositionEncoding::Snorm16)
+        {
+            format.positionOffset = center;
+            for (int k = 0; k < ranges.dimensions; ++k)
+            {
+                // A flat axis only ever encodes 0
+                format.positionScale[k] = halfExtents[k] > 0.0f ? halfExtents[k] : 1.0f;
+            }
+            format.errorBound.position = snorm16Error + arithmeticError;
+        }
+        else if (encoding == PositionEncoding::Float16)
+        {
+            format.positionOffset = center;
+            format.errorBound.position = float16Error + arithmeticError;
+        }
+
+        bool colorIsNormalized = ranges.colorMin >= 0.0f && ranges.colorMax <= 1.0f;
+        float unorm8Error = 0.5f / Unorm8Max;
+        ColorEncoding colorEncoding = options.colorEncoding;
+        if (colorEncoding == ColorEncoding::Auto)
+        {
+            colorEncoding = colorIsNormalized && unorm8Error <= options.maxColorError ? ColorEncoding::Unorm8 : ColorEncoding::Float32;
+        }
+        if (colorEncoding == ColorEncoding::Unorm8 && !colorIsNormalized)
+        {
+            std::cerr << "Colors out of [0, 1], keeping 32-bit floats" << std::endl;
+            colorEncoding = ColorEncoding::Float32;
+        }
+
+        format.colorEncoding = colorEncoding;
+        if (colorEncoding == ColorEncoding::Unorm8)
+        {
+            format.errorBound.color = unorm8Error + FLT_EPSILON;
+        }
+    }
+
+    uint32_t colorOffset = positionSize(format.positionEncoding, format.dimensions);
+    uint32_t colorSize = format.colorEncoding == ColorEncoding::Unorm8 ? 4 : 3 * sizeof(float);
+    format.stride = colorOffset + colorSize;
+
+    format.attributes[0].shaderLocation = 0;
+    format.attributes[0].format = positionFormat(format.positionEncoding, format.dimensions);
+    format.attributes[0].offset = 0;
+
+    format.attributes[1].shaderLocation = 1;
+    format.attributes[1].format = format.colorEncoding == ColorEncoding::Unorm8 ? WGPUVertexFormat_Unorm8x4 : WGPUVertexFormat_Float32x3;
+    format.attributes[1].offset = colorOffset;
+
+    return format;
+}
+
+QuantizationError measureQuantizationError(const PackedVertexFormat &format, const float *vertices, size_t vertexCount)
+{
+    int floatsPerVertex = format.dimensions + 3;
+    std::vector<uint8_t> packed(format.packedSize(vertexCount));
+    std::vector<float> unpacked(vertexCount * floatsPerVertex);
+    format.pack(vertices, vertexCount, packed.data());
+    format.unpack(packed.data(), vertexCount, unpacked.data());
+
+    QuantizationError error;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        const float *original = vertices + i * floatsPerVertex;
+        const float *decoded = unpacked.data() + i * floatsPerVertex;
+        for (int k = 0; k < format.dimensions; ++k)
+        {
+            error.position = std::max(error.position, std::abs(decoded[k] - original[k]));
+        }
+        for (int k = format.dimensions; k < floatsPerVertex; ++k)
+        {
+            error.color = std::max(error.color, std::abs(decoded[k] - original[k]));
+        }
+    }
+    return error;
+}
+
+bool validateQuantizationError(const PackedVertexFormat &format, const QuantizationError &error)
+{
+    std::cout << "Vertex quantization error: position " << error.position
+              << " (bound " << format.errorBound.position << "), color " << error.color
+              << " (bound " << format.errorBound.color << ")" << std::endl;
+
+    if (error.position > format.errorBound.position || error.color > format.errorBound.color)
+    {
+        std::cerr << "Vertex quantization error exceeds its bound!" << std::endl;
+        return false;
+    }
+    return true;
+}
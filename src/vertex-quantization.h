@@ -0,0 +1,125 @@
+#pragma once
+
+#include <webgpu/webgpu.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Value ranges of the vertices as laid out by loadGeometry(): `dimensions`
+ * position coordinates followed by an r g b color. Vertices can be added in
+ * several calls, e.g. block by block as they come out of a GeometryStream.
+ */
+struct VertexRanges
+{
+    explicit VertexRanges(int dimensions);
+
+    void add(const float *vertices, size_t vertexCount);
+
+    int dimensions;
+    size_t vertexCount = 0;
+    std::array<float, 3> positionMin;
+    std::array<float, 3> positionMax;
+    float colorMin;
+    float colorMax;
+};
+
+enum class PositionEncoding
+{
+    // Pick the most compact encoding within the error bound
+    Auto,
+    Float32,
+    // Half floats, relative to the center of the bounding box
+    Float16,
+    // Normalized 16-bit integers spanning the bounding box
+    Snorm16,
+};
+
+enum class ColorEncoding
+{
+    Auto,
+    Float32,
+    // Only possible for colors in [0, 1]
+    Unorm8,
+};
+
+struct VertexQuantizationOptions
+{
+    PositionEncoding positionEncoding = PositionEncoding::Auto;
+    ColorEncoding colorEncoding = ColorEncoding::Auto;
+    // Largest position error allowed, as a fraction of the largest extent of
+    // the bounding box
+    float maxRelativePositionError = 1.0f / 4096.0f;
+    // Largest error allowed on each color channel
+    float maxColorError = 1.0f / 255.0f;
+};
+
+/**
+ * Measured round trip error, in the units of the original vertices.
+ */
+struct QuantizationError
+{
+    float position = 0.0f;
+    float color = 0.0f;
+
+    void merge(const QuantizationError &other);
+};
+
+/**
+ * A packed vertex layout and the transform that goes with it.
+ *
+ * Shaders keep declaring `vec3f` inputs, whatever the formats: the vertex
+ * fetch converts normalized and half float formats to f32 (dropping or
+ * zero-filling the extra components), and the code returned by wgslDecode()
+ * undoes the scale and offset applied when packing.
+ */
+struct PackedVertexFormat
+{
+    int dimensions = 3;
+    PositionEncoding positionEncoding = PositionEncoding::Float32;
+    ColorEncoding colorEncoding = ColorEncoding::Float32;
+    // decoded = fetched * positionScale + positionOffset
+    std::array<float, 3> positionScale = {1.0f, 1.0f, 1.0f};
+    std::array<float, 3> positionOffset = {0.0f, 0.0f, 0.0f};
+    // Error bound guaranteed by the encodings, see QuantizationError
+    QuantizationError errorBound;
+    uint32_t stride = 0;
+    std::array<WGPUVertexAttribute, 2> attributes = {};
+
+    /**
+     * The layout for the pipeline. It points into `attributes`, so it is
+     * only valid as long as this object is alive and does not move.
+     */
+    WGPUVertexBufferLayout vertexBufferLayout() const;
+
+    uint64_t packedSize(size_t vertexCount) const { return static_cast<uint64_t>(vertexCount) * stride; }
+
+    // `packed` must hold packedSize(vertexCount) bytes
+    void pack(const float *vertices, size_t vertexCount, void *packed) const;
+    // The CPU equivalent of what the vertex fetch and wgslDecode() compute
+    void unpack(const void *packed, size_t vertexCount, float *vertices) const;
+
+    /**
+     * WGSL definitions of `decodePosition(vec3f) -> vec3f` and
+     * `decodeColor(vec3f) -> vec3f`, to put before the shader code.
+     */
+    std::string wgslDecode() const;
+};
+
+/**
+ * Choose the most compact formats that keep the error within the bounds of
+ * `options`, falling back to 32-bit floats otherwise.
+ */
+PackedVertexFormat choosePackedVertexFormat(const VertexRanges &ranges, const VertexQuantizationOptions &options = {});
+
+/**
+ * Pack then unpack the vertices and measure the largest difference.
+ */
+QuantizationError measureQuantizationError(const PackedVertexFormat &format, const float *vertices, size_t vertexCount);
+
+/**
+ * Check a measured error against the bound of the format, and report it.
+ */
+bool validateQuantizationError(const PackedVertexFormat &format, const QuantizationError &error);
@@ -0,0 +1,245 @@
+#include "vertex-transform.h"
+
+#include <cmath>
+#include <initializer_list>
+
+// This file must be compiled without floating point contraction (see
+// CMakeLists.txt), so that no path turns a multiply and an add into a fused
+// multiply-add, which rounds once instead of twice.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VERTEX_TRANSFORM_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define VERTEX_TRANSFORM_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only let a function use AVX2 instructions when it is
+// compiled for them, MSVC always does
+#if defined(VERTEX_TRANSFORM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+    /**
+     * One vertex, and the tail of the vectorized loops.
+     */
+    inline void transformVertex(const VertexTransform &t, VertexPositions in, ClipPositions out, size_t i)
+    {
+        float x = in.x[i];
+        float y = in.y[i];
+        float z = in.z[i];
+        float rotatedY = t.alpha * y + t.beta * z;
+        float rotatedZ = t.alpha * z - t.beta * y;
+        out.x[i] = x;
+        out.y[i] = rotatedY * t.ratio;
+        out.z[i] = rotatedZ * 0.5f + 0.5f;
+    }
+
+#ifdef VERTEX_TRANSFORM_X86
+    void transformSse(const VertexTransform &t, VertexPositions in, ClipPositions out, size_t count)
+    {
+        __m128 alpha = _mm_set1_ps(t.alpha);
+        __m128 beta = _mm_set1_ps(t.beta);
+        __m128 ratio = _mm_set1_ps(t.ratio);
+        __m128 half = _mm_set1_ps(0.5f);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in.x + i);
+            __m128 y = _mm_loadu_ps(in.y + i);
+            __m128 z = _mm_loadu_ps(in.z + i);
+            __m128 rotatedY = _mm_add_ps(_mm_mul_ps(alpha, y), _mm_mul_ps(beta, z));
+            __m128 rotatedZ = _mm_sub_ps(_mm_mul_ps(alpha, z), _mm_mul_ps(beta, y));
+            _mm_storeu_ps(out.x + i, x);
+            _mm_storeu_ps(out.y + i, _mm_mul_ps(rotatedY, ratio));
+            _mm_storeu_ps(out.z + i, _mm_add_ps(_mm_mul_ps(rotatedZ, half), half));
+        }
+        for (; i < count; ++i)
+        {
+            transformVertex(t, in, out, i);
+        }
+    }
+
+    TARGET_AVX2 void transformAvx2(const VertexTransform &t, VertexPositions in, ClipPositions out, size_t count)
+    {
+        __m256 alpha = _mm256_set1_ps(t.alpha);
+        __m256 beta = _mm256_set1_ps(t.beta);
+        __m256 ratio = _mm256_set1_ps(t.ratio);
+        __m256 half = _mm256_set1_ps(0.5f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(in.x + i);
+            __m256 y = _mm256_loadu_ps(in.y + i);
+            __m256 z = _mm256_loadu_ps(in.z + i);
+            __m256 rotatedY = _mm256_add_ps(_mm256_mul_ps(alpha, y), _mm256_mul_ps(beta, z));
+            __m256 rotatedZ = _mm256_sub_ps(_mm256_mul_ps(alpha, z), _mm256_mul_ps(beta, y));
+            _mm256_storeu_ps(out.x + i, x);
+            _mm256_storeu_ps(out.y + i, _mm256_mul_ps(rotatedY, ratio));
+            _mm256_storeu_ps(out.z + i, _mm256_add_ps(_mm256_mul_ps(rotatedZ, half), half));
+        }
+        for (; i < count; ++i)
+        {
+            transformVertex(t, in, out, i);
+        }
+    }
+
+    bool cpuHasAvx2()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        // Also checks that the OS saves the AVX registers
+        return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return false;
+#endif
+    }
+#endif
+
+#ifdef VERTEX_TRANSFORM_NEON
+    void transformNeon(const VertexTransform &t, VertexPositions in, ClipPositions out, size_t count)
+    {
+        float32x4_t alpha = vdupq_n_f32(t.alpha);
+        float32x4_t beta = vdupq_n_f32(t.beta);
+        float32x4_t ratio = vdupq_n_f32(t.ratio);
+        float32x4_t half = vdupq_n_f32(0.5f);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t x = vld1q_f32(in.x + i);
+            float32x4_t y = vld1q_f32(in.y + i);
+            float32x4_t z = vld1q_f32(in.z + i);
+            // Separate multiplies and adds, not vmlaq/vfmaq
+            float32x4_t rotatedY = vaddq_f32(vmulq_f32(alpha, y), vmulq_f32(beta, z));
+            float32x4_t rotatedZ = vsubq_f32(vmulq_f32(alpha, z), vmulq_f32(beta, y));
+            vst1q_f32(out.x + i, x);
+            vst1q_f32(out.y + i, vmulq_f32(rotatedY, ratio));
+            vst1q_f32(out.z + i, vaddq_f32(vmulq_f32(rotatedZ, half), half));
+        }
+        for (; i < count; ++i)
+        {
+            transformVertex(t, in, out, i);
+        }
+    }
+#endif
+} // namespace
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Scalar:
+        return "scalar";
+    case SimdLevel::SSE:
+        return "SSE";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::NEON:
+        return "NEON";
+    }
+    return "unknown";
+}
+
+bool isSimdLevelSupported(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Scalar:
+        return true;
+#ifdef VERTEX_TRANSFORM_X86
+    case SimdLevel::SSE:
+        return true;
+    case SimdLevel::AVX2:
+    {
+        static const bool hasAvx2 = cpuHasAvx2();
+        return hasAvx2;
+    }
+#endif
+#ifdef VERTEX_TRANSFORM_NEON
+    case SimdLevel::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+SimdLevel bestSimdLevel()
+{
+    static const SimdLevel best = []()
+    {
+        for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::SSE, SimdLevel::NEON})
+        {
+            if (isSimdLevelSupported(level))
+            {
+                return level;
+            }
+        }
+        return SimdLevel::Scalar;
+    }();
+    return best;
+}
+
+VertexTransform VertexTransform::fromTime(float time, float ratio)
+{
+    return {std::cos(time), std::sin(time), ratio};
+}
+
+void transformVertices(const VertexTransform &transform, VertexPositions in, ClipPositions out, size_t count)
+{
+    transformVertices(transform, in, out, count, bestSimdLevel());
+}
+
+void transformVertices(const VertexTransform &transform, VertexPositions in, ClipPositions out, size_t count, SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef VERTEX_TRANSFORM_X86
+    case SimdLevel::SSE:
+        transformSse(transform, in, out, count);
+        return;
+    case SimdLevel::AVX2:
+        transformAvx2(transform, in, out, count);
+        return;
+#endif
+#ifdef VERTEX_TRANSFORM_NEON
+    case SimdLevel::NEON:
+        transformNeon(transform, in, out, count);
+        return;
+#endif
+    default:
+        transformVerticesReference(transform, in, out, count);
+        return;
+    }
+}
+
+void transformVerticesReference(const VertexTransform &transform, VertexPositions in, ClipPositions out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        transformVertex(transform, in, out, i);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Instruction sets the vertex transform kernel has a path for.
+ */
+enum class SimdLevel
+{
+    Scalar,
+    // 4 lanes, x86 (always there on x86-64)
+    SSE,
+    // 8 lanes, x86, chosen at runtime when the CPU has it
+    AVX2,
+    // 4 lanes, ARM
+    NEON,
+};
+
+const char *simdLevelName(SimdLevel level);
+
+/**
+ * Whether this build has a path for `level` and the CPU runs it.
+ */
+bool isSimdLevelSupported(SimdLevel level);
+
+/**
+ * The widest supported level, detected once.
+ */
+SimdLevel bestSimdLevel();
+
+/**
+ * The parameters of the transform of vs_main: a rotation around the x axis
+ * by `time` radians, then the aspect ratio correction.
+ */
+struct VertexTransform
+{
+    // cos(time) and sin(time), as vs_main computes them
+    float alpha;
+    float beta;
+    // The aspectRatio override of the shader, the width over the height of
+    // the target (640 / 480 by default)
+    float ratio;
+
+    static VertexTransform fromTime(float time, float ratio = 640.0f / 480.0f);
+};
+
+/**
+ * Positions in structure of arrays layout: one array per coordinate.
+ */
+struct VertexPositions
+{
+    const float *x;
+    const float *y;
+    const float *z;
+};
+
+/**
+ * Clip space positions out of vs_main, whose w is always 1.
+ */
+struct ClipPositions
+{
+    float *x;
+    float *y;
+    float *z;
+};
+
+/**
+ * Compute out.position of vs_main for `count` vertices:
+ *
+ *   x' = x
+ *   y' = (alpha * y + beta * z) * ratio
+ *   z' = (alpha * z - beta * y) * 0.5 + 0.5
+ *
+ * Every path rounds each operation the same way as the scalar reference
+ * (no fused multiply-add), so they all give the same bits. The output may
+ * be the input arrays themselves. Arrays need no particular alignment.
+ *
+ * Note that the GPU's cos() and sin() may round differently from the
+ * host's, so clip positions match the GPU closely, but not bit for bit.
+ */
+void transformVertices(const VertexTransform &transform, VertexPositions in, ClipPositions out, size_t count);
+
+/**
+ * The same with a given instruction set, which must be supported.
+ */
+void transformVertices(const VertexTransform &transform, VertexPositions in, ClipPositions out, size_t count, SimdLevel level);
+
+/**
+ * The scalar reference the SIMD paths are checked against.
+ */
+void transformVerticesReference(const VertexTransform &transform, VertexPositions in, ClipPositions out, size_t count);
@@ -0,0 +1,738 @@
+#include "wgsl-preprocessor.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool isIdentifierStart(char c)
+    {
+        return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    bool isIdentifierChar(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    std::string trim(const std::string &text)
+    {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+        {
+            return {};
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    /**
+     * Split "word rest" into the word and the trimmed rest.
+     */
+    std::string takeWord(std::string &text)
+    {
+        text = trim(text);
+        size_t end = 0;
+        while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end])))
+        {
+            ++end;
+        }
+        std::string word = text.substr(0, end);
+        text = trim(text.substr(end));
+        return word;
+    }
+
+    bool isIdentifier(const std::string &text)
+    {
+        return !text.empty() && isIdentifierStart(text[0]) &&
+               std::all_of(text.begin(), text.end(), isIdentifierChar);
+    }
+
+    /**
+     * Recursive descent over an already macro-expanded #if expression.
+     */
+    class ExpressionParser
+    {
+    public:
+        explicit ExpressionParser(const std::string &text) : m_text(text) {}
+
+        bool parse(long long &value, std::string &error)
+        {
+            value = parseOr();
+            skipSpaces();
+            if (m_error.empty() && m_position != m_text.size())
+            {
+                m_error = "unexpected '" + m_text.substr(m_position) + "'";
+            }
+            error = m_error;
+            return m_error.empty();
+        }
+
+    private:
+        void skipSpaces()
+        {
+            while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position])))
+            {
+                ++m_position;
+            }
+        }
+
+        bool accept(const char *token)
+        {
+            skipSpaces();
+            size_t length = std::char_traits<char>::length(token);
+            if (m_text.compare(m_position, length, token) != 0)
+            {
+                return false;
+            }
+            // Do not take the first character of "<=" as "<", and so on
+            if (length == 1 && m_position + 1 < m_text.size() && m_text[m_position + 1] == '=' &&
+                (token[0] == '<' || token[0] == '>' || token[0] == '!' || token[0] == '='))
+            {
+                return false;
+            }
+            m_position += length;
+            return true;
+        }
+
+        long long parseOr()
+        {
+            long long value = parseAnd();
+            while (accept("||"))
+            {
+                long long right = parseAnd();
+                value = value || right;
+            }
+            return value;
+        }
+
+        long long parseAnd()
+        {
+            long long value = parseEquality();
+            while (accept("&&"))
+            {
+                long long right = parseEquality();
+                value = value && right;
+            }
+            return value;
+        }
+
+        long long parseEquality()
+        {
+            long long value = parseRelation();
+            while (true)
+            {
+                if (accept("=="))
+                {
+                    value = value == parseRelation();
+                }
+                else if (accept("!="))
+                {
+                    value = value != parseRelation();
+                }
+                else
+                {
+                    return value;
+                }
+            }
+        }
+
+        long long parseRelation()
+        {
+            long long value = parseAdditive();
+            while (true)
+            {
+                if (accept("<="))
+                {
+                    value = value <= parseAdditive();
+                }
+                else if (accept(">="))
+                {
+                    value = value >= parseAdditive();
+                }
+                else if (accept("<"))
+                {
+                    value = value < parseAdditive();
+                }
+                else if (accept(">"))
+                {
+                    value = value > parseAdditive();
+                }
+                else
+                {
+                    return value;
+                }
+            }
+        }
+
+        long long parseAdditive()
+        {
+            long long value = parseMultiplicative();
+            while (true)
+            {
+                bool add = accept("+");
+                if (!add && !accept("-"))
+                {
+                    return value;
+                }
+                long long right = parseMultiplicative();
+                if (add ? addOverflows(value, right) : subtractOverflows(value, right))
+                {
+                    setError("integer overflow");
+                    return 0;
+                }
+                value = add ? value + right : value - right;
+            }
+        }
+
+        long long parseMultiplicative()
+        {
+            long long value = parseUnary();
+            while (true)
+            {
+                char operation;
+                if (accept("*"))
+                {
+                    operation = '*';
+                }
+                else if (accept("/"))
+                {
+                    operation = '/';
+                }
+                else if (accept("%"))
+                {
+                    operation = '%';
+                }
+                else
+                {
+                    return value;
+                }
+                long long right = parseUnary();
+                if (operation == '*')
+                {
+                    if (multiplyOverflows(value, right))
+                    {
+                        setError("integer overflow");
+                        return 0;
+                    }
+                    value *= right;
+                }
+                else if (right == 0)
+                {
+                    setError("division by zero");
+                    return 0;
+                }
+                else if (value == std::numeric_limits<long long>::min() && right == -1)
+                {
+                    // Traps (SIGFPE) rather than wrapping
+                    setError("integer overflow");
+                    return 0;
+                }
+                else
+                {
+                    value = operation == '/' ? value / right : value % right;
+                }
+            }
+        }
+
+        long long parseUnary()
+        {
+            if (accept("!"))
+            {
+                return !parseUnary();
+            }
+            if (accept("-"))
+            {
+                long long value = parseUnary();
+                if (value == std::numeric_limits<long long>::min())
+                {
+                    setError("integer overflow");
+                    return 0;
+                }
+                return -value;
+            }
+            if (accept("+"))
+            {
+                return parseUnary();
+            }
+            return parsePrimary();
+        }
+
+        long long parsePrimary()
+        {
+            skipSpaces();
+            if (accept("("))
+            {
+                long long value = parseOr();
+                if (!accept(")"))
+                {
+                    setError("missing ')'");
+                }
+                return value;
+            }
+            if (m_position < m_text.size() && std::isdigit(static_cast<unsigned char>(m_text[m_position])))
+            {
+                const char *begin = m_text.c_str() + m_position;
+                char *end = nullptr;
+                errno = 0;
+                long long value = std::strtoll(begin, &end, 0);
+                m_position += end - begin;
+                if (errno == ERANGE)
+                {
+                    setError("'" + std::string(begin, static_cast<size_t>(end - begin)) + "' is out of range");
+                    return 0;
+                }
+                // WGSL integer suffixes
+                if (m_position < m_text.size() && (m_text[m_position] == 'u' || m_text[m_position] == 'i'))
+                {
+                    ++m_position;
+                }
+                if (m_position < m_text.size() && (isIdentifierChar(m_text[m_position]) || m_text[m_position] == '.'))
+                {
+                    setError("'" + std::string(begin) + "' is not an integer");
+                }
+                return value;
+            }
+            if (m_position < m_text.size() && isIdentifierStart(m_text[m_position]))
+            {
+                // A name that is not a macro
+                while (m_position < m_text.size() && isIdentifierChar(m_text[m_position]))
+                {
+                    ++m_position;
+                }
+                return 0;
+            }
+            setError(m_position < m_text.size() ? "unexpected '" + m_text.substr(m_position) + "'" : "missing operand");
+            return 0;
+        }
+
+        // Signed overflow is undefined behavior, so these are checked before
+        // computing, and reported like a division by zero
+        static bool addOverflows(long long left, long long right)
+        {
+            return right > 0 ? left > std::numeric_limits<long long>::max() - right
+                             : left < std::numeric_limits<long long>::min() - right;
+        }
+
+        static bool subtractOverflows(long long left, long long right)
+        {
+            return right < 0 ? left > std::numeric_limits<long long>::max() + right
+                             : left < std::numeric_limits<long long>::min() + right;
+        }
+
+        static bool multiplyOverflows(long long left, long long right)
+        {
+            if (left == 0 || right == 0)
+            {
+                return false;
+            }
+            if (left > 0)
+            {
+                return right > 0 ? left > std::numeric_limits<long long>::max() / right
+                                 : right < std::numeric_limits<long long>::min() / left;
+            }
+            return right > 0 ? left < std::numeric_limits<long long>::min() / right
+                             : left < std::numeric_limits<long long>::max() / right;
+        }
+
+        void setError(const std::string &error)
+        {
+            if (m_error.empty())
+            {
+                m_error = error;
+            }
+            // Stop parsing
+            m_position = m_text.size();
+        }
+
+        const std::string &m_text;
+        size_t m_position = 0;
+        std::string m_error;
+    };
+
+    class Preprocessor
+    {
+    public:
+        Preprocessor(const WgslDefines &defines, WgslSource &source)
+            : m_defines(defines), m_macros(defines), m_source(source)
+        {
+        }
+
+        bool processFile(const fs::path &path)
+        {
+            fs::path normalized = path.lexically_normal();
+            if (!m_included.insert(normalized).second)
+            {
+                return true;
+            }
+            std::ifstream file(normalized, std::ios::binary);
+            if (!file.is_open())
+            {
+                m_error = "Could not read " + normalized.string();
+                return false;
+            }
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            std::string text = buffer.str();
+            m_source.dependencies.push_back(normalized);
+
+            std::vector<Conditional> conditionals;
+            size_t lineStart = 0;
+            int lineNumber = 0;
+            while (lineStart < text.size())
+            {
+                size_t lineEnd = text.find('\n', lineStart);
+                if (lineEnd == std::string::npos)
+                {
+                    lineEnd = text.size();
+                }
+                std::string line = text.substr(lineStart, lineEnd - lineStart);
+                lineStart = lineEnd + 1;
+                ++lineNumber;
+
+                bool active = conditionals.empty() || conditionals.back().active;
+                std::string directiveLine = trim(line);
+                if (directiveLine.empty() || directiveLine[0] != '#')
+                {
+                    if (active)
+                    {
+                        m_source.code += expand(line);
+                    }
+                    m_source.code += '\n';
+                    continue;
+                }
+
+                std::string rest = directiveLine.substr(1);
+                std::string directive = takeWord(rest);
+                std::string error;
+                if (!directive.empty() && !processDirective(normalized, directive, rest, active, conditionals, error))
+                {
+                    if (m_error.empty())
+                    {
+                        m_error = normalized.string() + ":" + std::to_string(lineNumber) + ": " + error;
+                    }
+                    return false;
+                }
+                // Includes write their own lines
+                if (!(directive == "include" && active))
+                {
+                    m_source.code += '\n';
+                }
+            }
+            if (!conditionals.empty())
+            {
+                m_error = normalized.string() + ": missing #endif";
+                return false;
+            }
+            return true;
+        }
+
+        const std::string &error() const { return m_error; }
+
+    private:
+        struct Conditional
+        {
+            // Whether lines are kept
+            bool active;
+            // Whether a branch was already kept, or the enclosing block is
+            // inactive, so that the next branches are not
+            bool done;
+            bool sawElse;
+        };
+
+        bool processDirective(const fs::path &path, const std::string &directive, const std::string &rest, bool active,
+                              std::vector<Conditional> &conditionals, std::string &error)
+        {
+            if (directive == "if" || directive == "ifdef" || directive == "ifndef")
+            {
+                bool condition = false;
+                if (active && !evaluateCondition(directive, rest, condition, error))
+                {
+                    return false;
+                }
+                conditionals.push_back({active && condition, !active || condition, false});
+                return true;
+            }
+            if (directive == "elif" || directive == "else")
+            {
+                if (conditionals.empty() || conditionals.back().sawElse)
+                {
+                    error = "#" + directive + " without #if";
+                    return false;
+                }
+                Conditional &conditional = conditionals.back();
+                bool condition = directive == "else";
+                if (!conditional.done && directive == "elif" && !evaluateCondition("if", rest, condition, error))
+                {
+                    return false;
+                }
+                conditional.active = !conditional.done && condition;
+                conditional.done = conditional.done || condition;
+                conditional.sawElse = directive == "else";
+                return true;
+            }
+            if (directive == "endif")
+            {
+                if (conditionals.empty())
+                {
+                    error = "#endif without #if";
+                    return false;
+                }
+                conditionals.pop_back();
+                return true;
+            }
+            if (!active)
+            {
+                return true;
+            }
+
+            if (directive == "include")
+            {
+                if (rest.size() < 2 || rest.front() != '"' || rest.back() != '"')
+                {
+                    error = "expected #include \"file\"";
+                    return false;
+                }
+                return processFile(path.parent_path() / rest.substr(1, rest.size() - 2));
+            }
+            if (directive == "define" || directive == "undef")
+            {
+                std::string value = rest;
+                std::string name = takeWord(value);
+                if (!isIdentifier(name))
+                {
+                    error = "expected a name after #" + directive;
+                    return false;
+                }
+                if (directive == "define")
+                {
+                    m_macros[name] = value.empty() ? "1" : value;
+                }
+                else
+                {
+                    m_macros.erase(name);
+                }
+                return true;
+            }
+            if (directive == "permutation")
+            {
+                std::string values = rest;
+                WgslPermutationAxis axis;
+                axis.name = takeWord(values);
+                while (!values.empty())
+                {
+                    axis.values.push_back(takeWord(values));
+                }
+                if (!isIdentifier(axis.name) || axis.values.empty())
+                {
+                    error = "expected #permutation NAME value0 value1 ...";
+                    return false;
+                }
+                for (const WgslPermutationAxis &other : m_source.permutationAxes)
+                {
+                    if (other.name == axis.name)
+                    {
+                        error = "permutation " + axis.name + " is declared twice";
+                        return false;
+                    }
+                }
+                auto given = m_defines.find(axis.name);
+                if (given == m_defines.end())
+                {
+                    m_macros[axis.name] = axis.values.front();
+                }
+                else if (std::find(axis.values.begin(), axis.values.end(), given->second) == axis.values.end())
+                {
+                    error = axis.name + "=" + given->second + " is not one of the values of its permutation";
+                    return false;
+                }
+                m_source.permutationAxes.push_back(std::move(axis));
+                return true;
+            }
+            error = "unknown directive #" + directive;
+            return false;
+        }
+
+        bool evaluateCondition(const std::string &directive, const std::string &rest, bool &condition, std::string &error)
+        {
+            if (directive != "if")
+            {
+                if (!isIdentifier(rest))
+                {
+                    error = "expected a name after #" + directive;
+                    return false;
+                }
+                condition = (m_macros.count(rest) != 0) == (directive == "ifdef");
+                return true;
+            }
+
+            // Replace defined(NAME) and defined NAME before expanding macros
+            std::string text;
+            size_t i = 0;
+            while (i < rest.size())
+            {
+                if (!isIdentifierStart(rest[i]) || (i > 0 && isIdentifierChar(rest[i - 1])))
+                {
+                    text += rest[i++];
+                    continue;
+                }
+                size_t end = i;
+                while (end < rest.size() && isIdentifierChar(rest[end]))
+                {
+                    ++end;
+                }
+                std::string word = rest.substr(i, end - i);
+                i = end;
+                if (word != "defined")
+                {
+                    text += word;
+                    continue;
+                }
+                while (i < rest.size() && rest[i] == ' ')
+                {
+                    ++i;
+                }
+                bool parenthesis = i < rest.size() && rest[i] == '(';
+                size_t nameStart = parenthesis ? i + 1 : i;
+                while (nameStart < rest.size() && rest[nameStart] == ' ')
+                {
+                    ++nameStart;
+                }
+                size_t nameEnd = nameStart;
+                while (nameEnd < rest.size() && isIdentifierChar(rest[nameEnd]))
+                {
+                    ++nameEnd;
+                }
+                std::string name = rest.substr(nameStart, nameEnd - nameStart);
+                i = nameEnd;
+                while (parenthesis && i < rest.size() && rest[i] == ' ')
+                {
+                    ++i;
+                }
+                if (!isIdentifier(name) || (parenthesis && (i >= rest.size() || rest[i++] != ')')))
+                {
+                    error = "expected defined(NAME)";
+                    return false;
+                }
+                text += m_macros.count(name) ? " 1 " : " 0 ";
+            }
+
+            long long value = 0;
+            std::string expressionError;
+            if (!ExpressionParser(expand(text)).parse(value, expressionError))
+            {
+                error = "in #if " + rest + ": " + expressionError;
+                return false;
+            }
+            condition = value != 0;
+            return true;
+        }
+
+        /**
+         * Replace the macros in a line, and in what they expand to, without
+         * expanding a macro within itself.
+         */
+        std::string expand(const std::string &text)
+        {
+            std::string result;
+            size_t i = 0;
+            while (i < text.size())
+            {
+                char c = text[i];
+                if (std::isdigit(static_cast<unsigned char>(c)))
+                {
+                    // Keep literals such as 1e5f or 0x1Fu whole
+                    size_t end = i;
+                    while (end < text.size() && (isIdentifierChar(text[end]) || text[end] == '.'))
+                    {
+                        ++end;
+                    }
+                    result.append(text, i, end - i);
+                    i = end;
+                    continue;
+                }
+                if (!isIdentifierStart(c))
+                {
+                    result += c;
+                    ++i;
+                    continue;
+                }
+                size_t end = i;
+                while (end < text.size() && isIdentifierChar(text[end]))
+                {
+                    ++end;
+                }
+                std::string word = text.substr(i, end - i);
+                i = end;
+                auto macro = m_macros.find(word);
+                if (macro == m_macros.end() || std::find(m_expanding.begin(), m_expanding.end(), word) != m_expanding.end())
+                {
+                    result += word;
+                    continue;
+                }
+                m_expanding.push_back(word);
+                result += expand(macro->second);
+                m_expanding.pop_back();
+            }
+            return result;
+        }
+
+        const WgslDefines &m_defines;
+        WgslDefines m_macros;
+        WgslSource &m_source;
+        std::set<fs::path> m_included;
+        std::vector<std::string> m_expanding;
+        std::string m_error;
+    };
+} // namespace
+
+bool preprocessWgsl(const fs::path &path, const WgslDefines &defines, WgslSource &source, std::string &error)
+{
+    source = {};
+    Preprocessor preprocessor(defines, source);
+    if (!preprocessor.processFile(path))
+    {
+        error = preprocessor.error();
+        return false;
+    }
+    return true;
+}
+
+std::vector<WgslDefines> expandPermutations(const std::vector<WgslPermutationAxis> &axes)
+{
+    std::vector<WgslDefines> permutations(1);
+    for (const WgslPermutationAxis &axis : axes)
+    {
+        std::vector<WgslDefines> expanded;
+        expanded.reserve(permutations.size() * axis.values.size());
+        for (const WgslDefines &permutation : permutations)
+        {
+            for (const std::string &value : axis.values)
+            {
+                WgslDefines defines = permutation;
+                defines[axis.name] = value;
+                expanded.push_back(std::move(defines));
+            }
+        }
+        permutations = std::move(expanded);
+    }
+    return permutations;
+}
+
+std::string permutationName(const WgslDefines &permutation)
+{
+    std::string name;
+    for (const auto &define : permutation)
+    {
+        name += (name.empty() ? "" : ",") + define.first + "=" + define.second;
+    }
+    return name;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Macro names and values. Ordered, so that equal sets of definitions give
+ * the same cache key.
+ */
+using WgslDefines = std::map<std::string, std::string>;
+
+/**
+ * An axis of the permutation matrix of a shader, declared in it with
+ *
+ *     #permutation NAME value0 value1 ...
+ */
+struct WgslPermutationAxis
+{
+    std::string name;
+    // The first one is the default, when NAME is not defined otherwise
+    std::vector<std::string> values;
+};
+
+struct WgslSource
+{
+    std::string code;
+    // Every file read, the main one first, to know when the code is stale
+    std::vector<std::filesystem::path> dependencies;
+    // In the order they were declared
+    std::vector<WgslPermutationAxis> permutationAxes;
+};
+
+/**
+ * Run a C-like preprocessor over a WGSL file:
+ *
+ *  - `#include "file.wgsl"`, relative to the including file. A file is
+ *    included at most once, WGSL declarations cannot be repeated.
+ *  - `#define NAME value`, `#define NAME` (which defines it to 1) and
+ *    `#undef NAME`. Names are replaced by their value in code, as whole
+ *    identifiers (comments included), so that e.g. `const ratio =
+ *    f32(WIDTH) / f32(HEIGHT);` folds at shader compile time.
+ *  - `#if expr`, `#ifdef NAME`, `#ifndef NAME`, `#elif expr`, `#else` and
+ *    `#endif`, with integer expressions made of numbers, macros,
+ *    `defined(NAME)`, parentheses and the C operators ! * / % + - < <= >
+ *    >= == != && ||. Unknown names are 0.
+ *  - `#permutation NAME value0 value1 ...`, which declares an axis of the
+ *    permutation matrix and defines NAME to value0 unless `defines` already
+ *    has it.
+ *
+ * Directives start a line (after spaces). Lines they remove are left empty,
+ * so that the compiler's line numbers stay meaningful in the main file up
+ * to its first include.
+ *
+ * `defines` are defined before the first line. On failure, returns false
+ * with a message naming the file and line.
+ */
+bool preprocessWgsl(const std::filesystem::path &path, const WgslDefines &defines, WgslSource &source, std::string &error);
+
+/**
+ * All combinations of the values of `axes`, the first axis varying slowest.
+ * No axes give a single empty set of definitions.
+ */
+std::vector<WgslDefines> expandPermutations(const std::vector<WgslPermutationAxis> &axes);
+
+/**
+ * A readable name for a permutation, e.g. "GAMMA_CORRECTION=0,SHADING=1".
+ */
+std::string permutationName(const WgslDefines &permutation);
@@ -0,0 +1,173 @@
+/**
+ * Checks the readback bookkeeping of gpu-profiler.h against
+ * libs/webgpu-mock, whose callbacks can be held to play a GPU that is
+ * still busy:
+ *
+ *  - a frame's readback goes Free -> Resolved -> Mapping -> Mapped -> Free,
+ *    and its timestamps become one sample of its scope;
+ *  - a frame that finds every readback still mapping is not measured and
+ *    counts as dropped, until the mapping completes;
+ *  - a scope whose end timestamp is before its beginning is dropped;
+ *  - without the TimestampQuery feature, scopes are timed on the CPU.
+ *
+ * Usage: GpuProfilerCheck (exits non-zero on failure)
+ */
+
+#define WEBGPU_CPP_IMPLEMENTATION
+#include <webgpu/webgpu.hpp>
+#include <webgpu-mock.h>
+
+#include "gpu-profiler.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace wgpu;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string &what)
+    {
+        std::cout << (condition ? "ok      " : "FAILED  ") << what << std::endl;
+        failures += condition ? 0 : 1;
+    }
+
+    Device createDevice(bool timestampQuery)
+    {
+        static Instance instance = createInstance(InstanceDescriptor{});
+        static Adapter adapter = instance.requestAdapter(RequestAdapterOptions{});
+        WGPUFeatureName feature = WGPUFeatureName_TimestampQuery;
+        DeviceDescriptor deviceDesc;
+        deviceDesc.label = timestampQuery ? "Device with timestamps" : "Device without timestamps";
+        deviceDesc.requiredFeaturesCount = timestampQuery ? 1 : 0;
+        deviceDesc.requiredFeatures = timestampQuery ? &feature : nullptr;
+        deviceDesc.requiredLimits = nullptr;
+        deviceDesc.defaultQueue.label = "Queue";
+        return adapter.requestDevice(deviceDesc);
+    }
+
+    uint64_t callCount(const char *function)
+    {
+        return webgpu_mock::statistics().call(function).count;
+    }
+
+    uint64_t samplesOf(const GpuProfiler &profiler, const std::string &name)
+    {
+        for (const GpuScopeStatistics &scope : profiler.scopeStatistics())
+        {
+            if (scope.name == name)
+            {
+                return scope.samples;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * One frame with a scope around an empty span of the encoder, left
+     * open if not `endScope`. Returns the scope, InvalidScope if the frame
+     * was not measured.
+     */
+    uint32_t frame(Device device, GpuProfiler &profiler, const char *name, bool endScope = true)
+    {
+        profiler.beginFrame();
+        CommandEncoder encoder = device.createCommandEncoder(CommandEncoderDescriptor{});
+        uint32_t scope = profiler.beginScope(encoder, name);
+        if (endScope)
+        {
+            profiler.endScope(encoder, scope);
+        }
+        profiler.resolve(encoder);
+        CommandBuffer commands = encoder.finish(CommandBufferDescriptor{});
+        device.getQueue().submit(commands);
+        profiler.afterSubmit();
+        return scope;
+    }
+
+    void checkReadbackCycle()
+    {
+        Device device = createDevice(true);
+        // One readback buffer, so that each state is the only one
+        GpuProfiler profiler(device, true, 4, 1);
+        check(profiler.usesTimestamps(), "timestamps are used with TimestampQuery");
+
+        webgpu_mock::resetStatistics();
+        uint32_t scope = frame(device, profiler, "Pass");
+        check(scope != GpuProfiler::InvalidScope, "Free: the first frame is measured");
+        check(callCount("wgpuCommandEncoderResolveQuerySet") == 1, "Resolved: the timestamps are resolved once");
+        check(callCount("wgpuBufferMapAsync") == 1 && profiler.statistics().resolvedFrames == 0,
+              "Mapping: the readback is mapped after submit, nothing read yet");
+
+        webgpu_mock::setCallbacksHeld(true);
+        uint32_t busyScope = frame(device, profiler, "Pass");
+        check(busyScope == GpuProfiler::InvalidScope, "while mapping, the next frame is not measured");
+        check(profiler.statistics().droppedFrames == 1, "it counts as a dropped frame");
+        check(callCount("wgpuBufferMapAsync") == 1, "and maps nothing");
+        webgpu_mock::setCallbacksHeld(false);
+
+        uint32_t nextScope = frame(device, profiler, "Pass");
+        check(callCount("wgpuBufferGetConstMappedRange") == 1 && samplesOf(profiler, "Pass") == 1,
+              "Mapped: the timestamps are read into one sample");
+        check(callCount("wgpuBufferUnmap") == 1 && profiler.statistics().resolvedFrames == 1, "the readback is unmapped");
+        check(nextScope != GpuProfiler::InvalidScope, "Free: the frame after that is measured again");
+        check(profiler.statistics().droppedFrames == 1 && profiler.statistics().droppedScopes == 0,
+              "no more frames or scopes dropped");
+
+        profiler.beginFrame();
+        std::vector<GpuScopeStatistics> statistics = profiler.scopeStatistics();
+        check(statistics.size() == 1 && statistics[0].samples == 2, "two frames read back, in one scope");
+        check(statistics.size() == 1 && statistics[0].minSeconds >= 0.0 && statistics[0].maxSeconds < 1.0,
+              "durations come from the mock's timestamps");
+    }
+
+    void checkEndBeforeBegin()
+    {
+        Device device = createDevice(true);
+        GpuProfiler profiler(device, true, 4, 1);
+        // The end query is never written, and keeps 0 from the creation of
+        // the query set
+        frame(device, profiler, "Open", false);
+        profiler.beginFrame();
+        check(profiler.statistics().resolvedFrames == 1, "a frame with an open scope is read back");
+        check(profiler.statistics().droppedScopes == 1 && samplesOf(profiler, "Open") == 0,
+              "its end before its beginning drops the scope");
+    }
+
+    void checkCpuFallback()
+    {
+        Device device = createDevice(false);
+        GpuProfiler profiler(device);
+        check(!profiler.usesTimestamps(), "no timestamps without TimestampQuery");
+
+        webgpu_mock::resetStatistics();
+        profiler.beginFrame();
+        WGPURenderPassDescriptor renderPassDesc = {};
+        uint32_t scope = profiler.beginPass("Pass", renderPassDesc);
+        check(scope != GpuProfiler::InvalidScope && renderPassDesc.timestampWriteCount == 0, "passes get no timestamp writes");
+        profiler.endPass(scope);
+        check(samplesOf(profiler, "Pass") == 1, "a pass is timed on the CPU right away");
+
+        CommandEncoder encoder = device.createCommandEncoder(CommandEncoderDescriptor{});
+        profiler.endScope(encoder, profiler.beginScope(encoder, "Scope"));
+        profiler.resolve(encoder);
+        profiler.afterSubmit();
+        check(samplesOf(profiler, "Scope") == 1, "so is a scope of an encoder");
+        check(callCount("wgpuCommandEncoderWriteTimestamp") == 0 && callCount("wgpuBufferMapAsync") == 0,
+              "no queries written or read back");
+
+        GpuProfiler disabled(createDevice(true), false);
+        check(!disabled.usesTimestamps(), "no timestamps when not asked to, even with TimestampQuery");
+    }
+} // namespace
+
+int main()
+{
+    checkReadbackCycle();
+    checkEndBeforeBegin();
+    checkCpuFallback();
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
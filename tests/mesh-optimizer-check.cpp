@@ -0,0 +1,164 @@
+/**
+ * Checks the CPU cache simulators and optimization stages of
+ * mesh-optimizer.h on meshes small enough to know the answers of:
+ *
+ *  - a triangle strip transforms each vertex once (ATVR 1), in any cache;
+ *  - the same strip in a scattered order misses far more, exactly as much
+ *    as a plain FIFO replay says, and optimizeVertexCache() recovers it;
+ *  - welding a triangle list with duplicated corners keeps one vertex per
+ *    position and the same triangles;
+ *  - optimizeMesh() refuses indices past the last vertex.
+ *
+ * Usage: MeshOptimizerCheck (exits non-zero on failure)
+ */
+
+#include "mesh-optimizer.h"
+
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string &what)
+    {
+        std::cout << (condition ? "ok      " : "FAILED  ") << what << std::endl;
+        failures += condition ? 0 : 1;
+    }
+
+    bool near(double value, double expected)
+    {
+        return std::abs(value - expected) < 1e-9;
+    }
+
+    // Triangles (i, i+1, i+2) over triangleCount + 2 vertices
+    std::vector<uint32_t> strip(uint32_t triangleCount)
+    {
+        std::vector<uint32_t> indices;
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            indices.insert(indices.end(), {t, t + 1, t + 2});
+        }
+        return indices;
+    }
+
+    // The same triangles, visited with a stride so that neighbours are far
+    // apart in the index buffer
+    std::vector<uint32_t> scattered(const std::vector<uint32_t> &indices, uint32_t stride)
+    {
+        uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+        std::vector<uint32_t> result;
+        for (uint32_t i = 0; i < triangleCount; ++i)
+        {
+            uint32_t t = (i * stride) % triangleCount;
+            result.insert(result.end(), indices.begin() + 3 * t, indices.begin() + 3 * t + 3);
+        }
+        return result;
+    }
+
+    // Vertex shader invocations of a FIFO cache, simulated the plain way
+    size_t fifoMisses(const std::vector<uint32_t> &indices, size_t cacheSize)
+    {
+        std::deque<uint32_t> fifo;
+        size_t misses = 0;
+        for (uint32_t index : indices)
+        {
+            bool hit = false;
+            for (uint32_t cached : fifo)
+            {
+                hit = hit || cached == index;
+            }
+            if (!hit)
+            {
+                ++misses;
+                fifo.push_back(index);
+                if (fifo.size() > cacheSize)
+                {
+                    fifo.pop_front();
+                }
+            }
+        }
+        return misses;
+    }
+
+    void checkVertexCache()
+    {
+        constexpr uint32_t TriangleCount = 100;
+        constexpr size_t VertexCount = TriangleCount + 2;
+        std::vector<uint32_t> good = strip(TriangleCount);
+        VertexCacheStatistics stripStatistics = analyzeVertexCache(good, VertexCount);
+        check(stripStatistics.transformedVertexCount == VertexCount, "strip transforms each vertex once");
+        check(near(stripStatistics.atvr, 1.0), "strip ATVR is 1");
+        check(near(stripStatistics.acmr, static_cast<double>(VertexCount) / TriangleCount), "strip ACMR is (n + 2) / n");
+        check(analyzeVertexCache(good, VertexCount, 3).transformedVertexCount == VertexCount, "strip needs a cache of 3 only");
+
+        std::vector<uint32_t> bad = scattered(good, 37);
+        VertexCacheStatistics badStatistics = analyzeVertexCache(bad, VertexCount);
+        check(badStatistics.transformedVertexCount == fifoMisses(bad, DefaultVertexCacheSize), "scattered strip matches a FIFO replay");
+        check(badStatistics.acmr > 2.5, "scattered strip ACMR is close to 3 (" + std::to_string(badStatistics.acmr) + ")");
+        check(analyzeVertexCache(bad, VertexCount, 1).transformedVertexCount == fifoMisses(bad, 1), "cache of 1 matches a FIFO replay");
+
+        optimizeVertexCache(bad, VertexCount);
+        VertexCacheStatistics optimized = analyzeVertexCache(bad, VertexCount);
+        check(optimized.acmr < 1.5, "optimizeVertexCache brings the ACMR back down (" + std::to_string(optimized.acmr) + ")");
+        check(indicesInRange(bad, VertexCount) && bad.size() == good.size(), "optimizeVertexCache keeps every triangle");
+    }
+
+    void checkWeld()
+    {
+        // A quad as two triangles with their own corners: (0, 0) and (1, 1)
+        // appear twice
+        std::vector<float> points = {
+            0, 0, 1, 0, 0,
+            1, 0, 0, 1, 0,
+            1, 1, 0, 0, 1,
+            0, 0, 1, 0, 0,
+            1, 1, 0, 0, 1,
+            0, 1, 1, 1, 1,
+        };
+        std::vector<uint32_t> indices = {0, 1, 2, 3, 4, 5};
+        std::vector<float> corners;
+        for (uint32_t index : indices)
+        {
+            corners.insert(corners.end(), points.begin() + 5 * index, points.begin() + 5 * index + 5);
+        }
+
+        size_t vertexCount = weldVertices(points, indices, 5);
+        check(vertexCount == 4 && points.size() == 4 * 5, "welding keeps 4 of 6 vertices");
+        check(indices.size() == 6 && indicesInRange(indices, vertexCount), "welded indices are in range");
+        std::vector<float> weldedCorners;
+        for (uint32_t index : indices)
+        {
+            weldedCorners.insert(weldedCorners.end(), points.begin() + 5 * index, points.begin() + 5 * index + 5);
+        }
+        check(weldedCorners == corners, "welded triangles have the same corners");
+        check(indices[0] == indices[3] && indices[2] == indices[4], "duplicates share one index");
+
+        size_t fetched = optimizeVertexFetch(points, indices, 5);
+        check(fetched == 4 && indices == std::vector<uint32_t>({0, 1, 2, 0, 2, 3}), "vertex fetch order is first use");
+    }
+
+    void checkOutOfRange()
+    {
+        std::vector<float> points = {0, 0, 1, 0, 0, 1, 0, 0, 1, 0};
+        std::vector<uint32_t> indices = {0, 1, 99};
+        std::vector<float> pointsBefore = points;
+        std::vector<uint32_t> indicesBefore = indices;
+        MeshOptimizationReport report;
+        bool optimized = optimizeMesh(points, indices, 5, report);
+        check(!optimized && points == pointsBefore && indices == indicesBefore, "optimizeMesh rejects index 99 of 2 vertices");
+    }
+} // namespace
+
+int main()
+{
+    checkVertexCache();
+    checkWeld();
+    checkOutOfRange();
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+/**
+ * Renders the frames of the headless App on the CPU, with the reference
+ * rasterizer of software-rasterizer.h: the same geometry, vertex packing,
+ * uniforms (a 60 Hz clock, then a block of zeros for the second draw) and
+ * pipeline state.
+ *
+ * Usage: SoftwareRender [geometry.txt] [--frames N] [--threads N]
+ *                       [--size WxH] [--output dir] [--format png|raw]
+ *                       [--compare dir] [--tolerance N] [--scaling]
+ *
+ *  - --output writes frame-NNNNN.png (or .rgba) files, named like the ones
+ *    of `App --headless`, to be kept as golden images.
+ *  - --compare checks each frame against frame-NNNNN.rgba in a directory
+ *    (golden images, or `App --headless N --format raw` output from a GPU),
+ *    allowing channels to differ by --tolerance (default 1), and fails if
+ *    any frame does not match.
+ *  - --scaling renders the frames with 1 to N threads, and checks that all
+ *    thread counts give the same images.
+ *
+ * Throughput is reported in triangles per second and fill rate (fragments
+ * written per second), file I/O excluded.
+ */
+
+#include "geometry.h"
+#include "image-writer.h"
+#include "software-rasterizer.h"
+#include "thread-pool.h"
+#include "vertex-quantization.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        fs::path geometryPath = RESOURCE_DIR "pyramid.txt";
+        uint32_t frameCount = 60;
+        unsigned threadCount = 0;
+        uint32_t width = 640;
+        uint32_t height = 480;
+        fs::path outputDirectory;
+        bool rawFrames = false;
+        fs::path compareDirectory;
+        int tolerance = 1;
+        bool scaling = false;
+    };
+
+    void printUsage()
+    {
+        std::cerr << "Usage: SoftwareRender [geometry.txt] [--frames N] [--threads N] [--size WxH]" << std::endl
+                  << "                      [--output dir] [--format png|raw] [--compare dir] [--tolerance N] [--scaling]" << std::endl;
+    }
+
+    // Throws std::invalid_argument or std::out_of_range for a number option
+    // that is not one, see parseOptions()
+    bool parseOptionList(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--frames" && hasValue)
+            {
+                options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--threads" && hasValue)
+            {
+                options.threadCount = static_cast<unsigned>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--size" && hasValue && std::sscanf(argv[i + 1], "%ux%u", &options.width, &options.height) == 2 &&
+                     options.width > 0 && options.height > 0)
+            {
+                ++i;
+            }
+            else if (arg == "--output" && hasValue)
+            {
+                options.outputDirectory = argv[++i];
+            }
+            else if (arg == "--format" && hasValue)
+            {
+                options.rawFrames = std::strcmp(argv[++i], "raw") == 0;
+            }
+            else if (arg == "--compare" && hasValue)
+            {
+                options.compareDirectory = argv[++i];
+            }
+            else if (arg == "--tolerance" && hasValue)
+            {
+                options.tolerance = std::stoi(argv[++i]);
+            }
+            else if (arg == "--scaling")
+            {
+                options.scaling = true;
+            }
+            else if (arg[0] != '-')
+            {
+                options.geometryPath = arg;
+            }
+            else
+            {
+                printUsage();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        try
+        {
+            return parseOptionList(argc, argv, options);
+        }
+        catch (const std::exception &)
+        {
+            // A number option whose value is not a number (or is out of range)
+            printUsage();
+            return false;
+        }
+    }
+
+    std::string frameName(uint32_t frame)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame-%05u", frame);
+        return name;
+    }
+
+    /**
+     * Compare a frame with a tightly packed RGBA file, and report how much
+     * they differ.
+     */
+    bool compareFrame(const RasterTarget &target, const fs::path &path, int tolerance)
+    {
+        std::ifstream file(path, std::ios::binary);
+        size_t rowSize = static_cast<size_t>(target.width) * 4;
+        std::vector<uint8_t> expected(rowSize * target.height);
+        if (!file.read(reinterpret_cast<char *>(expected.data()), expected.size()))
+        {
+            std::cerr << "Could not read " << rowSize * target.height << " bytes from " << path << std::endl;
+            return false;
+        }
+
+        int maxDifference = 0;
+        size_t differentPixels = 0;
+        for (uint32_t y = 0; y < target.height; ++y)
+        {
+            const uint8_t *actual = target.color.data() + y * target.bytesPerRow();
+            const uint8_t *reference = expected.data() + y * rowSize;
+            for (uint32_t x = 0; x < target.width; ++x)
+            {
+                int pixelDifference = 0;
+                for (int k = 0; k < 4; ++k)
+                {
+                    pixelDifference = std::max(pixelDifference, std::abs(actual[4 * x + k] - reference[4 * x + k]));
+                }
+                maxDifference = std::max(maxDifference, pixelDifference);
+                differentPixels += pixelDifference > tolerance ? 1 : 0;
+            }
+        }
+        if (differentPixels > 0)
+        {
+            std::cerr << path.filename().string() << ": " << differentPixels << " pixels differ by more than "
+                      << tolerance << " (up to " << maxDifference << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * FNV-1a of the visible pixels, to compare runs.
+     */
+    uint64_t imageHash(const RasterTarget &target)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t y = 0; y < target.height; ++y)
+        {
+            const uint8_t *row = target.color.data() + y * target.bytesPerRow();
+            for (size_t i = 0; i < static_cast<size_t>(target.width) * 4; ++i)
+            {
+                hash = (hash ^ row[i]) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    struct RunResult
+    {
+        double seconds = 0.0;
+        RasterStatistics statistics;
+        uint64_t hash = 0;
+        bool succeeded = true;
+    };
+
+    /**
+     * Render all frames with `threadCount` threads. `writeFrames` saves and
+     * compares them, which is not timed.
+     */
+    RunResult render(const Options &options, unsigned threadCount, const std::vector<float> &vertices, size_t vertexCount,
+                     const std::vector<uint32_t> &indexData, bool writeFrames)
+    {
+        ThreadPool threadPool(threadCount);
+        SoftwareRasterizer rasterizer(threadPool);
+        RasterTarget target(options.width, options.height);
+
+        // Two MyUniforms blocks, at the offsets the uniform ring gives them
+        // with a 256-byte alignment
+        const uint32_t secondDrawOffset = 256;
+        std::vector<uint8_t> uniformBuffer(secondDrawOffset + sizeof(RasterUniforms), 0);
+        RasterUniforms uniforms{};
+        uniforms.color = {0.0f, 1.0f, 0.4f, 1.0f};
+
+        RasterDraw draw;
+        draw.vertices = vertices.data();
+        draw.vertexCount = vertexCount;
+        draw.dimensions = 3;
+        draw.indices = indexData.data();
+        draw.indexCount = indexData.size();
+        draw.uniformBuffer = uniformBuffer.data();
+
+        RunResult result;
+        for (uint32_t frame = 0; frame < options.frameCount; ++frame)
+        {
+            uniforms.time = static_cast<float>(frame) / 60.0f;
+            std::memcpy(uniformBuffer.data(), &uniforms, sizeof(uniforms));
+
+            auto start = std::chrono::steady_clock::now();
+            rasterizer.clear(target, {0.05f, 0.05f, 0.05f, 1.0f}, 1.0f);
+            draw.uniformOffset = 0;
+            rasterizer.draw(target, draw);
+            draw.uniformOffset = secondDrawOffset;
+            rasterizer.draw(target, draw);
+            result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            result.hash = result.hash * 31 + imageHash(target);
+            if (!writeFrames)
+            {
+                continue;
+            }
+            if (!options.outputDirectory.empty())
+            {
+                fs::path path = options.outputDirectory / (frameName(frame) + (options.rawFrames ? ".rgba" : ".png"));
+                bool written = options.rawFrames
+                                   ? writeRaw(path, target.width, target.height, target.color.data(), target.bytesPerRow())
+                                   : writePng(path, target.width, target.height, target.color.data(), target.bytesPerRow());
+                result.succeeded = result.succeeded && written;
+            }
+            if (!options.compareDirectory.empty())
+            {
+                fs::path path = options.compareDirectory / (frameName(frame) + ".rgba");
+                result.succeeded = compareFrame(target, path, options.tolerance) && result.succeeded;
+            }
+        }
+        result.statistics = rasterizer.statistics();
+        return result;
+    }
+
+    void printThroughput(const RunResult &result, uint32_t frameCount)
+    {
+        double seconds = std::max(result.seconds, 1e-9);
+        std::cout << frameCount << " frames in " << result.seconds * 1000.0 << " ms ("
+                  << frameCount / seconds << " frames/s), "
+                  << result.statistics.triangles / seconds / 1e6 << " Mtriangles/s, fill rate "
+                  << result.statistics.fragmentsWritten / seconds / 1e6 << " Mfragments/s ("
+                  << result.statistics.fragments / seconds / 1e6 << " M covered/s)" << std::endl;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        return 1;
+    }
+
+    std::vector<float> pointData;
+    std::vector<uint32_t> indexData;
+    if (!loadGeometry(options.geometryPath, pointData, indexData, 3))
+    {
+        std::cerr << "Could not load geometry from " << options.geometryPath << std::endl;
+        return 1;
+    }
+    size_t vertexCount = pointData.size() / 6;
+
+    // Go through the same packing as the App, so that the vertex shader
+    // sees the values the GPU would fetch
+    VertexRanges ranges(3);
+    ranges.add(pointData.data(), vertexCount);
+    PackedVertexFormat vertexFormat = choosePackedVertexFormat(ranges);
+    std::vector<uint8_t> packed(vertexFormat.packedSize(vertexCount));
+    std::vector<float> vertices(pointData.size());
+    vertexFormat.pack(pointData.data(), vertexCount, packed.data());
+    vertexFormat.unpack(packed.data(), vertexCount, vertices.data());
+
+    std::cout << "Rendering " << vertexCount << " vertices and " << indexData.size() / 3 << " triangles at "
+              << options.width << "x" << options.height << std::endl;
+    if (!options.outputDirectory.empty())
+    {
+        fs::create_directories(options.outputDirectory);
+    }
+
+    RunResult result = render(options, options.threadCount, vertices, vertexCount, indexData, true);
+    std::cout << "Threads: " << ThreadPool(options.threadCount).threadCount() << std::endl;
+    std::cout << "Triangles: " << result.statistics.triangles << " (" << result.statistics.trianglesRasterized
+              << " rasterized), fragments: " << result.statistics.fragments << " ("
+              << result.statistics.fragmentsWritten << " written)" << std::endl;
+    printThroughput(result, options.frameCount);
+    if (!result.succeeded)
+    {
+        return 1;
+    }
+
+    if (options.scaling)
+    {
+        // Powers of two, then all hardware threads
+        unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> threadCounts;
+        for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+        {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+
+        bool identical = true;
+        RunResult reference;
+        for (unsigned threads : threadCounts)
+        {
+            RunResult run = render(options, threads, vertices, vertexCount, indexData, false);
+            if (threads == 1)
+            {
+                reference = run;
+            }
+            std::cout << threads << " threads: ";
+            printThroughput(run, options.frameCount);
+            std::cout << "  speedup " << reference.seconds / std::max(run.seconds, 1e-9) << "x" << std::endl;
+            identical = identical && run.hash == reference.hash;
+        }
+        if (!identical)
+        {
+            std::cerr << "Images depend on the number of threads" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}